@@ -148,6 +148,7 @@ CFLAGS = /nologo /TC /MD \
          /D"_CRT_SECURE_NO_DEPRECATE" \
          /D"__LITTLE_ENDIAN__" \
          /D"VL_DISABLE_AVX" \
+         /D"VL_DISABLE_AVX512" \
          /I. \
          /W1 /Zp8 /openmp
 
@@ -173,6 +174,8 @@ libsrc = \
   vl\aib.c \
   vl\array.c \
   vl\covdet.c \
+  vl\covdet_avx.c \
+  vl\covdet_sse2.c \
   vl\dsift.c \
   vl\fisher.c \
   vl\generic.c \
@@ -184,6 +187,8 @@ libsrc = \
   vl\host.c \
   vl\ikmeans.c \
   vl\imopv.c \
+  vl\imopv_avx.c \
+  vl\imopv_avx512.c \
   vl\imopv_sse2.c \
   vl\kdtree.c \
   vl\kmeans.c \
@@ -194,11 +199,14 @@ libsrc = \
   vl\mathop_sse2.c \
   vl\mser.c \
   vl\pgm.c \
+  vl\phow.c \
   vl\quickshift.c \
   vl\random.c \
   vl\rodrigues.c \
   vl\scalespace.c \
   vl\sift.c \
+  vl\sift_avx.c \
+  vl\sift_sse2.c \
   vl\slic.c \
   vl\stringop.c \
   vl\svm.c \
@@ -209,12 +217,15 @@ cmdsrc = \
   src\aib.c \
   src\mser.c \
   src\sift.c \
+  src\test_covdet.c \
+  src\test_dsift.c \
   src\test_gauss_elimination.c \
   src\test_getopt_long.c \
   src\test_gmm.c \
   src\test_heap-def.c \
   src\test_host.c \
   src\test_imopv.c \
+  src\test_imsmooth.c \
   src\test_kmeans.c \
   src\test_liop.c \
   src\test_mathop.c \
@@ -222,6 +233,8 @@ cmdsrc = \
   src\test_nan.c \
   src\test_qsort-def.c \
   src\test_rand.c \
+  src\test_scalespace.c \
+  src\test_sift.c \
   src\test_sqrti.c \
   src\test_stringop.c \
   src\test_svd2.c \
@@ -232,12 +245,15 @@ cmdsrc = \
   src\aib.c \
   src\mser.c \
   src\sift.c \
+  src\test_covdet.c \
+  src\test_dsift.c \
   src\test_gauss_elimination.c \
   src\test_getopt_long.c \
   src\test_gmm.c \
   src\test_heap-def.c \
   src\test_host.c \
   src\test_imopv.c \
+  src\test_imsmooth.c \
   src\test_kmeans.c \
   src\test_liop.c \
   src\test_mathop.c \
@@ -245,6 +261,8 @@ cmdsrc = \
   src\test_nan.c \
   src\test_qsort-def.c \
   src\test_rand.c \
+  src\test_scalespace.c \
+  src\test_sift.c \
   src\test_sqrti.c \
   src\test_stringop.c \
   src\test_svd2.c \
@@ -446,6 +464,14 @@ $(objdir)\imopv_sse2.obj : vl\imopv_sse2.c
 	@echo .... CC [+SSE2] $(@)
 	@$(CC) $(CFLAGS) $(DLL_CFLAGS) /arch:SSE2 /D"__SSE2__" /c /Fo"$(@)" "vl\$(@B).c"
 
+$(objdir)\sift_sse2.obj : vl\sift_sse2.c
+	@echo .... CC [+SSE2] $(@)
+	@$(CC) $(CFLAGS) $(DLL_CFLAGS) /arch:SSE2 /D"__SSE2__" /c /Fo"$(@)" "vl\$(@B).c"
+
+$(objdir)\covdet_sse2.obj : vl\covdet_sse2.c
+	@echo .... CC [+SSE2] $(@)
+	@$(CC) $(CFLAGS) $(DLL_CFLAGS) /arch:SSE2 /D"__SSE2__" /c /Fo"$(@)" "vl\$(@B).c"
+
 # vl\*.c -> $objdir\*.obj
 {vl}.c{$(objdir)}.obj:
 	@echo .... CC $(@)
@@ -18,7 +18,7 @@ info: bin-info
 #                                                        Configuration
 # --------------------------------------------------------------------
 
-BIN_CFLAGS = $(STD_CFLAGS) -I$(VLDIR)
+BIN_CFLAGS = $(STD_CFLAGS) $(LINK_DLL_CFLAGS)
 BIN_CFLAGS += $(if $(DISABLE_THREADS),,-pthread)
 BIN_CFLAGS += $(if $(DISABLE_OPENMP),,-fopenmp)
 
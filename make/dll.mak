@@ -30,6 +30,7 @@ $(if $(DISABLE_THREADS),-DVL_DISABLE_THREADS) \
 $(if $(DISABLE_OPENMP),-DVL_DISABLE_OPENMP) \
 $(if $(DISABLE_SSE2),-DVL_DISABLE_SSE2) \
 $(if $(DISABLE_AVX),-DVL_DISABLE_AVX) \
+$(if $(DISABLE_AVX512),-DVL_DISABLE_AVX512) \
 -I$(VLDIR)
 
 LINK_DLL_LDFLAGS =\
@@ -41,6 +42,7 @@ $(STD_CFLAGS) \
 $(LINK_DLL_CFLAGS) \
 $(call if-like,%_sse2,$*, $(if $(DISABLE_SSE2),,-msse2)) \
 $(call if-like,%_avx,$*, $(if $(DISABLE_AVX),,-mavx)) \
+$(call if-like,%_avx512,$*, $(if $(DISABLE_AVX512),,-mavx512f -ffp-contract=off)) \
 $(if $(DISABLE_THREADS),,-pthread) \
 $(if $(DISABLE_OPENMP),,-fopenmp)
 
@@ -6,6 +6,7 @@
 #ifndef __CHECK_H__
 #define __CHECK_H__
 
+#include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -33,5 +34,20 @@ check_impl(condition, __FILE__, __LINE__, "" __VA_ARGS__)
 #define check_signoff() \
 fprintf(stdout, "%s passed\n", __FILE__)
 
+/* fill a width x height image with a smooth pattern plus a
+   checkerboard, which gives features at several scales */
+static void
+check_synthetic_image (float * image, int width, int height)
+{
+  int x, y ;
+  for (y = 0 ; y < height ; ++y) {
+    for (x = 0  ; x < width ; ++x) {
+      image [x + width * y] =
+        (float) (sin (0.11 * x + 0.04 * y * y / height) * cos (0.07 * y)
+                 + ((x / 7 + y / 11) % 2)) ;
+    }
+  }
+}
+
 /* __CHECK_H__ */
 #endif
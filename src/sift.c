@@ -428,6 +428,16 @@ main(int argc, char **argv)
     double           *ikeys = 0 ;
     int              nikeys = 0, ikeys_size = 0 ;
 
+    VlSiftKeypoint   *okeys = 0 ;
+    double           *oangles = 0 ;
+    int              *onangles = 0 ;
+    vl_sift_pix      *odescrs = 0 ;
+    VlSiftKeypoint   *fkeys = 0 ;
+    double           *fangles = 0 ;
+    int              nokeys = 0, okeys_size = 0, odata_size = 0 ;
+    int              nframes = 0 ;
+    int              j ;
+
     /* ...............................................................
      *                                                 Determine files
      * ............................................................ */
@@ -689,79 +699,100 @@ main(int argc, char **argv)
         nkeys = nikeys ;
       }
 
-      /* for each keypoint ........................................ */
-      for (; i < nkeys ; ++i) {
-        double                angles [4] ;
-        int                   nangles ;
-        VlSiftKeypoint        ik ;
-        VlSiftKeypoint const *k ;
-
-        /* obtain keypoint orientations ........................... */
-        if (ikeys) {
+      /* collect the keypoints of this octave ...................... */
+      if (ikeys) {
+        nokeys = 0 ;
+        for (; i < nkeys ; ++i) {
+          VlSiftKeypoint ik ;
           vl_sift_keypoint_init (filt, &ik,
                                  ikeys [4 * i + 0],
                                  ikeys [4 * i + 1],
                                  ikeys [4 * i + 2]) ;
-
           if (ik.o != vl_sift_get_octave_index (filt)) {
             break ;
           }
+          if (okeys_size < nokeys + 1) {
+            okeys_size += 10000 ;
+            okeys = realloc (okeys, sizeof(VlSiftKeypoint) * okeys_size) ;
+          }
+          okeys [nokeys++] = ik ;
+        }
+        keys = okeys ;
+      } else {
+        nokeys = nkeys ;
+      }
 
-          k          = &ik ;
+      /* make enough space for orientations and descriptors */
+      if (odata_size < nokeys) {
+        odata_size = nokeys ;
+        oangles  = realloc (oangles,  4 * sizeof(double) * odata_size) ;
+        onangles = realloc (onangles, sizeof(int) * odata_size) ;
+        fkeys    = realloc (fkeys,    4 * sizeof(VlSiftKeypoint) * odata_size) ;
+        fangles  = realloc (fangles,  4 * sizeof(double) * odata_size) ;
+        odescrs  = realloc (odescrs,  4 * 128 * sizeof(vl_sift_pix) * odata_size) ;
+      }
 
-          /* optionally compute orientations too */
-          if (force_orientations) {
-            nangles = vl_sift_calc_keypoint_orientations
-              (filt, angles, k) ;
-          } else {
-            angles [0] = ikeys [4 * i + 3] ;
-            nangles    = 1 ;
-          }
-        } else {
-          k = keys + i ;
-          nangles = vl_sift_calc_keypoint_orientations
-            (filt, angles, k) ;
+      /* obtain keypoint orientations ............................. */
+      if (ikeys && ! force_orientations) {
+        for (j = 0 ; j < nokeys ; ++j) {
+          oangles  [4 * j] = ikeys [4 * (i - nokeys + j) + 3] ;
+          onangles [j]     = 1 ;
         }
+      } else {
+        vl_sift_calc_octave_orientations
+          (filt, oangles, onangles, keys, nokeys) ;
+      }
 
-        /* for each orientation ................................... */
-        for (q = 0 ; q < (unsigned) nangles ; ++q) {
-          vl_sift_pix descr [128] ;
+      /* one frame for each keypoint orientation */
+      nframes = 0 ;
+      for (j = 0 ; j < nokeys ; ++j) {
+        for (q = 0 ; q < (unsigned) onangles [j] ; ++q) {
+          fkeys   [nframes] = keys [j] ;
+          fangles [nframes] = oangles [4 * j + q] ;
+          ++ nframes ;
+        }
+      }
 
-          /* compute descriptor (if necessary) */
-          if (out.active || dsc.active) {
-            vl_sift_calc_keypoint_descriptor
-              (filt, descr, k, angles [q]) ;
-          }
+      /* compute descriptors (if necessary) ....................... */
+      if (out.active || dsc.active) {
+        vl_sift_calc_octave_descriptors
+          (filt, odescrs, fkeys, fangles, nframes) ;
+      }
 
-          if (out.active) {
-            int l ;
-            vl_file_meta_put_double (&out, k -> x     ) ;
-            vl_file_meta_put_double (&out, k -> y     ) ;
-            vl_file_meta_put_double (&out, k -> sigma ) ;
-            vl_file_meta_put_double (&out, angles [q] ) ;
-            for (l = 0 ; l < 128 ; ++l) {
-              vl_file_meta_put_uint8 (&out, (vl_uint8) (512.0 * descr [l])) ;
-            }
-            if (out.protocol == VL_PROT_ASCII) fprintf(out.file, "\n") ;
+      /* for each frame ........................................... */
+      for (j = 0 ; j < nframes ; ++j) {
+        VlSiftKeypoint const *k     = fkeys + j ;
+        double                angle = fangles [j] ;
+        vl_sift_pix const    *descr = odescrs + 128 * j ;
+
+        if (out.active) {
+          int l ;
+          vl_file_meta_put_double (&out, k -> x     ) ;
+          vl_file_meta_put_double (&out, k -> y     ) ;
+          vl_file_meta_put_double (&out, k -> sigma ) ;
+          vl_file_meta_put_double (&out, angle      ) ;
+          for (l = 0 ; l < 128 ; ++l) {
+            vl_file_meta_put_uint8 (&out, (vl_uint8) (512.0 * descr [l])) ;
           }
+          if (out.protocol == VL_PROT_ASCII) fprintf(out.file, "\n") ;
+        }
 
-          if (frm.active) {
-            vl_file_meta_put_double (&frm, k -> x     ) ;
-            vl_file_meta_put_double (&frm, k -> y     ) ;
-            vl_file_meta_put_double (&frm, k -> sigma ) ;
-            vl_file_meta_put_double (&frm, angles [q] ) ;
-            if (frm.protocol == VL_PROT_ASCII) fprintf(frm.file, "\n") ;
-          }
+        if (frm.active) {
+          vl_file_meta_put_double (&frm, k -> x     ) ;
+          vl_file_meta_put_double (&frm, k -> y     ) ;
+          vl_file_meta_put_double (&frm, k -> sigma ) ;
+          vl_file_meta_put_double (&frm, angle      ) ;
+          if (frm.protocol == VL_PROT_ASCII) fprintf(frm.file, "\n") ;
+        }
 
-          if (dsc.active) {
-            int l ;
-            for (l = 0 ; l < 128 ; ++l) {
-              double x = 512.0 * descr[l] ;
-              x = (x < 255.0) ? x : 255.0 ;
-              vl_file_meta_put_uint8 (&dsc, (vl_uint8) (x)) ;
-            }
-            if (dsc.protocol == VL_PROT_ASCII) fprintf(dsc.file, "\n") ;
+        if (dsc.active) {
+          int l ;
+          for (l = 0 ; l < 128 ; ++l) {
+            double x = 512.0 * descr[l] ;
+            x = (x < 255.0) ? x : 255.0 ;
+            vl_file_meta_put_uint8 (&dsc, (vl_uint8) (x)) ;
           }
+          if (dsc.protocol == VL_PROT_ASCII) fprintf(dsc.file, "\n") ;
         }
       }
     }
@@ -790,6 +821,14 @@ main(int argc, char **argv)
       ikeys = 0 ;
     }
 
+    /* release octave buffers */
+    if (okeys)    { free (okeys) ;    okeys = 0 ; }
+    if (oangles)  { free (oangles) ;  oangles = 0 ; }
+    if (onangles) { free (onangles) ; onangles = 0 ; }
+    if (fkeys)    { free (fkeys) ;    fkeys = 0 ; }
+    if (fangles)  { free (fangles) ;  fangles = 0 ; }
+    if (odescrs)  { free (odescrs) ;  odescrs = 0 ; }
+
     /* release filter */
     if (filt) {
       vl_sift_delete (filt) ;
@@ -0,0 +1,368 @@
+/** @file   test_covdet.c
+ ** @brief  Test the covariant feature detector
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include <vl/generic.h>
+#include <vl/covdet.h>
+#include <vl/mathop.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+
+/* run Hessian-Laplace with affine adaptation and orientations */
+static VlCovDet *
+run_covdet (float const * image, int width, int height)
+{
+  VlCovDet * covdet = vl_covdet_new (VL_COVDET_METHOD_HESSIAN_LAPLACE) ;
+  vl_covdet_put_image (covdet, image, width, height) ;
+  vl_covdet_detect (covdet) ;
+  vl_covdet_extract_affine_shape (covdet) ;
+  vl_covdet_extract_orientations (covdet) ;
+  return covdet ;
+}
+
+/* check that the covariant detector does not depend on the number of
+   threads and that the batch functions match the single frame ones */
+static void
+check_covdet_threads (float const * image, int width, int height)
+{
+  vl_size numThreads = vl_get_max_threads () ;
+  VlCovDet * serial, * parallel ;
+  VlCovDetFeature * features ;
+  vl_size numFeatures, i, j = 0 ;
+
+  vl_set_num_threads (1) ;
+  serial = run_covdet (image, width, height) ;
+  vl_set_num_threads (numThreads) ;
+  parallel = run_covdet (image, width, height) ;
+
+  check (vl_covdet_get_num_features (serial) > 64,
+         "only %d features", (int) vl_covdet_get_num_features (serial)) ;
+  check (vl_covdet_get_num_features (serial) ==
+         vl_covdet_get_num_features (parallel)) ;
+  check (memcmp (vl_covdet_get_features (serial),
+                 vl_covdet_get_features (parallel),
+                 sizeof(VlCovDetFeature) * vl_covdet_get_num_features (serial)) == 0,
+         "features differ with %d threads", (int) numThreads) ;
+  vl_covdet_delete (parallel) ;
+  vl_covdet_delete (serial) ;
+
+  /* affine adaptation of each detected frame */
+  parallel = vl_covdet_new (VL_COVDET_METHOD_HESSIAN_LAPLACE) ;
+  vl_covdet_put_image (parallel, image, width, height) ;
+  vl_covdet_detect (parallel) ;
+  numFeatures = vl_covdet_get_num_features (parallel) ;
+  features = vl_malloc (sizeof(VlCovDetFeature) * numFeatures) ;
+  memcpy (features, vl_covdet_get_features (parallel),
+          sizeof(VlCovDetFeature) * numFeatures) ;
+  vl_covdet_extract_affine_shape (parallel) ;
+  for (i = 0 ; i < numFeatures ; ++i) {
+    VlFrameOrientedEllipse adapted ;
+    VlCovDetFeature const * result = vl_covdet_get_features (parallel) ;
+    if (vl_covdet_extract_affine_shape_for_frame
+        (parallel, &adapted, features[i].frame) != VL_ERR_OK) continue ;
+    check (j < vl_covdet_get_num_features (parallel)) ;
+    check (memcmp (&adapted, &result[j].frame, sizeof(adapted)) == 0,
+           "feature %d: batch and single frame affine shapes differ", (int) i) ;
+    ++ j ;
+  }
+  check (j == vl_covdet_get_num_features (parallel)) ;
+  vl_free (features) ;
+  vl_covdet_delete (parallel) ;
+}
+
+/* check that batch patch extraction matches the single frame one */
+static void
+check_covdet_patches (float const * image, int width, int height)
+{
+  vl_size const resolution = 7 ;
+  vl_size const side = 2 * resolution + 1 ;
+  VlCovDet * covdet = run_covdet (image, width, height) ;
+  VlCovDetFeature const * features = vl_covdet_get_features (covdet) ;
+  vl_size numFrames = vl_covdet_get_num_features (covdet) + 1 ;
+  VlFrameOrientedEllipse * frames = vl_malloc (sizeof(VlFrameOrientedEllipse) * numFrames) ;
+  float * patches = vl_malloc (sizeof(float) * side * side * numFrames) ;
+  float * patch = vl_malloc (sizeof(float) * side * side) ;
+  int * status = vl_malloc (sizeof(int) * numFrames) ;
+  vl_size i, j ;
+  int allowPadded ;
+
+  for (i = 0 ; i + 1 < numFrames ; ++i) frames [i] = features [i].frame ;
+  /* a frame partially out of the image */
+  frames [numFrames - 1] = features [0].frame ;
+  frames [numFrames - 1].x = 1 ;
+  frames [numFrames - 1].y = height - 2 ;
+
+  for (allowPadded = 0 ; allowPadded < 2 ; ++allowPadded) {
+    int err ;
+    vl_covdet_set_allow_padded_warping (covdet, allowPadded) ;
+    err = vl_covdet_extract_patches (covdet, patches, status,
+                                     resolution, 6.0, 1.0,
+                                     frames, numFrames) ;
+    check (err == (allowPadded ? VL_ERR_OK : VL_ERR_EOF),
+           "unexpected error %d (allowPadded=%d)", err, allowPadded) ;
+    for (i = 0 ; i < numFrames ; ++i) {
+      int expected = vl_covdet_extract_patch_for_frame
+        (covdet, patch, resolution, 6.0, 1.0, frames [i]) ;
+      check (status [i] == expected,
+             "frame %d: status %d, expected %d", (int) i, status [i], expected) ;
+      if (expected != VL_ERR_OK) {
+        for (j = 0 ; j < side * side ; ++j) check (patches [side * side * i + j] == 0) ;
+      } else {
+        check (memcmp (patches + side * side * i, patch,
+                       sizeof(float) * side * side) == 0,
+               "frame %d: batch and single frame patches differ", (int) i) ;
+      }
+    }
+  }
+  check (status [numFrames - 1] == VL_ERR_OK) ;
+
+  vl_free (status) ;
+  vl_free (patch) ;
+  vl_free (patches) ;
+  vl_free (frames) ;
+  vl_covdet_delete (covdet) ;
+}
+
+/* check that the SIMD and scalar cornerness measures agree exactly */
+static void
+check_covdet_response (float const * image, int width, int height)
+{
+  VlCovDetMethod const methods [] = {VL_COVDET_METHOD_HESSIAN,
+                                     VL_COVDET_METHOD_HARRIS_LAPLACE} ;
+  int m ;
+  for (m = 0 ; m < 2 ; ++m) {
+    VlCovDet * covdet [2] ;
+    VlScaleSpaceGeometry geom ;
+    vl_index o, s ;
+    int simd ;
+    for (simd = 0 ; simd < 2 ; ++simd) {
+      vl_set_simd_enabled (simd) ;
+      covdet [simd] = vl_covdet_new (methods [m]) ;
+      vl_covdet_put_image (covdet [simd], image, width, height) ;
+      vl_covdet_detect (covdet [simd]) ;
+    }
+    vl_set_simd_enabled (VL_TRUE) ;
+    geom = vl_scalespace_get_geometry (vl_covdet_get_css (covdet [0])) ;
+    for (o = geom.firstOctave ; o <= geom.lastOctave ; ++o) {
+      VlScaleSpaceOctaveGeometry ogeom =
+        vl_scalespace_get_octave_geometry (vl_covdet_get_css (covdet [0]), o) ;
+      for (s = geom.octaveFirstSubdivision ; s <= geom.octaveLastSubdivision ; ++s) {
+        check (memcmp (vl_scalespace_get_level (vl_covdet_get_css (covdet [0]), o, s),
+                       vl_scalespace_get_level (vl_covdet_get_css (covdet [1]), o, s),
+                       sizeof(float) * ogeom.width * ogeom.height) == 0,
+               "method %d, octave %d, level %d: SIMD and scalar responses differ",
+               m, (int) o, (int) s) ;
+      }
+    }
+    check (vl_covdet_get_num_features (covdet [0]) ==
+           vl_covdet_get_num_features (covdet [1])) ;
+    vl_covdet_delete (covdet [0]) ;
+    vl_covdet_delete (covdet [1]) ;
+  }
+}
+
+/* check that the feature budget keeps the strongest features of each
+   grid cell and a subset of the unconstrained detections; with
+   Laplacian scale selection, which runs on the features within the
+   budget only, check that the budget is still met */
+static void
+check_covdet_budget (float const * image, int width, int height)
+{
+  VlCovDetMethod const methods [2] = {VL_COVDET_METHOD_HESSIAN,
+                                       VL_COVDET_METHOD_HESSIAN_LAPLACE} ;
+  vl_size const gridSize = 8 ;
+  int m ;
+
+  for (m = 0 ; m < 2 ; ++m) {
+    VlCovDet * full, * budget ;
+    VlCovDetFeature const * all, * kept ;
+    vl_size numAll, numKept, maxNumFeatures, numCells = 0, i, j = 0 ;
+    vl_index best [64] ;
+
+    full = vl_covdet_new (methods [m]) ;
+    vl_covdet_set_non_extrema_suppression_threshold (full, 0) ;
+    vl_covdet_put_image (full, image, width, height) ;
+    vl_covdet_detect (full) ;
+    all = vl_covdet_get_features (full) ;
+    numAll = vl_covdet_get_num_features (full) ;
+
+    /* the strongest feature of each cell */
+    for (i = 0 ; i < gridSize * gridSize ; ++i) best [i] = -1 ;
+    for (i = 0 ; i < numAll ; ++i) {
+      vl_index cx = VL_MIN((vl_index)(all[i].frame.x * gridSize / width), (vl_index)gridSize - 1) ;
+      vl_index cy = VL_MIN((vl_index)(all[i].frame.y * gridSize / height), (vl_index)gridSize - 1) ;
+      vl_index * b = best + cy * gridSize + cx ;
+      if (*b < 0) {
+        ++ numCells ;
+        *b = i ;
+      } else if (vl_abs_d(all[i].peakScore) > vl_abs_d(all[*b].peakScore)) {
+        *b = i ;
+      }
+    }
+    maxNumFeatures = numCells ;
+    check (maxNumFeatures < numAll) ;
+
+    budget = vl_covdet_new (methods [m]) ;
+    vl_covdet_set_non_extrema_suppression_threshold (budget, 0) ;
+    vl_covdet_set_max_num_features (budget, maxNumFeatures) ;
+    vl_covdet_set_budget_grid_size (budget, gridSize) ;
+    vl_covdet_put_image (budget, image, width, height) ;
+    vl_covdet_detect (budget) ;
+    kept = vl_covdet_get_features (budget) ;
+    numKept = vl_covdet_get_num_features (budget) ;
+    check (numKept == maxNumFeatures, "method %d: %d features kept, budget %d",
+           (int) methods [m], (int) numKept, (int) maxNumFeatures) ;
+
+    if (methods [m] == VL_COVDET_METHOD_HESSIAN) {
+      /* kept features are an ordered subset containing the cell maxima */
+      for (i = 0 ; i < numAll && j < numKept ; ++i) {
+        vl_bool isBest = VL_FALSE ;
+        vl_size c ;
+        for (c = 0 ; c < gridSize * gridSize ; ++c) isBest |= (best [c] == (signed)i) ;
+        if (memcmp (all + i, kept + j, sizeof(VlCovDetFeature)) == 0) {
+          ++ j ;
+        } else {
+          check (! isBest, "feature %d is the strongest in its cell but was dropped", (int) i) ;
+        }
+      }
+      check (j == numKept, "kept features are not a subset of the detections") ;
+    } else {
+      /* kept features are detections, with the same scales */
+      for (j = 0 ; j < numKept ; ++j) {
+        for (i = 0 ; i < numAll ; ++i) {
+          if (memcmp (all + i, kept + j, sizeof(VlCovDetFeature)) == 0) break ;
+        }
+        check (i < numAll, "method %d: kept feature %d is not a detection",
+               (int) methods [m], (int) j) ;
+      }
+    }
+
+    vl_covdet_delete (budget) ;
+    vl_covdet_delete (full) ;
+  }
+}
+
+/* check that detecting in a region finds the same features in the
+   region as detecting in the whole image, with all the methods and
+   several octaves; the image is large enough for the octaves to be
+   cropped */
+static void
+check_covdet_region (void)
+{
+  int const width = 640 ;
+  int const height = 480 ;
+  vl_index const xmin = 260, ymin = 190, xmax = 379, ymax = 289 ;
+  float * image = vl_malloc (sizeof(float) * width * height) ;
+  int m ;
+
+  check_synthetic_image (image, width, height) ;
+
+  for (m = VL_COVDET_METHOD_DOG ; m < VL_COVDET_METHOD_NUM ; ++m) {
+    VlCovDet * full = vl_covdet_new (m) ;
+    VlCovDet * region = vl_covdet_new (m) ;
+    VlCovDetFeature const * all, * found ;
+    VlScaleSpaceGeometry geom ;
+    VlScaleSpaceOctaveGeometry ogeom ;
+    vl_size numAll, numFound, i, j = 0 ;
+
+    /* as many octaves as the region allows */
+    vl_covdet_set_num_octaves (full, 2) ;
+    vl_covdet_set_num_octaves (region, 2) ;
+    vl_covdet_set_non_extrema_suppression_threshold (full, 0) ;
+    vl_covdet_set_non_extrema_suppression_threshold (region, 0) ;
+    vl_covdet_put_image (full, image, width, height) ;
+    vl_covdet_put_image_region (region, image, width, height, xmin, ymin, xmax, ymax) ;
+    vl_covdet_detect (full) ;
+    vl_covdet_detect (region) ;
+
+    geom = vl_scalespace_get_geometry (vl_covdet_get_gss (region)) ;
+    check (geom.lastOctave - geom.firstOctave + 1 == 4,
+           "method %d: %d octaves", m, (int)(geom.lastOctave - geom.firstOctave + 1)) ;
+    ogeom = vl_scalespace_get_octave_geometry (vl_covdet_get_gss (region), geom.firstOctave) ;
+    check (ogeom.width * ogeom.height < (vl_size)(4 * width * height),
+           "method %d: the first octave covers the whole image", m) ;
+    ogeom = vl_scalespace_get_octave_geometry (vl_covdet_get_gss (region), geom.lastOctave) ;
+    check (ogeom.width < (vl_size)(width / 4) && ogeom.height < (vl_size)(height / 4),
+           "method %d: the last octave is not cropped", m) ;
+
+    all = vl_covdet_get_features (full) ;
+    numAll = vl_covdet_get_num_features (full) ;
+    found = vl_covdet_get_features (region) ;
+    numFound = vl_covdet_get_num_features (region) ;
+    check (numFound > 8, "method %d: only %d features", m, (int) numFound) ;
+    for (i = 0 ; i < numAll ; ++i) {
+      if (all[i].frame.x < xmin || all[i].frame.x > xmax ||
+          all[i].frame.y < ymin || all[i].frame.y > ymax) continue ;
+      check (j < numFound, "method %d: missing features in the region", m) ;
+      /* refined extrema are stored in single precision, relative to
+         the crop, and the Laplacian scales are sampled around them */
+      check (fabs (all[i].frame.x - found[j].frame.x) < 1e-4 &&
+             fabs (all[i].frame.y - found[j].frame.y) < 1e-4 &&
+             fabs (all[i].frame.a11 - found[j].frame.a11) < 1e-3 * all[i].frame.a11 &&
+             all[i].peakScore == found[j].peakScore &&
+             all[i].edgeScore == found[j].edgeScore &&
+             fabs (all[i].laplacianScaleScore - found[j].laplacianScaleScore) < 1e-3,
+             "method %d, feature %d: region and image detections differ", m, (int) i) ;
+      ++ j ;
+    }
+    check (j == numFound, "method %d: %d extra features in the region", m, (int)(numFound - j)) ;
+    vl_covdet_delete (region) ;
+    vl_covdet_delete (full) ;
+  }
+
+  /* regions smaller than an octave get one octave */
+  for (m = 1 ; m <= 8 ; m *= 2) {
+    VlCovDet * region = vl_covdet_new (VL_COVDET_METHOD_HESSIAN_LAPLACE) ;
+    VlCovDetFeature const * found ;
+    VlScaleSpaceGeometry geom ;
+    vl_size numFound, i ;
+    int err = vl_covdet_put_image_region (region, image, width, height,
+                                          xmin, ymin, xmin + m - 1, ymin + m - 1) ;
+    check (err == VL_ERR_OK, "%dx%d region: error %d", m, m, err) ;
+    geom = vl_scalespace_get_geometry (vl_covdet_get_gss (region)) ;
+    check (geom.lastOctave == geom.firstOctave,
+           "%dx%d region: %d octaves", m, m, (int)(geom.lastOctave - geom.firstOctave + 1)) ;
+    vl_covdet_detect (region) ;
+    found = vl_covdet_get_features (region) ;
+    numFound = vl_covdet_get_num_features (region) ;
+    for (i = 0 ; i < numFound ; ++i) {
+      check (found[i].frame.x >= xmin && found[i].frame.x <= xmin + m - 1 &&
+             found[i].frame.y >= ymin && found[i].frame.y <= ymin + m - 1,
+             "%dx%d region: feature %d outside", m, m, (int) i) ;
+    }
+    vl_covdet_delete (region) ;
+  }
+  vl_free (image) ;
+}
+
+int
+main (int argc VL_UNUSED, char** argv VL_UNUSED)
+{
+  int const width = 300 ;
+  int const height = 260 ;
+  float * image = vl_malloc (sizeof(float) * width * height) ;
+
+  check_synthetic_image (image, width, height) ;
+
+  check_covdet_threads (image, width, height) ;
+  check_covdet_patches (image, width, height) ;
+  check_covdet_response (image, width - 3, height) ;
+  check_covdet_budget (image, width, height) ;
+  check_covdet_region () ;
+
+  vl_free (image) ;
+  check_signoff () ;
+  return 0 ;
+}
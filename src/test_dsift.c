@@ -0,0 +1,348 @@
+/** @file   test_dsift.c
+ ** @brief  Test dense SIFT and PHOW
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include <vl/generic.h>
+#include <vl/dsift.h>
+#include <vl/phow.h>
+#include <vl/imopv.h>
+#include <vl/mathop.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+
+#define NUM_PROJ 32
+
+/* memory allocation functions failing on demand */
+static vl_bool failAllocations = VL_FALSE ;
+
+static void *
+failing_malloc (size_t size)
+{
+  return failAllocations ? NULL : malloc (size) ;
+}
+
+static void *
+failing_realloc (void * ptr, size_t size)
+{
+  return failAllocations ? NULL : realloc (ptr, size) ;
+}
+
+static void *
+failing_calloc (size_t n, size_t size)
+{
+  return failAllocations ? NULL : calloc (n, size) ;
+}
+
+/* check that dense SIFT does not depend on the number of threads */
+static void
+check_threads (float const * image, int width, int height)
+{
+  VlDsiftFilter * serial = vl_dsift_new_basic (width, height, 3, 5) ;
+  VlDsiftFilter * parallel = vl_dsift_new_basic (width, height, 3, 5) ;
+  vl_size numThreads = vl_get_max_threads () ;
+  int flat ;
+
+  for (flat = 0 ; flat < 2 ; ++flat) {
+    int numFrames, descrSize ;
+    vl_dsift_set_flat_window (serial, flat) ;
+    vl_dsift_set_flat_window (parallel, flat) ;
+    vl_set_num_threads (1) ;
+    vl_dsift_process (serial, image) ;
+    vl_set_num_threads (numThreads) ;
+    vl_dsift_process (parallel, image) ;
+
+    numFrames = vl_dsift_get_keypoint_num (serial) ;
+    descrSize = vl_dsift_get_descriptor_size (serial) ;
+    check (numFrames > 0) ;
+    check (vl_dsift_get_keypoint_num (parallel) == numFrames) ;
+    check (memcmp (vl_dsift_get_keypoints (serial), vl_dsift_get_keypoints (parallel),
+                   sizeof(VlDsiftKeypoint) * numFrames) == 0,
+           "frames differ with %d threads (flat=%d)", (int) numThreads, flat) ;
+    check (memcmp (vl_dsift_get_descriptors (serial), vl_dsift_get_descriptors (parallel),
+                   sizeof(float) * descrSize * numFrames) == 0,
+           "descriptors differ with %d threads (flat=%d)", (int) numThreads, flat) ;
+  }
+
+  vl_dsift_delete (parallel) ;
+  vl_dsift_delete (serial) ;
+}
+
+/* check PHOW features against dense SIFT */
+static void
+check_phow (float const * image, int width, int height)
+{
+  int const sizes [] = {8, 4, 6} ;
+  VlPhowFilter * phow = vl_phow_new (width, height, sizes, 3) ;
+  VlDsiftFilter * dsift = vl_dsift_new_basic (width, height, 2, 6) ;
+  float * smoothed = vl_malloc (sizeof(float) * width * height) ;
+  float * color = vl_malloc (sizeof(float) * 3 * width * height) ;
+  VlDsiftKeypoint const * frames ;
+  float const * descrs ;
+  vl_size begin = 0, i, numFrames ;
+  int si, c ;
+
+  check (vl_phow_process (phow, image, 2) == VL_ERR_BAD_ARG) ;
+  check (vl_phow_process (phow, image, 1) == VL_ERR_OK) ;
+  check (vl_phow_get_descriptor_size (phow) == 128) ;
+  frames = vl_phow_get_keypoints (phow) ;
+  descrs = vl_phow_get_descriptors (phow) ;
+  numFrames = vl_phow_get_keypoint_num (phow) ;
+
+  /* the frames of the largest size come first and all start at the
+     same center */
+  for (si = 0 ; si < 3 ; ++si) {
+    vl_size n = 0 ;
+    while (begin + n < numFrames && frames [begin + n].s == sizes [si]) ++ n ;
+    check (n > 0) ;
+    check (frames [begin].x == 1.5 * sizes [0] && frames [begin].y == 1.5 * sizes [0],
+           "size %d starts at %g %g", sizes [si], frames [begin].x, frames [begin].y) ;
+    if (sizes [si] == 6) {
+      /* same as dense SIFT on the smoothed image, up to the
+         incremental smoothing */
+      vl_imsmooth_f (smoothed, width, image, width, height, width, 6.0 / 6, 6.0 / 6) ;
+      vl_dsift_set_flat_window (dsift, VL_TRUE) ;
+      vl_dsift_set_window_size (dsift, 1.5) ;
+      vl_dsift_set_bounds (dsift, 3, 3, width - 1, height - 1) ;
+      vl_dsift_process (dsift, smoothed) ;
+      check ((vl_size) vl_dsift_get_keypoint_num (dsift) == n) ;
+      for (i = 0 ; i < n ; ++i) {
+        VlDsiftKeypoint const * k = vl_dsift_get_keypoints (dsift) + i ;
+        float const * d = vl_dsift_get_descriptors (dsift) + 128 * i ;
+        float const * e = descrs + 128 * (begin + i) ;
+        int j ;
+        check (frames [begin + i].x == k->x && frames [begin + i].y == k->y) ;
+        check (fabs (frames [begin + i].norm - k->norm) <= 1e-2 * k->norm + 1e-6) ;
+        if (k->norm < 0.005 * 0.98) {
+          for (j = 0 ; j < 128 ; ++j) check (e [j] == 0) ;
+        } else if (k->norm > 0.005 * 1.02) {
+          for (j = 0 ; j < 128 ; ++j) check (fabs (e [j] - d [j]) < 2e-2) ;
+        }
+      }
+    }
+    begin += n ;
+  }
+  check (begin == numFrames) ;
+
+  /* color descriptors of a gray image: the RGB channels are equal */
+  vl_phow_set_color (phow, VlPhowRgb) ;
+  for (c = 0 ; c < 3 ; ++c) {
+    memcpy (color + c * width * height, image, sizeof(float) * width * height) ;
+  }
+  check (vl_phow_process (phow, color, 3) == VL_ERR_OK) ;
+  check (vl_phow_get_descriptor_size (phow) == 3 * 128) ;
+  check (vl_phow_get_keypoint_num (phow) == numFrames) ;
+  descrs = vl_phow_get_descriptors (phow) ;
+  for (i = 0 ; i < numFrames ; ++i) {
+    float const * d = descrs + 3 * 128 * i ;
+    check (memcmp (d, d + 128, sizeof(float) * 128) == 0 &&
+           memcmp (d, d + 256, sizeof(float) * 128) == 0) ;
+  }
+
+  /* allocation failures are reported rather than crashing */
+  failAllocations = VL_TRUE ;
+  check (vl_phow_new (width, height, sizes, 3) == NULL) ;
+  vl_phow_set_color (phow, VlPhowGray) ;
+  check (vl_phow_process (phow, image, 1) == VL_ERR_ALLOC) ;
+  failAllocations = VL_FALSE ;
+  check (vl_phow_get_keypoint_num (phow) == 0) ;
+  check (vl_phow_process (phow, image, 1) == VL_ERR_OK) ;
+  check (vl_phow_get_keypoint_num (phow) == numFrames) ;
+
+  vl_free (color) ;
+  vl_free (smoothed) ;
+  vl_dsift_delete (dsift) ;
+  vl_phow_delete (phow) ;
+}
+
+/* check the quantized dense SIFT descriptors */
+static void
+check_descriptor_type (float const * image, int width, int height)
+{
+  VlDsiftFilter * dsift = vl_dsift_new_basic (width, height, 4, 5) ;
+  VlDsiftFilter * reference = vl_dsift_new_basic (width, height, 4, 5) ;
+  float const * descrs ;
+  vl_uint8 const * descrs8 ;
+  vl_uint16 const * descrs16 ;
+  float proj [128 * NUM_PROJ] ;
+  float mean [128] ;
+  vl_size n, i ;
+
+  for (i = 0 ; i < 128 * NUM_PROJ ; ++i) proj [i] = (float) sin (i) ;
+  for (i = 0 ; i < 128 ; ++i) mean [i] = 0.01f * (i % 7) ;
+
+  vl_dsift_process (reference, image) ;
+  descrs = vl_dsift_get_descriptors (reference) ;
+  check (vl_dsift_get_descriptor_type (reference) == VlDsiftDescriptorFloat) ;
+  check (descrs != NULL) ;
+  check (vl_dsift_get_descriptors_uint8 (reference) == NULL) ;
+  check (vl_dsift_get_descriptors_half (reference) == NULL) ;
+  n = (vl_size) vl_dsift_get_keypoint_num (reference) * vl_dsift_get_descriptor_size (reference) ;
+
+  /* the descriptors are packed in place of the float ones */
+  check (vl_dsift_set_descriptor_type (dsift, (VlDsiftDescriptorType) 3) == VL_ERR_BAD_ARG) ;
+  check (vl_dsift_get_descriptor_type (dsift) == VlDsiftDescriptorFloat) ;
+  check (vl_dsift_set_descriptor_type (dsift, VlDsiftDescriptorUInt8) == VL_ERR_OK) ;
+  vl_dsift_process (dsift, image) ;
+  descrs8 = vl_dsift_get_descriptors_uint8 (dsift) ;
+  check (descrs8 != NULL) ;
+  check (vl_dsift_get_descriptors (dsift) == NULL) ;
+  check (vl_dsift_get_descriptors_half (dsift) == NULL) ;
+  for (i = 0 ; i < n ; ++i) {
+    check (descrs8 [i] == (vl_uint8) VL_MIN (512.0F * descrs [i], 255.0F)) ;
+  }
+
+  /* 8-bit descriptors cannot represent projected ones */
+  check (vl_dsift_set_projection (dsift, proj, mean, NUM_PROJ) == VL_ERR_BAD_ARG) ;
+  check (vl_dsift_get_descriptor_size (dsift) == 128) ;
+
+  /* projected descriptors may be negative */
+  check (vl_dsift_set_descriptor_type (dsift, VlDsiftDescriptorHalf) == VL_ERR_OK) ;
+  check (vl_dsift_get_descriptors_uint8 (dsift) == descrs8) ;
+  check (vl_dsift_set_projection (dsift, proj, mean, NUM_PROJ) == VL_ERR_OK) ;
+  check (vl_dsift_set_descriptor_type (dsift, VlDsiftDescriptorUInt8) == VL_ERR_BAD_ARG) ;
+  check (vl_dsift_get_descriptor_type (dsift) == VlDsiftDescriptorHalf) ;
+  vl_dsift_set_projection (reference, proj, mean, NUM_PROJ) ;
+  vl_dsift_process (reference, image) ;
+  vl_dsift_process (dsift, image) ;
+  n = (vl_size) vl_dsift_get_keypoint_num (dsift) * NUM_PROJ ;
+  descrs = vl_dsift_get_descriptors (reference) ;
+  descrs16 = vl_dsift_get_descriptors_half (dsift) ;
+  check (descrs16 != NULL) ;
+  check (vl_dsift_get_descriptors_uint8 (dsift) == NULL) ;
+  for (i = 0 ; i < n ; ++i) {
+    float x = vl_half_to_float (descrs16 [i]) ;
+    check (fabs (x - descrs [i]) <= fabs (descrs [i]) / 2048 + 1e-7,
+           "component %d: %g vs %g", (int) i, x, descrs [i]) ;
+  }
+
+  /* switching back to floats */
+  vl_dsift_set_descriptor_type (dsift, VlDsiftDescriptorFloat) ;
+  vl_dsift_process (dsift, image) ;
+  check (vl_dsift_get_descriptors_half (dsift) == NULL) ;
+  check (memcmp (vl_dsift_get_descriptors (dsift), descrs, sizeof(float) * n) == 0) ;
+
+  check (vl_float_to_half (1.0F) == 0x3c00) ;
+  check (vl_float_to_half (-2.0F) == 0xc000) ;
+  check (vl_float_to_half (1e6F) == 0x7c00) ;
+  check (vl_half_to_float (0x0001) == 1.0F / 16777216.0F) ;
+
+  vl_dsift_delete (reference) ;
+  vl_dsift_delete (dsift) ;
+}
+
+/* check that processing regions of interest in a batch is the same
+   as processing them one by one */
+static void
+check_rois (float const * image, int width, int height)
+{
+  VlDsiftRoi const rois [] = {
+    {10, 20, 90, 80, 3, 4},
+    {50, 40, 130, 110, 5, 2},
+    {-20, height - 40, 60, height + 30, 4, 4}, /* partially outside */
+    {100, 100, 110, 110, 1, 1}                 /* too small */
+  } ;
+  vl_size const numRois = sizeof(rois) / sizeof(rois[0]) ;
+  VlDsiftFilter * batch = vl_dsift_new_basic (width, height, 1, 6) ;
+  VlDsiftFilter * dsift = vl_dsift_new_basic (width, height, 1, 6) ;
+  int flat ;
+
+  for (flat = 0 ; flat < 2 ; ++flat) {
+    vl_size const * offsets ;
+    vl_size r ;
+    int descrSize ;
+    vl_dsift_set_flat_window (batch, flat) ;
+    vl_dsift_set_flat_window (dsift, flat) ;
+    check (vl_dsift_process_rois (batch, image, rois, numRois) == VL_ERR_OK) ;
+    descrSize = vl_dsift_get_descriptor_size (batch) ;
+    offsets = vl_dsift_get_roi_offsets (batch) ;
+    check (vl_dsift_get_roi_num (batch) == numRois) ;
+    check (offsets [0] == 0) ;
+    check (offsets [numRois] == (vl_size) vl_dsift_get_keypoint_num (batch)) ;
+    check (offsets [4] == offsets [3]) ;
+    for (r = 0 ; r < numRois ; ++r) {
+      vl_size n = offsets [r + 1] - offsets [r] ;
+      vl_dsift_set_bounds (dsift,
+                           VL_MAX (rois[r].minX, 0), VL_MAX (rois[r].minY, 0),
+                           VL_MIN (rois[r].maxX, width - 1), VL_MIN (rois[r].maxY, height - 1)) ;
+      vl_dsift_set_steps (dsift, rois[r].stepX, rois[r].stepY) ;
+      vl_dsift_process (dsift, image) ;
+      check ((vl_size) vl_dsift_get_keypoint_num (dsift) == n) ;
+      if (n == 0) continue ;
+      check (vl_dsift_get_keypoints (batch) [offsets [r]].x == vl_dsift_get_keypoints (dsift) [0].x &&
+             vl_dsift_get_keypoints (batch) [offsets [r + 1] - 1].y == vl_dsift_get_keypoints (dsift) [n - 1].y) ;
+      check (memcmp (vl_dsift_get_descriptors (batch) + descrSize * offsets [r],
+                     vl_dsift_get_descriptors (dsift),
+                     sizeof(float) * descrSize * n) == 0,
+             "region %d differs (flat window: %d)", (int) r, flat) ;
+    }
+  }
+
+  /* invalid steps are rejected */
+  {
+    VlDsiftRoi bad = {10, 20, 90, 80, 3, 0} ;
+    check (vl_dsift_process_rois (batch, image, &bad, 1) == VL_ERR_BAD_ARG) ;
+    check (vl_dsift_get_roi_num (batch) == numRois) ;
+  }
+
+  /* regions that cannot be stored are reported */
+  {
+    VlDsiftRoi many [2 * sizeof(rois) / sizeof(rois[0])] ;
+    memcpy (many, rois, sizeof(rois)) ;
+    memcpy (many + numRois, rois, sizeof(rois)) ;
+    failAllocations = VL_TRUE ;
+    check (vl_dsift_process_rois (batch, image, many, 2 * numRois) == VL_ERR_ALLOC) ;
+    failAllocations = VL_FALSE ;
+    check (vl_dsift_get_roi_num (batch) == 0) ;
+    check (vl_dsift_get_keypoint_num (batch) == 0) ;
+    check (vl_dsift_process_rois (batch, image, many, 2 * numRois) == VL_ERR_OK) ;
+    check (vl_dsift_get_roi_num (batch) == 2 * numRois) ;
+  }
+
+  /* changing the parameters resets the regions to the bounds */
+  vl_dsift_set_steps (batch, 2, 2) ;
+  check (vl_dsift_get_roi_num (batch) == 1) ;
+  check (vl_dsift_get_roi_offsets (batch) [0] == 0) ;
+  check (vl_dsift_get_roi_offsets (batch) [1] == (vl_size) vl_dsift_get_keypoint_num (batch)) ;
+  vl_dsift_set_steps (dsift, 2, 2) ;
+  vl_dsift_set_bounds (dsift, 0, 0, width - 1, height - 1) ;
+  check (vl_dsift_get_keypoint_num (batch) == vl_dsift_get_keypoint_num (dsift)) ;
+  vl_dsift_process (dsift, image) ;
+  check (vl_dsift_get_keypoint_num (batch) == vl_dsift_get_keypoint_num (dsift)) ;
+
+  vl_dsift_delete (dsift) ;
+  vl_dsift_delete (batch) ;
+}
+
+int
+main (int argc VL_UNUSED, char** argv VL_UNUSED)
+{
+  int const width = 300 ;
+  int const height = 260 ;
+  float * image ;
+
+  vl_set_alloc_func (failing_malloc, failing_realloc, failing_calloc, free) ;
+  image = vl_malloc (sizeof(float) * width * height) ;
+
+  check_synthetic_image (image, width, height) ;
+
+  check_threads (image, width, height) ;
+  check_phow (image, width, height) ;
+  check_descriptor_type (image, width, height) ;
+  check_rois (image, width, height) ;
+
+  vl_free (image) ;
+  check_signoff () ;
+  return 0 ;
+}
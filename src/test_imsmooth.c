@@ -0,0 +1,332 @@
+/** @file   test_imsmooth.c
+ ** @brief  Test and benchmark Gaussian smoothing
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+/*
+ Checks the Gaussian smoothing functions. If arguments are given, it
+ also compares the tiled, transpose-free vl_imsmooth_f against the
+ previous implementation, which applies vl_imconvcol_vf twice with
+ VL_TRANSPOSE, on images of 1 to 40 megapixels. The bandwidth is the
+ number of bytes read and written by the two passes (four times the
+ image size) divided by the time.
+
+ Usage: test_imsmooth [SIGMA [MAX_MEGAPIXELS]]
+ */
+
+#include <vl/generic.h>
+#include <vl/imopv.h>
+#include <vl/imopv_sse2.h>
+#include <vl/imopv_avx.h>
+#include <vl/imopv_avx512.h>
+#include <vl/mathop.h>
+#include <vl/random.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "check.h"
+
+#define NUM_TRIALS 3
+
+static void
+smooth_transposed (float * smoothed, float * buffer, float const * image,
+                   vl_size width, vl_size height,
+                   float const * filt, vl_index filtWidth)
+{
+  vl_imconvcol_vf (buffer, height, image, width, height, width,
+                   filt, -filtWidth, filtWidth, 1,
+                   VL_PAD_BY_CONTINUITY | VL_TRANSPOSE) ;
+  vl_imconvcol_vf (smoothed, width, buffer, height, width, height,
+                   filt, -filtWidth, filtWidth, 1,
+                   VL_PAD_BY_CONTINUITY | VL_TRANSPOSE) ;
+}
+
+static void
+benchmark (double sigma, int maxMegapixels)
+{
+  int const megapixels [] = {1, 2, 5, 10, 20, 40} ;
+  vl_index filtWidth ;
+  float * filt ;
+  int m, i ;
+
+  /* the same filter as vl_imsmooth_f */
+  filtWidth = (vl_index) vl_ceil_d (3.0 * sigma) ;
+  filt = vl_malloc (sizeof(float) * (2 * filtWidth + 1)) ;
+  {
+    float mass = 1.0f ;
+    filt [filtWidth] = 1.0f ;
+    for (i = 1 ; i <= filtWidth ; ++i) {
+      double x = (double) i / sigma ;
+      double g = exp (-0.5 * x * x) ;
+      mass += g + g ;
+      filt [filtWidth - i] = (float) g ;
+      filt [filtWidth + i] = (float) g ;
+    }
+    for (i = 0 ; i < 2 * filtWidth + 1 ; ++i) filt [i] /= mass ;
+  }
+
+  VL_PRINTF ("test_imsmooth: sigma %g, %d thread(s)\n", sigma, (int) vl_get_max_threads ()) ;
+  VL_PRINTF ("%6s %11s %11s %11s %11s %8s %6s\n",
+             "MP", "old [s]", "old [GB/s]", "new [s]", "new [GB/s]", "speedup", "equal") ;
+
+  for (m = 0 ; m < (signed)(sizeof(megapixels) / sizeof(megapixels[0])) ; ++m) {
+    /* 4:3 images */
+    vl_size const height = (vl_size) (sqrt (megapixels [m] * 1e6 * 3.0 / 4.0)) ;
+    vl_size const width = (vl_size) (megapixels [m] * 1e6) / height ;
+    vl_size const numPixels = width * height ;
+    double const numBytes = 4.0 * sizeof(float) * numPixels ;
+    float * image, * buffer, * old, * new ;
+    double oldTime = VL_INFINITY_D, newTime = VL_INFINITY_D ;
+    vl_bool equal ;
+    VlRand rand ;
+    int trial ;
+
+    if (megapixels [m] > maxMegapixels) break ;
+
+    image = vl_malloc (sizeof(float) * numPixels) ;
+    buffer = vl_malloc (sizeof(float) * numPixels) ;
+    old = vl_malloc (sizeof(float) * numPixels) ;
+    new = vl_malloc (sizeof(float) * numPixels) ;
+    if (image == NULL || buffer == NULL || old == NULL || new == NULL) {
+      VL_PRINTF ("test_imsmooth: out of memory at %d MP\n", megapixels [m]) ;
+      break ;
+    }
+
+    vl_rand_init (&rand) ;
+    for (i = 0 ; i < (signed)numPixels ; ++i) {
+      image [i] = (float) vl_rand_real1 (&rand) ;
+    }
+
+    for (trial = 0 ; trial < NUM_TRIALS ; ++trial) {
+      vl_tic () ;
+      smooth_transposed (old, buffer, image, width, height, filt, filtWidth) ;
+      oldTime = VL_MIN (oldTime, vl_toc ()) ;
+
+      vl_tic () ;
+      vl_imsmooth_f (new, width, image, width, height, width, sigma, sigma) ;
+      newTime = VL_MIN (newTime, vl_toc ()) ;
+    }
+    equal = memcmp (old, new, sizeof(float) * numPixels) == 0 ;
+
+    VL_PRINTF ("%6d %11.4f %11.2f %11.4f %11.2f %8.2f %6s\n",
+               megapixels [m],
+               oldTime, numBytes / oldTime * 1e-9,
+               newTime, numBytes / newTime * 1e-9,
+               oldTime / newTime,
+               equal ? "yes" : "NO") ;
+
+    vl_free (new) ;
+    vl_free (old) ;
+    vl_free (buffer) ;
+    vl_free (image) ;
+  }
+
+  vl_free (filt) ;
+}
+
+/* check the recursive Gaussian smoothing against the FIR one, on
+   the test image and on checkerboards, whose high frequencies are the
+   hardest to approximate */
+static void
+check_imsmooth_recursive (float const * image, int width, int height)
+{
+  double const sigmas [] = {1.2, 2.0, 3.5, 9.0, 25.0} ;
+  int const squareSizes [] = {0, 8, 32} ;
+  float * input = vl_malloc (sizeof(float) * width * height) ;
+  float * fir = vl_malloc (sizeof(float) * width * height) ;
+  float * iir = vl_malloc (sizeof(float) * width * height) ;
+  int i, k, p, x, y ;
+
+  for (p = 0 ; p < 3 ; ++p) {
+    float minValue, maxValue ;
+    for (y = 0 ; y < height ; ++y) {
+      for (x = 0 ; x < width ; ++x) {
+        input [x + width * y] = (squareSizes [p] == 0) ? image [x + width * y] :
+          (float) ((x / squareSizes [p] + y / squareSizes [p]) % 2) ;
+      }
+    }
+    minValue = maxValue = input [0] ;
+    for (i = 1 ; i < width * height ; ++i) {
+      minValue = VL_MIN (minValue, input [i]) ;
+      maxValue = VL_MAX (maxValue, input [i]) ;
+    }
+
+    for (k = 0 ; k < 5 ; ++k) {
+      double sigmax = sigmas [k], sigmay = sigmas [(k + 1) % 5] ;
+      float maxError = 0 ;
+      vl_imsmooth_f (fir, width, input, width, height, width, sigmax, sigmay) ;
+      vl_imsmooth_recursive_f (iir, width, input, width, height, width, sigmax, sigmay) ;
+      for (i = 0 ; i < width * height ; ++i) {
+        maxError = VL_MAX (maxError, vl_abs_f (fir [i] - iir [i])) ;
+      }
+      check (maxError <= 0.01f * (maxValue - minValue),
+             "sigma %g x %g, squares %d: error %g",
+             sigmax, sigmay, squareSizes [p], maxError) ;
+    }
+  }
+
+  vl_free (iir) ;
+  vl_free (fir) ;
+  vl_free (input) ;
+}
+
+/* check that the SIMD column convolution kernels match the C code */
+typedef void (*ConvColFunction) (float*, vl_size, float const*, vl_size, vl_size, vl_size,
+                                 float const*, vl_index, vl_index, int, unsigned int) ;
+
+static void
+check_imconvcol_simd (float const * image, int width, int height)
+{
+  ConvColFunction kernels [3] = {NULL, NULL, NULL} ;
+  char const * names [3] = {"SSE2", "AVX", "AVX-512"} ;
+  float const filt [] = {0.1f, 0.2f, 0.3f, 0.25f, 0.15f} ;
+  unsigned int const flags [] = {VL_PAD_BY_ZERO, VL_PAD_BY_CONTINUITY,
+                                 VL_PAD_BY_ZERO | VL_TRANSPOSE,
+                                 VL_PAD_BY_CONTINUITY | VL_TRANSPOSE} ;
+  /* odd sizes and an unaligned source exercise the partial vectors */
+  int const w = width - 3, h = height - 1 ;
+  float const * src = image + 1 ;
+  float * ref = vl_malloc (sizeof(float) * width * height) ;
+  float * out = vl_malloc (sizeof(float) * width * height) ;
+  int k, f, step ;
+
+#ifndef VL_DISABLE_SSE2
+  if (vl_cpu_has_sse2()) kernels [0] = _vl_imconvcol_vf_sse2 ;
+#endif
+#ifndef VL_DISABLE_AVX
+  if (vl_cpu_has_avx()) kernels [1] = _vl_imconvcol_vf_avx ;
+#endif
+#ifndef VL_DISABLE_AVX512
+  if (vl_cpu_has_avx512f()) kernels [2] = _vl_imconvcol_vf_avx512 ;
+#endif
+
+  for (k = 0 ; k < 3 ; ++k) {
+    if (kernels [k] == NULL) continue ;
+    for (f = 0 ; f < 4 ; ++f) {
+      for (step = 1 ; step <= 2 ; ++step) {
+        int const dheight = (h - 1) / step + 1 ;
+        vl_size const dstStride = (flags [f] & VL_TRANSPOSE) ? dheight : w ;
+        vl_set_simd_enabled (VL_FALSE) ;
+        vl_imconvcol_vf (ref, dstStride, src, w, h, width, filt, -1, 3, step, flags [f]) ;
+        vl_set_simd_enabled (VL_TRUE) ;
+        kernels [k] (out, dstStride, src, w, h, width, filt, -1, 3, step, flags [f]) ;
+        check (memcmp (ref, out, sizeof(float) * w * dheight) == 0,
+               "%s kernel differs (flags %u, step %d)", names [k], flags [f], step) ;
+      }
+    }
+  }
+
+  vl_free (out) ;
+  vl_free (ref) ;
+}
+
+/* check that the tiled smoothing matches two transposed column passes */
+static void
+check_imsmooth_tiled (float const * image, int width, int height)
+{
+  double const sigmas [] = {0.8, 1.6, 5.0} ;
+  int const w = width - 3, h = height - 1 ;
+  float * buffer = vl_malloc (sizeof(float) * w * h) ;
+  float * ref = vl_malloc (sizeof(float) * w * h) ;
+  float * out = vl_malloc (sizeof(float) * w * h) ;
+  int k, simd ;
+
+  for (simd = 0 ; simd <= 1 ; ++simd) {
+    vl_set_simd_enabled (simd) ;
+    for (k = 0 ; k < 3 ; ++k) {
+      double sigmax = sigmas [k], sigmay = sigmas [(k + 1) % 3] ;
+      vl_size sizex = 2 * (vl_size) vl_ceil_d (3.0 * sigmax) + 1 ;
+      vl_size sizey = 2 * (vl_size) vl_ceil_d (3.0 * sigmay) + 1 ;
+      float * filtx = vl_malloc (sizeof(float) * sizex) ;
+      float * filty = vl_malloc (sizeof(float) * sizey) ;
+      vl_size i ;
+      /* the filters of vl_imsmooth_f, recovered from impulses */
+      for (i = 0 ; i < sizex ; ++i) filtx [i] = (float) (i == sizex / 2) ;
+      for (i = 0 ; i < sizey ; ++i) filty [i] = (float) (i == sizey / 2) ;
+      vl_imsmooth_f (filtx, sizex, filtx, sizex, 1, sizex, sigmax, 0.01) ;
+      vl_imsmooth_f (filty, sizey, filty, sizey, 1, sizey, sigmay, 0.01) ;
+
+      vl_imconvcol_vf (buffer, h, image + 1, w, h, width,
+                       filty, -(signed)sizey/2, sizey/2, 1,
+                       VL_PAD_BY_CONTINUITY | VL_TRANSPOSE) ;
+      vl_imconvcol_vf (ref, w, buffer, h, w, h,
+                       filtx, -(signed)sizex/2, sizex/2, 1,
+                       VL_PAD_BY_CONTINUITY | VL_TRANSPOSE) ;
+      vl_imsmooth_f (out, w, image + 1, w, h, width, sigmax, sigmay) ;
+      check (memcmp (ref, out, sizeof(float) * w * h) == 0,
+             "sigma %g x %g, SIMD %d: tiled smoothing differs", sigmax, sigmay, simd) ;
+      vl_free (filtx) ;
+      vl_free (filty) ;
+    }
+  }
+  vl_set_simd_enabled (VL_TRUE) ;
+
+  vl_free (out) ;
+  vl_free (ref) ;
+  vl_free (buffer) ;
+}
+
+/* check that smoothing several planes at once, in place, matches
+   smoothing them one by one */
+static void
+check_imsmooth_planes (float const * image, int width, int height)
+{
+  vl_size const n = (vl_size) width * height ;
+  float * data = vl_malloc (sizeof(float) * 3 * n) ;
+  float * ref = vl_malloc (sizeof(float) * n) ;
+  float * planes [3] ;
+  float const * constPlanes [3] ;
+  vl_size i ;
+  int p ;
+
+  for (p = 0 ; p < 3 ; ++p) {
+    planes [p] = data + p * n ;
+    constPlanes [p] = data + p * n ;
+    for (i = 0 ; i < n ; ++i) planes [p][i] = image [i] * (p + 1) - p ;
+  }
+  vl_imsmooth_planes_f (planes, width, constPlanes, 3,
+                        width, height, width, 2.5, 2.5) ;
+  for (p = 0 ; p < 3 ; ++p) {
+    for (i = 0 ; i < n ; ++i) ref [i] = image [i] * (p + 1) - p ;
+    vl_imsmooth_f (ref, width, ref, width, height, width, 2.5, 2.5) ;
+    check (memcmp (ref, planes [p], sizeof(float) * n) == 0,
+           "plane %d: smoothing several planes differs", p) ;
+  }
+
+  vl_free (ref) ;
+  vl_free (data) ;
+}
+
+int
+main (int argc, char** argv)
+{
+  int const width = 300 ;
+  int const height = 260 ;
+  float * image = vl_malloc (sizeof(float) * width * height) ;
+
+  check_synthetic_image (image, width, height) ;
+
+  check_imsmooth_recursive (image, width, height) ;
+  check_imconvcol_simd (image, width, height) ;
+  check_imsmooth_tiled (image, width, height) ;
+  check_imsmooth_planes (image, width, height) ;
+
+  vl_free (image) ;
+  check_signoff () ;
+
+  if (argc > 1) {
+    benchmark (atof (argv [1]), (argc > 2) ? atoi (argv [2]) : 40) ;
+  }
+  return 0 ;
+}
@@ -0,0 +1,301 @@
+/** @file   test_scalespace.c
+ ** @brief  Test the Gaussian scale space
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include <vl/generic.h>
+#include <vl/scalespace.h>
+#include <vl/mathop.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "check.h"
+
+/* memory allocation functions counting the allocated bytes; they
+   fail beyond allocationLimit bytes if it is not zero */
+static vl_size allocated = 0 ;
+static vl_size allocationLimit = 0 ;
+
+#define HEADER 16
+
+static void *
+counting_malloc (size_t size)
+{
+  char * block ;
+  if (allocationLimit > 0 && allocated + size > allocationLimit) return NULL ;
+  block = malloc (size + HEADER) ;
+  if (block == NULL) return NULL ;
+  *(size_t*) block = size ;
+#if defined(_OPENMP)
+#pragma omp atomic
+#endif
+  allocated += size ;
+  return block + HEADER ;
+}
+
+static void
+counting_free (void * ptr)
+{
+  char * block ;
+  if (ptr == NULL) return ;
+  block = (char*) ptr - HEADER ;
+#if defined(_OPENMP)
+#pragma omp atomic
+#endif
+  allocated -= *(size_t*) block ;
+  free (block) ;
+}
+
+static void *
+counting_calloc (size_t n, size_t size)
+{
+  void * ptr = counting_malloc (n * size) ;
+  if (ptr) memset (ptr, 0, n * size) ;
+  return ptr ;
+}
+
+static void *
+counting_realloc (void * ptr, size_t size)
+{
+  void * copy = counting_malloc (size) ;
+  if (copy && ptr) {
+    size_t oldSize = *(size_t*) ((char*) ptr - HEADER) ;
+    memcpy (copy, ptr, VL_MIN (oldSize, size)) ;
+    counting_free (ptr) ;
+  }
+  return copy ;
+}
+
+/* check that the scale space does not depend on the number of threads */
+static void
+check_scale_space_threads (float const * image, int width, int height)
+{
+  VlScaleSpace * serial = vl_scalespace_new (width, height) ;
+  VlScaleSpace * parallel = vl_scalespace_new (width, height) ;
+  VlScaleSpaceGeometry geom = vl_scalespace_get_geometry (serial) ;
+  vl_size numThreads = vl_get_max_threads () ;
+  vl_index o, s ;
+
+  vl_set_num_threads (1) ;
+  vl_scalespace_put_image (serial, image) ;
+  vl_set_num_threads (numThreads) ;
+  vl_scalespace_put_image (parallel, image) ;
+
+  for (o = geom.firstOctave ; o <= geom.lastOctave ; ++o) {
+    VlScaleSpaceOctaveGeometry ogeom = vl_scalespace_get_octave_geometry (serial, o) ;
+    for (s = geom.octaveFirstSubdivision ; s <= geom.octaveLastSubdivision ; ++s) {
+      check (memcmp (vl_scalespace_get_level (serial, o, s),
+                     vl_scalespace_get_level (parallel, o, s),
+                     sizeof(float) * ogeom.width * ogeom.height) == 0,
+             "octave %d level %d differs", (int) o, (int) s) ;
+    }
+  }
+
+  vl_scalespace_delete (parallel) ;
+  vl_scalespace_delete (serial) ;
+}
+
+/* check that computing the scale space on demand gives the same levels */
+static void
+check_scale_space_lazy (float const * image, int width, int height)
+{
+  VlScaleSpaceGeometry geom = vl_scalespace_get_default_geometry (width, height) ;
+  VlScaleSpace * eager, * lazy, * copy ;
+  vl_index o, s ;
+
+  geom.firstOctave = -1 ;
+  geom.octaveFirstSubdivision = -1 ;
+  geom.octaveLastSubdivision = geom.octaveResolution + 1 ;
+  eager = vl_scalespace_new_with_geometry (geom) ;
+  lazy = vl_scalespace_new_with_geometry (geom) ;
+  vl_scalespace_put_image (eager, image) ;
+  vl_scalespace_set_lazy (lazy, VL_TRUE) ;
+  check (vl_scalespace_get_lazy (lazy)) ;
+
+  /* without an image there is no level to return */
+  check (vl_scalespace_get_level (lazy, geom.firstOctave, 0) == NULL) ;
+  vl_scalespace_set_lazy (lazy, VL_FALSE) ;
+  check (vl_scalespace_get_level (lazy, geom.firstOctave, 0) != NULL) ;
+  vl_scalespace_set_lazy (lazy, VL_TRUE) ;
+
+  vl_scalespace_put_image (lazy, image) ;
+
+#define check_level(ss,o,s) \
+  { VlScaleSpaceOctaveGeometry ogeom = vl_scalespace_get_octave_geometry (eager, o) ; \
+    check (memcmp (vl_scalespace_get_level (eager, o, s), \
+                   vl_scalespace_get_level (ss, o, s), \
+                   sizeof(float) * ogeom.width * ogeom.height) == 0, \
+           "octave %d level %d differs", (int) o, (int) s) ; }
+
+  /* the octaves computed only to reach a coarse level are released,
+     including the first one */
+  {
+    vl_size baseline = allocated ;
+    VlScaleSpaceOctaveGeometry ogeom = vl_scalespace_get_octave_geometry (lazy, geom.firstOctave + 1) ;
+    vl_size secondOctaveSize = ogeom.width * ogeom.height * sizeof(float)
+      * (geom.octaveLastSubdivision - geom.octaveFirstSubdivision + 1) ;
+    vl_scalespace_get_level (lazy, geom.lastOctave, 1) ;
+    check (allocated - baseline < secondOctaveSize,
+           "%d bytes retained to compute the last octave", (int) (allocated - baseline)) ;
+  }
+
+  /* coarse level first, then the others in decreasing order */
+  check_level (lazy, geom.lastOctave, 1) ;
+  for (o = geom.lastOctave ; o >= geom.firstOctave ; --o) {
+    for (s = geom.octaveLastSubdivision ; s >= geom.octaveFirstSubdivision ; --s) {
+      check_level (lazy, o, s) ;
+    }
+  }
+
+  /* a new image invalidates the levels */
+  vl_scalespace_put_image (eager, image + width) ;
+  vl_scalespace_put_image (lazy, image + width) ;
+  copy = vl_scalespace_new_copy (lazy) ;
+  check (! vl_scalespace_get_lazy (copy)) ;
+  for (o = geom.firstOctave ; o <= geom.lastOctave ; ++o) {
+    for (s = geom.octaveFirstSubdivision ; s <= geom.octaveLastSubdivision ; ++s) {
+      check_level (copy, o, s) ;
+      check_level (lazy, o, s) ;
+    }
+  }
+#undef check_level
+
+  vl_scalespace_delete (copy) ;
+  vl_scalespace_delete (lazy) ;
+  vl_scalespace_delete (eager) ;
+}
+
+/* check that a lazy scale space reports allocation failures and
+   recovers from them */
+static void
+check_scale_space_lazy_alloc (float const * image, int width, int height)
+{
+  VlScaleSpace * eager = vl_scalespace_new (width, height) ;
+  VlScaleSpace * lazy = vl_scalespace_new (width, height) ;
+  VlScaleSpaceGeometry geom = vl_scalespace_get_geometry (lazy) ;
+  VlScaleSpaceOctaveGeometry ogeom = vl_scalespace_get_octave_geometry (lazy, geom.lastOctave) ;
+
+  vl_scalespace_put_image (eager, image) ;
+  vl_scalespace_set_lazy (lazy, VL_TRUE) ;
+
+  allocationLimit = allocated + 1 ;
+  check (vl_scalespace_put_image (lazy, image) == VL_ERR_ALLOC) ;
+  check (vl_scalespace_get_level (lazy, geom.lastOctave, 0) == NULL) ;
+
+  /* enough for the image copy but not for the octaves */
+  allocationLimit = allocated + sizeof(float) * width * height + 1 ;
+  check (vl_scalespace_put_image (lazy, image) == VL_ERR_OK) ;
+  check (vl_scalespace_get_level (lazy, geom.lastOctave, 0) == NULL) ;
+  check (vl_get_last_error () == VL_ERR_ALLOC) ;
+  vl_scalespace_set_lazy (lazy, VL_FALSE) ;
+  check (vl_scalespace_get_lazy (lazy)) ;
+  check (vl_get_last_error () == VL_ERR_ALLOC) ;
+
+  allocationLimit = 0 ;
+  check (memcmp (vl_scalespace_get_level (eager, geom.lastOctave, 0),
+                 vl_scalespace_get_level (lazy, geom.lastOctave, 0),
+                 sizeof(float) * ogeom.width * ogeom.height) == 0) ;
+
+  vl_scalespace_delete (lazy) ;
+  vl_scalespace_delete (eager) ;
+}
+
+/* check that cropping the octaves gives the same levels far from
+   the crop boundaries */
+static void
+check_scale_space_crops (float const * image, int width, int height)
+{
+  vl_index const region [4] = {130, 110, 169, 149} ;
+  vl_index const margin = 40 ;
+  VlScaleSpaceGeometry geom = vl_scalespace_get_default_geometry (width, height) ;
+  VlScaleSpace * full, * cropped ;
+  vl_index * crops ;
+  vl_index o, s, x, y, k ;
+
+  geom.firstOctave = -2 ;
+  geom.lastOctave = 1 ;
+  crops = vl_malloc (sizeof(vl_index) * 4 * (geom.lastOctave - geom.firstOctave + 1)) ;
+
+  /* from the coarsest octave, each crop contains the next one */
+  for (o = geom.lastOctave ; o >= geom.firstOctave ; --o) {
+    vl_index * crop = crops + 4 * (o - geom.firstOctave) ;
+    vl_index const size [2] = {VL_SHIFT_LEFT (width, -o), VL_SHIFT_LEFT (height, -o)} ;
+    for (k = 0 ; k < 2 ; ++k) {
+      crop [k] = VL_MAX ((vl_index) floor (region [k] * pow (2.0, -o)) - margin, 0) ;
+      crop [k+2] = VL_MIN ((vl_index) ceil (region [k+2] * pow (2.0, -o)) + margin, size [k] - 1) ;
+      if (o < geom.lastOctave) {
+        crop [k] = VL_MIN (crop [k], 2 * crop [k+4]) ;
+        crop [k+2] = VL_MAX (crop [k+2], 2 * crop [k+6]) ;
+      }
+    }
+  }
+
+  full = vl_scalespace_new_with_geometry (geom) ;
+  cropped = vl_scalespace_new_with_crops (geom, crops) ;
+  vl_scalespace_put_image (full, image) ;
+  vl_scalespace_put_image (cropped, image) ;
+
+  for (o = geom.firstOctave ; o <= geom.lastOctave ; ++o) {
+    VlScaleSpaceOctaveGeometry fgeom = vl_scalespace_get_octave_geometry (full, o) ;
+    VlScaleSpaceOctaveGeometry cgeom = vl_scalespace_get_octave_geometry (cropped, o) ;
+    vl_index const * crop = crops + 4 * (o - geom.firstOctave) ;
+    check (cgeom.origin [0] == crop [0] && cgeom.origin [1] == crop [1] &&
+           cgeom.width == (vl_size) (crop [2] - crop [0] + 1) &&
+           cgeom.height == (vl_size) (crop [3] - crop [1] + 1),
+           "octave %d: wrong crop geometry", (int) o) ;
+    check (cgeom.width < fgeom.width || cgeom.height < fgeom.height || o == geom.lastOctave,
+           "octave %d is not cropped", (int) o) ;
+    for (s = geom.octaveFirstSubdivision ; s <= geom.octaveLastSubdivision ; ++s) {
+      float const * a = vl_scalespace_get_level (full, o, s) ;
+      float const * b = vl_scalespace_get_level (cropped, o, s) ;
+      vl_index numDifferent = 0 ;
+      for (y = (vl_index) floor (region [1] * pow (2.0, -o)) ;
+           y <= (vl_index) ceil (region [3] * pow (2.0, -o)) ; ++y) {
+        for (x = (vl_index) floor (region [0] * pow (2.0, -o)) ;
+             x <= (vl_index) ceil (region [2] * pow (2.0, -o)) ; ++x) {
+          numDifferent +=
+          a [x + y * fgeom.width] !=
+          b [(x - cgeom.origin [0]) + (y - cgeom.origin [1]) * cgeom.width] ;
+        }
+      }
+      check (numDifferent == 0, "octave %d level %d: %d pixels differ",
+             (int) o, (int) s, (int) numDifferent) ;
+    }
+  }
+
+  vl_scalespace_delete (cropped) ;
+  vl_scalespace_delete (full) ;
+  vl_free (crops) ;
+}
+
+int
+main (int argc VL_UNUSED, char** argv VL_UNUSED)
+{
+  int const width = 300 ;
+  int const height = 260 ;
+  float * image ;
+
+  vl_set_alloc_func (counting_malloc, counting_realloc, counting_calloc, counting_free) ;
+  image = vl_malloc (sizeof(float) * width * height) ;
+
+  check_synthetic_image (image, width, height) ;
+
+  check_scale_space_threads (image, width, height) ;
+  check_scale_space_lazy (image, width, height - 1) ;
+  check_scale_space_lazy_alloc (image, width, height) ;
+  check_scale_space_crops (image, width, height) ;
+
+  vl_free (image) ;
+  check_signoff () ;
+  return 0 ;
+}
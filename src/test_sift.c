@@ -0,0 +1,712 @@
+/** @file   test_sift.c
+ ** @brief  Test SIFT descriptors
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include <vl/generic.h>
+#include <vl/sift.h>
+#include <vl/dsift.h>
+#include <vl/scalespace.h>
+#include <vl/mathop.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+
+#define NUM_KEYS 64
+#define NUM_PROJ 32
+
+/* check that projected = proj' * (descrs - mean), column by column */
+static void
+check_projection (float const * projected, float const * descrs,
+                  float const * proj, float const * mean,
+                  int descrSize, int numDescrs)
+{
+  int i, j, k ;
+  for (i = 0 ; i < numDescrs ; ++i) {
+    for (j = 0 ; j < NUM_PROJ ; ++j) {
+      double acc = 0 ;
+      for (k = 0 ; k < descrSize ; ++k) {
+        acc += proj [descrSize * j + k] * (descrs [descrSize * i + k] - mean [k]) ;
+      }
+      check (fabs (acc - projected [NUM_PROJ * i + j]) < 1e-4,
+             "descriptor %d, projection %d: %g, expected %g",
+             i, j, projected [NUM_PROJ * i + j], acc) ;
+    }
+  }
+}
+
+/* features collected by the tiled and whole image runs */
+typedef struct _Feature
+{
+  VlSiftKeypoint key ;
+  double angle ;
+  vl_sift_pix descr [128] ;
+} Feature ;
+
+typedef struct _Features
+{
+  float const * image ;
+  int width ;
+  Feature * features ;
+  int numFeatures ;
+} Features ;
+
+static int
+read_tile (void * data, vl_sift_pix * tile, int x, int y, int width, int height)
+{
+  Features const * self = data ;
+  int i ;
+  for (i = 0 ; i < height ; ++i) {
+    memcpy (tile + i * width, self->image + x + (y + i) * self->width,
+            sizeof(vl_sift_pix) * width) ;
+  }
+  return VL_ERR_OK ;
+}
+
+static int
+collect_features (void * data, VlSiftFilt * filt,
+                  VlSiftKeypoint const * keys, int numKeys)
+{
+  Features * self = data ;
+  int i, j ;
+  for (i = 0 ; i < numKeys ; ++i) {
+    double angles [4] ;
+    int numAngles = vl_sift_calc_keypoint_orientations (filt, angles, keys + i) ;
+    for (j = 0 ; j < numAngles ; ++j) {
+      Feature * feature ;
+      self->features = vl_realloc (self->features,
+                                   sizeof(Feature) * (self->numFeatures + 1)) ;
+      feature = self->features + self->numFeatures++ ;
+      memset (feature, 0, sizeof(Feature)) ;
+      feature->key = keys [i] ;
+      feature->angle = angles [j] ;
+      vl_sift_calc_keypoint_descriptor (filt, feature->descr, keys + i, angles [j]) ;
+    }
+  }
+  return VL_ERR_OK ;
+}
+
+static int
+compare_features (void const * a, void const * b)
+{
+  Feature const * fa = a ;
+  Feature const * fb = b ;
+  if (fa->key.o != fb->key.o) return fa->key.o - fb->key.o ;
+  if (fa->key.y != fb->key.y) return (fa->key.y < fb->key.y) ? -1 : 1 ;
+  if (fa->key.x != fb->key.x) return (fa->key.x < fb->key.x) ? -1 : 1 ;
+  if (fa->key.s != fb->key.s) return (fa->key.s < fb->key.s) ? -1 : 1 ;
+  if (fa->angle != fb->angle) return (fa->angle < fb->angle) ? -1 : 1 ;
+  return 0 ;
+}
+
+/* process a whole image */
+static void
+process_whole (VlSiftFilt * filt, float const * image, Features * features)
+{
+  int err = vl_sift_process_first_octave (filt, image) ;
+  while (err == VL_ERR_OK) {
+    vl_sift_detect (filt) ;
+    collect_features (features, filt, vl_sift_get_keypoints (filt),
+                      vl_sift_get_nkeypoints (filt)) ;
+    err = vl_sift_process_next_octave (filt) ;
+  }
+}
+
+/* process a whole image with the batch orientation and descriptor
+   functions */
+static void
+process_batch (VlSiftFilt * filt, float const * image, Features * features)
+{
+  int err = vl_sift_process_first_octave (filt, image) ;
+  while (err == VL_ERR_OK) {
+    VlSiftKeypoint const * keys ;
+    VlSiftKeypoint * orientedKeys ;
+    double * angles, * orientedAngles ;
+    vl_sift_pix * descrs ;
+    int * numAngles ;
+    int i, j, n, numOriented = 0 ;
+
+    vl_sift_detect (filt) ;
+    keys = vl_sift_get_keypoints (filt) ;
+    n = vl_sift_get_nkeypoints (filt) ;
+    angles = vl_malloc (sizeof(double) * 4 * (n + 1)) ;
+    numAngles = vl_malloc (sizeof(int) * (n + 1)) ;
+    orientedKeys = vl_malloc (sizeof(VlSiftKeypoint) * 4 * (n + 1)) ;
+    orientedAngles = vl_malloc (sizeof(double) * 4 * (n + 1)) ;
+    vl_sift_calc_octave_orientations (filt, angles, numAngles, keys, n) ;
+    for (i = 0 ; i < n ; ++i) {
+      for (j = 0 ; j < numAngles [i] ; ++j) {
+        orientedKeys [numOriented] = keys [i] ;
+        orientedAngles [numOriented] = angles [4 * i + j] ;
+        ++ numOriented ;
+      }
+    }
+    descrs = vl_malloc (sizeof(vl_sift_pix) * 128 * (numOriented + 1)) ;
+    vl_sift_calc_octave_descriptors (filt, descrs, orientedKeys, orientedAngles, numOriented) ;
+
+    features->features = vl_realloc (features->features, sizeof(Feature) *
+                                     (features->numFeatures + numOriented + 1)) ;
+    for (i = 0 ; i < numOriented ; ++i) {
+      Feature * feature = features->features + features->numFeatures++ ;
+      memset (feature, 0, sizeof(Feature)) ;
+      feature->key = orientedKeys [i] ;
+      feature->angle = orientedAngles [i] ;
+      memcpy (feature->descr, descrs + 128 * i, sizeof(feature->descr)) ;
+    }
+
+    vl_free (descrs) ;
+    vl_free (orientedAngles) ;
+    vl_free (orientedKeys) ;
+    vl_free (numAngles) ;
+    vl_free (angles) ;
+    err = vl_sift_process_next_octave (filt) ;
+  }
+}
+
+/* check that the features do not depend on the number of threads */
+static void
+check_threads (float const * image, int width, int height)
+{
+  VlSiftFilt * filt = vl_sift_new (width, height, -1, 3, -1) ;
+  vl_size numThreads = vl_get_max_threads () ;
+  Features serial = {0}, parallel = {0}, single = {0} ;
+
+  vl_set_num_threads (1) ;
+  process_batch (filt, image, &serial) ;
+  vl_set_num_threads (numThreads) ;
+  process_batch (filt, image, &parallel) ;
+  process_whole (filt, image, &single) ;
+
+  check (serial.numFeatures > 0) ;
+  check (parallel.numFeatures == serial.numFeatures,
+         "%d features with %d threads, %d with one",
+         parallel.numFeatures, (int) numThreads, serial.numFeatures) ;
+  check (memcmp (parallel.features, serial.features,
+                 sizeof(Feature) * serial.numFeatures) == 0,
+         "features differ with %d threads", (int) numThreads) ;
+  check (single.numFeatures == serial.numFeatures) ;
+  check (memcmp (single.features, serial.features,
+                 sizeof(Feature) * serial.numFeatures) == 0,
+         "batch and single keypoint features differ") ;
+
+  vl_free (serial.features) ;
+  vl_free (parallel.features) ;
+  vl_free (single.features) ;
+  vl_sift_delete (filt) ;
+}
+
+/* check that a filter re-targeted to a new geometry gives the same
+   features as a new filter */
+static void
+check_reset (float const * image, int width, int height)
+{
+  VlSiftFilt * filt = vl_sift_new (width / 2, height / 3, 2, 5, 1) ;
+  VlSiftFilt * fresh = vl_sift_new (width, height, -1, 3, -1) ;
+  Features reused = {0}, expected = {0} ;
+
+  vl_sift_set_peak_thresh (filt, 0.01) ;
+  vl_sift_set_peak_thresh (fresh, 0.01) ;
+
+  /* use the filter on a smaller image first */
+  process_whole (filt, image, &reused) ;
+  vl_free (reused.features) ;
+  reused.features = NULL ;
+  reused.numFeatures = 0 ;
+
+  vl_sift_reset_geometry (filt, width, height, -1, 3, -1) ;
+  check (vl_sift_get_noctaves (filt) == vl_sift_get_noctaves (fresh)) ;
+  process_whole (filt, image, &reused) ;
+  process_whole (fresh, image, &expected) ;
+
+  check (expected.numFeatures > 0) ;
+  check (reused.numFeatures == expected.numFeatures,
+         "re-targeted filter found %d features instead of %d",
+         reused.numFeatures, expected.numFeatures) ;
+  check (memcmp (reused.features, expected.features,
+                 sizeof(Feature) * expected.numFeatures) == 0,
+         "re-targeted filter features differ") ;
+
+  vl_free (reused.features) ;
+  vl_free (expected.features) ;
+  vl_sift_delete (fresh) ;
+  vl_sift_delete (filt) ;
+}
+
+/* keypoints of all octaves, with their scores */
+typedef struct _Keypoints
+{
+  VlSiftKeypoint * keys ;
+  float * scores ;
+  int numKeys ;
+} Keypoints ;
+
+static void
+detect_all (VlSiftFilt * filt, float const * image, Keypoints * keypoints)
+{
+  int err = vl_sift_process_first_octave (filt, image) ;
+  while (err == VL_ERR_OK) {
+    int n ;
+    vl_sift_detect (filt) ;
+    n = vl_sift_get_nkeypoints (filt) ;
+    keypoints->keys = vl_realloc (keypoints->keys, sizeof(VlSiftKeypoint) * (keypoints->numKeys + n + 1)) ;
+    keypoints->scores = vl_realloc (keypoints->scores, sizeof(float) * (keypoints->numKeys + n + 1)) ;
+    memcpy (keypoints->keys + keypoints->numKeys, vl_sift_get_keypoints (filt),
+            sizeof(VlSiftKeypoint) * n) ;
+    memcpy (keypoints->scores + keypoints->numKeys, vl_sift_get_keypoint_scores (filt),
+            sizeof(float) * n) ;
+    keypoints->numKeys += n ;
+    err = vl_sift_process_next_octave (filt) ;
+  }
+}
+
+static int
+compare_scores (void const * a, void const * b)
+{
+  float sa = *(float const *) a ;
+  float sb = *(float const *) b ;
+  return (sa > sb) ? -1 : ((sa < sb) ? 1 : 0) ;
+}
+
+/* check that the keypoint budget keeps the strongest keypoints */
+static void
+check_max_keypoints (float const * image, int width, int height, int maxNumKeypoints)
+{
+  VlSiftFilt * filt = vl_sift_new (width, height, -1, 3, 0) ;
+  Keypoints all = {0}, scored = {0}, best = {0} ;
+  float * sorted ;
+  int i, j ;
+
+  detect_all (filt, image, &all) ;
+  vl_sift_set_max_keypoints (filt, 1000000) ;
+  detect_all (filt, image, &scored) ;
+  check (scored.numKeys == all.numKeys) ;
+  check (memcmp (scored.keys, all.keys, sizeof(VlSiftKeypoint) * all.numKeys) == 0) ;
+  check (all.numKeys > maxNumKeypoints) ;
+
+  vl_sift_set_max_keypoints (filt, maxNumKeypoints) ;
+  check (vl_sift_get_max_keypoints (filt) == maxNumKeypoints) ;
+  detect_all (filt, image, &best) ;
+  check (best.numKeys == maxNumKeypoints,
+         "%d keypoints kept out of %d with a budget of %d",
+         best.numKeys, all.numKeys, maxNumKeypoints) ;
+
+  sorted = vl_malloc (sizeof(float) * scored.numKeys) ;
+  memcpy (sorted, scored.scores, sizeof(float) * scored.numKeys) ;
+  qsort (sorted, scored.numKeys, sizeof(float), compare_scores) ;
+
+  /* the kept keypoints are detected keypoints, and they are the
+     budget strongest ones of the image */
+  for (i = 0, j = 0 ; i < scored.numKeys ; ++i) {
+    if (j < best.numKeys &&
+        memcmp (scored.keys + i, best.keys + j, sizeof(VlSiftKeypoint)) == 0) {
+      check (scored.scores [i] == best.scores [j]) ;
+      check (best.scores [j] >= sorted [maxNumKeypoints - 1]) ;
+      ++ j ;
+    } else {
+      check (scored.scores [i] <= sorted [maxNumKeypoints - 1],
+             "keypoint %d with score %g dropped", i, scored.scores [i]) ;
+    }
+  }
+  check (j == best.numKeys) ;
+
+  vl_free (sorted) ;
+  vl_free (all.keys) ; vl_free (all.scores) ;
+  vl_free (scored.keys) ; vl_free (scored.scores) ;
+  vl_free (best.keys) ; vl_free (best.scores) ;
+  vl_sift_delete (filt) ;
+}
+
+/* memory allocation functions failing on demand */
+static vl_bool failAllocations = VL_FALSE ;
+
+static void *
+failing_malloc (size_t size)
+{
+  return failAllocations ? NULL : malloc (size) ;
+}
+
+static void *
+failing_realloc (void * ptr, size_t size)
+{
+  return failAllocations ? NULL : realloc (ptr, size) ;
+}
+
+static void *
+failing_calloc (size_t n, size_t size)
+{
+  return failAllocations ? NULL : calloc (n, size) ;
+}
+
+/* check that the keypoint buffers report allocation failures */
+static void
+check_keypoints_alloc (float const * image, int width, int height)
+{
+  VlSiftFilt * filt = vl_sift_new (width, height, -1, 3, 0) ;
+
+  /* keypoint buffer, reported by the next octave */
+  check (vl_sift_process_first_octave (filt, image) == VL_ERR_OK) ;
+  failAllocations = VL_TRUE ;
+  vl_sift_detect (filt) ;
+  failAllocations = VL_FALSE ;
+  check (vl_sift_get_nkeypoints (filt) == 0) ;
+  check (vl_sift_process_next_octave (filt) == VL_ERR_ALLOC) ;
+  check (vl_sift_process_next_octave (filt) == VL_ERR_OK) ;
+
+  /* heap of the keypoint budget */
+  vl_sift_set_max_keypoints (filt, 10) ;
+  failAllocations = VL_TRUE ;
+  check (vl_sift_process_first_octave (filt, image) == VL_ERR_ALLOC) ;
+  failAllocations = VL_FALSE ;
+  check (vl_sift_process_first_octave (filt, image) == VL_ERR_OK) ;
+  vl_sift_detect (filt) ;
+  check (vl_sift_get_nkeypoints (filt) > 0) ;
+
+  vl_sift_delete (filt) ;
+}
+
+/* check that upright features have orientation zero and the same
+   descriptors as the general code, with and without SIMD */
+static void
+check_upright (float const * image, int width, int height)
+{
+  VlSiftFilt * filt = vl_sift_new (width, height, -1, 3, 0) ;
+  VlSiftFilt * upright = vl_sift_new (width, height, -1, 3, 0) ;
+  int err, numKeys = 0 ;
+
+  vl_sift_set_upright (upright, VL_TRUE) ;
+  check (vl_sift_get_upright (upright)) ;
+  check (! vl_sift_get_upright (filt)) ;
+
+  vl_sift_process_first_octave (filt, image) ;
+  err = vl_sift_process_first_octave (upright, image) ;
+  while (err == VL_ERR_OK) {
+    int i, n ;
+    VlSiftKeypoint const * keys ;
+    vl_sift_detect (upright) ;
+    n = vl_sift_get_nkeypoints (upright) ;
+    keys = vl_sift_get_keypoints (upright) ;
+    for (i = 0 ; i < n ; ++i) {
+      double angles [4] ;
+      float descr [128], expected [128] ;
+      int numAngles = vl_sift_calc_keypoint_orientations (upright, angles, keys + i) ;
+      if (numAngles == 0) continue ;
+      check (numAngles == 1 && angles [0] == 0) ;
+      vl_sift_calc_keypoint_descriptor (upright, descr, keys + i, angles [0]) ;
+      vl_set_simd_enabled (VL_FALSE) ;
+      vl_sift_calc_keypoint_descriptor (filt, expected, keys + i, 0) ;
+      vl_set_simd_enabled (VL_TRUE) ;
+      check (memcmp (descr, expected, sizeof(descr)) == 0,
+             "upright descriptor %d differs", numKeys) ;
+      ++ numKeys ;
+    }
+    err = vl_sift_process_next_octave (upright) ;
+    vl_sift_process_next_octave (filt) ;
+  }
+  check (numKeys > 0) ;
+
+  vl_sift_delete (upright) ;
+  vl_sift_delete (filt) ;
+}
+
+/* process a whole image from its Gaussian scale space */
+static void
+process_scale_space (VlSiftFilt * filt, VlScaleSpace const * ss, Features * features)
+{
+  int err = vl_sift_process_first_octave_from_scale_space (filt, ss) ;
+  while (err == VL_ERR_OK) {
+    vl_sift_detect (filt) ;
+    collect_features (features, filt, vl_sift_get_keypoints (filt),
+                      vl_sift_get_nkeypoints (filt)) ;
+    err = vl_sift_process_next_octave (filt) ;
+  }
+}
+
+/* check processing a Gaussian scale space computed outside the filter */
+static void
+check_scale_space (float const * image, int width, int height)
+{
+  VlSiftFilt * filt = vl_sift_new (width, height, -1, 3, -1) ;
+  VlScaleSpaceGeometry geom = vl_sift_get_scale_space_geometry (filt) ;
+  VlScaleSpace * own = vl_scalespace_new_with_geometry (geom) ;
+  VlScaleSpace * ss ;
+  Features expected = {0} ;
+  int err, o, s, pass ;
+
+  /* process the image and keep a copy of the filter scale space */
+  err = vl_sift_process_first_octave (filt, image) ;
+  while (err == VL_ERR_OK) {
+    o = vl_sift_get_octave_index (filt) ;
+    for (s = geom.octaveFirstSubdivision ; s <= (int) geom.octaveLastSubdivision ; ++s) {
+      memcpy (vl_scalespace_get_level (own, o, s), vl_sift_get_octave (filt, s),
+              sizeof(float) * vl_sift_get_octave_width (filt) * vl_sift_get_octave_height (filt)) ;
+    }
+    vl_sift_detect (filt) ;
+    collect_features (&expected, filt, vl_sift_get_keypoints (filt),
+                      vl_sift_get_nkeypoints (filt)) ;
+    err = vl_sift_process_next_octave (filt) ;
+  }
+  check (expected.numFeatures > 0) ;
+
+  /* the same scale space gives exactly the same features, also when
+     levels and octaves are missing from it */
+  for (pass = 0 ; pass < 2 ; ++pass) {
+    VlScaleSpaceGeometry sgeom = geom ;
+    Features features = {0} ;
+    if (pass == 1) {
+      sgeom.octaveLastSubdivision = sgeom.octaveResolution ;
+      sgeom.lastOctave = sgeom.firstOctave + 1 ;
+    }
+    ss = vl_scalespace_new_with_geometry (sgeom) ;
+    for (o = sgeom.firstOctave ; o <= sgeom.lastOctave ; ++o) {
+      VlScaleSpaceOctaveGeometry ogeom = vl_scalespace_get_octave_geometry (ss, o) ;
+      for (s = sgeom.octaveFirstSubdivision ; s <= (int) sgeom.octaveLastSubdivision ; ++s) {
+        memcpy (vl_scalespace_get_level (ss, o, s), vl_scalespace_get_level (own, o, s),
+                sizeof(float) * ogeom.width * ogeom.height) ;
+      }
+    }
+    process_scale_space (filt, ss, &features) ;
+    check (features.numFeatures == expected.numFeatures,
+           "%d features from the scale space, %d from the image (pass %d)",
+           features.numFeatures, expected.numFeatures, pass) ;
+    check (memcmp (features.features, expected.features,
+                   sizeof(Feature) * expected.numFeatures) == 0,
+           "features from the scale space differ (pass %d)", pass) ;
+    vl_free (features.features) ;
+    vl_scalespace_delete (ss) ;
+  }
+
+  /* incompatible smoothing */
+  {
+    VlScaleSpaceGeometry sgeom = geom ;
+    sgeom.baseScale *= 1.1 ;
+    ss = vl_scalespace_new_with_geometry (sgeom) ;
+    check (vl_sift_process_first_octave_from_scale_space (filt, ss) == VL_ERR_BAD_ARG) ;
+    check (vl_get_last_error () == VL_ERR_BAD_ARG) ;
+    vl_scalespace_delete (ss) ;
+  }
+
+  /* a scale space computed from the image is copied as it is */
+  ss = vl_scalespace_new_with_geometry (geom) ;
+  vl_scalespace_put_image (ss, image) ;
+  err = vl_sift_process_first_octave_from_scale_space (filt, ss) ;
+  while (err == VL_ERR_OK) {
+    int const w = vl_sift_get_octave_width (filt) ;
+    int const h = vl_sift_get_octave_height (filt) ;
+    o = vl_sift_get_octave_index (filt) ;
+    for (s = geom.octaveFirstSubdivision ; s <= (int) geom.octaveLastSubdivision ; ++s) {
+      check (memcmp (vl_sift_get_octave (filt, s),
+                     vl_scalespace_get_level_const (ss, o, s),
+                     sizeof(float) * w * h) == 0,
+             "octave %d level %d differs", o, s) ;
+    }
+    err = vl_sift_process_next_octave (filt) ;
+  }
+  vl_scalespace_delete (ss) ;
+
+  vl_free (expected.features) ;
+  vl_scalespace_delete (own) ;
+  vl_sift_delete (filt) ;
+}
+
+/* check that processing by tiles gives the same features */
+static void
+check_tiled (float const * image, int width, int height, int o_min, int tileSize)
+{
+  VlSiftFilt * filt = vl_sift_new (width, height, -1, 3, o_min) ;
+  Features whole = {0}, tiled = {0} ;
+  int err ;
+
+  whole.image = tiled.image = image ;
+  whole.width = tiled.width = width ;
+
+  process_whole (filt, image, &whole) ;
+
+  err = vl_sift_process_tiled (filt, tileSize, read_tile, collect_features, &tiled) ;
+  check (err == VL_ERR_OK) ;
+
+  qsort (whole.features, whole.numFeatures, sizeof(Feature), compare_features) ;
+  qsort (tiled.features, tiled.numFeatures, sizeof(Feature), compare_features) ;
+  check (whole.numFeatures > 0) ;
+  check (whole.numFeatures == tiled.numFeatures,
+         "tiled run found %d features instead of %d (o_min=%d, tile size %d)",
+         tiled.numFeatures, whole.numFeatures, o_min, tileSize) ;
+  check (memcmp (whole.features, tiled.features,
+                 sizeof(Feature) * whole.numFeatures) == 0,
+         "tiled and whole image features differ (o_min=%d, tile size %d)",
+         o_min, tileSize) ;
+
+  vl_free (whole.features) ;
+  vl_free (tiled.features) ;
+  vl_sift_delete (filt) ;
+}
+
+static vl_uint8
+quantize (vl_sift_pix x)
+{
+  x = 512.0F * x ;
+  return (vl_uint8) ((x < 255.0F) ? x : 255.0F) ;
+}
+
+int
+main (int argc VL_UNUSED, char** argv VL_UNUSED)
+{
+  int const width = 160 ;
+  int const height = 120 ;
+  float * image ;
+  vl_sift_pix * descrs, * descrs2 ;
+  vl_uint8 * descrs8 ;
+  VlSiftKeypoint keys [NUM_KEYS] ;
+  double angles [NUM_KEYS] ;
+  float proj [128 * NUM_PROJ] ;
+  float mean [128] ;
+  VlSiftFilt * filt ;
+  int x, y, i, j, rootSift ;
+
+  vl_set_alloc_func (failing_malloc, failing_realloc, failing_calloc, free) ;
+  image = vl_malloc (sizeof(float) * width * height) ;
+  descrs = vl_malloc (sizeof(vl_sift_pix) * 128 * NUM_KEYS) ;
+  descrs2 = vl_malloc (sizeof(vl_sift_pix) * 128 * NUM_KEYS) ;
+  descrs8 = vl_malloc (128 * NUM_KEYS) ;
+  filt = vl_sift_new (width, height, 1, 3, 0) ;
+
+  for (y = 0 ; y < height ; ++y) {
+    for (x = 0  ; x < width ; ++x) {
+      image [x + width * y] =
+        (float) (sin (0.13 * x + 0.05 * y * y / height) + ((x / 9 + y / 13) % 2)) ;
+    }
+  }
+
+  vl_sift_process_first_octave (filt, image) ;
+  for (i = 0 ; i < NUM_KEYS ; ++i) {
+    vl_sift_keypoint_init (filt, keys + i,
+                           10 + (37 * i) % (width - 20),
+                           10 + (23 * i) % (height - 20),
+                           1.6 + 0.1 * (i % 20)) ;
+    angles [i] = 0.7 * i ;
+  }
+
+  for (rootSift = 0 ; rootSift < 2 ; ++rootSift) {
+    vl_sift_set_root_sift (filt, rootSift) ;
+
+    /* SIMD and scalar descriptors must agree exactly; the octave is
+       processed again so that its gradient is computed again too */
+    vl_set_simd_enabled (VL_FALSE) ;
+    vl_sift_process_first_octave (filt, image) ;
+    vl_sift_calc_octave_descriptors (filt, descrs2, keys, angles, NUM_KEYS) ;
+    vl_set_simd_enabled (VL_TRUE) ;
+    vl_sift_process_first_octave (filt, image) ;
+    vl_sift_calc_octave_descriptors (filt, descrs, keys, angles, NUM_KEYS) ;
+    check (memcmp (descrs, descrs2, sizeof(vl_sift_pix) * 128 * NUM_KEYS) == 0,
+           "SIMD and scalar descriptors differ (rootSift=%d)", rootSift) ;
+
+    /* quantized descriptors must match quantizing the float ones */
+    vl_sift_calc_octave_descriptors_ui8 (filt, descrs8, keys, angles, NUM_KEYS) ;
+    for (i = 0 ; i < NUM_KEYS ; ++i) {
+      vl_uint8 d8 [128] ;
+      vl_sift_calc_keypoint_descriptor_ui8 (filt, d8, keys + i, angles [i]) ;
+      for (j = 0 ; j < 128 ; ++j) {
+        check (descrs8 [128 * i + j] == quantize (descrs [128 * i + j]),
+               "keypoint %d, bin %d: quantized %d, expected %d (rootSift=%d)",
+               i, j, descrs8 [128 * i + j], quantize (descrs [128 * i + j]),
+               rootSift) ;
+        check (d8 [j] == descrs8 [128 * i + j]) ;
+      }
+    }
+  }
+
+  /* projected descriptors */
+  for (i = 0 ; i < 128 * NUM_PROJ ; ++i) proj [i] = (float) sin (i) ;
+  for (i = 0 ; i < 128 ; ++i) mean [i] = 0.01f * (i % 7) ;
+
+  check (vl_sift_set_projection (filt, proj, mean, 0) == VL_ERR_BAD_ARG) ;
+  check (vl_sift_set_projection (filt, proj, mean, 129) == VL_ERR_BAD_ARG) ;
+  check (vl_sift_get_descriptor_size (filt) == 128) ;
+  check (vl_sift_set_projection (filt, proj, mean, NUM_PROJ) == VL_ERR_OK) ;
+  check (vl_sift_get_descriptor_size (filt) == NUM_PROJ) ;
+  vl_sift_calc_octave_descriptors (filt, descrs2, keys, angles, NUM_KEYS) ;
+  vl_sift_set_projection (filt, NULL, NULL, 0) ;
+  check (vl_sift_get_descriptor_size (filt) == 128) ;
+  vl_sift_calc_octave_descriptors (filt, descrs, keys, angles, NUM_KEYS) ;
+  for (i = 0 ; i < NUM_KEYS ; ++i) {
+    /* out of bounds keypoints are zero and not projected */
+    int isZero = 1 ;
+    for (j = 0 ; j < 128 ; ++j) isZero &= (descrs [128 * i + j] == 0) ;
+    if (isZero) {
+      for (j = 0 ; j < NUM_PROJ ; ++j) check (descrs2 [NUM_PROJ * i + j] == 0) ;
+    } else {
+      check_projection (descrs2 + NUM_PROJ * i, descrs + 128 * i,
+                        proj, mean, 128, 1) ;
+    }
+  }
+
+  /* projected dense descriptors */
+  {
+    VlDsiftFilter * dsift = vl_dsift_new_basic (width, height, 8, 4) ;
+    int numFrames, descrSize ;
+    float * dense ;
+    vl_dsift_set_root_sift (dsift, VL_TRUE) ;
+    vl_dsift_process (dsift, image) ;
+    numFrames = vl_dsift_get_keypoint_num (dsift) ;
+    descrSize = vl_dsift_get_descriptor_size (dsift) ;
+    check (descrSize == 128) ;
+    dense = vl_malloc (sizeof(float) * descrSize * numFrames) ;
+    memcpy (dense, vl_dsift_get_descriptors (dsift),
+            sizeof(float) * descrSize * numFrames) ;
+
+    check (vl_dsift_set_projection (dsift, proj, mean, 129) == VL_ERR_BAD_ARG) ;
+    check (vl_dsift_get_descriptor_size (dsift) == 128) ;
+    check (vl_dsift_set_projection (dsift, proj, mean, NUM_PROJ) == VL_ERR_OK) ;
+    vl_dsift_process (dsift, image) ;
+    check (vl_dsift_get_descriptor_size (dsift) == NUM_PROJ) ;
+    check_projection (vl_dsift_get_descriptors (dsift), dense,
+                      proj, mean, 128, numFrames) ;
+
+    /* a new descriptor geometry removes the projection */
+    {
+      VlDsiftDescriptorGeometry geom = *vl_dsift_get_geometry (dsift) ;
+      geom.numBinX = 2 ;
+      vl_dsift_set_geometry (dsift, &geom) ;
+      check (vl_dsift_get_descriptor_size (dsift) == 64) ;
+      vl_dsift_process (dsift, image) ;
+      check (vl_dsift_get_keypoint_num (dsift) > 0) ;
+    }
+    vl_free (dense) ;
+    vl_dsift_delete (dsift) ;
+  }
+
+  /* tiled processing */
+  {
+    int const tiledWidth = 300 ;
+    int const tiledHeight = 260 ;
+    float * tiledImage = vl_malloc (sizeof(float) * tiledWidth * tiledHeight) ;
+    check_synthetic_image (tiledImage, tiledWidth, tiledHeight) ;
+    check_threads (tiledImage, tiledWidth, tiledHeight) ;
+    check_tiled (tiledImage, tiledWidth, tiledHeight, 0, 64) ;
+    check_tiled (tiledImage, tiledWidth, tiledHeight, -1, 128) ;
+    check_tiled (tiledImage, tiledWidth, tiledHeight, -1, 40) ;
+    check_reset (tiledImage, tiledWidth, tiledHeight) ;
+    check_max_keypoints (tiledImage, tiledWidth, tiledHeight, 50) ;
+    check_keypoints_alloc (tiledImage, tiledWidth, tiledHeight) ;
+    check_upright (tiledImage, tiledWidth, tiledHeight) ;
+    check_scale_space (tiledImage, tiledWidth, tiledHeight) ;
+    vl_free (tiledImage) ;
+  }
+
+  vl_sift_delete (filt) ;
+  vl_free (descrs8) ;
+  vl_free (descrs2) ;
+  vl_free (descrs) ;
+  vl_free (image) ;
+  check_signoff () ;
+  return 0 ;
+}
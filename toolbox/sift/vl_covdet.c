@@ -32,6 +32,8 @@ enum {
   opt_peak_threshold,
   opt_edge_threshold,
   opt_laplacian_peak_threshold,
+  opt_max_num_features,
+  opt_budget_grid_size,
   opt_estimate_orientation,
   opt_max_num_orientations,
   opt_estimate_affine_shape,
@@ -58,6 +60,8 @@ vlmxOption  options [] = {
   {"PeakThreshold",         1,   opt_peak_threshold          },
   {"EdgeThreshold",         1,   opt_edge_threshold          },
   {"LaplacianPeakThreshold",1,   opt_laplacian_peak_threshold},
+  {"MaxNumFeatures",        1,   opt_max_num_features        },
+  {"BudgetGridSize",        1,   opt_budget_grid_size        },
 
   {"EstimateOrientation",   1,   opt_estimate_orientation    },
   {"MaxNumOrientations",    1,   opt_max_num_orientations    },
@@ -209,6 +213,8 @@ mexFunction(int nout, mxArray *out[],
   vl_bool estimateAffineShape = VL_FALSE ;
   vl_bool estimateOrientation = VL_FALSE ;
   vl_size maxNumOrientations = 0 ;
+  vl_index maxNumFeatures = 0 ;
+  vl_index budgetGridSize = 0 ;
 
   vl_bool doubleImage = VL_TRUE ;
   vl_index octaveResolution = -1 ;
@@ -304,6 +310,18 @@ mexFunction(int nout, mxArray *out[],
       }
       break ;
 
+    case opt_max_num_features :
+      if (!vlmxIsPlainScalar(optarg) || (maxNumFeatures = (vl_index)*mxGetPr(optarg)) < 0) {
+        vlmxError(vlmxErrInvalidArgument, "MAXNUMFEATURES must be a non-negative integer.") ;
+      }
+      break ;
+
+    case opt_budget_grid_size :
+      if (!vlmxIsPlainScalar(optarg) || (budgetGridSize = (vl_index)*mxGetPr(optarg)) < 1) {
+        vlmxError(vlmxErrInvalidArgument, "BUDGETGRIDSIZE must be an integer not smaller than 1.") ;
+      }
+      break ;
+
     case opt_double_image:
       if (!mxIsLogicalScalar(optarg)) {
         vlmxError(vlmxErrInvalidArgument, "DOUBLEIMAGE must be a logical scalar value.") ;
@@ -478,6 +496,8 @@ mexFunction(int nout, mxArray *out[],
     if (peakThreshold >= 0) vl_covdet_set_peak_threshold(covdet, peakThreshold) ;
     if (edgeThreshold >= 0) vl_covdet_set_edge_threshold(covdet, edgeThreshold) ;
     if (lapPeakThreshold >= 0) vl_covdet_set_laplacian_peak_threshold(covdet, lapPeakThreshold) ;
+    if (maxNumFeatures > 0) vl_covdet_set_max_num_features(covdet, maxNumFeatures) ;
+    if (budgetGridSize > 0) vl_covdet_set_budget_grid_size(covdet, budgetGridSize) ;
     
     if (verbose) {
       VL_PRINTF("vl_covdet: doubling image: %s\n",
@@ -682,9 +702,11 @@ mexFunction(int nout, mxArray *out[],
         {
           vl_size numFeatures ;
           VlCovDetFeature const * feature ;
+          VlFrameOrientedEllipse * frames ;
           vl_index i ;
           vl_size w = 2*patchResolution + 1 ;
           float * desc ;
+          int err ;
 
           if (verbose) {
             mexPrintf("vl_covdet: descriptors: type=patch, "
@@ -696,17 +718,18 @@ mexFunction(int nout, mxArray *out[],
           feature = vl_covdet_get_features(covdet);
           OUT(DESCRIPTORS) = mxCreateNumericMatrix(w*w, numFeatures, mxSINGLE_CLASS, mxREAL) ;
           desc = mxGetData(OUT(DESCRIPTORS)) ;
+          frames = vl_malloc(sizeof(VlFrameOrientedEllipse) * numFeatures) ;
           for (i = 0 ; i < (signed)numFeatures ; ++i) {
-            vl_bool res = vl_covdet_extract_patch_for_frame(covdet,
-                                                            desc,
-                                                            patchResolution,
-                                                            patchRelativeExtent,
-                                                            patchRelativeSmoothing,
-                                                            feature[i].frame) ;
-            if (res != VL_ERR_OK) {
-              vlmxError(vlmxErrInconsistentData, vl_get_last_error_message()) ;
-            }
-            desc += w*w ;
+            frames[i] = feature[i].frame ;
+          }
+          err = vl_covdet_extract_patches(covdet, desc, NULL,
+                                          patchResolution,
+                                          patchRelativeExtent,
+                                          patchRelativeSmoothing,
+                                          frames, numFeatures) ;
+          vl_free(frames) ;
+          if (err != VL_ERR_OK) {
+            vlmxError(vlmxErrInconsistentData, vl_get_last_error_message()) ;
           }
           break ;
         }
@@ -59,6 +59,13 @@
 %   scale of the detected frames. These peaks are filtered by
 %   a threshold adjustable by using the 'LaplacianPeakThreshold' option.
 %
+%   VL_COVDET(..., 'MaxNumFeatures', N) caps the number of detected
+%   features to N. The image is divided into a grid of cells
+%   ('BudgetGridSize' along each side) and the strongest features of
+%   each cell are retained, so that the features are spread over the
+%   image. This bounds the cost of affine adaptation, orientation
+%   assignment and descriptor computation.
+%
 %   VL_COVDET(..., 'EstimateAffineShape', true) switches on affine
 %   adaptation, an algorithm [2] that attempts to estimate the affine
 %   covariant shape of each feature.
@@ -176,6 +183,13 @@
 %     Maximum number of orientations per feature when EstimateOrientation
 %     is true.
 %
+%   MaxNumFeatures:: 0
+%     Maximum number of detected features (0 for no limit).
+%
+%   BudgetGridSize:: 8
+%     Number of cells along each side of the grid used to spread the
+%     features when MaxNumFeatures is set.
+%
 %   AllowPaddedWarping:: true
 %     Set to `false` to drop all features where measurement region gets out
 %     of the input image.
@@ -93,8 +93,12 @@ This example code:
 - Calls ::vl_covdet_put_image to start processing a new image. It
   causes the detector to compute the scale space representation of the
   image, but does not compute the features yet.
+  ::vl_covdet_put_image_region does the same for a region of the image
+  only, for example to re-detect features in a window.
 - Calls ::vl_covdet_detect runs the detector. At this point features are
-  ready to be extracted. However, one or all of the following steps
+  ready to be extracted. A feature budget
+  (::vl_covdet_set_max_num_features) limits their number, keeping
+  them spread over the image. However, one or all of the following steps
   may be executed in order to process the features further.
 - Optionally calls ::vl_covdet_drop_features_outside to drop features
   outside the image boundary.
@@ -102,10 +106,13 @@ This example code:
   affine shape of features using affine adaptation.
 - Optionally calls ::vl_covdet_extract_orientations to compute the
   dominant orientation of features looking for the dominant gradient
-  orientation in patches.
+  orientation in patches. If ::vl_covdet_set_upright is set, the
+  gradient is not examined and features are simply rotated to be
+  upright (see below).
 - Optionally calls ::vl_covdet_extract_patch_for_frame to extract a
   normalized feature patch, for example to compute an invariant
-  feature descriptor.
+  feature descriptor. ::vl_covdet_extract_patches does the same for
+  a whole set of frames at once, in parallel.
 
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ -->
 @page covdet-fundamentals Covariant detectors fundamentals
@@ -943,6 +950,8 @@ $\ell_{(\kappa\sigma)^2}$ and $\ell_{\sigma^2}$.
 **/
 
 #include "covdet.h"
+#include "covdet_sse2.h"
+#include "covdet_avx.h"
 #include <string.h>
 
 /** @brief Reallocate buffer
@@ -1451,6 +1460,29 @@ vl_refine_local_extreum_2 (VlCovDetExtremum2 * refined,
 #define VL_COVDET_HESSIAN_DEF_PEAK_THRESHOLD 0.003
 #define VL_COVDET_HESSIAN_DEF_EDGE_THRESHOLD 10.0
 #define VL_COVDET_GSS_BASE_SCALE 1.6
+#define VL_COVDET_PARALLEL_CHUNK_SIZE 16
+#define VL_COVDET_BUDGET_DEF_GRID_SIZE 8
+
+/** @internal
+ ** @brief Scratch buffers used to process a feature
+ **
+ ** The per-feature stages (affine adaptation, orientation and
+ ** Laplacian scale selection) warp and filter small patches in these
+ ** buffers. The detector owns one instance used by the
+ ** <code>*_for_frame</code> functions; the batch functions give each
+ ** thread its own.
+ **/
+typedef struct _VlCovDetWorkspace
+{
+  float * patch ;            /**< padded copy of a scale space region. */
+  vl_size patchBufferSize ;  /**< size of @c patch in bytes. */
+  VlCovDetFeatureOrientation orientations [VL_COVDET_MAX_NUM_ORIENTATIONS] ;
+  VlCovDetFeatureLaplacianScale scales [VL_COVDET_MAX_NUM_LAPLACIAN_SCALES] ;
+  float aaPatch [(2*VL_COVDET_AA_PATCH_RESOLUTION+1)*(2*VL_COVDET_AA_PATCH_RESOLUTION+1)] ;
+  float aaPatchX [(2*VL_COVDET_AA_PATCH_RESOLUTION+1)*(2*VL_COVDET_AA_PATCH_RESOLUTION+1)] ;
+  float aaPatchY [(2*VL_COVDET_AA_PATCH_RESOLUTION+1)*(2*VL_COVDET_AA_PATCH_RESOLUTION+1)] ;
+  float lapPatch [(2*VL_COVDET_LAP_PATCH_RESOLUTION+1)*(2*VL_COVDET_LAP_PATCH_RESOLUTION+1)] ;
+} VlCovDetWorkspace ;
 
 /** @brief Covariant feature detector */
 struct _VlCovDet
@@ -1470,28 +1502,29 @@ struct _VlCovDet
   double nonExtremaSuppression ;
   vl_size numNonExtremaSuppressed ;
 
+  vl_size maxNumFeatures ;     /**< feature budget (0 for no limit). */
+  vl_size budgetGridSize ;     /**< cells along each side of the budget grid. */
+
   VlCovDetFeature *features ;
   vl_size numFeatures ;
   vl_size numFeatureBufferSize ;
 
-  float * patch ;
-  vl_size patchBufferSize ;
+  VlCovDetWorkspace workspace ; /**< scratch buffers for the single frame functions. */
 
   vl_bool transposed ;
-  VlCovDetFeatureOrientation orientations [VL_COVDET_MAX_NUM_ORIENTATIONS] ;
-  VlCovDetFeatureLaplacianScale scales [VL_COVDET_MAX_NUM_LAPLACIAN_SCALES] ;
+
+  vl_bool useRegion ;          /**< whether to detect only in the region. */
+  vl_index region [4] ;        /**< detection region (xmin, ymin, xmax, ymax). */
+  vl_index * crops ;           /**< crops of the scale space octaves (NULL for the whole image). */
 
   vl_bool aaAccurateSmoothing ;
-  float aaPatch [(2*VL_COVDET_AA_PATCH_RESOLUTION+1)*(2*VL_COVDET_AA_PATCH_RESOLUTION+1)] ;
-  float aaPatchX [(2*VL_COVDET_AA_PATCH_RESOLUTION+1)*(2*VL_COVDET_AA_PATCH_RESOLUTION+1)] ;
-  float aaPatchY [(2*VL_COVDET_AA_PATCH_RESOLUTION+1)*(2*VL_COVDET_AA_PATCH_RESOLUTION+1)] ;
   float aaMask [(2*VL_COVDET_AA_PATCH_RESOLUTION+1)*(2*VL_COVDET_AA_PATCH_RESOLUTION+1)] ;
 
-  float lapPatch [(2*VL_COVDET_LAP_PATCH_RESOLUTION+1)*(2*VL_COVDET_LAP_PATCH_RESOLUTION+1)] ;
   float laplacians [(2*VL_COVDET_LAP_PATCH_RESOLUTION+1)*(2*VL_COVDET_LAP_PATCH_RESOLUTION+1)*VL_COVDET_LAP_NUM_LEVELS] ;
   vl_size numFeaturesWithNumScales [VL_COVDET_MAX_NUM_LAPLACIAN_SCALES + 1] ;
 
   vl_bool allowPaddedWarping ;
+  vl_bool upright ;
 }  ;
 
 VlEnumerator vlCovdetMethods [VL_COVDET_METHOD_NUM] = {
@@ -1543,14 +1576,19 @@ vl_covdet_new (VlCovDetMethod method)
   }
 
   self->nonExtremaSuppression = 0.5 ;
+  self->maxNumFeatures = 0 ;
+  self->budgetGridSize = VL_COVDET_BUDGET_DEF_GRID_SIZE ;
   self->features = NULL ;
   self->numFeatures = 0 ;
   self->numFeatureBufferSize = 0 ;
-  self->patch = NULL ;
-  self->patchBufferSize = 0 ;
+  self->workspace.patch = NULL ;
+  self->workspace.patchBufferSize = 0 ;
   self->transposed = VL_FALSE ;
+  self->useRegion = VL_FALSE ;
+  self->crops = NULL ;
   self->aaAccurateSmoothing = VL_COVDET_AA_ACCURATE_SMOOTHING ;
   self->allowPaddedWarping = VL_TRUE ;
+  self->upright = VL_FALSE ;
 
   {
     vl_index const w = VL_COVDET_AA_PATCH_RESOLUTION ;
@@ -1631,6 +1669,10 @@ vl_covdet_reset (VlCovDet * self)
     vl_scalespace_delete(self->gss) ;
     self->gss = NULL ;
   }
+  if (self->crops) {
+    vl_free(self->crops) ;
+    self->crops = NULL ;
+  }
 }
 
 /** @brief Delete object instance
@@ -1641,7 +1683,7 @@ void
 vl_covdet_delete (VlCovDet * self)
 {
   vl_covdet_reset(self) ;
-  if (self->patch) vl_free (self->patch) ;
+  if (self->workspace.patch) vl_free (self->workspace.patch) ;
   vl_free(self) ;
 }
 
@@ -1678,21 +1720,23 @@ vl_covdet_append_feature (VlCovDet * self, VlCovDetFeature const * feature)
 /*                                              Process a new image */
 /* ---------------------------------------------------------------- */
 
-/** @brief Detect features in an image
+/** @internal
+ ** @brief Get the scale space geometry for an image
  ** @param self object.
- ** @param image image to process.
  ** @param width image width.
  ** @param height image height.
- ** @return status.
+ ** @param minSize size of the smaller side of the region to process.
+ ** @return geometry.
  **
- ** @a width and @a height must be at least one pixel. The function
- ** fails by returing ::VL_ERR_ALLOC if the memory is insufficient.
+ ** The number of octaves is limited so that the coarsest one
+ ** samples @a minSize pixels with at least 16 pixels, but there is
+ ** always at least one octave.
  **/
 
-int
-vl_covdet_put_image (VlCovDet * self,
-                     float const * image,
-                     vl_size width, vl_size height)
+static VlScaleSpaceGeometry
+_vl_covdet_get_geometry (VlCovDet const * self,
+                         vl_size width, vl_size height,
+                         vl_size minSize)
 {
   vl_size const minOctaveSize = 16 ;
   vl_index lastOctave ;
@@ -1700,16 +1744,16 @@ vl_covdet_put_image (VlCovDet * self,
   vl_index octaveLastSubdivision ;
   VlScaleSpaceGeometry geom = vl_scalespace_get_default_geometry(width,height) ;
 
-  assert (self) ;
-  assert (image) ;
-  assert (width >= 1) ;
-  assert (height >= 1) ;
-
-  /* (minOctaveSize - 1) 2^lastOctave <= min(width,height) - 1 */
-  lastOctave = vl_floor_d(vl_log2_d(VL_MIN((double)width-1,(double)height-1) / (minOctaveSize - 1))) ;
+  /* (minOctaveSize - 1) 2^lastOctave <= minSize - 1 */
+  lastOctave = self->firstOctave ;
+  if (minSize > 1) {
+    lastOctave = vl_floor_d(vl_log2_d(((double)minSize-1) / (minOctaveSize - 1))) ;
+  }
   if (self->numOctaves > 0) {
       lastOctave = VL_MIN((vl_index)self->numOctaves - self->firstOctave - 1, lastOctave);
   }
+  /* small regions still get the first octave */
+  lastOctave = VL_MAX(lastOctave, self->firstOctave) ;
 
   if (self->method == VL_COVDET_METHOD_DOG) {
     octaveFirstSubdivision = -1 ;
@@ -1730,19 +1774,382 @@ vl_covdet_put_image (VlCovDet * self,
   geom.baseScale = self->baseScale * pow(2.0, 1.0 / self->octaveResolution) ;
   geom.octaveFirstSubdivision = octaveFirstSubdivision ;
   geom.octaveLastSubdivision = octaveLastSubdivision ;
+  return geom ;
+}
 
-  if (self->gss == NULL ||
-      ! vl_scalespacegeometry_is_equal (geom,
-                                        vl_scalespace_get_geometry(self->gss)))
-  {
+/** @internal
+ ** @brief Check the geometry and the crops of a scale space
+ ** @param ss scale space (may be @c NULL).
+ ** @param geom scale space geometry.
+ ** @param crops crops of the octaves or @c NULL.
+ ** @return whether @a ss has geometry @a geom and crops @a crops.
+ **
+ ** See ::vl_scalespace_new_with_crops.
+ **/
+
+static vl_bool
+_vl_covdet_check_scalespace (VlScaleSpace const * ss,
+                             VlScaleSpaceGeometry geom,
+                             vl_index const * crops)
+{
+  vl_index o ;
+  if (ss == NULL ||
+      ! vl_scalespacegeometry_is_equal (geom, vl_scalespace_get_geometry(ss))) {
+    return VL_FALSE ;
+  }
+  for (o = geom.firstOctave ; o <= geom.lastOctave ; ++o) {
+    VlScaleSpaceOctaveGeometry oct = vl_scalespace_get_octave_geometry(ss, o) ;
+    vl_index crop [4] = {0, 0,
+                         VL_SHIFT_LEFT(geom.width, -o) - 1,
+                         VL_SHIFT_LEFT(geom.height, -o) - 1} ;
+    if (crops) memcpy(crop, crops + 4 * (o - geom.firstOctave), sizeof(crop)) ;
+    if (oct.origin[0] != crop[0] || oct.origin[1] != crop[1] ||
+        (signed)oct.width != crop[2] - crop[0] + 1 ||
+        (signed)oct.height != crop[3] - crop[1] + 1) {
+      return VL_FALSE ;
+    }
+  }
+  return VL_TRUE ;
+}
+
+/** @internal
+ ** @brief Compute the Gaussian scale space of an image
+ ** @param self object.
+ ** @param image image to process.
+ ** @param geom scale space geometry.
+ ** @return status.
+ **
+ ** The scale space is restricted to the crops @c self->crops, if any.
+ **/
+
+static int
+_vl_covdet_put_image (VlCovDet * self,
+                      float const * image,
+                      VlScaleSpaceGeometry geom)
+{
+  if (! _vl_covdet_check_scalespace(self->gss, geom, self->crops)) {
     if (self->gss) vl_scalespace_delete(self->gss) ;
-    self->gss = vl_scalespace_new_with_geometry(geom) ;
+    self->gss = vl_scalespace_new_with_crops(geom, self->crops) ;
     if (self->gss == NULL) return VL_ERR_ALLOC ;
   }
-  vl_scalespace_put_image(self->gss, image) ;
+  return vl_scalespace_put_image(self->gss, image) ;
+}
+
+/** @brief Detect features in an image
+ ** @param self object.
+ ** @param image image to process.
+ ** @param width image width.
+ ** @param height image height.
+ ** @return status.
+ **
+ ** @a width and @a height must be at least one pixel. The function
+ ** fails by returing ::VL_ERR_ALLOC if the memory is insufficient.
+ **
+ ** @sa ::vl_covdet_put_image_region
+ **/
+
+int
+vl_covdet_put_image (VlCovDet * self,
+                     float const * image,
+                     vl_size width, vl_size height)
+{
+  assert (self) ;
+  assert (image) ;
+  assert (width >= 1) ;
+  assert (height >= 1) ;
+
+  self->useRegion = VL_FALSE ;
+  if (self->crops) {
+    vl_free(self->crops) ;
+    self->crops = NULL ;
+  }
+  self->region[0] = 0 ;
+  self->region[1] = 0 ;
+  self->region[2] = width - 1 ;
+  self->region[3] = height - 1 ;
+
+  return _vl_covdet_put_image
+  (self, image, _vl_covdet_get_geometry(self, width, height, VL_MIN(width,height))) ;
+}
+
+/** @internal
+ ** @brief Select the scale space level to warp a patch from
+ ** @param geom scale space geometry.
+ ** @param[out] o_ octave of the level.
+ ** @param[out] s_ subdivision of the level.
+ ** @param sigma desired smoothing in the patch frame.
+ ** @param d1 first singular value of the patch to image transformation.
+ ** @param d2 second singular value of the patch to image transformation.
+ ** @return smoothing of the selected level.
+ **/
+
+static double
+_vl_covdet_select_patch_level (VlScaleSpaceGeometry geom,
+                               vl_index * o_, vl_index * s_,
+                               double sigma, double d1, double d2)
+{
+  vl_index o, s ;
+  double factor ;
+  double sigma_ ;
+
+  /* Starting from a pre-smoothed image at scale sigma_
+     because of the mapping A the resulting smoothing in
+     the warped patch is S, where
+
+        sigma_^2 I = A S A',
+
+        S = sigma_^2 inv(A) inv(A)' = sigma_^2 V D^-2 V',
+
+        A = U D V'.
+
+     Thus we rotate A by V to obtain an axis-aligned smoothing:
+
+        A = U*D,
+
+        S = sigma_^2 D^-2.
+
+     Then we search the scale-space for the best sigma_ such
+     that the target smoothing is approximated from below:
+
+        max sigma_(o,s) :    simga_(o,s) factor <= sigma,
+        factor = max{abs(D11), abs(D22)}.
+   */
+
+
+  /*
+   Determine the best level (o,s) such that sigma_(o,s) factor <= sigma.
+   This can be obtained by scanning octaves from smallest to largest
+   and stopping when no level in the octave satisfies the relation.
+
+   Given the range of octave availables, do the best you can.
+   */
+
+  factor = 1.0 / VL_MIN(d1, d2) ;
+
+  for (o = geom.firstOctave + 1 ; o <= geom.lastOctave ; ++o) {
+    s = vl_floor_d(vl_log2_d(sigma / (factor * geom.baseScale)) - o) ;
+    s = VL_MAX(s, geom.octaveFirstSubdivision) ;
+    s = VL_MIN(s, geom.octaveLastSubdivision) ;
+    sigma_ = geom.baseScale * pow(2.0, o + (double)s / geom.octaveResolution) ;
+    /*VL_PRINTF(".. %d D=%g %g; sigma_=%g factor*sigma_=%g\n", o, d1, d2, sigma_, factor* sigma_) ;*/
+    if (factor * sigma_ > sigma) {
+      o -- ;
+      break ;
+    }
+  }
+  o = VL_MIN(o, geom.lastOctave) ;
+  s = vl_floor_d(vl_log2_d(sigma / (factor * geom.baseScale)) - o) ;
+  s = VL_MAX(s, geom.octaveFirstSubdivision) ;
+  s = VL_MIN(s, geom.octaveLastSubdivision) ;
+  sigma_ = geom.baseScale * pow(2.0, o + (double)s / geom.octaveResolution) ;
+
+  *o_ = o ;
+  *s_ = s ;
+  return sigma_ ;
+}
+
+/** @internal
+ ** @brief Get the crops required to detect features in a region
+ ** @param self object.
+ ** @param geom scale space geometry.
+ ** @param region detection region (xmin, ymin, xmax, ymax).
+ ** @param[out] crops crops of the octaves (see ::vl_scalespace_new_with_crops).
+ ** @return status.
+ **
+ ** Each octave is cropped to the region plus a margin, which is the
+ ** distance from the region of the furthest pixel of the octave that
+ ** affects the detection of a feature in the region. The margin
+ ** accounts, for each level, for the support of the cornerness
+ ** measure, the displacement of the extrema by the refinement and,
+ ** for the Laplace methods, the patches used to select the scale of
+ ** the features. It accumulates the support of the Gaussian filters
+ ** (truncated at three standard deviations by ::vl_imsmooth_f) that
+ ** compute each level from the previous one. Since an octave is
+ ** computed from the previous one, the latter must also contain the
+ ** margin of the former, but not its own margin, which grows with
+ ** the sampling step.
+ **/
+
+static int
+_vl_covdet_get_region_crops (VlCovDet const * self,
+                             VlScaleSpaceGeometry geom,
+                             vl_index const region [4],
+                             vl_index * crops)
+{
+  vl_index const numLevels = geom.octaveLastSubdivision - geom.octaveFirstSubdivision + 1 ;
+  vl_index const startLevel =
+  VL_MIN(geom.octaveFirstSubdivision + (signed)geom.octaveResolution,
+         geom.octaveLastSubdivision) ;
+  double * margins ;
+  vl_index o, s, k ;
+
+#define SIGMA(o,s) (geom.baseScale * pow(2.0, (o) + (double)(s) / geom.octaveResolution))
+#define SUPPORT(sigma,step) (vl_ceil_d(3.0 * (sigma) / (step)) * (step))
+#define MARGIN(o,s) margins[((o) - geom.firstOctave) * numLevels + (s) - geom.octaveFirstSubdivision]
+
+  margins = vl_malloc(sizeof(double) * numLevels * (geom.lastOctave - geom.firstOctave + 1)) ;
+  if (margins == NULL) return VL_ERR_ALLOC ;
+
+  for (o = geom.firstOctave ; o <= geom.lastOctave ; ++o) {
+    double const step = pow(2.0, o) ;
+    for (s = geom.octaveFirstSubdivision ; s <= geom.octaveLastSubdivision ; ++s) {
+      /* derivatives and, for Harris, the integration window */
+      double responseMargin ;
+      switch (self->method) {
+        case VL_COVDET_METHOD_HARRIS_LAPLACE:
+        case VL_COVDET_METHOD_MULTISCALE_HARRIS:
+          responseMargin = step + SUPPORT(1.4 * SIGMA(o, s), step) ;
+          break ;
+        default:
+          responseMargin = step ;
+          break ;
+      }
+      /* the extrema are refined by up to five steps of one pixel */
+      MARGIN(o, s) = responseMargin + 6 * step ;
+    }
+  }
+
+  if (self->method == VL_COVDET_METHOD_HARRIS_LAPLACE ||
+      self->method == VL_COVDET_METHOD_HESSIAN_LAPLACE) {
+    /* see _vl_covdet_extract_laplacian_scales_for_frame() */
+    double const sigmaImage = 1.0 / sqrt(2.0) ;
+    double const extent = 0.5 * sigmaImage * VL_COVDET_LAP_PATCH_RESOLUTION ;
+    for (o = geom.firstOctave ; o <= geom.lastOctave ; ++o) {
+      for (s = geom.octaveFirstSubdivision ; s < geom.octaveLastSubdivision ; ++s) {
+        double const sigma = SIGMA(o, s) ;
+        vl_index po, ps ;
+        _vl_covdet_select_patch_level(geom, &po, &ps, sigmaImage, sigma, sigma) ;
+        /* warping reads one more pixel on each side for bilinear interpolation */
+        MARGIN(po, ps) = VL_MAX(MARGIN(po, ps), extent * sigma + 2 * pow(2.0, po)) ;
+      }
+    }
+  }
+
+  for (o = geom.lastOctave ; o >= geom.firstOctave ; --o) {
+    double const step = pow(2.0, o) ;
+    double const sigma = SIGMA(o, geom.octaveFirstSubdivision) ;
+    double const previousSigma = (o == geom.firstOctave) ?
+      geom.nominalScale : SIGMA(o - 1, startLevel) ;
+    vl_index const size [2] = {VL_SHIFT_LEFT(geom.width, -o),
+                               VL_SHIFT_LEFT(geom.height, -o)} ;
+    vl_index * crop = crops + 4 * (o - geom.firstOctave) ;
+    double margin ;
+
+    for (s = geom.octaveLastSubdivision ; s > geom.octaveFirstSubdivision ; --s) {
+      double const a = SIGMA(o, s) ;
+      double const b = SIGMA(o, s - 1) ;
+      MARGIN(o, s - 1) = VL_MAX(MARGIN(o, s - 1),
+                                MARGIN(o, s) + SUPPORT(sqrt(a*a - b*b), step)) ;
+    }
+    margin = MARGIN(o, geom.octaveFirstSubdivision) ;
+    if (sigma > previousSigma) {
+      margin += SUPPORT(sqrt(sigma*sigma - previousSigma*previousSigma), step) ;
+    }
+    if (o > geom.firstOctave) {
+      MARGIN(o - 1, startLevel) = VL_MAX(MARGIN(o - 1, startLevel), margin) ;
+    }
+
+    for (k = 0 ; k < 2 ; ++k) {
+      crop[k] = VL_MAX((vl_index)vl_floor_d((region[k] - margin) / step), 0) ;
+      crop[k+2] = VL_MIN((vl_index)vl_ceil_d((region[k+2] + margin) / step), size[k] - 1) ;
+      if (o < geom.lastOctave) {
+        /* contain the samples of the next octave */
+        crop[k] = VL_MIN(crop[k], 2 * crop[k+4]) ;
+        crop[k+2] = VL_MAX(crop[k+2], 2 * crop[k+6]) ;
+      }
+    }
+  }
+#undef MARGIN
+#undef SUPPORT
+#undef SIGMA
+  vl_free(margins) ;
   return VL_ERR_OK ;
 }
 
+/** @brief Detect features in a region of an image
+ ** @param self object.
+ ** @param image image to process.
+ ** @param width image width.
+ ** @param height image height.
+ ** @param xmin left column of the region.
+ ** @param ymin top row of the region.
+ ** @param xmax right column of the region.
+ ** @param ymax bottom row of the region.
+ ** @return status.
+ **
+ ** The function is like ::vl_covdet_put_image, but each octave of
+ ** the scale spaces covers only the region [@a xmin, @a xmax] x [@a
+ ** ymin, @a ymax] (clamped to the image) and a margin around it, so
+ ** that the cost of processing the region grows with its area rather
+ ** than with the area of the image. The margin of an octave accounts
+ ** for the support of the filters used to compute its levels and the
+ ** cornerness measure, for the refinement of the extrema and, for
+ ** ::VL_COVDET_METHOD_HARRIS_LAPLACE and
+ ** ::VL_COVDET_METHOD_HESSIAN_LAPLACE, for the patches used to select
+ ** the Laplacian scales; it also contains the margin of the coarser
+ ** octaves. Hence ::vl_covdet_detect finds the same features in the
+ ** region as for the whole image, and only those, except that the
+ ** number of octaves is limited by the size of the region rather than
+ ** of the image (see ::vl_covdet_set_num_octaves) and that
+ ** non-extrema suppression does not consider the features outside the
+ ** region. Since the refined extrema are computed in single precision
+ ** relatively to the crops, the feature positions may differ in the
+ ** last digits, and so may the Laplacian scales, which are sampled
+ ** around them.
+ **
+ ** Features are in the coordinates of @a image. The octaves of the
+ ** scale spaces returned by ::vl_covdet_get_gss and
+ ** ::vl_covdet_get_css are cropped (see
+ ** ::vl_scalespace_get_octave_geometry). Measurement regions which
+ ** exceed the crops (for example when extracting the affine shape of
+ ** large features) are padded as at the image boundaries, so they may
+ ** differ from the ones obtained from the whole image.
+ **/
+
+int
+vl_covdet_put_image_region (VlCovDet * self,
+                            float const * image,
+                            vl_size width, vl_size height,
+                            vl_index xmin, vl_index ymin,
+                            vl_index xmax, vl_index ymax)
+{
+  VlScaleSpaceGeometry geom ;
+  vl_index * crops ;
+  int err ;
+
+  assert (self) ;
+  assert (image) ;
+  assert (width >= 1) ;
+  assert (height >= 1) ;
+
+  xmin = VL_MAX(xmin, 0) ;
+  ymin = VL_MAX(ymin, 0) ;
+  xmax = VL_MIN(xmax, (signed)width - 1) ;
+  ymax = VL_MIN(ymax, (signed)height - 1) ;
+  assert (xmin <= xmax) ;
+  assert (ymin <= ymax) ;
+
+  self->region[0] = xmin ;
+  self->region[1] = ymin ;
+  self->region[2] = xmax ;
+  self->region[3] = ymax ;
+
+  geom = _vl_covdet_get_geometry(self, width, height,
+                                 VL_MIN(xmax - xmin, ymax - ymin) + 1) ;
+  crops = vl_malloc(sizeof(vl_index) * 4 * (geom.lastOctave - geom.firstOctave + 1)) ;
+  if (crops == NULL) return VL_ERR_ALLOC ;
+  err = _vl_covdet_get_region_crops(self, geom, self->region, crops) ;
+  if (err) {
+    vl_free(crops) ;
+    return err ;
+  }
+  if (self->crops) vl_free(self->crops) ;
+  self->crops = crops ;
+  self->useRegion = VL_TRUE ;
+
+  return _vl_covdet_put_image(self, image, geom) ;
+}
+
 /* ---------------------------------------------------------------- */
 /*                                              Cornerness measures */
 /* ---------------------------------------------------------------- */
@@ -1765,48 +2172,43 @@ _vl_det_hessian_response (float * hessian,
   float factor = (float) pow(sigma/step, 4.0) ;
   vl_index const xo = 1 ; /* x-stride */
   vl_index const yo = width;  /* y-stride */
-  vl_size r, c;
-
-  float p11, p12, p13, p21, p22, p23, p31, p32, p33;
+  vl_size r;
 
-  /* setup input pointer to be centered at 0,1 */
-  float const *in = image + yo ;
+  float const *in ;
+  float *out ;
 
-  /* setup output pointer to be centered at 1,1 */
-  float *out = hessian + xo + yo;
-
-  /* move 3x3 window and convolve */
+  /* compute the interior pixels one row at a time */
   for (r = 1; r < height - 1; ++r)
   {
-    /* fill in shift registers at the beginning of the row */
-    p11 = in[-yo]; p12 = in[xo - yo];
-    p21 = in[  0]; p22 = in[xo     ];
-    p31 = in[+yo]; p32 = in[xo + yo];
-    /* setup input pointer to (2,1) of the 3x3 square */
-    in += 2;
-    for (c = 1; c < width - 1; ++c)
-    {
-      float Lxx, Lyy, Lxy;
-      /* fetch remaining values (last column) */
-      p13 = in[-yo]; p23 = *in; p33 = in[+yo];
-
+    /* input and output pointers centered at (1,r) */
+    float const *src = image + r * yo + xo ;
+    float *dst = hessian + r * yo + xo ;
+    float *end = dst + width - 2 ;
+
+#ifndef VL_DISABLE_AVX
+    if (vl_cpu_has_avx() && vl_get_simd_enabled() && dst < end) {
+      vl_size n = _vl_covdet_hessian_avx (dst, src, end - dst, yo, factor) ;
+      dst += n ;
+      src += n ;
+    }
+#endif
+#ifndef VL_DISABLE_SSE2
+    if (vl_cpu_has_sse2() && vl_get_simd_enabled() && dst < end) {
+      vl_size n = _vl_covdet_hessian_sse2 (dst, src, end - dst, yo, factor) ;
+      dst += n ;
+      src += n ;
+    }
+#endif
+    while (dst < end) {
       /* Compute 3x3 Hessian values from pixel differences. */
-      Lxx = (-p21 + 2*p22 - p23);
-      Lyy = (-p12 + 2*p22 - p32);
-      Lxy = ((p11 - p31 - p13 + p33)/4.0f);
+      float Lxx = (-src[-xo] + 2*src[0] - src[+xo]);
+      float Lyy = (-src[-yo] + 2*src[0] - src[+yo]);
+      float Lxy = ((src[-xo-yo] - src[-xo+yo] - src[+xo-yo] + src[+xo+yo])/4.0f);
 
       /* normalize and write out */
-      *out = (Lxx * Lyy - Lxy * Lxy) * factor ;
-
-      /* move window */
-      p11=p12; p12=p13;
-      p21=p22; p22=p23;
-      p31=p32; p32=p33;
-
-      /* move input/output pointers */
-      in++; out++;
+      *dst++ = (Lxx * Lyy - Lxy * Lxy) * factor ;
+      src++ ;
     }
-    out += 2;
   }
 
   /* Copy the computed values to borders */
@@ -1836,6 +2238,74 @@ _vl_det_hessian_response (float * hessian,
   memcpy(out, in, (width - 2)*sizeof(float));
 }
 
+/** @internal
+ ** @brief Gradient products of an image row
+ ** @param xx output squared horizontal derivative.
+ ** @param yy output squared vertical derivative.
+ ** @param xy output product of the derivatives.
+ ** @param src input row.
+ ** @param width image width.
+ ** @param up offset to the row above (zero on the first row).
+ ** @param down offset to the row below (zero on the last row).
+ **
+ ** The derivatives are the same as ::vl_imgradient_f: central
+ ** differences, or forward/backward differences at the image
+ ** boundaries. Computing the products in the same pass avoids
+ ** storing the gradient. The interior pixels are processed by the
+ ** SSE2 or AVX kernels if available; the result does not change.
+ **/
+
+static void
+_vl_harris_products_row (float * xx, float * yy, float * xy,
+                         float const * src, vl_size width,
+                         vl_index up, vl_index down)
+{
+  float const dyscale = (up && down) ? 0.5f : 1.0f ;
+  float const * end ;
+  float gx, gy ;
+
+#define SAVE_BACK                                                       \
+    *xx++ = gx * gx ;                                                   \
+    *yy++ = gy * gy ;                                                   \
+    *xy++ = gx * gy ;                                                   \
+    ++src ;                                                             \
+
+  /* first pixel */
+  gx = src[+1] - src[0] ;
+  gy = dyscale * (src[+down] - src[-up]) ;
+  SAVE_BACK ;
+
+  /* middle pixels */
+  end = (src - 1) + width - 1 ;
+#ifndef VL_DISABLE_AVX
+  if (vl_cpu_has_avx() && vl_get_simd_enabled() && src < end) {
+    vl_size n = _vl_covdet_harris_products_avx (xx, yy, xy, src, end - src,
+                                                up, down, dyscale) ;
+    xx += n ; yy += n ; xy += n ;
+    src += n ;
+  }
+#endif
+#ifndef VL_DISABLE_SSE2
+  if (vl_cpu_has_sse2() && vl_get_simd_enabled() && src < end) {
+    vl_size n = _vl_covdet_harris_products_sse2 (xx, yy, xy, src, end - src,
+                                                 up, down, dyscale) ;
+    xx += n ; yy += n ; xy += n ;
+    src += n ;
+  }
+#endif
+  while (src < end) {
+    gx = 0.5f * (src[+1] - src[-1]) ;
+    gy = dyscale * (src[+down] - src[-up]) ;
+    SAVE_BACK ;
+  }
+
+  /* last pixel */
+  gx = src[0] - src[-1] ;
+  gy = dyscale * (src[+down] - src[-up]) ;
+  SAVE_BACK ;
+#undef SAVE_BACK
+}
+
 /** @brief Scale-normalised Harris response
  ** @param harris output image.
  ** @param image input image.
@@ -1845,6 +2315,15 @@ _vl_det_hessian_response (float * hessian,
  ** @param sigma Gaussian smoothing of the input image.
  ** @param sigmaI integration scale.
  ** @param alpha factor in the definition of the Harris score.
+ ** @param LxLx buffer of @a width x @a height floats.
+ ** @param LyLy buffer of @a width x @a height floats.
+ ** @param LxLy buffer of @a width x @a height floats.
+ **
+ ** The gradient and its products are computed in a single pass.
+ ** The three products are then smoothed together by
+ ** ::vl_imsmooth_planes_f, which shares the filters, the temporary
+ ** buffer and the threads, and combined into the response, using
+ ** SIMD kernels if available.
  **/
 
 static void
@@ -1852,39 +2331,45 @@ _vl_harris_response (float * harris,
                      float const * image,
                      vl_size width, vl_size height,
                      double step, double sigma,
-                     double sigmaI, double alpha)
+                     double sigmaI, double alpha,
+                     float * LxLx, float * LyLy, float * LxLy)
 {
   float factor = (float) pow(sigma/step, 4.0) ;
-  vl_index k ;
-
-  float * LxLx ;
-  float * LyLy ;
-  float * LxLy ;
-
-  LxLx = vl_malloc(sizeof(float) * width * height) ;
-  LyLy = vl_malloc(sizeof(float) * width * height) ;
-  LxLy = vl_malloc(sizeof(float) * width * height) ;
-
-  vl_imgradient_f (LxLx, LyLy, 1, width, image, width, height, width) ;
-
-  for (k = 0 ; k < (signed)(width * height) ; ++k) {
-    float dx = LxLx[k] ;
-    float dy = LyLy[k] ;
-    LxLx[k] = dx*dx ;
-    LyLy[k] = dy*dy ;
-    LxLy[k] = dx*dy ;
+  vl_size const numPixels = width * height ;
+  vl_size k = 0 ;
+  vl_size y ;
+
+  for (y = 0 ; y < height ; ++y) {
+    _vl_harris_products_row (LxLx + y * width, LyLy + y * width, LxLy + y * width,
+                             image + y * width, width,
+                             (y > 0) ? (signed)width : 0,
+                             (y < height - 1) ? (signed)width : 0) ;
   }
 
-  vl_imsmooth_f(LxLx, width, LxLx, width, height, width,
-                sigmaI / step, sigmaI / step) ;
-
-  vl_imsmooth_f(LyLy, width, LyLy, width, height, width,
-                sigmaI / step, sigmaI / step) ;
-
-  vl_imsmooth_f(LxLy, width, LxLy, width, height, width,
-                sigmaI / step, sigmaI / step) ;
+  {
+    float * planes [3] ;
+    float const * constPlanes [3] ;
+    planes [0] = LxLx ; constPlanes [0] = LxLx ;
+    planes [1] = LyLy ; constPlanes [1] = LyLy ;
+    planes [2] = LxLy ; constPlanes [2] = LxLy ;
+    vl_imsmooth_planes_f(planes, width, constPlanes, 3,
+                         width, height, width,
+                         sigmaI / step, sigmaI / step) ;
+  }
 
-  for (k = 0 ; k < (signed)(width * height) ; ++k) {
+#ifndef VL_DISABLE_AVX
+  if (vl_cpu_has_avx() && vl_get_simd_enabled()) {
+    k += _vl_covdet_harris_avx (harris, LxLx, LyLy, LxLy,
+                                numPixels, factor, alpha) ;
+  }
+#endif
+#ifndef VL_DISABLE_SSE2
+  if (vl_cpu_has_sse2() && vl_get_simd_enabled()) {
+    k += _vl_covdet_harris_sse2 (harris + k, LxLx + k, LyLy + k, LxLy + k,
+                                 numPixels - k, factor, alpha) ;
+  }
+#endif
+  for ( ; k < numPixels ; ++k) {
     float a = LxLx[k] ;
     float b = LyLy[k] ;
     float c = LxLy[k] ;
@@ -1894,10 +2379,6 @@ _vl_harris_response (float * harris,
 
     harris[k] = factor * (determinant - alpha * (trace * trace)) ;
   }
-
-  vl_free(LxLy) ;
-  vl_free(LyLy) ;
-  vl_free(LxLx) ;
 }
 
 /** @brief Difference of Gaussian
@@ -1924,6 +2405,157 @@ _vl_dog_response (float * dog,
 /*                                                  Detect features */
 /* ---------------------------------------------------------------- */
 
+/* ---------------------------------------------------------------- */
+/*                                                   Feature budget */
+/* ---------------------------------------------------------------- */
+
+/** @internal
+ ** @brief A feature ranked for the feature budget
+ **/
+
+typedef struct _VlCovDetRankedFeature
+{
+  vl_uindex cell ;  /**< grid cell containing the feature. */
+  vl_uindex rank ;  /**< rank of the feature within its cell. */
+  double score ;    /**< absolute peak score. */
+  vl_uindex index ; /**< index of the feature. */
+} VlCovDetRankedFeature ;
+
+static int
+_vl_covdet_compare_ranked_by_cell (void const * a_, void const * b_)
+{
+  VlCovDetRankedFeature const * a = a_ ;
+  VlCovDetRankedFeature const * b = b_ ;
+  if (a->cell != b->cell) return (a->cell < b->cell) ? -1 : +1 ;
+  if (a->score != b->score) return (a->score > b->score) ? -1 : +1 ;
+  if (a->index != b->index) return (a->index < b->index) ? -1 : +1 ;
+  return 0 ;
+}
+
+static int
+_vl_covdet_compare_ranked_by_rank (void const * a_, void const * b_)
+{
+  VlCovDetRankedFeature const * a = a_ ;
+  VlCovDetRankedFeature const * b = b_ ;
+  if (a->rank != b->rank) return (a->rank < b->rank) ? -1 : +1 ;
+  if (a->score != b->score) return (a->score > b->score) ? -1 : +1 ;
+  if (a->index != b->index) return (a->index < b->index) ? -1 : +1 ;
+  return 0 ;
+}
+
+static int
+_vl_covdet_compare_ranked_by_index (void const * a_, void const * b_)
+{
+  VlCovDetRankedFeature const * a = a_ ;
+  VlCovDetRankedFeature const * b = b_ ;
+  if (a->index != b->index) return (a->index < b->index) ? -1 : +1 ;
+  return 0 ;
+}
+
+/** @internal
+ ** @brief Rank the detected features for the feature budget
+ ** @param self object.
+ ** @param ranked ranked features (output).
+ **
+ ** The image (or the region passed to ::vl_covdet_put_image_region)
+ ** is divided in a grid of ::vl_covdet_get_budget_grid_size cells
+ ** along each side and the features in each cell are ranked by
+ ** decreasing absolute peak score. The function stores in @a ranked
+ ** the features of rank zero (the strongest in each cell), then
+ ** those of rank one, and so on, breaking ties by score. @a ranked
+ ** must have space for all the features.
+ **/
+
+static void
+_vl_covdet_rank_features (VlCovDet const * self, VlCovDetRankedFeature * ranked)
+{
+  double const width = self->region[2] - self->region[0] + 1 ;
+  double const height = self->region[3] - self->region[1] + 1 ;
+  vl_size const numCells = self->budgetGridSize ;
+  vl_size const numFeatures = self->numFeatures ;
+  vl_uindex rank = 0 ;
+  vl_index i ;
+
+  for (i = 0 ; i < (signed)numFeatures ; ++i) {
+    VlCovDetFeature const * feature = self->features + i ;
+    vl_index cx = (vl_index) floor((feature->frame.x - self->region[0]) * numCells / width) ;
+    vl_index cy = (vl_index) floor((feature->frame.y - self->region[1]) * numCells / height) ;
+    cx = VL_MAX(0, VL_MIN((signed)numCells - 1, cx)) ;
+    cy = VL_MAX(0, VL_MIN((signed)numCells - 1, cy)) ;
+    ranked[i].cell = cy * numCells + cx ;
+    ranked[i].score = vl_abs_d(feature->peakScore) ;
+    ranked[i].index = i ;
+  }
+
+  /* rank the features within each cell */
+  qsort(ranked, numFeatures, sizeof(VlCovDetRankedFeature),
+        _vl_covdet_compare_ranked_by_cell) ;
+  for (i = 0 ; i < (signed)numFeatures ; ++i) {
+    if (i > 0 && ranked[i].cell == ranked[i-1].cell) {
+      ++ rank ;
+    } else {
+      rank = 0 ;
+    }
+    ranked[i].rank = rank ;
+  }
+
+  /* best ranks first */
+  qsort(ranked, numFeatures, sizeof(VlCovDetRankedFeature),
+        _vl_covdet_compare_ranked_by_rank) ;
+}
+
+/** @internal
+ ** @brief Reduce the detected features to the feature budget
+ ** @param self object.
+ **
+ ** The function ranks the features (::_vl_covdet_rank_features)
+ ** and keeps the first ::vl_covdet_get_max_num_features ones. Hence
+ ** each cell of the budget grid retains its top-k features, with k
+ ** adapted so that the budget is met exactly, and the slots of cells
+ ** with few features go to the other cells.
+ **
+ ** The selected features retain their order.
+ **/
+
+static void
+_vl_covdet_apply_feature_budget (VlCovDet * self)
+{
+  vl_size const numFeatures = self->numFeatures ;
+  VlCovDetRankedFeature * ranked ;
+  vl_bool * keep ;
+  vl_index i, j ;
+
+  if (self->maxNumFeatures == 0 || numFeatures <= self->maxNumFeatures) return ;
+
+  ranked = vl_malloc(sizeof(VlCovDetRankedFeature) * numFeatures) ;
+  keep = vl_calloc(numFeatures, sizeof(vl_bool)) ;
+  if (ranked == NULL || keep == NULL) {
+    vl_free(ranked) ;
+    vl_free(keep) ;
+    vl_set_last_error(VL_ERR_ALLOC, "Unable to allocate data.") ;
+    return ;
+  }
+
+  /* keep the best ranks */
+  _vl_covdet_rank_features(self, ranked) ;
+  for (i = 0 ; i < (signed)self->maxNumFeatures ; ++i) {
+    keep[ranked[i].index] = VL_TRUE ;
+  }
+  vl_free(ranked) ;
+
+  j = 0 ;
+  for (i = 0 ; i < (signed)numFeatures ; ++i) {
+    if (keep[i]) {
+      self->features[j++] = self->features[i] ;
+    }
+  }
+  vl_free(keep) ;
+  self->numFeatures = j ;
+}
+
+static void
+_vl_covdet_extract_laplacian_scales_within_budget (VlCovDet * self) ;
+
 /** @brief Detect scale-space features
  ** @param self object.
  **
@@ -1952,12 +2584,9 @@ vl_covdet_detect (VlCovDet * self)
   if (self->method == VL_COVDET_METHOD_DOG) {
     cgeom.octaveLastSubdivision -= 1 ;
   }
-  if (!self->css ||
-      !vl_scalespacegeometry_is_equal(cgeom,
-                                      vl_scalespace_get_geometry(self->css)))
-  {
+  if (! _vl_covdet_check_scalespace(self->css, cgeom, self->crops)) {
     if (self->css) vl_scalespace_delete(self->css) ;
-    self->css = vl_scalespace_new_with_geometry(cgeom) ;
+    self->css = vl_scalespace_new_with_crops(cgeom, self->crops) ;
   }
   if (self->method == VL_COVDET_METHOD_HARRIS_LAPLACE ||
       self->method == VL_COVDET_METHOD_MULTISCALE_HARRIS) {
@@ -1987,7 +2616,8 @@ vl_covdet_detect (VlCovDet * self)
         case VL_COVDET_METHOD_MULTISCALE_HARRIS:
           _vl_harris_response(clevel,
                               level, oct.width, oct.height, oct.step,
-                              sigma, 1.4 * sigma, 0.05) ;
+                              sigma, 1.4 * sigma, 0.05,
+                              levelxx, levelyy, levelxy) ;
           break ;
 
         case VL_COVDET_METHOD_HESSIAN:
@@ -2041,8 +2671,8 @@ vl_covdet_detect (VlCovDet * self)
               double sigma = cgeom.baseScale *
               pow(2.0, o + (refined.z + cgeom.octaveFirstSubdivision)
                   / cgeom.octaveResolution) ;
-              feature.frame.x = refined.x * step ;
-              feature.frame.y = refined.y * step ;
+              feature.frame.x = (refined.x + octgeom.origin[0]) * step ;
+              feature.frame.y = (refined.y + octgeom.origin[1]) * step ;
               feature.frame.a11 = sigma ;
               feature.frame.a12 = 0.0 ;
               feature.frame.a21 = 0.0 ;
@@ -2078,8 +2708,8 @@ vl_covdet_detect (VlCovDet * self)
               if (ok) {
                 double sigma = cgeom.baseScale *
                 pow(2.0, o + (double)s / cgeom.octaveResolution) ;
-                feature.frame.x = refined.x * step ;
-                feature.frame.y = refined.y * step ;
+                feature.frame.x = (refined.x + octgeom.origin[0]) * step ;
+                feature.frame.y = (refined.y + octgeom.origin[1]) * step ;
                 feature.frame.a11 = sigma ;
                 feature.frame.a12 = 0.0 ;
                 feature.frame.a21 = 0.0 ;
@@ -2098,11 +2728,25 @@ vl_covdet_detect (VlCovDet * self)
     if (extrema) { vl_free(extrema) ; extrema = 0 ; }
   }
 
-  /* Laplacian scale selection for certain methods */
+  /* drop the features detected in the margin of the region */
+  if (self->useRegion) {
+    vl_index i, j = 0 ;
+    for (i = 0 ; i < (signed)self->numFeatures ; ++i) {
+      VlCovDetFeature const * feature = self->features + i ;
+      if (feature->frame.x >= self->region[0] && feature->frame.x <= self->region[2] &&
+          feature->frame.y >= self->region[1] && feature->frame.y <= self->region[3]) {
+        self->features[j++] = *feature ;
+      }
+    }
+    self->numFeatures = j ;
+  }
+
+  /* Laplacian scale selection for certain methods, on the features
+     within the budget only */
   switch (self->method) {
     case VL_COVDET_METHOD_HARRIS_LAPLACE :
     case VL_COVDET_METHOD_HESSIAN_LAPLACE :
-      vl_covdet_extract_laplacian_scales (self) ;
+      _vl_covdet_extract_laplacian_scales_within_budget (self) ;
       break ;
     default:
       break ;
@@ -2144,122 +2788,127 @@ vl_covdet_detect (VlCovDet * self)
     self->numFeatures = j ;
   }
 
+  /* feature budget, again if Laplacian scale selection added features */
+  _vl_covdet_apply_feature_budget (self) ;
+
   if (levelxx) vl_free(levelxx) ;
   if (levelyy) vl_free(levelyy) ;
   if (levelxy) vl_free(levelxy) ;
 }
 
+/* ---------------------------------------------------------------- */
+/*                                        Per-thread scratch buffers */
+/* ---------------------------------------------------------------- */
+
+/** @internal
+ ** @brief Create the scratch buffers for a thread
+ ** @return new scratch buffers or @c NULL if memory is insufficient.
+ **
+ ** The function can be called from a parallel region.
+ **/
+
+static VlCovDetWorkspace *
+_vl_covdet_new_workspace (void)
+{
+  VlCovDetWorkspace * workspace ;
+#if defined(_OPENMP)
+#pragma omp critical
+#endif
+  {
+    workspace = vl_calloc(1, sizeof(VlCovDetWorkspace)) ;
+  }
+  return workspace ;
+}
+
+/** @internal
+ ** @brief Delete the scratch buffers of a thread
+ ** @param workspace scratch buffers (may be @c NULL).
+ **/
+
+static void
+_vl_covdet_delete_workspace (VlCovDetWorkspace * workspace)
+{
+  if (workspace == NULL) return ;
+#if defined(_OPENMP)
+#pragma omp critical
+#endif
+  {
+    if (workspace->patch) vl_free(workspace->patch) ;
+    vl_free(workspace) ;
+  }
+}
+
 /* ---------------------------------------------------------------- */
 /*                                                  Extract patches */
 /* ---------------------------------------------------------------- */
 
 /** @internal
- ** @brief Helper for extracting patches
+ ** @brief Select the scale space level to warp a patch from
  ** @param self object.
- ** @param[out] sigma1 actual patch smoothing along the first axis.
- ** @param[out] sigma2 actual patch smoothing along the second axis.
+ ** @param[out] o_ octave of the level.
+ ** @param[out] s_ subdivision of the level.
+ ** @param sigma desired smoothing in the patch frame.
+ ** @param d1 first singular value of the patch to image transformation.
+ ** @param d2 second singular value of the patch to image transformation.
+ ** @return smoothing of the selected level.
+ **/
+
+static double
+_vl_covdet_get_patch_level (VlCovDet const * self,
+                            vl_index * o_, vl_index * s_,
+                            double sigma, double d1, double d2)
+{
+  return _vl_covdet_select_patch_level(vl_scalespace_get_geometry(self->gss),
+                                       o_, s_, sigma, d1, d2) ;
+}
+
+/** @internal
+ ** @brief Warp a patch from a scale space level
+ ** @param self object.
+ ** @param workspace scratch buffers.
  ** @param patch buffer.
  ** @param resolution patch resolution.
  ** @param extent patch extent.
- ** @param sigma desired smoothing in the patch frame.
  ** @param A_ linear transfomration from patch to image.
  ** @param T_ translation from patch to image.
- ** @param d1 first singular value @a A.
- ** @param d2 second singular value of @a A.
+ ** @param o octave of the level (see ::_vl_covdet_get_patch_level).
+ ** @param s subdivision of the level.
+ ** @return error code.
  **/
 
-vl_bool
-vl_covdet_extract_patch_helper (VlCovDet * self,
-                                double * sigma1,
-                                double * sigma2,
-                                float * patch,
-                                vl_size resolution,
-                                double extent,
-                                double sigma,
-                                double A_ [4],
-                                double T_ [2],
-                                double d1, double d2)
+static int
+_vl_covdet_warp_patch (VlCovDet * self,
+                       VlCovDetWorkspace * workspace,
+                       float * patch,
+                       vl_size resolution,
+                       double extent,
+                       double A_ [4],
+                       double T_ [2],
+                       vl_index o, vl_index s)
 {
-  vl_index o, s ;
-  double factor ;
-  double sigma_ ;
   float const * level ;
   vl_size width, height ;
+  vl_index originx, originy ;
   double step ;
 
   double A [4] = {A_[0], A_[1], A_[2], A_[3]} ;
   double T [2] = {T_[0], T_[1]} ;
 
-  VlScaleSpaceGeometry geom = vl_scalespace_get_geometry(self->gss) ;
   VlScaleSpaceOctaveGeometry oct ;
 
-  /* Starting from a pre-smoothed image at scale sigma_
-     because of the mapping A the resulting smoothing in
-     the warped patch is S, where
-
-        sigma_^2 I = A S A',
-
-        S = sigma_^2 inv(A) inv(A)' = sigma_^2 V D^-2 V',
-
-        A = U D V'.
-
-     Thus we rotate A by V to obtain an axis-aligned smoothing:
-
-        A = U*D,
-
-        S = sigma_^2 D^-2.
-
-     Then we search the scale-space for the best sigma_ such
-     that the target smoothing is approximated from below:
-
-        max sigma_(o,s) :    simga_(o,s) factor <= sigma,
-        factor = max{abs(D11), abs(D22)}.
-   */
-
-
   /*
-   Determine the best level (o,s) such that sigma_(o,s) factor <= sigma.
-   This can be obtained by scanning octaves from smallest to largest
-   and stopping when no level in the octave satisfies the relation.
-
-   Given the range of octave availables, do the best you can.
-   */
-
-  factor = 1.0 / VL_MIN(d1, d2) ;
-
-  for (o = geom.firstOctave + 1 ; o <= geom.lastOctave ; ++o) {
-    s = vl_floor_d(vl_log2_d(sigma / (factor * geom.baseScale)) - o) ;
-    s = VL_MAX(s, geom.octaveFirstSubdivision) ;
-    s = VL_MIN(s, geom.octaveLastSubdivision) ;
-    sigma_ = geom.baseScale * pow(2.0, o + (double)s / geom.octaveResolution) ;
-    /*VL_PRINTF(".. %d D=%g %g; sigma_=%g factor*sigma_=%g\n", o, d1, d2, sigma_, factor* sigma_) ;*/
-    if (factor * sigma_ > sigma) {
-      o -- ;
-      break ;
-    }
-  }
-  o = VL_MIN(o, geom.lastOctave) ;
-  s = vl_floor_d(vl_log2_d(sigma / (factor * geom.baseScale)) - o) ;
-  s = VL_MAX(s, geom.octaveFirstSubdivision) ;
-  s = VL_MIN(s, geom.octaveLastSubdivision) ;
-  sigma_ = geom.baseScale * pow(2.0, o + (double)s / geom.octaveResolution) ;
-  if (sigma1) *sigma1 = sigma_ / d1 ;
-  if (sigma2) *sigma2 = sigma_ / d2 ;
-
-  /*VL_PRINTF("%d %d %g %g %g %g\n", o, s, factor, sigma_, factor * sigma_, sigma) ;*/
-
-  /*
-   Now the scale space level to be used for this warping has been
-   determined.
-
    If the patch is partially or completely out of the image boundary,
-   create a padded copy of the required region first.
+   create a padded copy of the required region first. The level
+   covers the pixels [originx, originx + width - 1] x [originy,
+   originy + height - 1] of the octave (see ::vl_covdet_put_image_region).
    */
 
   level = vl_scalespace_get_level(self->gss, o, s) ;
   oct = vl_scalespace_get_octave_geometry(self->gss, o) ;
   width = oct.width ;
   height = oct.height ;
+  originx = oct.origin[0] ;
+  originy = oct.origin[1] ;
   step = oct.step ;
 
   A[0] /= step ;
@@ -2294,7 +2943,8 @@ vl_covdet_extract_patch_helper (VlCovDet * self,
       y1 = VL_MAX(y1, y) ;
     }
 
-    if ((x0 < 0 || x1 > (signed)width-1 || y0 < 0 || y1 > (signed)height-1) &&
+    if ((x0 < originx || x1 > originx + (signed)width - 1 ||
+         y0 < originy || y1 > originy + (signed)height - 1) &&
         !self->allowPaddedWarping) {
       return vl_set_last_error(VL_ERR_EOF, "Frame out of image.");
     }
@@ -2311,49 +2961,58 @@ vl_covdet_extract_patch_helper (VlCovDet * self,
      the image. The image is extended by continuity.
      */
 
-    if (x0i < 0 || x1i > (signed)width-1 ||
-        y0i < 0 || y1i > (signed)height-1) {
+    if (x0i < originx || x1i > originx + (signed)width - 1 ||
+        y0i < originy || y1i > originy + (signed)height - 1) {
      
       vl_index xi, yi ;
 
       /* compute the amount of l,r,t,b padding needed to complete the patch */
-      vl_index padx0 = VL_MAX(0, - x0i) ;
-      vl_index pady0 = VL_MAX(0, - y0i) ;
-      vl_index padx1 = VL_MAX(0, x1i - ((signed)width - 1)) ;
-      vl_index pady1 = VL_MAX(0, y1i - ((signed)height - 1)) ;
+      vl_index padx0 = VL_MAX(0, originx - x0i) ;
+      vl_index pady0 = VL_MAX(0, originy - y0i) ;
+      vl_index padx1 = VL_MAX(0, x1i - (originx + (signed)width - 1)) ;
+      vl_index pady1 = VL_MAX(0, y1i - (originy + (signed)height - 1)) ;
 
       /* make enough room for the patch */
       vl_index patchWidth = x1i - x0i + 1 ;
       vl_index patchHeight = y1i - y0i + 1 ;
       vl_size patchBufferSize = patchWidth * patchHeight * sizeof(float) ;
-      if (patchBufferSize > self->patchBufferSize) {
-        int err = _vl_resize_buffer((void**)&self->patch, &self->patchBufferSize, patchBufferSize) ;
+      if (patchBufferSize > workspace->patchBufferSize) {
+        int err ;
+#if defined(_OPENMP)
+#pragma omp critical
+#endif
+        {
+          err = _vl_resize_buffer((void**)&workspace->patch,
+                                  &workspace->patchBufferSize,
+                                  patchBufferSize) ;
+        }
         if (err) return vl_set_last_error(VL_ERR_ALLOC, "Unable to allocate data.") ;
       }
 
       if (pady0 < patchHeight - pady1) {
         /* start by filling the central horizontal band */
         for (yi = y0i + pady0 ; yi < y0i + patchHeight - pady1 ; ++ yi) {
-          float *dst = self->patch + (yi - y0i) * patchWidth ;
-          float const *src = level + yi * width + VL_MIN(VL_MAX(0, x0i),(signed)width-1) ;
+          float *dst = workspace->patch + (yi - y0i) * patchWidth ;
+          float const *src = level + (yi - originy) * width
+          + VL_MIN(VL_MAX(0, x0i - originx),(signed)width-1) ;
           for (xi = x0i ; xi < x0i + padx0 ; ++xi) *dst++ = *src ;
           for ( ; xi < x0i + patchWidth - padx1 - 2 ; ++xi) *dst++ = *src++ ;
           for ( ; xi < x0i + patchWidth ; ++xi) *dst++ = *src ;
         }
         /* now extend the central band up and down */
         for (yi = 0 ; yi < pady0 ; ++yi) {
-          memcpy(self->patch + yi * patchWidth,
-                 self->patch + pady0 * patchWidth,
+          memcpy(workspace->patch + yi * patchWidth,
+                 workspace->patch + pady0 * patchWidth,
                  patchWidth * sizeof(float)) ;
         }
         for (yi = patchHeight - pady1 ; yi < patchHeight ; ++yi) {
-          memcpy(self->patch + yi * patchWidth,
-                 self->patch + (patchHeight - pady1 - 1) * patchWidth,
+          memcpy(workspace->patch + yi * patchWidth,
+                 workspace->patch + (patchHeight - pady1 - 1) * patchWidth,
                  patchWidth * sizeof(float)) ;
         }
       } else {
         /* should be handled better! */
-        memset(self->patch, 0, self->patchBufferSize) ;
+        memset(workspace->patch, 0, workspace->patchBufferSize) ;
       }
 #if 0
       {
@@ -2363,9 +3022,11 @@ vl_covdet_extract_patch_helper (VlCovDet * self,
       }
 #endif
 
-      level = self->patch ;
+      level = workspace->patch ;
       width = patchWidth ;
       height = patchHeight ;
+      originx = 0 ;
+      originy = 0 ;
       T[0] -= x0i ;
       T[1] -= y0i ;
     }
@@ -2390,15 +3051,16 @@ vl_covdet_extract_patch_helper (VlCovDet * self,
         double y = A[1] * xhat + ry ;
         vl_index xi = vl_floor_d(x) ;
         vl_index yi = vl_floor_d(y) ;
-        double i00 = level[yi * width + xi] ;
-        double i10 = level[yi * width + xi + 1] ;
-        double i01 = level[(yi + 1) * width + xi] ;
-        double i11 = level[(yi + 1) * width + xi + 1] ;
+        float const * pixel = level + (yi - originy) * width + (xi - originx) ;
+        double i00 = pixel[0] ;
+        double i10 = pixel[1] ;
+        double i01 = pixel[width] ;
+        double i11 = pixel[width + 1] ;
         double wx = x - xi ;
         double wy = y - yi ;
 
-        assert(xi >= 0 && xi <= (signed)width - 1) ;
-        assert(yi >= 0 && yi <= (signed)height - 1) ;
+        assert(xi >= originx && xi <= originx + (signed)width - 1) ;
+        assert(yi >= originy && yi <= originy + (signed)height - 1) ;
 
         *pt++ =
         (1.0 - wy) * ((1.0 - wx) * i00 + wx * i10) +
@@ -2419,6 +3081,78 @@ vl_covdet_extract_patch_helper (VlCovDet * self,
   return VL_ERR_OK ;
 }
 
+/** @internal
+ ** @brief Helper for extracting patches
+ ** @param self object.
+ ** @param workspace scratch buffers.
+ ** @param[out] sigma1 actual patch smoothing along the first axis.
+ ** @param[out] sigma2 actual patch smoothing along the second axis.
+ ** @param patch buffer.
+ ** @param resolution patch resolution.
+ ** @param extent patch extent.
+ ** @param sigma desired smoothing in the patch frame.
+ ** @param A_ linear transfomration from patch to image.
+ ** @param T_ translation from patch to image.
+ ** @param d1 first singular value @a A.
+ ** @param d2 second singular value of @a A.
+ **/
+
+static vl_bool
+_vl_covdet_extract_patch_helper (VlCovDet * self,
+                                 VlCovDetWorkspace * workspace,
+                                 double * sigma1,
+                                 double * sigma2,
+                                 float * patch,
+                                 vl_size resolution,
+                                 double extent,
+                                 double sigma,
+                                 double A_ [4],
+                                 double T_ [2],
+                                 double d1, double d2)
+{
+  vl_index o, s ;
+  double sigma_ = _vl_covdet_get_patch_level(self, &o, &s, sigma, d1, d2) ;
+  if (sigma1) *sigma1 = sigma_ / d1 ;
+  if (sigma2) *sigma2 = sigma_ / d2 ;
+  return _vl_covdet_warp_patch(self, workspace, patch, resolution, extent,
+                               A_, T_, o, s) ;
+}
+
+/** @internal
+ ** @brief Helper for extracting patches
+ ** @param self object.
+ ** @param[out] sigma1 actual patch smoothing along the first axis.
+ ** @param[out] sigma2 actual patch smoothing along the second axis.
+ ** @param patch buffer.
+ ** @param resolution patch resolution.
+ ** @param extent patch extent.
+ ** @param sigma desired smoothing in the patch frame.
+ ** @param A_ linear transfomration from patch to image.
+ ** @param T_ translation from patch to image.
+ ** @param d1 first singular value @a A.
+ ** @param d2 second singular value of @a A.
+ **
+ ** Same as ::_vl_covdet_extract_patch_helper, using the scratch
+ ** buffers of the object.
+ **/
+
+vl_bool
+vl_covdet_extract_patch_helper (VlCovDet * self,
+                                double * sigma1,
+                                double * sigma2,
+                                float * patch,
+                                vl_size resolution,
+                                double extent,
+                                double sigma,
+                                double A_ [4],
+                                double T_ [2],
+                                double d1, double d2)
+{
+  return _vl_covdet_extract_patch_helper
+  (self, &self->workspace, sigma1, sigma2, patch,
+   resolution, extent, sigma, A_, T_, d1, d2) ;
+}
+
 /** @brief Helper for extracting patches
  ** @param self object.
  ** @param patch buffer.
@@ -2451,30 +3185,212 @@ vl_covdet_extract_patch_for_frame (VlCovDet * self,
   double T[2] = {frame.x, frame.y} ;
   double D[4], U[4], V[4] ;
 
-  vl_svd2(D, U, V, A) ;
+  vl_svd2(D, U, V, A) ;
+
+  return vl_covdet_extract_patch_helper
+  (self, NULL, NULL, patch, resolution, extent, sigma, A, T, D[0], D[3]) ;
+}
+
+/** @internal
+ ** @brief A frame to be warped by ::vl_covdet_extract_patches
+ **/
+
+typedef struct _VlCovDetPatchJob
+{
+  vl_index o ;      /**< octave of the scale space level. */
+  vl_index s ;      /**< subdivision of the scale space level. */
+  double y ;        /**< vertical coordinate of the frame center. */
+  vl_uindex index ; /**< index of the frame. */
+} VlCovDetPatchJob ;
+
+static int
+_vl_covdet_compare_patch_jobs (void const * a_, void const * b_)
+{
+  VlCovDetPatchJob const * a = a_ ;
+  VlCovDetPatchJob const * b = b_ ;
+  if (a->o != b->o) return (a->o < b->o) ? -1 : +1 ;
+  if (a->s != b->s) return (a->s < b->s) ? -1 : +1 ;
+  if (a->y != b->y) return (a->y < b->y) ? -1 : +1 ;
+  if (a->index != b->index) return (a->index < b->index) ? -1 : +1 ;
+  return 0 ;
+}
+
+/** @brief Extract the patches of several frames
+ ** @param self object.
+ ** @param patches buffer.
+ ** @param status per frame status (may be @c NULL).
+ ** @param resolution patch resolution.
+ ** @param extent patch extent.
+ ** @param sigma desired smoothing in the patch frame.
+ ** @param frames feature frames.
+ ** @param numFrames number of frames.
+ ** @return ::VL_ERR_OK if all the patches are extracted.
+ **
+ ** The function is equivalent to calling
+ ** ::vl_covdet_extract_patch_for_frame for each of the @a numFrames
+ ** @a frames. The patches are stored one after the other in
+ ** @a patches, which must hold <code>numFrames * side * side</code>
+ ** floats, where <code>side = 2*resolution+1</code>. This is the
+ ** layout of a @c numFrames x @c side x @c side tensor.
+ **
+ ** The frames are warped in order of scale space level, and of
+ ** vertical position within each level, so that the level data is
+ ** accessed sequentially. They are processed in parallel
+ ** (::vl_set_num_threads), each thread using its own scratch buffers.
+ ** The patches do not depend on the processing order.
+ **
+ ** If the patch of frame @c k cannot be extracted (for example
+ ** because the frame is out of the image and padded warping is
+ ** disabled, see ::vl_covdet_set_allow_padded_warping), the patch is
+ ** filled with zeros and @c status[k] is set to the error code. The
+ ** function then returns the error code of the first such frame.
+ **/
+
+int
+vl_covdet_extract_patches (VlCovDet * self,
+                           float * patches,
+                           int * status,
+                           vl_size resolution,
+                           double extent,
+                           double sigma,
+                           VlFrameOrientedEllipse const * frames,
+                           vl_size numFrames)
+{
+  vl_size const side = 2 * resolution + 1 ;
+  VlCovDetPatchJob * jobs ;
+  int * errors = status ;
+  int err = VL_ERR_OK ;
+  vl_index k ;
+
+  assert(self) ;
+  assert(self->gss) ;
+  assert(patches || numFrames == 0) ;
+  assert(frames || numFrames == 0) ;
+
+  if (numFrames == 0) return VL_ERR_OK ;
+
+  jobs = vl_malloc(sizeof(VlCovDetPatchJob) * numFrames) ;
+  if (errors == NULL) errors = vl_malloc(sizeof(int) * numFrames) ;
+  if (jobs == NULL || errors == NULL) {
+    if (jobs) vl_free(jobs) ;
+    if (errors && errors != status) vl_free(errors) ;
+    return vl_set_last_error(VL_ERR_ALLOC, "Unable to allocate data.") ;
+  }
+
+  /* select the scale space level of each frame */
+  for (k = 0 ; k < (signed)numFrames ; ++k) {
+    VlFrameOrientedEllipse const * frame = frames + k ;
+    double A [2*2] = {frame->a11, frame->a21, frame->a12, frame->a22} ;
+    double D [4], U [4], V [4] ;
+    vl_svd2(D, U, V, A) ;
+    _vl_covdet_get_patch_level(self, &jobs[k].o, &jobs[k].s,
+                               sigma, D[0], D[3]) ;
+    jobs[k].y = frame->y ;
+    jobs[k].index = k ;
+  }
+  qsort(jobs, numFrames, sizeof(VlCovDetPatchJob),
+        _vl_covdet_compare_patch_jobs) ;
+
+#if defined(_OPENMP)
+#pragma omp parallel default(shared) private(k) num_threads(vl_get_max_threads()) \
+  if(numFrames >= 2 * VL_COVDET_PARALLEL_CHUNK_SIZE)
+#endif
+  {
+    VlCovDetWorkspace * workspace = _vl_covdet_new_workspace() ;
+#if defined(_OPENMP)
+#pragma omp for schedule(dynamic, VL_COVDET_PARALLEL_CHUNK_SIZE)
+#endif
+    for (k = 0 ; k < (signed)numFrames ; ++k) {
+      vl_uindex i = jobs[k].index ;
+      VlFrameOrientedEllipse const * frame = frames + i ;
+      double A [2*2] = {frame->a11, frame->a21, frame->a12, frame->a22} ;
+      double T [2] = {frame->x, frame->y} ;
+      float * patch = patches + side * side * i ;
+      if (workspace) {
+        errors[i] = _vl_covdet_warp_patch(self, workspace, patch,
+                                          resolution, extent, A, T,
+                                          jobs[k].o, jobs[k].s) ;
+      } else {
+        errors[i] = VL_ERR_ALLOC ;
+      }
+      if (errors[i] != VL_ERR_OK) {
+        memset(patch, 0, sizeof(float) * side * side) ;
+      }
+    }
+    _vl_covdet_delete_workspace(workspace) ;
+  }
 
-  return vl_covdet_extract_patch_helper
-  (self, NULL, NULL, patch, resolution, extent, sigma, A, T, D[0], D[3]) ;
+  /* the error state of the worker threads is not the caller's */
+  for (k = 0 ; k < (signed)numFrames ; ++k) {
+    if (errors[k] != VL_ERR_OK) {
+      err = errors[k] ;
+      if (err == VL_ERR_EOF) {
+        vl_set_last_error(err, "Frame out of image.") ;
+      } else {
+        vl_set_last_error(err, "Unable to allocate data.") ;
+      }
+      break ;
+    }
+  }
+
+  vl_free(jobs) ;
+  if (errors != status) vl_free(errors) ;
+  return err ;
 }
 
 /* ---------------------------------------------------------------- */
 /*                                                     Affine shape */
 /* ---------------------------------------------------------------- */
 
-/** @brief Extract the affine shape for a feature frame
+/** @internal
+ ** @brief Get the rotation that makes a frame upright
+ ** @param self object.
+ ** @param A affine part of the frame (column major).
+ ** @return rotation angle.
+ **
+ ** The frame @f$ A R(\theta) @f$ maps the vertical axis (the horizontal
+ ** one for transposed conventions) to a vector with the same direction,
+ ** i.e. it does not rotate it.
+ **/
+
+static double
+_vl_covdet_get_upright_angle (VlCovDet const * self, double const * A)
+{
+  double ref [2] ;
+  double ref_ [2] ;
+  double angle ;
+  double angle_ ;
+
+  if (self->transposed) {
+    /* up is the x axis */
+    ref[0] = 1 ;
+    ref[1] = 0 ;
+  } else {
+    /* up is the y axis */
+    ref[0] = 0 ;
+    ref[1] = 1 ;
+  }
+
+  vl_solve_linear_system_2 (ref_, A, ref) ;
+  angle = atan2(ref[1], ref[0]) ;
+  angle_ = atan2(ref_[1], ref_[0]) ;
+  return angle_ - angle ;
+}
+
+/** @internal
+ ** @brief Extract the affine shape for a feature frame
  ** @param self object.
+ ** @param workspace scratch buffers.
  ** @param adapted the shape-adapted frame.
  ** @param frame the input frame.
  ** @return ::VL_ERR_OK if affine adaptation is successful.
- **
- ** This function may fail if adaptation is unsuccessful or if
- ** memory is insufficient.
  **/
 
-int
-vl_covdet_extract_affine_shape_for_frame (VlCovDet * self,
-                                          VlFrameOrientedEllipse * adapted,
-                                          VlFrameOrientedEllipse frame)
+static int
+_vl_covdet_extract_affine_shape_for_frame (VlCovDet * self,
+                                           VlCovDetWorkspace * workspace,
+                                           VlFrameOrientedEllipse * adapted,
+                                           VlFrameOrientedEllipse frame)
 {
   vl_index iter = 0 ;
 
@@ -2539,31 +3455,31 @@ vl_covdet_extract_affine_shape_for_frame (VlCovDet * self,
 
     if (++iter >= VL_COVDET_AA_MAX_NUM_ITERATIONS) break ;
 
-    err = vl_covdet_extract_patch_helper(self,
-                                         &sigma1, &sigma2,
-                                         self->aaPatch,
-                                         resolution,
-                                         extent,
-                                         sigmaD,
-                                         A, T, D[0], D[3]) ;
+    err = _vl_covdet_extract_patch_helper(self, workspace,
+                                          &sigma1, &sigma2,
+                                          workspace->aaPatch,
+                                          resolution,
+                                          extent,
+                                          sigmaD,
+                                          A, T, D[0], D[3]) ;
     if (err) return err ;
 
     if (self->aaAccurateSmoothing ) {
       double deltaSigma1 = sqrt(VL_MAX(sigmaD*sigmaD - sigma1*sigma1,0)) ;
       double deltaSigma2 = sqrt(VL_MAX(sigmaD*sigmaD - sigma2*sigma2,0)) ;
       double stephat = extent / resolution ;
-      vl_imsmooth_f(self->aaPatch, side,
-                    self->aaPatch, side, side, side,
+      vl_imsmooth_f(workspace->aaPatch, side,
+                    workspace->aaPatch, side, side, side,
                     deltaSigma1 / stephat, deltaSigma2 / stephat) ;
     }
 
     /* compute second moment matrix */
-    vl_imgradient_f (self->aaPatchX, self->aaPatchY, 1, side,
-                     self->aaPatch, side, side, side) ;
+    vl_imgradient_f (workspace->aaPatchX, workspace->aaPatchY, 1, side,
+                     workspace->aaPatch, side, side, side) ;
 
     for (k = 0 ; k < (signed)(side*side) ; ++k) {
-      double lx = self->aaPatchX[k] ;
-      double ly = self->aaPatchY[k] ;
+      double lx = workspace->aaPatchX[k] ;
+      double ly = workspace->aaPatchY[k] ;
       lxx += lx * lx * self->aaMask[k] ;
       lyy += ly * ly * self->aaMask[k] ;
       lxy += lx * ly * self->aaMask[k] ;
@@ -2616,34 +3532,13 @@ vl_covdet_extract_affine_shape_for_frame (VlCovDet * self,
 
    Shape adaptation does not estimate rotation. This is fixed by default
    so that a selected axis is not rotated at all (usually this is the
-   vertical axis for upright features). To do so, the frame is rotated
-   as follows.
+   vertical axis for upright features).
    */
   {
     double A [2*2] = {adapted->a11, adapted->a21, adapted->a12, adapted->a22} ;
-    double ref [2] ;
-    double ref_ [2] ;
-    double angle ;
-    double angle_ ;
-    double dangle ;
-    double r1, r2 ;
-
-    if (self->transposed) {
-      /* up is the x axis */
-      ref[0] = 1 ;
-      ref[1] = 0 ;
-    } else {
-      /* up is the y axis */
-      ref[0] = 0 ;
-      ref[1] = 1 ;
-    }
-
-    vl_solve_linear_system_2 (ref_, A, ref) ;
-    angle = atan2(ref[1], ref[0]) ;
-    angle_ = atan2(ref_[1], ref_[0]) ;
-    dangle = angle_ - angle ;
-    r1 = cos(dangle) ;
-    r2 = sin(dangle) ;
+    double dangle = _vl_covdet_get_upright_angle (self, A) ;
+    double r1 = cos(dangle) ;
+    double r2 = sin(dangle) ;
     adapted->a11 = + A[0] * r1 + A[2] * r2 ;
     adapted->a21 = + A[1] * r1 + A[3] * r2 ;
     adapted->a12 = - A[0] * r2 + A[2] * r1 ;
@@ -2653,11 +3548,34 @@ vl_covdet_extract_affine_shape_for_frame (VlCovDet * self,
   return VL_ERR_OK ;
 }
 
+/** @brief Extract the affine shape for a feature frame
+ ** @param self object.
+ ** @param adapted the shape-adapted frame.
+ ** @param frame the input frame.
+ ** @return ::VL_ERR_OK if affine adaptation is successful.
+ **
+ ** This function may fail if adaptation is unsuccessful or if
+ ** memory is insufficient.
+ **/
+
+int
+vl_covdet_extract_affine_shape_for_frame (VlCovDet * self,
+                                          VlFrameOrientedEllipse * adapted,
+                                          VlFrameOrientedEllipse frame)
+{
+  return _vl_covdet_extract_affine_shape_for_frame
+  (self, &self->workspace, adapted, frame) ;
+}
+
 /** @brief Extract the affine shape for the stored features
  ** @param self object.
  **
  ** This function may discard features for which no affine
  ** shape can reliably be detected.
+ **
+ ** Features are processed in parallel (::vl_set_num_threads), each
+ ** thread using its own scratch buffers. The result does not depend
+ ** on the number of threads.
  **/
 
 void
@@ -2666,17 +3584,50 @@ vl_covdet_extract_affine_shape (VlCovDet * self)
   vl_index i, j = 0 ;
   vl_size numFeatures = vl_covdet_get_num_features(self) ;
   VlCovDetFeature * feature = vl_covdet_get_features(self);
+  VlFrameOrientedEllipse * adapted ;
+  int * status ;
+
+  if (numFeatures == 0) return ;
+
+  adapted = vl_malloc(sizeof(VlFrameOrientedEllipse) * numFeatures) ;
+  status = vl_malloc(sizeof(int) * numFeatures) ;
+  if (adapted == NULL || status == NULL) {
+    vl_set_last_error(VL_ERR_ALLOC, "Unable to allocate data.") ;
+    goto done ;
+  }
+
+#if defined(_OPENMP)
+#pragma omp parallel default(shared) private(i) num_threads(vl_get_max_threads()) \
+  if(numFeatures >= 2 * VL_COVDET_PARALLEL_CHUNK_SIZE)
+#endif
+  {
+    VlCovDetWorkspace * workspace = _vl_covdet_new_workspace() ;
+#if defined(_OPENMP)
+#pragma omp for schedule(dynamic, VL_COVDET_PARALLEL_CHUNK_SIZE)
+#endif
+    for (i = 0 ; i < (signed)numFeatures ; ++i) {
+      if (workspace) {
+        status[i] = _vl_covdet_extract_affine_shape_for_frame
+        (self, workspace, adapted + i, feature[i].frame) ;
+      } else {
+        status[i] = VL_ERR_ALLOC ;
+      }
+    }
+    _vl_covdet_delete_workspace(workspace) ;
+  }
+
   for (i = 0 ; i < (signed)numFeatures ; ++i) {
-    int status ;
-    VlFrameOrientedEllipse adapted ;
-    status = vl_covdet_extract_affine_shape_for_frame(self, &adapted, feature[i].frame) ;
-    if (status == VL_ERR_OK) {
+    if (status[i] == VL_ERR_OK) {
       feature[j] = feature[i] ;
-      feature[j].frame = adapted ;
+      feature[j].frame = adapted[i] ;
       ++ j ;
     }
   }
   self->numFeatures = j ;
+
+done:
+  if (adapted) vl_free(adapted) ;
+  if (status) vl_free(status) ;
 }
 
 /* ---------------------------------------------------------------- */
@@ -2694,22 +3645,20 @@ _vl_covdet_compare_orientations_descending (void const * a_,
   return 0 ;
 }
 
-/** @brief Extract the orientation(s) for a feature
+/** @internal
+ ** @brief Extract the orientation(s) for a feature
  ** @param self object.
+ ** @param workspace scratch buffers.
  ** @param numOrientations the number of detected orientations.
  ** @param frame pose of the feature.
- ** @return an array of detected orientations with their scores.
- **
- ** The returned array is a matrix of size @f$ 2 \times n @f$
- ** where <em>n</em> is the number of detected orientations.
- **
- ** The function returns @c NULL if memory is insufficient.
+ ** @return an array of detected orientations (in @a workspace).
  **/
 
-VlCovDetFeatureOrientation *
-vl_covdet_extract_orientations_for_frame (VlCovDet * self,
-                                          vl_size * numOrientations,
-                                          VlFrameOrientedEllipse frame)
+static VlCovDetFeatureOrientation *
+_vl_covdet_extract_orientations_for_frame (VlCovDet * self,
+                                           VlCovDetWorkspace * workspace,
+                                           vl_size * numOrientations,
+                                           VlFrameOrientedEllipse frame)
 {
   int err ;
   vl_index k, i ;
@@ -2737,6 +3686,13 @@ vl_covdet_extract_orientations_for_frame (VlCovDet * self,
   assert(self);
   assert(numOrientations) ;
 
+  if (self->upright) {
+    workspace->orientations[0].angle = _vl_covdet_get_upright_angle (self, A) ;
+    workspace->orientations[0].score = 0 ;
+    *numOrientations = 1 ;
+    return workspace->orientations ;
+  }
+
   /*
    The goal is to estimate a rotation R(theta) such that the patch given
    by the transformation A R(theta) has the strongest average
@@ -2763,13 +3719,13 @@ vl_covdet_extract_orientations_for_frame (VlCovDet * self,
 
   theta0 = atan2(V[1],V[0]) ;
 
-  err = vl_covdet_extract_patch_helper(self,
-                                       &sigma1, &sigma2,
-                                       self->aaPatch,
-                                       resolution,
-                                       extent,
-                                       sigmaD,
-                                       A, T, D[0], D[3]) ;
+  err = _vl_covdet_extract_patch_helper(self, workspace,
+                                        &sigma1, &sigma2,
+                                        workspace->aaPatch,
+                                        resolution,
+                                        extent,
+                                        sigmaD,
+                                        A, T, D[0], D[3]) ;
 
   if (err) {
     *numOrientations = 0 ;
@@ -2780,20 +3736,20 @@ vl_covdet_extract_orientations_for_frame (VlCovDet * self,
     double deltaSigma1 = sqrt(VL_MAX(sigmaD*sigmaD - sigma1*sigma1,0)) ;
     double deltaSigma2 = sqrt(VL_MAX(sigmaD*sigmaD - sigma2*sigma2,0)) ;
     double stephat = extent / resolution ;
-    vl_imsmooth_f(self->aaPatch, side,
-                  self->aaPatch, side, side, side,
+    vl_imsmooth_f(workspace->aaPatch, side,
+                  workspace->aaPatch, side, side, side,
                   deltaSigma1 / stephat, deltaSigma2 / stephat) ;
   }
 
   /* histogram of oriented gradients */
-  vl_imgradient_polar_f (self->aaPatchX, self->aaPatchY, 1, side,
-                         self->aaPatch, side, side, side) ;
+  vl_imgradient_polar_f (workspace->aaPatchX, workspace->aaPatchY, 1, side,
+                         workspace->aaPatch, side, side, side) ;
 
   memset (hist, 0, sizeof(double) * numBins) ;
 
   for (k = 0 ; k < (signed)(side*side) ; ++k) {
-    double modulus = self->aaPatchX[k] ;
-    double angle = self->aaPatchY[k] ;
+    double modulus = workspace->aaPatchX[k] ;
+    double angle = workspace->aaPatchY[k] ;
     double weight = self->aaMask[k] ;
 
     double x = angle / binExtent ;
@@ -2840,8 +3796,8 @@ vl_covdet_extract_orientations_for_frame (VlCovDet * self,
         /* the axis to the right is y, measure orientations from this */
         th = th - VL_PI/2 ;
       }
-      self->orientations[*numOrientations].angle = th ;
-      self->orientations[*numOrientations].score = h0 ;
+      workspace->orientations[*numOrientations].angle = th ;
+      workspace->orientations[*numOrientations].score = h0 ;
       *numOrientations += 1 ;
       //VL_PRINTF("%d %g\n", *numOrientations, th) ;
 
@@ -2850,12 +3806,37 @@ vl_covdet_extract_orientations_for_frame (VlCovDet * self,
   }
 
   /* sort the orientations by decreasing scores */
-  qsort(self->orientations,
+  qsort(workspace->orientations,
         *numOrientations,
         sizeof(VlCovDetFeatureOrientation),
         _vl_covdet_compare_orientations_descending) ;
 
-  return self->orientations ;
+  return workspace->orientations ;
+}
+
+/** @brief Extract the orientation(s) for a feature
+ ** @param self object.
+ ** @param numOrientations the number of detected orientations.
+ ** @param frame pose of the feature.
+ ** @return an array of detected orientations with their scores.
+ **
+ ** The returned array is a matrix of size @f$ 2 \times n @f$
+ ** where <em>n</em> is the number of detected orientations.
+ **
+ ** In upright mode (::vl_covdet_set_upright) the image is not
+ ** examined and the function returns the single orientation that
+ ** makes the frame upright (with score zero).
+ **
+ ** The function returns @c NULL if memory is insufficient.
+ **/
+
+VlCovDetFeatureOrientation *
+vl_covdet_extract_orientations_for_frame (VlCovDet * self,
+                                          vl_size * numOrientations,
+                                          VlFrameOrientedEllipse frame)
+{
+  return _vl_covdet_extract_orientations_for_frame
+  (self, &self->workspace, numOrientations, frame) ;
 }
 
 /** @brief Extract the orientation(s) for the stored features.
@@ -2864,6 +3845,10 @@ vl_covdet_extract_orientations_for_frame (VlCovDet * self,
  ** Note that, since more than one orientation can be detected
  ** for each feature, this function may create copies of them,
  ** one for each orientation.
+ **
+ ** The orientations are computed in parallel (::vl_set_num_threads),
+ ** each thread using its own scratch buffers. The copies are then
+ ** appended in the same order as with a single thread.
  **/
 
 void
@@ -2871,11 +3856,51 @@ vl_covdet_extract_orientations (VlCovDet * self)
 {
   vl_index i, j  ;
   vl_size numFeatures = vl_covdet_get_num_features(self) ;
+  VlCovDetFeatureOrientation * allOrientations ;
+  vl_size * allNumOrientations ;
+
+  if (numFeatures == 0) return ;
+
+  allOrientations = vl_malloc(sizeof(VlCovDetFeatureOrientation) *
+                              VL_COVDET_MAX_NUM_ORIENTATIONS * numFeatures) ;
+  allNumOrientations = vl_malloc(sizeof(vl_size) * numFeatures) ;
+  if (allOrientations == NULL || allNumOrientations == NULL) {
+    vl_set_last_error(VL_ERR_ALLOC, "Unable to allocate data.") ;
+    goto done ;
+  }
+
+#if defined(_OPENMP)
+#pragma omp parallel default(shared) private(i) num_threads(vl_get_max_threads()) \
+  if(numFeatures >= 2 * VL_COVDET_PARALLEL_CHUNK_SIZE)
+#endif
+  {
+    VlCovDetWorkspace * workspace = _vl_covdet_new_workspace() ;
+#if defined(_OPENMP)
+#pragma omp for schedule(dynamic, VL_COVDET_PARALLEL_CHUNK_SIZE)
+#endif
+    for (i = 0 ; i < (signed)numFeatures ; ++i) {
+      VlCovDetFeatureOrientation const * orientations = NULL ;
+      allNumOrientations[i] = 0 ;
+      if (workspace) {
+        orientations = _vl_covdet_extract_orientations_for_frame
+        (self, workspace, allNumOrientations + i, self->features[i].frame) ;
+      }
+      if (orientations) {
+        memcpy(allOrientations + VL_COVDET_MAX_NUM_ORIENTATIONS * i,
+               orientations,
+               sizeof(VlCovDetFeatureOrientation) * allNumOrientations[i]) ;
+      } else {
+        allNumOrientations[i] = 0 ;
+      }
+    }
+    _vl_covdet_delete_workspace(workspace) ;
+  }
+
   for (i = 0 ; i < (signed)numFeatures ; ++i) {
-    vl_size numOrientations ;
+    vl_size numOrientations = allNumOrientations[i] ;
     VlCovDetFeature feature = self->features[i] ;
-    VlCovDetFeatureOrientation* orientations =
-    vl_covdet_extract_orientations_for_frame(self, &numOrientations, feature.frame) ;
+    VlCovDetFeatureOrientation const * orientations =
+    allOrientations + VL_COVDET_MAX_NUM_ORIENTATIONS * i ;
 
     for (j = 0 ; j < (signed)numOrientations ; ++j) {
       double A [2*2] = {
@@ -2901,25 +3926,30 @@ vl_covdet_extract_orientations (VlCovDet * self)
       oriented->frame.a22 = - A[1] * r2 + A[3] * r1 ;
     }
   }
+
+done:
+  if (allOrientations) vl_free(allOrientations) ;
+  if (allNumOrientations) vl_free(allNumOrientations) ;
 }
 
 /* ---------------------------------------------------------------- */
 /*                                                 Laplacian scales */
 /* ---------------------------------------------------------------- */
 
-/** @brief Extract the Laplacian scale(s) for a feature frame.
+/** @internal
+ ** @brief Extract the Laplacian scale(s) for a feature frame.
  ** @param self object.
+ ** @param workspace scratch buffers.
  ** @param numScales the number of detected scales.
  ** @param frame pose of the feature.
- ** @return an array of detected scales.
- **
- ** The function returns @c NULL if memory is insufficient.
+ ** @return an array of detected scales (in @a workspace).
  **/
 
-VlCovDetFeatureLaplacianScale *
-vl_covdet_extract_laplacian_scales_for_frame (VlCovDet * self,
-                                              vl_size * numScales,
-                                              VlFrameOrientedEllipse frame)
+static VlCovDetFeatureLaplacianScale *
+_vl_covdet_extract_laplacian_scales_for_frame (VlCovDet * self,
+                                               VlCovDetWorkspace * workspace,
+                                               vl_size * numScales,
+                                               VlFrameOrientedEllipse frame)
 {
   /*
    We try to explore one octave, with the nominal detection scale 1.0
@@ -2958,8 +3988,9 @@ vl_covdet_extract_laplacian_scales_for_frame (VlCovDet * self,
 
   vl_svd2(D, U, V, A) ;
 
-  err = vl_covdet_extract_patch_helper
-  (self, &sigma1, &sigma2, self->lapPatch, resolution, extent, sigmaImage, A, T, D[0], D[3]) ;
+  err = _vl_covdet_extract_patch_helper
+  (self, workspace, &sigma1, &sigma2, workspace->lapPatch,
+   resolution, extent, sigmaImage, A, T, D[0], D[3]) ;
   if (err) return NULL ;
 
   /* the actual smoothing after warping is never the target one */
@@ -2983,7 +4014,7 @@ vl_covdet_extract_laplacian_scales_for_frame (VlCovDet * self,
                     + actualSigmaImage*actualSigmaImage) ;
 
     for (q = 0 ; q < (signed)(num * num) ; ++q) {
-      score += (*pt++) * self->lapPatch[q] ;
+      score += (*pt++) * workspace->lapPatch[q] ;
     }
     scores[k] = score * sigmaLap * sigmaLap ;
   }
@@ -3009,48 +4040,107 @@ vl_covdet_extract_laplacian_scales_for_frame (VlCovDet * self,
        k,s,sigmaLapFilter,sigmaLap,scale,a,b,c) ;
        */
       if (*numScales < VL_COVDET_MAX_NUM_LAPLACIAN_SCALES) {
-        self->scales[*numScales].scale = scale * factor ;
-        self->scales[*numScales].score = b + 0.5 * (c - a) * dk ;
+        workspace->scales[*numScales].scale = scale * factor ;
+        workspace->scales[*numScales].score = b + 0.5 * (c - a) * dk ;
         *numScales += 1 ;
       }
     }
   }
-  return self->scales ;
+  return workspace->scales ;
 }
 
-/** @brief Extract the Laplacian scales for the stored features
+/** @brief Extract the Laplacian scale(s) for a feature frame.
  ** @param self object.
+ ** @param numScales the number of detected scales.
+ ** @param frame pose of the feature.
+ ** @return an array of detected scales.
  **
- ** Note that, since more than one orientation can be detected
- ** for each feature, this function may create copies of them,
- ** one for each orientation.
+ ** The function returns @c NULL if memory is insufficient.
  **/
-void
-vl_covdet_extract_laplacian_scales (VlCovDet * self)
+
+VlCovDetFeatureLaplacianScale *
+vl_covdet_extract_laplacian_scales_for_frame (VlCovDet * self,
+                                              vl_size * numScales,
+                                              VlFrameOrientedEllipse frame)
+{
+  return _vl_covdet_extract_laplacian_scales_for_frame
+  (self, &self->workspace, numScales, frame) ;
+}
+
+/** @internal
+ ** @brief Extract the Laplacian scales for the last stored features
+ ** @param self object.
+ ** @param first index of the first feature to process.
+ **
+ ** The function is like ::vl_covdet_extract_laplacian_scales, but
+ ** processes only the features from @a first on and adds to the
+ ** statistics (::vl_covdet_get_laplacian_scales_statistics) instead
+ ** of resetting them.
+ **/
+
+static void
+_vl_covdet_extract_laplacian_scales_from (VlCovDet * self, vl_uindex first)
 {
   vl_index i, j  ;
   vl_bool dropFeaturesWithoutScale = VL_TRUE ;
-  vl_size numFeatures = vl_covdet_get_num_features(self) ;
-  memset(self->numFeaturesWithNumScales, 0,
-         sizeof(self->numFeaturesWithNumScales)) ;
+  vl_size numFeatures = vl_covdet_get_num_features(self) - first ;
+  VlCovDetFeatureLaplacianScale * allScales ;
+  vl_size * allNumScales ;
+
+  if (numFeatures == 0) return ;
+
+  allScales = vl_malloc(sizeof(VlCovDetFeatureLaplacianScale) *
+                        VL_COVDET_MAX_NUM_LAPLACIAN_SCALES * numFeatures) ;
+  allNumScales = vl_malloc(sizeof(vl_size) * numFeatures) ;
+  if (allScales == NULL || allNumScales == NULL) {
+    vl_set_last_error(VL_ERR_ALLOC, "Unable to allocate data.") ;
+    goto done ;
+  }
+
+#if defined(_OPENMP)
+#pragma omp parallel default(shared) private(i) num_threads(vl_get_max_threads()) \
+  if(numFeatures >= 2 * VL_COVDET_PARALLEL_CHUNK_SIZE)
+#endif
+  {
+    VlCovDetWorkspace * workspace = _vl_covdet_new_workspace() ;
+#if defined(_OPENMP)
+#pragma omp for schedule(dynamic, VL_COVDET_PARALLEL_CHUNK_SIZE)
+#endif
+    for (i = 0 ; i < (signed)numFeatures ; ++i) {
+      VlCovDetFeatureLaplacianScale const * scales = NULL ;
+      allNumScales[i] = 0 ;
+      if (workspace) {
+        scales = _vl_covdet_extract_laplacian_scales_for_frame
+        (self, workspace, allNumScales + i, self->features[first + i].frame) ;
+      }
+      if (scales) {
+        memcpy(allScales + VL_COVDET_MAX_NUM_LAPLACIAN_SCALES * i,
+               scales,
+               sizeof(VlCovDetFeatureLaplacianScale) * allNumScales[i]) ;
+      } else {
+        allNumScales[i] = 0 ;
+      }
+    }
+    _vl_covdet_delete_workspace(workspace) ;
+  }
 
   for (i = 0 ; i < (signed)numFeatures ; ++i) {
-    vl_size numScales ;
-    VlCovDetFeature feature = self->features[i] ;
+    vl_size numScales = allNumScales[i] ;
+    VlCovDetFeature feature = self->features[first + i] ;
     VlCovDetFeatureLaplacianScale const * scales =
-    vl_covdet_extract_laplacian_scales_for_frame(self, &numScales, feature.frame) ;
+    allScales + VL_COVDET_MAX_NUM_LAPLACIAN_SCALES * i ;
 
     self->numFeaturesWithNumScales[numScales] ++ ;
 
     if (numScales == 0 && dropFeaturesWithoutScale) {
-      self->features[i].peakScore = 0 ;
+      self->features[first + i].peakScore = 0 ;
     }
 
     for (j = 0 ; j < (signed)numScales ; ++j) {
       VlCovDetFeature * scaled ;
 
       if (j == 0) {
-        scaled = & self->features[i] ;
+        scaled = & self->features[first + i] ;
       } else {
         vl_covdet_append_feature(self, &feature) ;
         scaled = & self->features[self->numFeatures -1] ;
@@ -3064,8 +4154,8 @@ vl_covdet_extract_laplacian_scales (VlCovDet * self)
     }
   }
   if (dropFeaturesWithoutScale) {
-    j = 0 ;
-    for (i = 0 ; i < (signed)self->numFeatures ; ++i) {
+    j = first ;
+    for (i = first ; i < (signed)self->numFeatures ; ++i) {
       VlCovDetFeature feature = self->features[i] ;
       if (feature.peakScore) {
         self->features[j++] = feature ;
@@ -3074,6 +4164,95 @@ vl_covdet_extract_laplacian_scales (VlCovDet * self)
     self->numFeatures = j ;
   }
 
+done:
+  if (allScales) vl_free(allScales) ;
+  if (allNumScales) vl_free(allNumScales) ;
+}
+
+/** @brief Extract the Laplacian scales for the stored features
+ ** @param self object.
+ **
+ ** Note that, since more than one orientation can be detected
+ ** for each feature, this function may create copies of them,
+ ** one for each orientation.
+ **
+ ** As for ::vl_covdet_extract_orientations, the scales are computed
+ ** in parallel and the result does not depend on the number of
+ ** threads.
+ **/
+void
+vl_covdet_extract_laplacian_scales (VlCovDet * self)
+{
+  memset(self->numFeaturesWithNumScales, 0,
+         sizeof(self->numFeaturesWithNumScales)) ;
+  _vl_covdet_extract_laplacian_scales_from (self, 0) ;
+}
+
+/** @internal
+ ** @brief Extract the Laplacian scales for the features within the budget
+ ** @param self object.
+ **
+ ** The function is like ::vl_covdet_extract_laplacian_scales, but
+ ** with a feature budget (::vl_covdet_set_max_num_features) it
+ ** processes the features in the order of ::_vl_covdet_rank_features
+ ** and stops when there are enough features with a scale to meet the
+ ** budget. Features without a scale are dropped and replaced by the
+ ** next ones, and features with several scales may exceed the
+ ** budget, so the result is meant to be reduced to the budget again.
+ **
+ ** The features are processed in batches, each of which retains the
+ ** detection order.
+ **/
+
+static void
+_vl_covdet_extract_laplacian_scales_within_budget (VlCovDet * self)
+{
+  vl_size const numCandidates = self->numFeatures ;
+  vl_size const maxNumFeatures = self->maxNumFeatures ;
+  VlCovDetRankedFeature * ranked ;
+  VlCovDetFeature * candidates ;
+  vl_uindex next = 0 ;
+  vl_uindex i ;
+
+  if (maxNumFeatures == 0 || numCandidates <= maxNumFeatures) {
+    vl_covdet_extract_laplacian_scales (self) ;
+    return ;
+  }
+
+  ranked = vl_malloc(sizeof(VlCovDetRankedFeature) * numCandidates) ;
+  candidates = vl_malloc(sizeof(VlCovDetFeature) * numCandidates) ;
+  if (ranked == NULL || candidates == NULL) {
+    vl_set_last_error(VL_ERR_ALLOC, "Unable to allocate data.") ;
+    vl_covdet_extract_laplacian_scales (self) ;
+    goto done ;
+  }
+
+  _vl_covdet_rank_features(self, ranked) ;
+  memcpy(candidates, self->features, sizeof(VlCovDetFeature) * numCandidates) ;
+  memset(self->numFeaturesWithNumScales, 0,
+         sizeof(self->numFeaturesWithNumScales)) ;
+  self->numFeatures = 0 ;
+
+  while (self->numFeatures < maxNumFeatures && next < numCandidates) {
+    vl_size const first = self->numFeatures ;
+    vl_size const batch = VL_MIN(VL_MAX(maxNumFeatures - first,
+                                        2 * VL_COVDET_PARALLEL_CHUNK_SIZE),
+                                 numCandidates - next) ;
+    qsort(ranked + next, batch, sizeof(VlCovDetRankedFeature),
+          _vl_covdet_compare_ranked_by_index) ;
+    for (i = next ; i < next + batch ; ++i) {
+      if (vl_covdet_append_feature(self, candidates + ranked[i].index)) {
+        vl_set_last_error(VL_ERR_ALLOC, "Unable to allocate data.") ;
+        goto done ;
+      }
+    }
+    next += batch ;
+    _vl_covdet_extract_laplacian_scales_from(self, first) ;
+  }
+
+done:
+  if (ranked) vl_free(ranked) ;
+  if (candidates) vl_free(candidates) ;
 }
 
 /* ---------------------------------------------------------------- */
@@ -3421,6 +4600,76 @@ vl_covdet_get_num_non_extrema_suppressed (VlCovDet const * self)
   return self->numNonExtremaSuppressed ;
 }
 
+/* ---------------------------------------------------------------- */
+/** @brief Get the feature budget
+ ** @param self object.
+ ** @return maximum number of detected features (0 for no limit).
+ **/
+
+vl_size
+vl_covdet_get_max_num_features (VlCovDet const * self)
+{
+  return self->maxNumFeatures ;
+}
+
+/** @brief Set the feature budget
+ ** @param self object.
+ ** @param n maximum number of detected features (0 for no limit).
+ **
+ ** If @a n is not zero, ::vl_covdet_detect returns at most @a n
+ ** features, selected to be spread over the image: the image is
+ ** divided in a grid (::vl_covdet_set_budget_grid_size) and each
+ ** cell keeps its strongest features, so that dense textured
+ ** regions do not take the whole budget. The selection is done
+ ** after non-extrema suppression, so that the expensive
+ ** ::vl_covdet_extract_affine_shape and
+ ** ::vl_covdet_extract_orientations process at most @a n features.
+ **
+ ** With ::VL_COVDET_METHOD_HARRIS_LAPLACE and
+ ** ::VL_COVDET_METHOD_HESSIAN_LAPLACE, the features are also ranked
+ ** for the budget before the Laplacian scale selection, which
+ ** processes them in that order and stops once @a n of them have a
+ ** scale. The selection is then repeated after non-extrema
+ ** suppression to remove the extra scales. Features suppressed at
+ ** that point are not replaced, so that fewer than @a n features may
+ ** be returned.
+ **/
+
+void
+vl_covdet_set_max_num_features (VlCovDet * self, vl_size n)
+{
+  self->maxNumFeatures = n ;
+}
+
+/** @brief Get the size of the feature budget grid
+ ** @param self object.
+ ** @return number of cells along each side of the image.
+ **/
+
+vl_size
+vl_covdet_get_budget_grid_size (VlCovDet const * self)
+{
+  return self->budgetGridSize ;
+}
+
+/** @brief Set the size of the feature budget grid
+ ** @param self object.
+ ** @param n number of cells along each side of the image.
+ **
+ ** The default is 8, i.e. a grid of 8 x 8 cells. A finer grid
+ ** spreads the features more uniformly. A grid of size 1 keeps
+ ** the strongest features regardless of their location.
+ **
+ ** @sa ::vl_covdet_set_max_num_features
+ **/
+
+void
+vl_covdet_set_budget_grid_size (VlCovDet * self, vl_size n)
+{
+  assert(n >= 1) ;
+  self->budgetGridSize = n ;
+}
+
 
 /* ---------------------------------------------------------------- */
 /** @brief Get number of stored frames
@@ -3507,3 +4756,30 @@ vl_covdet_set_allow_padded_warping (VlCovDet * self, vl_bool t)
 {
   self->allowPaddedWarping = t ;
 }
+
+/** @brief Get whether features are made upright
+ ** @param self object.
+ ** @return whether features are made upright.
+ **/
+vl_bool
+vl_covdet_get_upright (VlCovDet const * self)
+{
+  return self->upright ;
+}
+
+/** @brief Set whether features are made upright
+ ** @param self object.
+ ** @param t whether features are made upright.
+ **
+ ** In upright mode, ::vl_covdet_extract_orientations does not
+ ** estimate the dominant orientation of the features, but rotates
+ ** them so that they do not rotate the vertical axis (the horizontal
+ ** one if ::vl_covdet_set_transposed is set). Features that
+ ** are already upright, such as the ones returned by the detector
+ ** and by ::vl_covdet_extract_affine_shape, are left unchanged.
+ **/
+void
+vl_covdet_set_upright (VlCovDet * self, vl_bool t)
+{
+  self->upright = t ;
+}
@@ -194,6 +194,11 @@ VL_EXPORT void vl_covdet_reset (VlCovDet * self) ;
 VL_EXPORT int vl_covdet_put_image (VlCovDet * self,
                                     float const * image,
                                     vl_size width, vl_size height) ;
+VL_EXPORT int vl_covdet_put_image_region (VlCovDet * self,
+                                           float const * image,
+                                           vl_size width, vl_size height,
+                                           vl_index xmin, vl_index ymin,
+                                           vl_index xmax, vl_index ymax) ;
 
 VL_EXPORT void vl_covdet_detect (VlCovDet * self) ;
 VL_EXPORT int vl_covdet_append_feature (VlCovDet * self, VlCovDetFeature const * feature) ;
@@ -222,6 +227,14 @@ vl_covdet_extract_patch_for_frame (VlCovDet * self, float * patch,
                                    double sigma,
                                    VlFrameOrientedEllipse frame) ;
 
+VL_EXPORT int
+vl_covdet_extract_patches (VlCovDet * self, float * patches, int * status,
+                           vl_size resolution,
+                           double extent,
+                           double sigma,
+                           VlFrameOrientedEllipse const * frames,
+                           vl_size numFrames) ;
+
 VL_EXPORT void
 vl_covdet_drop_features_outside (VlCovDet * self, double margin) ;
 /** @} */
@@ -246,6 +259,9 @@ VL_EXPORT vl_size const * vl_covdet_get_laplacian_scales_statistics (VlCovDet co
 VL_EXPORT double vl_covdet_get_non_extrema_suppression_threshold (VlCovDet const * self) ;
 VL_EXPORT vl_size vl_covdet_get_num_non_extrema_suppressed (VlCovDet const * self) ;
 VL_EXPORT vl_bool vl_covdet_get_allow_padded_warping (VlCovDet const * self) ;
+VL_EXPORT vl_bool vl_covdet_get_upright (VlCovDet const * self) ;
+VL_EXPORT vl_size vl_covdet_get_max_num_features (VlCovDet const * self) ;
+VL_EXPORT vl_size vl_covdet_get_budget_grid_size (VlCovDet const * self) ;
 /** @} */
 
 /** @name Set parameters
@@ -262,6 +278,9 @@ VL_EXPORT void vl_covdet_set_transposed (VlCovDet * self, vl_bool t) ;
 VL_EXPORT void vl_covdet_set_aa_accurate_smoothing (VlCovDet * self, vl_bool x) ;
 VL_EXPORT void vl_covdet_set_non_extrema_suppression_threshold (VlCovDet * self, double x) ;
 VL_EXPORT void vl_covdet_set_allow_padded_warping (VlCovDet * self, vl_bool x) ;
+VL_EXPORT void vl_covdet_set_upright (VlCovDet * self, vl_bool x) ;
+VL_EXPORT void vl_covdet_set_max_num_features (VlCovDet * self, vl_size n) ;
+VL_EXPORT void vl_covdet_set_budget_grid_size (VlCovDet * self, vl_size n) ;
 /** @} */
 
 /* VL_COVDET_H */
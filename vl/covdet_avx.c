@@ -0,0 +1,143 @@
+/** @file covdet_avx.c
+ ** @brief Covariant feature detectors - AVX - Definition
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_DISABLE_AVX
+
+#ifndef __AVX__
+#error Compiling AVX functions but AVX does not seem to be supported by the compiler.
+#endif
+
+#include <immintrin.h>
+#include "covdet_avx.h"
+
+/*
+ These are the same kernels as in covdet_sse2.c, processing eight
+ pixels at a time. The results are identical to the scalar code in
+ covdet.c.
+ */
+
+/* convert the lower and upper halves of a float vector to double */
+#define VLO(v) _mm256_cvtps_pd (_mm256_castps256_ps128 (v))
+#define VHI(v) _mm256_cvtps_pd (_mm256_extractf128_ps ((v), 1))
+/* convert two double vectors back to a float vector */
+#define VJOIN(a,b) _mm256_insertf128_ps \
+  (_mm256_castps128_ps256 (_mm256_cvtpd_ps (a)), _mm256_cvtpd_ps (b), 1)
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the determinant of the Hessian of a run of pixels
+ **
+ ** Same as ::_vl_covdet_hessian_sse2, but processes the pixels in
+ ** groups of eight.
+ **/
+
+vl_size
+_vl_covdet_hessian_avx (float *response,
+                        float const *src,
+                        vl_size numPixels,
+                        vl_index yo,
+                        float factor)
+{
+  __m256 const two = _mm256_set1_ps (2.0f) ;
+  __m256 const quarter = _mm256_set1_ps (0.25f) ;
+  __m256 const vfactor = _mm256_set1_ps (factor) ;
+  vl_size i ;
+
+  for (i = 0 ; i + 8 <= numPixels ; i += 8) {
+    float const * pt = src + i ;
+    __m256 c2 = _mm256_mul_ps (two, _mm256_loadu_ps (pt)) ;
+    __m256 lxx = _mm256_sub_ps (_mm256_sub_ps (c2, _mm256_loadu_ps (pt - 1)),
+                                _mm256_loadu_ps (pt + 1)) ;
+    __m256 lyy = _mm256_sub_ps (_mm256_sub_ps (c2, _mm256_loadu_ps (pt - yo)),
+                                _mm256_loadu_ps (pt + yo)) ;
+    __m256 lxy = _mm256_sub_ps (_mm256_loadu_ps (pt - yo - 1),
+                                _mm256_loadu_ps (pt + yo - 1)) ;
+    lxy = _mm256_sub_ps (lxy, _mm256_loadu_ps (pt - yo + 1)) ;
+    lxy = _mm256_add_ps (lxy, _mm256_loadu_ps (pt + yo + 1)) ;
+    lxy = _mm256_mul_ps (lxy, quarter) ;
+    _mm256_storeu_ps (response + i,
+                      _mm256_mul_ps (_mm256_sub_ps (_mm256_mul_ps (lxx, lyy),
+                                                    _mm256_mul_ps (lxy, lxy)),
+                                     vfactor)) ;
+  }
+  return i ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the gradient products of a run of pixels
+ **
+ ** Same as ::_vl_covdet_harris_products_sse2, but processes the
+ ** pixels in groups of eight.
+ **/
+
+vl_size
+_vl_covdet_harris_products_avx (float *xx, float *yy, float *xy,
+                                float const *src,
+                                vl_size numPixels,
+                                vl_index up, vl_index down,
+                                float dyscale)
+{
+  __m256 const half = _mm256_set1_ps (0.5f) ;
+  __m256 const vdyscale = _mm256_set1_ps (dyscale) ;
+  vl_size i ;
+
+  for (i = 0 ; i + 8 <= numPixels ; i += 8) {
+    float const * pt = src + i ;
+    __m256 gx = _mm256_mul_ps (half, _mm256_sub_ps (_mm256_loadu_ps (pt + 1),
+                                                    _mm256_loadu_ps (pt - 1))) ;
+    __m256 gy = _mm256_mul_ps (vdyscale, _mm256_sub_ps (_mm256_loadu_ps (pt + down),
+                                                        _mm256_loadu_ps (pt - up))) ;
+    _mm256_storeu_ps (xx + i, _mm256_mul_ps (gx, gx)) ;
+    _mm256_storeu_ps (yy + i, _mm256_mul_ps (gy, gy)) ;
+    _mm256_storeu_ps (xy + i, _mm256_mul_ps (gx, gy)) ;
+  }
+  return i ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the Harris cornerness of a run of pixels
+ **
+ ** Same as ::_vl_covdet_harris_sse2, but processes the pixels in
+ ** groups of eight.
+ **/
+
+vl_size
+_vl_covdet_harris_avx (float *response,
+                       float const *xx,
+                       float const *yy,
+                       float const *xy,
+                       vl_size numPixels,
+                       float factor, double alpha)
+{
+  __m256d const vfactor = _mm256_set1_pd ((double) factor) ;
+  __m256d const valpha = _mm256_set1_pd (alpha) ;
+  vl_size i ;
+
+  for (i = 0 ; i + 8 <= numPixels ; i += 8) {
+    __m256 a = _mm256_loadu_ps (xx + i) ;
+    __m256 b = _mm256_loadu_ps (yy + i) ;
+    __m256 c = _mm256_loadu_ps (xy + i) ;
+    __m256 det = _mm256_sub_ps (_mm256_mul_ps (a, b), _mm256_mul_ps (c, c)) ;
+    __m256 trace = _mm256_add_ps (a, b) ;
+    __m256 trace2 = _mm256_mul_ps (trace, trace) ;
+    __m256d lo = _mm256_mul_pd (vfactor, _mm256_sub_pd (VLO(det), _mm256_mul_pd (valpha, VLO(trace2)))) ;
+    __m256d hi = _mm256_mul_pd (vfactor, _mm256_sub_pd (VHI(det), _mm256_mul_pd (valpha, VHI(trace2)))) ;
+    _mm256_storeu_ps (response + i, VJOIN (lo, hi)) ;
+  }
+  return i ;
+}
+
+/* ! VL_DISABLE_AVX */
+#endif
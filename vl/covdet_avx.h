@@ -0,0 +1,46 @@
+/** @file covdet_avx.h
+ ** @brief Covariant feature detectors - AVX
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_COVDET_AVX_H
+#define VL_COVDET_AVX_H
+
+#include "generic.h"
+
+#ifndef VL_DISABLE_AVX
+
+VL_EXPORT
+vl_size _vl_covdet_hessian_avx (float *response,
+                                float const *src,
+                                vl_size numPixels,
+                                vl_index yo,
+                                float factor) ;
+
+VL_EXPORT
+vl_size _vl_covdet_harris_products_avx (float *xx, float *yy, float *xy,
+                                        float const *src,
+                                        vl_size numPixels,
+                                        vl_index up, vl_index down,
+                                        float dyscale) ;
+
+VL_EXPORT
+vl_size _vl_covdet_harris_avx (float *response,
+                               float const *xx,
+                               float const *yy,
+                               float const *xy,
+                               vl_size numPixels,
+                               float factor, double alpha) ;
+
+#endif
+
+/* VL_COVDET_AVX_H */
+#endif
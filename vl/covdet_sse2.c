@@ -0,0 +1,161 @@
+/** @file covdet_sse2.c
+ ** @brief Covariant feature detectors - SSE2 - Definition
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#if ! defined(VL_DISABLE_SSE2) & ! defined(__SSE2__)
+#error "Compiling with SSE2 enabled, but no __SSE2__ defined"
+#endif
+
+#if ! defined(VL_DISABLE_SSE2)
+
+#include <emmintrin.h>
+#include "covdet_sse2.h"
+
+/*
+ The kernels in this file replicate exactly the sequence of single
+ and double precision operations of the scalar code in covdet.c, so
+ that the cornerness measures are identical. Multiplying by 0.5 and
+ 0.25 instead of dividing by 2 and 4 is exact.
+ */
+
+/* convert the lower and upper halves of a float vector to double */
+#define VLO(v) _mm_cvtps_pd (v)
+#define VHI(v) _mm_cvtps_pd (_mm_movehl_ps ((v), (v)))
+/* convert two double vectors back to a float vector */
+#define VJOIN(a,b) _mm_movelh_ps (_mm_cvtpd_ps (a), _mm_cvtpd_ps (b))
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the determinant of the Hessian of a run of pixels
+ ** @param response output (one value per pixel).
+ ** @param src first input pixel.
+ ** @param numPixels number of pixels.
+ ** @param yo stride between image rows.
+ ** @param factor normalization factor.
+ ** @return number of pixels processed (a multiple of four).
+ **
+ ** The pixels must have a neighbor on each side in the image.
+ **/
+
+vl_size
+_vl_covdet_hessian_sse2 (float *response,
+                         float const *src,
+                         vl_size numPixels,
+                         vl_index yo,
+                         float factor)
+{
+  __m128 const two = _mm_set1_ps (2.0f) ;
+  __m128 const quarter = _mm_set1_ps (0.25f) ;
+  __m128 const vfactor = _mm_set1_ps (factor) ;
+  vl_size i ;
+
+  for (i = 0 ; i + 4 <= numPixels ; i += 4) {
+    float const * pt = src + i ;
+    __m128 c2 = _mm_mul_ps (two, _mm_loadu_ps (pt)) ;
+    __m128 lxx = _mm_sub_ps (_mm_sub_ps (c2, _mm_loadu_ps (pt - 1)),
+                             _mm_loadu_ps (pt + 1)) ;
+    __m128 lyy = _mm_sub_ps (_mm_sub_ps (c2, _mm_loadu_ps (pt - yo)),
+                             _mm_loadu_ps (pt + yo)) ;
+    __m128 lxy = _mm_sub_ps (_mm_loadu_ps (pt - yo - 1),
+                             _mm_loadu_ps (pt + yo - 1)) ;
+    lxy = _mm_sub_ps (lxy, _mm_loadu_ps (pt - yo + 1)) ;
+    lxy = _mm_add_ps (lxy, _mm_loadu_ps (pt + yo + 1)) ;
+    lxy = _mm_mul_ps (lxy, quarter) ;
+    _mm_storeu_ps (response + i,
+                   _mm_mul_ps (_mm_sub_ps (_mm_mul_ps (lxx, lyy),
+                                           _mm_mul_ps (lxy, lxy)),
+                               vfactor)) ;
+  }
+  return i ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the gradient products of a run of pixels
+ ** @param xx output squared horizontal derivative.
+ ** @param yy output squared vertical derivative.
+ ** @param xy output product of the derivatives.
+ ** @param src first input pixel.
+ ** @param numPixels number of pixels.
+ ** @param up offset to the pixel above (zero on the first row).
+ ** @param down offset to the pixel below (zero on the last row).
+ ** @param dyscale scale of the vertical difference.
+ ** @return number of pixels processed (a multiple of four).
+ **
+ ** The pixels must have a neighbor on the left and on the right.
+ **/
+
+vl_size
+_vl_covdet_harris_products_sse2 (float *xx, float *yy, float *xy,
+                                 float const *src,
+                                 vl_size numPixels,
+                                 vl_index up, vl_index down,
+                                 float dyscale)
+{
+  __m128 const half = _mm_set1_ps (0.5f) ;
+  __m128 const vdyscale = _mm_set1_ps (dyscale) ;
+  vl_size i ;
+
+  for (i = 0 ; i + 4 <= numPixels ; i += 4) {
+    float const * pt = src + i ;
+    __m128 gx = _mm_mul_ps (half, _mm_sub_ps (_mm_loadu_ps (pt + 1),
+                                              _mm_loadu_ps (pt - 1))) ;
+    __m128 gy = _mm_mul_ps (vdyscale, _mm_sub_ps (_mm_loadu_ps (pt + down),
+                                                  _mm_loadu_ps (pt - up))) ;
+    _mm_storeu_ps (xx + i, _mm_mul_ps (gx, gx)) ;
+    _mm_storeu_ps (yy + i, _mm_mul_ps (gy, gy)) ;
+    _mm_storeu_ps (xy + i, _mm_mul_ps (gx, gy)) ;
+  }
+  return i ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the Harris cornerness of a run of pixels
+ ** @param response output (one value per pixel).
+ ** @param xx smoothed squared horizontal derivative.
+ ** @param yy smoothed squared vertical derivative.
+ ** @param xy smoothed product of the derivatives.
+ ** @param numPixels number of pixels.
+ ** @param factor normalization factor.
+ ** @param alpha weight of the squared trace.
+ ** @return number of pixels processed (a multiple of four).
+ **/
+
+vl_size
+_vl_covdet_harris_sse2 (float *response,
+                        float const *xx,
+                        float const *yy,
+                        float const *xy,
+                        vl_size numPixels,
+                        float factor, double alpha)
+{
+  __m128d const vfactor = _mm_set1_pd ((double) factor) ;
+  __m128d const valpha = _mm_set1_pd (alpha) ;
+  vl_size i ;
+
+  for (i = 0 ; i + 4 <= numPixels ; i += 4) {
+    __m128 a = _mm_loadu_ps (xx + i) ;
+    __m128 b = _mm_loadu_ps (yy + i) ;
+    __m128 c = _mm_loadu_ps (xy + i) ;
+    __m128 det = _mm_sub_ps (_mm_mul_ps (a, b), _mm_mul_ps (c, c)) ;
+    __m128 trace = _mm_add_ps (a, b) ;
+    __m128 trace2 = _mm_mul_ps (trace, trace) ;
+    __m128d lo = _mm_mul_pd (vfactor, _mm_sub_pd (VLO(det), _mm_mul_pd (valpha, VLO(trace2)))) ;
+    __m128d hi = _mm_mul_pd (vfactor, _mm_sub_pd (VHI(det), _mm_mul_pd (valpha, VHI(trace2)))) ;
+    _mm_storeu_ps (response + i, VJOIN (lo, hi)) ;
+  }
+  return i ;
+}
+
+/* ! VL_DISABLE_SSE2 */
+#endif
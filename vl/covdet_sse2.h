@@ -0,0 +1,46 @@
+/** @file covdet_sse2.h
+ ** @brief Covariant feature detectors - SSE2
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_COVDET_SSE2_H
+#define VL_COVDET_SSE2_H
+
+#include "generic.h"
+
+#ifndef VL_DISABLE_SSE2
+
+VL_EXPORT
+vl_size _vl_covdet_hessian_sse2 (float *response,
+                                 float const *src,
+                                 vl_size numPixels,
+                                 vl_index yo,
+                                 float factor) ;
+
+VL_EXPORT
+vl_size _vl_covdet_harris_products_sse2 (float *xx, float *yy, float *xy,
+                                         float const *src,
+                                         vl_size numPixels,
+                                         vl_index up, vl_index down,
+                                         float dyscale) ;
+
+VL_EXPORT
+vl_size _vl_covdet_harris_sse2 (float *response,
+                                float const *xx,
+                                float const *yy,
+                                float const *xy,
+                                vl_size numPixels,
+                                float factor, double alpha) ;
+
+#endif
+
+/* VL_COVDET_SSE2_H */
+#endif
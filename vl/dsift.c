@@ -19,6 +19,10 @@ the terms of the BSD license (see the COPYING file).
 #include <math.h>
 #include <string.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 /**
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
 @page dsift Dense Scale Invariant Feature Transform (DSIFT)
@@ -62,6 +66,17 @@ reweighted by the average of the Gaussian window over the spatial
 support of that bin. This &ldquo;approximation&rdquo; substantially
 improves speed with little or no loss of performance in applications.
 
+Descriptors can be post-processed as they are computed. The
+RootSIFT (Hellinger) mapping is enabled by ::vl_dsift_set_root_sift,
+and a linear projection (for example learned by PCA) is set by
+::vl_dsift_set_projection. In the latter case,
+::vl_dsift_get_descriptors returns directly the projected descriptors.
+Finally, ::vl_dsift_set_descriptor_type makes the filter produce
+descriptors quantized to 8 bits (without projection) or stored in
+IEEE half precision, which take respectively a quarter and half the
+memory of the single precision ones. This is useful to retain the
+dense features of many images at once.
+
 Keypoints are sampled in such a way that the centers of the spatial
 bins are at integer coordinates within the image boundaries. For
 instance, the top-left bin of the top-left descriptor is centered on
@@ -69,6 +84,10 @@ the pixel (0,0). The bin immediately to the right at
 (<code>binSizeX</code>,0), where <code>binSizeX</code> is a paramtere
 in the ::VlDsiftDescriptorGeometry structure. ::vl_dsift_set_bounds
 can be used to further restrict sampling to the keypoints in an image.
+To sample keypoints in several regions of the same image, such as
+object proposals, ::vl_dsift_process_rois processes a list of
+::VlDsiftRoi regions, each with its own bounds and steps, sharing the
+gradient computation among them.
 
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
  @section dsift-usage Usage
@@ -310,6 +329,31 @@ _vl_dsift_normalize_histogram (float * begin, float * end)
   return norm ;
 }
 
+/** ------------------------------------------------------------------
+ ** @internal @brief Map histogram to RootSIFT
+ ** @param begin first element of the histogram.
+ ** @param end last plus one element of the histogram.
+ **
+ ** The function normalizes the histogram in l1 norm and takes the
+ ** square root of its elements (Hellinger mapping).
+ **/
+
+VL_INLINE void
+_vl_dsift_root_histogram (float * begin, float * end)
+{
+  float * iter ;
+  float  norm = 0.0F ;
+
+  for (iter = begin ; iter < end ; ++ iter) {
+    norm += *iter ;
+  }
+  norm += VL_EPSILON_F ;
+
+  for (iter = begin; iter < end ; ++ iter) {
+    *iter = sqrtf (*iter / norm) ;
+  }
+}
+
 /** ------------------------------------------------------------------
  ** @internal @brief Free internal buffers
  ** @param self DSIFT filter.
@@ -339,27 +383,100 @@ _vl_dsift_free_buffers (VlDsiftFilter* self)
 }
 
 /** ------------------------------------------------------------------
- ** @internal @brief Updates internal buffers to current geometry
+ ** @internal @brief Set the sampled regions
+ ** @param self DSIFT filter.
+ ** @param rois regions.
+ ** @param numRois number of regions.
+ **
+ ** The function stores the regions, clipped to the image boundaries,
+ ** and updates the number of frames and the region offsets
+ ** accordingly.
+ **
+ ** @return error code. If the regions cannot be stored, the function
+ ** returns ::VL_ERR_ALLOC and the filter is left with no region.
  **/
 
-VL_EXPORT void
-_vl_dsift_update_buffers (VlDsiftFilter * self)
+static int
+_vl_dsift_set_rois (VlDsiftFilter * self,
+                    VlDsiftRoi const * rois, vl_size numRois)
 {
-  int x1 = self->boundMinX ;
-  int x2 = self->boundMaxX ;
-  int y1 = self->boundMinY ;
-  int y2 = self->boundMaxY ;
-
-  int rangeX = x2 - x1 - (self->geom.numBinX - 1) * self->geom.binSizeX ;
-  int rangeY = y2 - y1 - (self->geom.numBinY - 1) * self->geom.binSizeY ;
+  vl_size r ;
+  int spanX = (self->geom.numBinX - 1) * self->geom.binSizeX ;
+  int spanY = (self->geom.numBinY - 1) * self->geom.binSizeY ;
 
-  int numFramesX = (rangeX >= 0) ? rangeX / self->stepX + 1 : 0 ;
-  int numFramesY = (rangeY >= 0) ? rangeY / self->stepY + 1 : 0 ;
-
-  self->numFrames = numFramesX * numFramesY ;
   self->descrSize = self->geom.numBinT *
                     self->geom.numBinX *
                     self->geom.numBinY ;
+
+  if (self->roiOffsets == NULL || numRois > self->numRoiAlloc) {
+    vl_size numRoiAlloc = VL_MAX(numRois, 1) ;
+    VlDsiftRoi * newRois = vl_malloc (sizeof(VlDsiftRoi) * numRoiAlloc) ;
+    vl_size * newRoiOffsets = vl_malloc (sizeof(vl_size) * (numRoiAlloc + 1)) ;
+    if (newRois == NULL || newRoiOffsets == NULL) {
+      if (newRois) vl_free (newRois) ;
+      if (newRoiOffsets) vl_free (newRoiOffsets) ;
+      if (self->roiOffsets) self->roiOffsets [0] = 0 ;
+      self->numRois = 0 ;
+      self->numFrames = 0 ;
+      return vl_set_last_error (VL_ERR_ALLOC, "Unable to allocate the regions.") ;
+    }
+    if (self->rois) vl_free (self->rois) ;
+    if (self->roiOffsets) vl_free (self->roiOffsets) ;
+    self->rois = newRois ;
+    self->roiOffsets = newRoiOffsets ;
+    self->numRoiAlloc = numRoiAlloc ;
+  }
+
+  self->roiOffsets [0] = 0 ;
+  for (r = 0 ; r < numRois ; ++r) {
+    VlDsiftRoi * roi = self->rois + r ;
+    int rangeX, rangeY, numFramesX, numFramesY ;
+
+    assert (rois [r].stepX >= 1 && rois [r].stepY >= 1) ;
+    *roi = rois [r] ;
+    roi->minX = VL_MAX (roi->minX, 0) ;
+    roi->minY = VL_MAX (roi->minY, 0) ;
+    roi->maxX = VL_MIN (roi->maxX, self->imWidth - 1) ;
+    roi->maxY = VL_MIN (roi->maxY, self->imHeight - 1) ;
+
+    rangeX = roi->maxX - roi->minX - spanX ;
+    rangeY = roi->maxY - roi->minY - spanY ;
+    numFramesX = (rangeX >= 0) ? rangeX / roi->stepX + 1 : 0 ;
+    numFramesY = (rangeY >= 0) ? rangeY / roi->stepY + 1 : 0 ;
+    self->roiOffsets [r + 1] = self->roiOffsets [r] + numFramesX * numFramesY ;
+  }
+
+  self->numRois = numRois ;
+  self->numFrames = (int) self->roiOffsets [numRois] ;
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Updates internal buffers to current geometry
+ **
+ ** The sampled regions are reset to the single region given by the
+ ** bounds and steps, so that the number of keypoints and the region
+ ** offsets are consistent with the new parameters. If memory is
+ ** insufficient, no region is left and ::vl_dsift_process reports
+ ** the error.
+ **/
+
+VL_EXPORT void
+_vl_dsift_update_buffers (VlDsiftFilter * self)
+{
+  VlDsiftRoi roi ;
+  roi.minX = self->boundMinX ;
+  roi.minY = self->boundMinY ;
+  roi.maxX = self->boundMaxX ;
+  roi.maxY = self->boundMaxY ;
+  roi.stepX = self->stepX ;
+  roi.stepY = self->stepY ;
+  _vl_dsift_set_rois (self, &roi, 1) ;
+
+  /* a projection for a different descriptor geometry is dropped */
+  if (self->projection && self->projectionInputSize != self->descrSize) {
+    vl_dsift_set_projection (self, NULL, NULL, 0) ;
+  }
 }
 
 /** ------------------------------------------------------------------
@@ -367,16 +484,18 @@ _vl_dsift_update_buffers (VlDsiftFilter * self)
  ** @param self DSIFT filter.
  **
  ** The function (re)allocates the internal buffers in accordance with
- ** the current image and descriptor geometry.
+ ** the current image and descriptor geometry and with the regions set
+ ** by ::_vl_dsift_set_rois.
+ **
+ ** @return error code. On failure the buffers are released.
  **/
 
-static void
+static int
 _vl_dsift_alloc_buffers (VlDsiftFilter* self)
 {
-  _vl_dsift_update_buffers (self) ;
   {
     int numFrameAlloc = vl_dsift_get_keypoint_num (self) ;
-    int numBinAlloc   = vl_dsift_get_descriptor_size (self) ;
+    int numBinAlloc   = self->descrSize ;
     int numGradAlloc  = self->geom.numBinT ;
 
     /* see if we need to update the buffers */
@@ -385,21 +504,29 @@ _vl_dsift_alloc_buffers (VlDsiftFilter* self)
         numFrameAlloc != self->numFrameAlloc) {
 
       int t ;
+      vl_bool ok ;
 
       _vl_dsift_free_buffers(self) ;
 
-      self->frames = vl_malloc(sizeof(VlDsiftKeypoint) * numFrameAlloc) ;
-      self->descrs = vl_malloc(sizeof(float) * numBinAlloc * numFrameAlloc) ;
-      self->grads  = vl_malloc(sizeof(float*) * numGradAlloc) ;
-      for (t = 0 ; t < numGradAlloc ; ++t) {
+      self->frames = vl_malloc(sizeof(VlDsiftKeypoint) * VL_MAX(numFrameAlloc, 1)) ;
+      self->descrs = vl_malloc(sizeof(float) * VL_MAX(numBinAlloc * numFrameAlloc, 1)) ;
+      self->grads  = vl_calloc(numGradAlloc, sizeof(float*)) ;
+      self->numGradAlloc = numGradAlloc ;
+      ok = self->frames && self->descrs && self->grads ;
+      for (t = 0 ; t < numGradAlloc && ok ; ++t) {
         self->grads[t] =
           vl_malloc(sizeof(float) * self->imWidth * self->imHeight) ;
+        ok = (self->grads[t] != NULL) ;
+      }
+      if (! ok) {
+        _vl_dsift_free_buffers(self) ;
+        return vl_set_last_error (VL_ERR_ALLOC, "Unable to allocate the descriptor buffers.") ;
       }
       self->numBinAlloc = numBinAlloc ;
-      self->numGradAlloc = numGradAlloc ;
       self->numFrameAlloc = numFrameAlloc ;
     }
   }
+  return VL_ERR_OK ;
 }
 
 /** ------------------------------------------------------------------
@@ -408,13 +535,14 @@ _vl_dsift_alloc_buffers (VlDsiftFilter* self)
  ** @param imWidth width of the image.
  ** @param imHeight height of the image
  **
- ** @return new filter.
+ ** @return new filter or @c NULL if the filter cannot be allocated.
  **/
 
 VL_EXPORT VlDsiftFilter *
 vl_dsift_new (int imWidth, int imHeight)
 {
   VlDsiftFilter * self = vl_malloc (sizeof(VlDsiftFilter)) ;
+  if (self == NULL) return NULL ;
   self->imWidth  = imWidth ;
   self->imHeight = imHeight ;
 
@@ -434,6 +562,13 @@ vl_dsift_new (int imWidth, int imHeight)
 
   self->useFlatWindow = VL_FALSE ;
   self->windowSize = 2.0 ;
+  self->useRootSift = VL_FALSE ;
+  self->descriptorType = VlDsiftDescriptorFloat ;
+
+  self->projection = NULL ;
+  self->projectionMean = NULL ;
+  self->projectionDimension = 0 ;
+  self->projectionInputSize = 0 ;
 
   self->convTmp1 = vl_malloc(sizeof(float) * self->imWidth * self->imHeight) ;
   self->convTmp2 = vl_malloc(sizeof(float) * self->imWidth * self->imHeight) ;
@@ -447,6 +582,17 @@ vl_dsift_new (int imWidth, int imHeight)
   self->grads = NULL ;
   self->frames = NULL ;
   self->descrs = NULL ;
+  self->descrsType = VlDsiftDescriptorFloat ;
+
+  self->rois = NULL ;
+  self->numRois = 0 ;
+  self->numRoiAlloc = 0 ;
+  self->roiOffsets = NULL ;
+
+  if (self->convTmp1 == NULL || self->convTmp2 == NULL) {
+    vl_dsift_delete (self) ;
+    return NULL ;
+  }
 
   _vl_dsift_update_buffers(self) ;
   return self ;
@@ -467,7 +613,9 @@ VL_EXPORT VlDsiftFilter *
 vl_dsift_new_basic (int imWidth, int imHeight, int step, int binSize)
 {
   VlDsiftFilter* self = vl_dsift_new(imWidth, imHeight) ;
-  VlDsiftDescriptorGeometry geom = *vl_dsift_get_geometry(self) ;
+  VlDsiftDescriptorGeometry geom ;
+  if (self == NULL) return NULL ;
+  geom = *vl_dsift_get_geometry(self) ;
   geom.binSizeX = binSize ;
   geom.binSizeY = binSize ;
   vl_dsift_set_geometry(self, &geom) ;
@@ -484,189 +632,498 @@ VL_EXPORT void
 vl_dsift_delete (VlDsiftFilter * self)
 {
   _vl_dsift_free_buffers (self) ;
+  if (self->rois) vl_free (self->rois) ;
+  if (self->roiOffsets) vl_free (self->roiOffsets) ;
   if (self->convTmp2) vl_free (self->convTmp2) ;
   if (self->convTmp1) vl_free (self->convTmp1) ;
+  if (self->projection) vl_free (self->projection) ;
+  if (self->projectionMean) vl_free (self->projectionMean) ;
   vl_free (self) ;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Set descriptor projection
+ ** @param self       DSIFT filter.
+ ** @param projection projection matrix (or @c NULL).
+ ** @param mean       projection mean (or @c NULL).
+ ** @param dimension  number of projections.
+ **
+ ** The function sets a linear projection @f$ P^\top (h - \mu) @f$
+ ** applied to the descriptors @f$ h @f$ after normalization (and
+ ** RootSIFT, see ::vl_dsift_set_root_sift). Let @c D be the size of
+ ** the descriptor for the current geometry. Then @a projection is a
+ ** @c D x @a dimension matrix stored by columns, @a mean is a
+ ** @c D-dimensional vector (or @c NULL for a zero mean), and
+ ** @a dimension must be in the range 1 to @c D. The data is copied
+ ** in the filter. Use @c NULL as @a projection to remove the
+ ** projection.
+ **
+ ** The projection must be set after the descriptor geometry. Once
+ ** it is set, ::vl_dsift_get_descriptors returns the projected
+ ** descriptors, of size ::vl_dsift_get_descriptor_size. Changing
+ ** the descriptor geometry afterwards (::vl_dsift_set_geometry)
+ ** removes the projection.
+ **
+ ** Projected descriptors may have negative components, which
+ ** cannot be represented by 8-bit descriptors. For this reason a
+ ** projection cannot be set if the descriptor type is
+ ** ::VlDsiftDescriptorUInt8 (see ::vl_dsift_set_descriptor_type).
+ **
+ ** @return error code. The function fails with ::VL_ERR_BAD_ARG if
+ ** @a dimension is invalid or the descriptor type is
+ ** ::VlDsiftDescriptorUInt8, and with ::VL_ERR_ALLOC if memory is
+ ** insufficient. In all cases the projection is removed.
+ **/
+
+VL_EXPORT int
+vl_dsift_set_projection (VlDsiftFilter * self,
+                         float const * projection,
+                         float const * mean,
+                         int dimension)
+{
+  int descrSize = self->descrSize ;
+
+  if (self->projection) vl_free (self->projection) ;
+  if (self->projectionMean) vl_free (self->projectionMean) ;
+  self->projection = NULL ;
+  self->projectionMean = NULL ;
+  self->projectionDimension = 0 ;
+  self->projectionInputSize = 0 ;
+
+  if (projection == NULL) return VL_ERR_OK ;
+
+  if (self->descriptorType == VlDsiftDescriptorUInt8) {
+    return vl_set_last_error (VL_ERR_BAD_ARG,
+                              "A projection cannot be used with 8-bit descriptors.") ;
+  }
+  if (dimension < 1 || dimension > descrSize) {
+    return vl_set_last_error (VL_ERR_BAD_ARG,
+                              "Projection dimension %d is not in the range 1 to %d.",
+                              dimension, descrSize) ;
+  }
+  self->projection = vl_malloc (sizeof(float) * descrSize * dimension) ;
+  if (mean) {
+    self->projectionMean = vl_malloc (sizeof(float) * descrSize) ;
+  }
+  if (self->projection == NULL || (mean && self->projectionMean == NULL)) {
+    vl_dsift_set_projection (self, NULL, NULL, 0) ;
+    return vl_set_last_error (VL_ERR_ALLOC, "Unable to allocate the projection.") ;
+  }
+  memcpy (self->projection, projection, sizeof(float) * descrSize * dimension) ;
+  if (mean) {
+    memcpy (self->projectionMean, mean, sizeof(float) * descrSize) ;
+  }
+  self->projectionDimension = dimension ;
+  self->projectionInputSize = descrSize ;
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the descriptor storage type
+ ** @param self DSIFT filter object.
+ ** @param type descriptor type.
+ **
+ ** If @a type is ::VlDsiftDescriptorUInt8 or ::VlDsiftDescriptorHalf,
+ ** ::vl_dsift_process converts the descriptors to that format after
+ ** normalization (and projection, if any). The conversion is done in
+ ** place, so that no memory is needed in addition to the single
+ ** precision descriptors used during the computation. The results
+ ** are retrieved by ::vl_dsift_get_descriptors_uint8 or
+ ** ::vl_dsift_get_descriptors_half respectively, while
+ ** ::vl_dsift_get_descriptors returns @c NULL. Keypoints and their
+ ** norms are not affected.
+ **
+ ** 8-bit descriptors are obtained by the same rule used by the
+ ** MATLAB interface, i.e. by multiplying the components by 512,
+ ** truncating, and clamping the result to the range [0, 255]. This
+ ** is appropriate for the normalized descriptors, whose components
+ ** are in the range [0, 1], but not for projected ones, which may be
+ ** negative; hence 8-bit descriptors cannot be combined with a
+ ** projection (::vl_dsift_set_projection). Half precision
+ ** descriptors are rounded to the nearest representable value and
+ ** can be decoded by ::vl_half_to_float.
+ **
+ ** @return error code. The function fails with ::VL_ERR_BAD_ARG,
+ ** leaving the type unchanged, if @a type is not a valid type or if
+ ** it is ::VlDsiftDescriptorUInt8 and a projection is set.
+ **/
+
+VL_EXPORT int
+vl_dsift_set_descriptor_type (VlDsiftFilter * self, VlDsiftDescriptorType type)
+{
+  if (type != VlDsiftDescriptorFloat &&
+      type != VlDsiftDescriptorUInt8 &&
+      type != VlDsiftDescriptorHalf) {
+    return vl_set_last_error (VL_ERR_BAD_ARG,
+                              "Unknown descriptor type %d.", (int) type) ;
+  }
+  if (type == VlDsiftDescriptorUInt8 && self->projection) {
+    return vl_set_last_error (VL_ERR_BAD_ARG,
+                              "8-bit descriptors cannot be used with a projection.") ;
+  }
+  self->descriptorType = type ;
+  return VL_ERR_OK ;
+}
+
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Sample a smoothed orientation plane
+ ** @param self DSIFT filter.
+ ** @param src smoothed orientation plane.
+ ** @param bint orientation bin.
+ ** @param binx horizontal spatial bin.
+ ** @param biny vertical spatial bin.
+ ** @param w weight.
+ **
+ ** The function writes the component (@a bint, @a binx, @a biny) of
+ ** all the descriptors, multiplied by @a w.
+ **/
+
+static void
+_vl_dsift_sample_plane (VlDsiftFilter * self, float const * src,
+                        int bint, int binx, int biny, float w)
+{
+  int framex, framey ;
+  vl_size r ;
+  float *dst = self->descrs
+    + bint
+    + binx * self->geom.numBinT
+    + biny * (self->geom.numBinX * self->geom.numBinT)  ;
+
+  int frameSizeX = self->geom.binSizeX * (self->geom.numBinX - 1) + 1 ;
+  int frameSizeY = self->geom.binSizeY * (self->geom.numBinY - 1) + 1 ;
+  int descrSize = self->descrSize ;
+
+  src += binx * self->geom.binSizeX + biny * self->geom.binSizeY * self->imWidth ;
+
+  for (r = 0 ; r < self->numRois ; ++r) {
+    VlDsiftRoi const * roi = self->rois + r ;
+    for (framey  = roi->minY ;
+         framey <= roi->maxY - frameSizeY + 1 ;
+         framey += roi->stepY) {
+      for (framex  = roi->minX ;
+           framex <= roi->maxX - frameSizeX + 1 ;
+           framex += roi->stepX) {
+        *dst = w * src [framex + framey * self->imWidth] ;
+        dst += descrSize ;
+      } /* framex */
+    } /* framey */
+  } /* next region */
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Allocate temporary buffers for the threads
+ ** @param self DSIFT filter.
+ ** @param buffers two buffers for each thread (out).
+ ** @param numThreads number of threads.
+ ** @return number of threads with buffers.
+ **
+ ** The first thread uses the buffers of the filter, the others get
+ ** their own, stored at <code>buffers[2*t]</code> and
+ ** <code>buffers[2*t+1]</code> for thread @c t. If memory is
+ ** insufficient, fewer threads (at least one) get buffers, and the
+ ** caller must use only as many threads as returned. @a buffers is
+ ** set to @c NULL if only the first thread is used. The buffers are
+ ** released by ::_vl_dsift_delete_thread_buffers.
+ **/
+
+static int
+_vl_dsift_new_thread_buffers (VlDsiftFilter * self, float *** buffers,
+                              int numThreads)
+{
+  vl_size const size = sizeof(float) * self->imWidth * self->imHeight ;
+  int t ;
+
+  *buffers = NULL ;
+  if (numThreads <= 1) return 1 ;
+  *buffers = vl_calloc (2 * numThreads, sizeof(float*)) ;
+  if (*buffers == NULL) return 1 ;
+
+  (*buffers) [0] = self->convTmp1 ;
+  (*buffers) [1] = self->convTmp2 ;
+  for (t = 1 ; t < numThreads ; ++t) {
+    float * convTmp1 = vl_malloc (size) ;
+    float * convTmp2 = vl_malloc (size) ;
+    if (convTmp1 == NULL || convTmp2 == NULL) {
+      if (convTmp1) vl_free (convTmp1) ;
+      if (convTmp2) vl_free (convTmp2) ;
+      break ;
+    }
+    (*buffers) [2*t] = convTmp1 ;
+    (*buffers) [2*t+1] = convTmp2 ;
+  }
+  return t ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Release the temporary buffers of the threads
+ ** @param buffers buffers.
+ ** @param numThreads number of threads with buffers.
+ **
+ ** @sa ::_vl_dsift_new_thread_buffers
+ **/
+
+static void
+_vl_dsift_delete_thread_buffers (float ** buffers, int numThreads)
+{
+  int t ;
+  if (buffers == NULL) return ;
+  for (t = 1 ; t < numThreads ; ++t) {
+    vl_free (buffers [2*t]) ;
+    vl_free (buffers [2*t+1]) ;
+  }
+  vl_free (buffers) ;
+}
 
 /** ------------------------------------------------------------------
  ** @internal @brief Process with Gaussian window
  ** @param self DSIFT filter.
+ **
+ ** The orientation planes are processed in parallel. Each plane is
+ ** smoothed vertically once for each vertical bin and then
+ ** horizontally for each horizontal bin.
  **/
 
 VL_INLINE void
 _vl_dsift_with_gaussian_window (VlDsiftFilter * self)
 {
-  int binx, biny, bint ;
-  int framex, framey ;
-  float *xker, *yker ;
+  int binx, biny, bint, numThreads ;
+  float **xkers, **ykers ;
+  float **buffers ;
 
   int Wx = self->geom.binSizeX - 1 ;
   int Wy = self->geom.binSizeY - 1 ;
 
+  xkers = vl_malloc (sizeof(float*) * self->geom.numBinX) ;
+  ykers = vl_malloc (sizeof(float*) * self->geom.numBinY) ;
+  for (binx = 0 ; binx < self->geom.numBinX ; ++binx) {
+    xkers [binx] = _vl_dsift_new_kernel (self->geom.binSizeX,
+                                         self->geom.numBinX,
+                                         binx,
+                                         self->windowSize) ;
+  }
   for (biny = 0 ; biny < self->geom.numBinY ; ++biny) {
+    ykers [biny] = _vl_dsift_new_kernel (self->geom.binSizeY,
+                                         self->geom.numBinY,
+                                         biny,
+                                         self->windowSize) ;
+  }
 
-    yker = _vl_dsift_new_kernel (self->geom.binSizeY,
-                                 self->geom.numBinY,
-                                 biny,
-                                 self->windowSize) ;
-
-    for (binx = 0 ; binx < self->geom.numBinX ; ++binx) {
+  numThreads = _vl_dsift_new_thread_buffers
+    (self, &buffers, VL_MIN((int) vl_get_max_threads(), self->geom.numBinT)) ;
 
-      xker = _vl_dsift_new_kernel(self->geom.binSizeX,
-                                  self->geom.numBinX,
-                                  binx,
-                                  self->windowSize) ;
+#if defined(_OPENMP)
+#pragma omp parallel default(shared) private(bint, binx, biny) \
+  num_threads(numThreads)
+#endif
+  {
+    float *convTmp1 = self->convTmp1, *convTmp2 = self->convTmp2 ;
+#if defined(_OPENMP)
+    if (omp_get_thread_num() > 0) {
+      convTmp1 = buffers [2 * omp_get_thread_num()] ;
+      convTmp2 = buffers [2 * omp_get_thread_num() + 1] ;
+    }
+#endif
 
-      for (bint = 0 ; bint < self->geom.numBinT ; ++bint) {
+#if defined(_OPENMP)
+#pragma omp for
+#endif
+    for (bint = 0 ; bint < self->geom.numBinT ; ++bint) {
+      for (biny = 0 ; biny < self->geom.numBinY ; ++biny) {
 
-        vl_imconvcol_vf (self->convTmp1, self->imHeight,
+        vl_imconvcol_vf (convTmp1, self->imHeight,
                          self->grads[bint], self->imWidth, self->imHeight,
                          self->imWidth,
-                         yker, -Wy, +Wy, 1,
+                         ykers[biny], -Wy, +Wy, 1,
                          VL_PAD_BY_CONTINUITY|VL_TRANSPOSE) ;
 
-        vl_imconvcol_vf (self->convTmp2, self->imWidth,
-                         self->convTmp1, self->imHeight, self->imWidth,
-                         self->imHeight,
-                         xker, -Wx, +Wx, 1,
-                         VL_PAD_BY_CONTINUITY|VL_TRANSPOSE) ;
+        for (binx = 0 ; binx < self->geom.numBinX ; ++binx) {
 
-        {
-          float *dst = self->descrs
-            + bint
-            + binx * self->geom.numBinT
-            + biny * (self->geom.numBinX * self->geom.numBinT)  ;
-
-          float *src = self->convTmp2 ;
-
-          int frameSizeX = self->geom.binSizeX * (self->geom.numBinX - 1) + 1 ;
-          int frameSizeY = self->geom.binSizeY * (self->geom.numBinY - 1) + 1 ;
-          int descrSize = vl_dsift_get_descriptor_size (self) ;
-
-          for (framey  = self->boundMinY ;
-               framey <= self->boundMaxY - frameSizeY + 1 ;
-               framey += self->stepY) {
-            for (framex  = self->boundMinX ;
-                 framex <= self->boundMaxX - frameSizeX + 1 ;
-                 framex += self->stepX) {
-              *dst = src [(framex + binx * self->geom.binSizeX) * 1 +
-                          (framey + biny * self->geom.binSizeY) * self->imWidth]  ;
-              dst += descrSize ;
-            } /* framex */
-          } /* framey */
-        }
+          vl_imconvcol_vf (convTmp2, self->imWidth,
+                           convTmp1, self->imHeight, self->imWidth,
+                           self->imHeight,
+                           xkers[binx], -Wx, +Wx, 1,
+                           VL_PAD_BY_CONTINUITY|VL_TRANSPOSE) ;
+
+          _vl_dsift_sample_plane (self, convTmp2, bint, binx, biny, 1.0F) ;
+        } /* for binx */
+      } /* for biny */
+    } /* for bint */
+  }
+  _vl_dsift_delete_thread_buffers (buffers, numThreads) ;
 
-      } /* for bint */
-      vl_free (xker) ;
-    } /* for binx */
-    vl_free (yker) ;
-  } /* for biny */
+  for (binx = 0 ; binx < self->geom.numBinX ; ++binx) vl_free (xkers [binx]) ;
+  for (biny = 0 ; biny < self->geom.numBinY ; ++biny) vl_free (ykers [biny]) ;
+  vl_free (xkers) ;
+  vl_free (ykers) ;
 }
 
 /** ------------------------------------------------------------------
  ** @internal @brief Process with flat window.
  ** @param self DSIFT filter object.
+ **
+ ** The orientation planes are processed in parallel.
  **/
 
 VL_INLINE void
 _vl_dsift_with_flat_window (VlDsiftFilter* self)
 {
-  int binx, biny, bint ;
-  int framex, framey ;
+  int binx, biny, bint, numThreads ;
+  float **buffers ;
+
+  numThreads = _vl_dsift_new_thread_buffers
+    (self, &buffers, VL_MIN((int) vl_get_max_threads(), self->geom.numBinT)) ;
+
+#if defined(_OPENMP)
+#pragma omp parallel default(shared) private(bint, binx, biny) \
+  num_threads(numThreads)
+#endif
+  {
+    float *convTmp1 = self->convTmp1, *convTmp2 = self->convTmp2 ;
+#if defined(_OPENMP)
+    if (omp_get_thread_num() > 0) {
+      convTmp1 = buffers [2 * omp_get_thread_num()] ;
+      convTmp2 = buffers [2 * omp_get_thread_num() + 1] ;
+    }
+#endif
+
+    /* for each orientation bin */
+#if defined(_OPENMP)
+#pragma omp for
+#endif
+    for (bint = 0 ; bint < self->geom.numBinT ; ++bint) {
+
+      vl_imconvcoltri_f (convTmp1, self->imHeight,
+                         self->grads [bint], self->imWidth, self->imHeight,
+                         self->imWidth,
+                         self->geom.binSizeY, /* filt size */
+                         1, /* subsampling step */
+                         VL_PAD_BY_CONTINUITY|VL_TRANSPOSE) ;
 
-  /* for each orientation bin */
-  for (bint = 0 ; bint < self->geom.numBinT ; ++bint) {
-
-    vl_imconvcoltri_f (self->convTmp1, self->imHeight,
-                       self->grads [bint], self->imWidth, self->imHeight,
-                       self->imWidth,
-                       self->geom.binSizeY, /* filt size */
-                       1, /* subsampling step */
-                       VL_PAD_BY_CONTINUITY|VL_TRANSPOSE) ;
-
-    vl_imconvcoltri_f (self->convTmp2, self->imWidth,
-                       self->convTmp1, self->imHeight, self->imWidth,
-                       self->imHeight,
-                       self->geom.binSizeX,
-                       1,
-                       VL_PAD_BY_CONTINUITY|VL_TRANSPOSE) ;
-
-    for (biny = 0 ; biny < self->geom.numBinY ; ++biny) {
-
-      /*
-      This fast version of DSIFT does not use a proper Gaussian
-      weighting scheme for the gradiens that are accumulated on the
-      spatial bins. Instead each spatial bins is accumulated based on
-      the triangular kernel only, equivalent to bilinear interpolation
-      plus a flat, rather than Gaussian, window. Eventually, however,
-      the magnitude of the spatial bins in the SIFT descriptor is
-      reweighted by the average of the Gaussian window on each bin.
-      */
-
-      float wy = _vl_dsift_get_bin_window_mean
-        (self->geom.binSizeY, self->geom.numBinY, biny,
-         self->windowSize) ;
-
-      /* The convolution functions vl_imconvcoltri_* convolve by a
-       * triangular kernel with unit integral. Instead for SIFT the
-       * triangular kernel should have unit height. This is
-       * compensated for by multiplying by the bin size:
-       */
-
-      wy *= self->geom.binSizeY ;
-
-      for (binx = 0 ; binx < self->geom.numBinX ; ++binx) {
-        float w ;
-        float wx = _vl_dsift_get_bin_window_mean (self->geom.binSizeX,
-                                                  self->geom.numBinX,
-                                                  binx,
-                                                  self->windowSize) ;
-
-        float *dst = self->descrs
-          + bint
-          + binx * self->geom.numBinT
-          + biny * (self->geom.numBinX * self->geom.numBinT)  ;
-
-        float *src = self->convTmp2 ;
-
-        int frameSizeX = self->geom.binSizeX * (self->geom.numBinX - 1) + 1 ;
-        int frameSizeY = self->geom.binSizeY * (self->geom.numBinY - 1) + 1 ;
-        int descrSize = vl_dsift_get_descriptor_size (self) ;
-
-        wx *= self->geom.binSizeX ;
-        w = wx * wy ;
-
-        for (framey  = self->boundMinY ;
-             framey <= self->boundMaxY - frameSizeY + 1 ;
-             framey += self->stepY) {
-          for (framex  = self->boundMinX ;
-               framex <= self->boundMaxX - frameSizeX + 1 ;
-               framex += self->stepX) {
-            *dst = w * src [(framex + binx * self->geom.binSizeX) * 1 +
-                            (framey + biny * self->geom.binSizeY) * self->imWidth]  ;
-            dst += descrSize ;
-          } /* framex */
-        } /* framey */
-      } /* binx */
-    } /* biny */
-  } /* bint */
+      vl_imconvcoltri_f (convTmp2, self->imWidth,
+                         convTmp1, self->imHeight, self->imWidth,
+                         self->imHeight,
+                         self->geom.binSizeX,
+                         1,
+                         VL_PAD_BY_CONTINUITY|VL_TRANSPOSE) ;
+
+      for (biny = 0 ; biny < self->geom.numBinY ; ++biny) {
+
+        /*
+        This fast version of DSIFT does not use a proper Gaussian
+        weighting scheme for the gradiens that are accumulated on the
+        spatial bins. Instead each spatial bins is accumulated based on
+        the triangular kernel only, equivalent to bilinear interpolation
+        plus a flat, rather than Gaussian, window. Eventually, however,
+        the magnitude of the spatial bins in the SIFT descriptor is
+        reweighted by the average of the Gaussian window on each bin.
+        */
+
+        float wy = _vl_dsift_get_bin_window_mean
+          (self->geom.binSizeY, self->geom.numBinY, biny,
+           self->windowSize) ;
+
+        /* The convolution functions vl_imconvcoltri_* convolve by a
+         * triangular kernel with unit integral. Instead for SIFT the
+         * triangular kernel should have unit height. This is
+         * compensated for by multiplying by the bin size:
+         */
+
+        wy *= self->geom.binSizeY ;
+
+        for (binx = 0 ; binx < self->geom.numBinX ; ++binx) {
+          float wx = _vl_dsift_get_bin_window_mean (self->geom.binSizeX,
+                                                    self->geom.numBinX,
+                                                    binx,
+                                                    self->windowSize) ;
+          wx *= self->geom.binSizeX ;
+          _vl_dsift_sample_plane (self, convTmp2, bint, binx, biny, wx * wy) ;
+        } /* binx */
+      } /* biny */
+    } /* bint */
+  }
+  _vl_dsift_delete_thread_buffers (buffers, numThreads) ;
 }
 
 /** ------------------------------------------------------------------
- ** @brief Compute keypoints and descriptors
+ ** @internal @brief Convert the descriptors to the storage type
+ ** @param self DSIFT filter object.
  **
+ ** The function converts the descriptors to the type set by
+ ** ::vl_dsift_set_descriptor_type in place, packing them at the
+ ** beginning of the descriptor buffer. Since a packed component is
+ ** never larger than a float, the @a i-th packed component
+ ** overwrites only floats with index not larger than @a i, which
+ ** have already been converted. For this reason the conversion is
+ ** sequential.
+ **/
+
+static void
+_vl_dsift_pack_descriptors (VlDsiftFilter * self)
+{
+  vl_size i ;
+  vl_size n = (vl_size) vl_dsift_get_descriptor_size (self) * self->numFrames ;
+  float const * src = self->descrs ;
+
+  switch (self->descriptorType) {
+    case VlDsiftDescriptorUInt8 :
+    {
+      vl_uint8 * dst = (vl_uint8*) self->descrs ;
+      for (i = 0 ; i < n ; ++i) {
+        float x = 512.0F * src [i] ;
+        x = VL_MIN (x, 255.0F) ;
+        x = VL_MAX (x, 0.0F) ;
+        dst [i] = (vl_uint8) x ;
+      }
+      break ;
+    }
+    case VlDsiftDescriptorHalf :
+    {
+      vl_uint16 * dst = (vl_uint16*) self->descrs ;
+      for (i = 0 ; i < n ; ++i) {
+        dst [i] = vl_float_to_half (src [i]) ;
+      }
+      break ;
+    }
+    default :
+      /* guaranteed by vl_dsift_set_descriptor_type */
+      assert (0) ;
+  }
+  self->descrsType = self->descriptorType ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Compute keypoints and descriptors in the regions
  ** @param self DSIFT filter.
  ** @param im   image data.
+ **
+ ** @return error code.
+ **
+ ** The regions are set by ::_vl_dsift_set_rois.
  **/
 
-void vl_dsift_process (VlDsiftFilter* self, float const* im)
+static int
+_vl_dsift_process (VlDsiftFilter* self, float const* im)
 {
-  int t, x, y ;
+  int t, y ;
+  int const numThreads = (int) vl_get_max_threads() ;
+  float * projected = NULL ;
+  float * hists = NULL ;
 
   /* update buffers */
-  _vl_dsift_alloc_buffers (self) ;
+  if (_vl_dsift_alloc_buffers (self) != VL_ERR_OK) return VL_ERR_ALLOC ;
+
+  /* buffers of the projection, allocated before any parallel region */
+  if (self->projection) {
+    projected = vl_malloc (sizeof(float) * vl_dsift_get_descriptor_size (self)
+                           * VL_MAX(self->numFrames, 1)) ;
+    hists = vl_malloc (sizeof(float) * self->descrSize * numThreads) ;
+    if (projected == NULL || hists == NULL) {
+      if (projected) vl_free (projected) ;
+      if (hists) vl_free (hists) ;
+      return vl_set_last_error (VL_ERR_ALLOC, "Unable to allocate the projection buffers.") ;
+    }
+  }
 
   /* clear integral images */
   for (t = 0 ; t < self->geom.numBinT ; ++t)
@@ -678,7 +1135,11 @@ void vl_dsift_process (VlDsiftFilter* self, float const* im)
 
   /* Compute gradients, their norm, and their angle */
 
+#if defined(_OPENMP)
+#pragma omp parallel for default(shared) private(y) num_threads(vl_get_max_threads())
+#endif
   for (y = 0 ; y < self->imHeight ; ++ y) {
+    int x ;
     for (x = 0 ; x < self->imWidth ; ++ x) {
       float gx, gy ;
       float angle, mod, nt, rbint ;
@@ -724,29 +1185,62 @@ void vl_dsift_process (VlDsiftFilter* self, float const* im)
   }
 
   {
-    VlDsiftKeypoint* frameIter = self->frames ;
-    float * descrIter = self->descrs ;
-    int framex, framey, bint ;
+    int frameIndex ;
 
     int frameSizeX = self->geom.binSizeX * (self->geom.numBinX - 1) + 1 ;
     int frameSizeY = self->geom.binSizeY * (self->geom.numBinY - 1) + 1 ;
-    int descrSize = vl_dsift_get_descriptor_size (self) ;
+    int numFrames = self->numFrames ;
+    int descrSize = self->descrSize ;
+    int outSize = vl_dsift_get_descriptor_size (self) ;
+    VlFloatVectorComparisonFunction dot =
+      vl_get_vector_comparison_function_f (VlKernelL2) ;
 
     float deltaCenterX = 0.5F * self->geom.binSizeX * (self->geom.numBinX - 1) ;
     float deltaCenterY = 0.5F * self->geom.binSizeY * (self->geom.numBinY - 1) ;
 
     float normConstant = frameSizeX * frameSizeY ;
 
-    for (framey  = self->boundMinY ;
-         framey <= self->boundMaxY - frameSizeY + 1 ;
-         framey += self->stepY) {
+    /* guaranteed by _vl_dsift_update_buffers */
+    assert (self->projection == NULL || self->projectionInputSize == descrSize) ;
+
+    /* frame centers, in the same order as the descriptors */
+    {
+      VlDsiftKeypoint * frameIter = self->frames ;
+      vl_size r ;
+      for (r = 0 ; r < self->numRois ; ++r) {
+        VlDsiftRoi const * roi = self->rois + r ;
+        int framex, framey ;
+        for (framey  = roi->minY ;
+             framey <= roi->maxY - frameSizeY + 1 ;
+             framey += roi->stepY) {
+          for (framex  = roi->minX ;
+               framex <= roi->maxX - frameSizeX + 1 ;
+               framex += roi->stepX) {
+            frameIter->x = framex + deltaCenterX ;
+            frameIter->y = framey + deltaCenterY ;
+            frameIter ++ ;
+          }
+        }
+      }
+    }
 
-      for (framex  = self->boundMinX ;
-           framex <= self->boundMaxX - frameSizeX + 1 ;
-           framex += self->stepX) {
+#if defined(_OPENMP)
+#pragma omp parallel default(shared) private(frameIndex) num_threads(numThreads)
+#endif
+    {
+      float * hist = hists ;
+      int bint ;
+
+#if defined(_OPENMP)
+      if (hist) hist += descrSize * omp_get_thread_num() ;
+#endif
 
-        frameIter->x    = framex + deltaCenterX ;
-        frameIter->y    = framey + deltaCenterY ;
+#if defined(_OPENMP)
+#pragma omp for
+#endif
+      for (frameIndex = 0 ; frameIndex < numFrames ; ++frameIndex) {
+        VlDsiftKeypoint * frameIter = self->frames + frameIndex ;
+        float * descrIter = self->descrs + descrSize * frameIndex ;
 
         /* mass */
         {
@@ -767,9 +1261,112 @@ void vl_dsift_process (VlDsiftFilter* self, float const* im)
         /* L2 normalize */
         _vl_dsift_normalize_histogram (descrIter, descrIter + descrSize) ;
 
-        frameIter ++ ;
-        descrIter += descrSize ;
-      } /* for framex */
-    } /* for framey */
+        if (self->useRootSift) {
+          _vl_dsift_root_histogram (descrIter, descrIter + descrSize) ;
+        }
+
+        /* project */
+        if (self->projection) {
+          int i ;
+          for (bint = 0 ; bint < descrSize ; ++ bint) {
+            hist[bint] = descrIter[bint] ;
+            if (self->projectionMean) hist[bint] -= self->projectionMean[bint] ;
+          }
+          for (i = 0 ; i < outSize ; ++ i) {
+            projected[outSize * frameIndex + i] =
+              dot (descrSize, self->projection + descrSize * i, hist) ;
+          }
+        }
+      } /* next frame */
+    }
+
+    /*
+     The projected descriptors are packed at the beginning of the
+     descriptor buffer. They are computed in a separate buffer since,
+     when frames are processed in parallel, packing them in place
+     could overwrite descriptors not yet projected.
+     */
+    if (projected) {
+      memcpy (self->descrs, projected, sizeof(float) * outSize * numFrames) ;
+      vl_free (projected) ;
+      vl_free (hists) ;
+    }
+  }
+
+  self->descrsType = VlDsiftDescriptorFloat ;
+  if (self->descriptorType != VlDsiftDescriptorFloat) {
+    _vl_dsift_pack_descriptors (self) ;
+  }
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Compute keypoints and descriptors
+ **
+ ** @param self DSIFT filter.
+ ** @param im   image data.
+ **
+ ** If VLFeat is compiled with OpenMP, the computation is split across
+ ** up to ::vl_get_max_threads() threads (see @ref threads-parallel).
+ ** The result and the order of the descriptors do not depend on the
+ ** number of threads.
+ **
+ ** @return error code. The function fails with ::VL_ERR_ALLOC if
+ ** memory is insufficient.
+ **/
+
+int vl_dsift_process (VlDsiftFilter* self, float const* im)
+{
+  VlDsiftRoi roi ;
+  roi.minX = self->boundMinX ;
+  roi.minY = self->boundMinY ;
+  roi.maxX = self->boundMaxX ;
+  roi.maxY = self->boundMaxY ;
+  roi.stepX = self->stepX ;
+  roi.stepY = self->stepY ;
+  if (_vl_dsift_set_rois (self, &roi, 1) != VL_ERR_OK) return VL_ERR_ALLOC ;
+  return _vl_dsift_process (self, im) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Compute keypoints and descriptors in regions of interest
+ **
+ ** @param self DSIFT filter.
+ ** @param im   image data.
+ ** @param rois regions of interest.
+ ** @param numRois number of regions of interest.
+ **
+ ** The function is like ::vl_dsift_process, but samples the
+ ** keypoints in each of the regions @a rois in turn, with the region
+ ** bounding box and steps in place of the ones set by
+ ** ::vl_dsift_set_bounds and ::vl_dsift_set_steps. The regions are
+ ** clipped to the image and may overlap. The gradients and the
+ ** smoothed orientation planes are computed only once for all the
+ ** regions.
+ **
+ ** The keypoints and descriptors of all the regions are stored one
+ ** after the other in the buffers returned by ::vl_dsift_get_keypoints
+ ** and ::vl_dsift_get_descriptors; ::vl_dsift_get_roi_offsets gives the
+ ** index of the first keypoint of each region. Changing the bounds,
+ ** steps or geometry afterwards resets the regions to the single one
+ ** used by ::vl_dsift_process.
+ **
+ ** @return error code. The function fails with ::VL_ERR_BAD_ARG,
+ ** without processing the image, if the step of a region is smaller
+ ** than one, and with ::VL_ERR_ALLOC if memory is insufficient.
+ **/
+
+int vl_dsift_process_rois (VlDsiftFilter* self, float const* im,
+                           VlDsiftRoi const* rois, vl_size numRois)
+{
+  vl_size r ;
+  for (r = 0 ; r < numRois ; ++r) {
+    if (rois [r].stepX < 1 || rois [r].stepY < 1) {
+      return vl_set_last_error (VL_ERR_BAD_ARG,
+                                "The steps of region %d are smaller than one.",
+                                (int) r) ;
+    }
   }
+  if (_vl_dsift_set_rois (self, rois, numRois) != VL_ERR_OK) return VL_ERR_ALLOC ;
+  return _vl_dsift_process (self, im) ;
 }
@@ -17,6 +17,14 @@ the terms of the BSD license (see the COPYING file).
 
 #include "generic.h"
 
+/** @brief Dense SIFT descriptor storage type */
+typedef enum _VlDsiftDescriptorType
+{
+  VlDsiftDescriptorFloat = 0, /**< single precision descriptors (default) */
+  VlDsiftDescriptorUInt8,     /**< descriptors quantized to 8 bits */
+  VlDsiftDescriptorHalf       /**< IEEE half precision descriptors */
+} VlDsiftDescriptorType ;
+
 /** @brief Dense SIFT keypoint */
 typedef struct VlDsiftKeypoint_
 {
@@ -36,6 +44,17 @@ typedef struct VlDsiftDescriptorGeometry_
   int binSizeY ; /**< size of bins along Y */
 } VlDsiftDescriptorGeometry ;
 
+/** @brief Dense SIFT region of interest */
+typedef struct VlDsiftRoi_
+{
+  int minX ;  /**< bounding box min X */
+  int minY ;  /**< bounding box min Y */
+  int maxX ;  /**< bounding box max X */
+  int maxY ;  /**< bounding box max Y */
+  int stepX ; /**< frame sampling step X */
+  int stepY ; /**< frame sampling step Y */
+} VlDsiftRoi ;
+
 /** @brief Dense SIFT filter */
 typedef struct VlDsiftFilter_
 {
@@ -55,11 +74,24 @@ typedef struct VlDsiftFilter_
 
   int useFlatWindow ;      /**< flag: whether to approximate the Gaussian window with a flat one */
   double windowSize ;      /**< size of the Gaussian window */
+  vl_bool useRootSift ;    /**< flag: whether to compute RootSIFT descriptors */
+  VlDsiftDescriptorType descriptorType ; /**< descriptor storage type */
+
+  float *projection ;      /**< descriptor projection matrix */
+  float *projectionMean ;  /**< descriptor projection mean */
+  int projectionDimension ; /**< descriptor projection dimension */
+  int projectionInputSize ; /**< size of the projected descriptors */
+
+  VlDsiftRoi *rois ;       /**< sampled regions */
+  vl_size numRois ;        /**< number of sampled regions */
+  vl_size numRoiAlloc ;    /**< buffer allocated: number of regions */
+  vl_size *roiOffsets ;    /**< index of the first frame of each region */
 
   int numFrames ;          /**< number of sampled frames */
   int descrSize ;          /**< size of a descriptor */
   VlDsiftKeypoint *frames ; /**< frame buffer */
   float *descrs ;          /**< descriptor buffer */
+  VlDsiftDescriptorType descrsType ; /**< type of the descriptors in the buffer */
 
   int numBinAlloc ;        /**< buffer allocated: descriptor size */
   int numFrameAlloc ;      /**< buffer allocated: number of frames  */
@@ -73,7 +105,13 @@ typedef struct VlDsiftFilter_
 VL_EXPORT VlDsiftFilter *vl_dsift_new (int width, int height) ;
 VL_EXPORT VlDsiftFilter *vl_dsift_new_basic (int width, int height, int step, int binSize) ;
 VL_EXPORT void vl_dsift_delete (VlDsiftFilter *self) ;
-VL_EXPORT void vl_dsift_process (VlDsiftFilter *self, float const* im) ;
+VL_EXPORT int vl_dsift_process (VlDsiftFilter *self, float const* im) ;
+VL_EXPORT int vl_dsift_process_rois (VlDsiftFilter *self, float const* im,
+                                     VlDsiftRoi const *rois, vl_size numRois) ;
+VL_EXPORT int vl_dsift_set_projection (VlDsiftFilter *self,
+                                       float const *projection,
+                                       float const *mean,
+                                       int dimension) ;
 VL_INLINE void vl_dsift_transpose_descriptor (float* dst,
                                              float const* src,
                                              int numBinT,
@@ -95,15 +133,21 @@ VL_INLINE void vl_dsift_set_geometry (VlDsiftFilter *self,
                                       VlDsiftDescriptorGeometry const* geom) ;
 VL_INLINE void vl_dsift_set_flat_window (VlDsiftFilter *self, vl_bool useFlatWindow) ;
 VL_INLINE void vl_dsift_set_window_size (VlDsiftFilter *self, double windowSize) ;
+VL_INLINE void vl_dsift_set_root_sift (VlDsiftFilter *self, vl_bool useRootSift) ;
+VL_EXPORT int vl_dsift_set_descriptor_type (VlDsiftFilter *self, VlDsiftDescriptorType type) ;
 /** @} */
 
 /** @name Retrieving data and parameters
  ** @{
  **/
 VL_INLINE float const    *vl_dsift_get_descriptors     (VlDsiftFilter const *self) ;
+VL_INLINE vl_uint8 const *vl_dsift_get_descriptors_uint8 (VlDsiftFilter const *self) ;
+VL_INLINE vl_uint16 const *vl_dsift_get_descriptors_half (VlDsiftFilter const *self) ;
 VL_INLINE int             vl_dsift_get_descriptor_size (VlDsiftFilter const *self) ;
 VL_INLINE int             vl_dsift_get_keypoint_num    (VlDsiftFilter const *self) ;
 VL_INLINE VlDsiftKeypoint const *vl_dsift_get_keypoints (VlDsiftFilter const *self) ;
+VL_INLINE vl_size         vl_dsift_get_roi_num         (VlDsiftFilter const *self) ;
+VL_INLINE vl_size const  *vl_dsift_get_roi_offsets     (VlDsiftFilter const *self) ;
 VL_INLINE void            vl_dsift_get_bounds          (VlDsiftFilter const *self,
                                                        int* minX,
                                                        int* minY,
@@ -115,6 +159,8 @@ VL_INLINE void            vl_dsift_get_steps           (VlDsiftFilter const* sel
 VL_INLINE VlDsiftDescriptorGeometry const* vl_dsift_get_geometry (VlDsiftFilter const *self) ;
 VL_INLINE vl_bool         vl_dsift_get_flat_window     (VlDsiftFilter const *self) ;
 VL_INLINE double          vl_dsift_get_window_size     (VlDsiftFilter const *self) ;
+VL_INLINE vl_bool         vl_dsift_get_root_sift       (VlDsiftFilter const *self) ;
+VL_INLINE VlDsiftDescriptorType vl_dsift_get_descriptor_type (VlDsiftFilter const *self) ;
 /** @} */
 
 VL_EXPORT
@@ -124,24 +170,64 @@ void _vl_dsift_update_buffers (VlDsiftFilter *self) ;
  ** @brief Get descriptor size.
  ** @param self DSIFT filter object.
  ** @return size of a descriptor.
+ **
+ ** If a projection is set (::vl_dsift_set_projection), this is the
+ ** projection dimension.
  **/
 
 int
 vl_dsift_get_descriptor_size (VlDsiftFilter const *self)
 {
-  return self->descrSize ;
+  return self->projection ? self->projectionDimension : self->descrSize ;
 }
 
 /** ------------------------------------------------------------------
  ** @brief Get descriptors.
  ** @param self DSIFT filter object.
  ** @return descriptors.
+ **
+ ** The function returns @c NULL if the descriptors were stored in a
+ ** different format (see ::vl_dsift_set_descriptor_type).
  **/
 
 float const *
 vl_dsift_get_descriptors (VlDsiftFilter const *self)
 {
-  return self->descrs ;
+  return (self->descrsType == VlDsiftDescriptorFloat) ? self->descrs : NULL ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get descriptors quantized to 8 bits.
+ ** @param self DSIFT filter object.
+ ** @return descriptors.
+ **
+ ** The function returns @c NULL unless the descriptors were stored
+ ** as ::VlDsiftDescriptorUInt8 (see ::vl_dsift_set_descriptor_type).
+ **/
+
+VL_INLINE vl_uint8 const *
+vl_dsift_get_descriptors_uint8 (VlDsiftFilter const *self)
+{
+  return (self->descrsType == VlDsiftDescriptorUInt8) ?
+    (vl_uint8 const*) self->descrs : NULL ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get half precision descriptors.
+ ** @param self DSIFT filter object.
+ ** @return descriptors.
+ **
+ ** The descriptor components are IEEE half precision numbers, which
+ ** can be decoded by ::vl_half_to_float. The function returns @c NULL
+ ** unless the descriptors were stored as ::VlDsiftDescriptorHalf (see
+ ** ::vl_dsift_set_descriptor_type).
+ **/
+
+VL_INLINE vl_uint16 const *
+vl_dsift_get_descriptors_half (VlDsiftFilter const *self)
+{
+  return (self->descrsType == VlDsiftDescriptorHalf) ?
+    (vl_uint16 const*) self->descrs : NULL ;
 }
 
 /** ------------------------------------------------------------------
@@ -166,6 +252,38 @@ vl_dsift_get_keypoint_num (VlDsiftFilter const *self)
   return self->numFrames ;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Get number of regions of interest
+ ** @param self DSIFT filter object.
+ ** @return number of sampled regions.
+ **
+ ** This is the number of regions passed to ::vl_dsift_process_rois,
+ ** and one after ::vl_dsift_process or after changing the bounds,
+ ** steps or geometry.
+ **/
+
+VL_INLINE vl_size
+vl_dsift_get_roi_num (VlDsiftFilter const *self)
+{
+  return self->numRois ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get offsets of the regions of interest
+ ** @param self DSIFT filter object.
+ ** @return offsets.
+ **
+ ** The function returns an array of ::vl_dsift_get_roi_num + 1
+ ** elements. The keypoints and descriptors of the region @c r are the
+ ** ones with index in the range <code>[offsets[r], offsets[r+1])</code>.
+ **/
+
+VL_INLINE vl_size const *
+vl_dsift_get_roi_offsets (VlDsiftFilter const *self)
+{
+  return self->roiOffsets ;
+}
+
 /** ------------------------------------------------------------------
  ** @brief Get SIFT descriptor geometry
  ** @param self DSIFT filter object.
@@ -350,5 +468,45 @@ vl_dsift_get_window_size(VlDsiftFilter const * self)
   return self->windowSize ;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Set RootSIFT flag
+ ** @param self DSIFT filter object.
+ ** @param useRootSift @c true if the DSIFT filter should compute RootSIFT descriptors.
+ **
+ ** RootSIFT descriptors are obtained by normalizing the SIFT
+ ** descriptors in L1 norm and taking their square root (Hellinger
+ ** mapping).
+ **/
+
+VL_INLINE void
+vl_dsift_set_root_sift (VlDsiftFilter * self, vl_bool useRootSift)
+{
+  self->useRootSift = useRootSift ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get RootSIFT flag
+ ** @param self DSIFT filter object.
+ ** @return @c TRUE if the DSIFT filter computes RootSIFT descriptors.
+ **/
+
+VL_INLINE vl_bool
+vl_dsift_get_root_sift (VlDsiftFilter const * self)
+{
+  return self->useRootSift ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the descriptor storage type
+ ** @param self DSIFT filter object.
+ ** @return descriptor type.
+ **/
+
+VL_INLINE VlDsiftDescriptorType
+vl_dsift_get_descriptor_type (VlDsiftFilter const * self)
+{
+  return self->descriptorType ;
+}
+
 /*  VL_DSIFT_H */
 #endif
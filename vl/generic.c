@@ -35,6 +35,7 @@ VLFeat strives to be clutter-free, simple, portable, and well documented.
 - **Visual feature detectors and descriptors**
   - @subpage sift
   - @subpage dsift
+  - @subpage phow
   - @subpage mser
   - @subpage covdet
   - @subpage scalespace
@@ -1084,8 +1085,39 @@ vl_get_simd_enabled (void)
   return vl_get_state()->simdEnabled ;
 }
 
+/** @brief Check for AVX-512 foundation instruction set
+ ** @return @c true if AVX-512F is present.
+ **
+ ** As for ::vl_cpu_has_avx, this also checks that the operating
+ ** system saves the extended register state.
+ **/
+
+vl_bool
+vl_cpu_has_avx512f (void)
+{
+#if defined(VL_ARCH_IX86) || defined(VL_ARCH_X64) || defined(VL_ARCH_IA64)
+  return vl_get_state()->cpuInfo.hasAVX512F ;
+#else
+  return VL_FALSE ;
+#endif
+}
+
+/** @brief Check for AVX2 instruction set
+ ** @return @c true if AVX2 is present.
+ **/
+
+vl_bool
+vl_cpu_has_avx2 (void)
+{
+#if defined(VL_ARCH_IX86) || defined(VL_ARCH_X64) || defined(VL_ARCH_IA64)
+  return vl_get_state()->cpuInfo.hasAVX2 ;
+#else
+  return VL_FALSE ;
+#endif
+}
+
 /** @brief Check for AVX instruction set
- ** @return @c true if AVX is present.
+ ** @return @c true if AVX is present and enabled by the operating system.
  **/
 
 vl_bool
@@ -367,6 +367,20 @@ it supports POSIX threads.
  ** to another project to disable VLFeat SSE2 support.
  **/
 
+/** @def VL_DISABLE_AVX
+ ** @brief Defined if AVX support if disabled
+ **
+ ** Define this symbol during compliation of the library and linking
+ ** to another project to disable VLFeat AVX support.
+ **/
+
+/** @def VL_DISABLE_AVX512
+ ** @brief Defined if AVX-512 support if disabled
+ **
+ ** Define this symbol during compliation of the library and linking
+ ** to another project to disable VLFeat AVX-512 support.
+ **/
+
 /** @def VL_DISABLE_THREADS
  ** @brief Defined if multi-threading support is disabled
  **
@@ -408,7 +422,13 @@ it supports POSIX threads.
 VL_INLINE void
 _vl_cpuid (vl_int32* info, int function)
 {
-  __cpuid(info, function) ;
+  __cpuidex(info, function, 0) ;
+}
+
+VL_INLINE vl_uint64
+_vl_xgetbv (void)
+{
+  return _xgetbv(0) ;
 }
 #endif
 
@@ -428,17 +448,29 @@ _vl_cpuid (vl_int32* info, int function)
    "movl %%ebx, %1   \n" /* save what cpuid just put in %ebx */
    "popl %%ebx       \n" /* restore the old %ebx */
    : "=a"(info[0]), "=r"(info[1]), "=c"(info[2]), "=d"(info[3])
-   : "a"(function)
+   : "a"(function), "c"(0)
    : "cc") ; /* clobbered (cc=condition codes) */
 #else /* no -fPIC or -fPIC with a 64-bit target */
   __asm__ __volatile__
   ("cpuid"
    : "=a"(info[0]), "=b"(info[1]), "=c"(info[2]), "=d"(info[3])
-   : "a"(function)
+   : "a"(function), "c"(0)
    : "cc") ;
 #endif
 }
 
+VL_INLINE vl_uint64
+_vl_xgetbv (void)
+{
+  vl_uint32 eax, edx ;
+  /* xgetbv with ecx = 0 reads XCR0 (the register state enabled by the OS) */
+  __asm__ __volatile__
+  (".byte 0x0f, 0x01, 0xd0"
+   : "=a"(eax), "=d"(edx)
+   : "c"(0)) ;
+  return ((vl_uint64)edx << 32) | eax ;
+}
+
 #endif
 
 #if defined(HAS_CPUID)
@@ -447,6 +479,7 @@ _vl_x86cpu_info_init (VlX86CpuInfo *self)
 {
   vl_int32 info [4] ;
   int max_func = 0 ;
+  vl_uint64 xcr0 = 0 ;
   _vl_cpuid(info, 0) ;
   max_func = info[0] ;
   self->vendor.words[0] = info[1] ;
@@ -462,6 +495,20 @@ _vl_x86cpu_info_init (VlX86CpuInfo *self)
     self->hasSSE41 = info[2] & (1 << 19) ;
     self->hasSSE42 = info[2] & (1 << 20) ;
     self->hasAVX   = info[2] & (1 << 28) ;
+    /* AVX and AVX-512 also require the OS to save the YMM/ZMM state
+       (OSXSAVE flag and XCR0 bits) */
+    if (info[2] & (1 << 27)) {
+      xcr0 = _vl_xgetbv() ;
+    }
+    if ((xcr0 & 0x06) != 0x06) {
+      self->hasAVX = VL_FALSE ;
+    }
+  }
+
+  if (max_func >= 7) {
+    _vl_cpuid(info, 7) ;
+    self->hasAVX2    = self->hasAVX && (info[1] & (1 << 5)) ;
+    self->hasAVX512F = self->hasAVX && (info[1] & (1 << 16)) && (xcr0 & 0xe0) == 0xe0 ;
   }
 }
 #endif
@@ -476,7 +523,7 @@ _vl_x86cpu_info_to_string_copy (VlX86CpuInfo const *self)
       string = vl_malloc(sizeof(char) * length) ;
       if (string == NULL) break ;
     }
-    length = snprintf(string, length, "%s%s%s%s%s%s%s%s",
+    length = snprintf(string, length, "%s%s%s%s%s%s%s%s%s%s",
                       self->vendor.string,
                       self->hasMMX   ? " MMX" : "",
                       self->hasSSE   ? " SSE" : "",
@@ -484,7 +531,9 @@ _vl_x86cpu_info_to_string_copy (VlX86CpuInfo const *self)
                       self->hasSSE3  ? " SSE3" : "",
                       self->hasSSE41 ? " SSE41" : "",
                       self->hasSSE42 ? " SSE42" : "",
-                      self->hasAVX   ? " AVX" : "") ;
+                      self->hasAVX   ? " AVX" : "",
+                      self->hasAVX2  ? " AVX2" : "",
+                      self->hasAVX512F ? " AVX512F" : "") ;
     length += 1 ;
   }
   return string ;
@@ -539,6 +588,12 @@ vl_static_configuration_to_string_copy ()
 #ifndef VL_DISABLE_SSE2
   ", SSE2"
 #endif
+#ifndef VL_DISABLE_AVX
+  ", AVX"
+#endif
+#ifndef VL_DISABLE_AVX512
+  ", AVX-512"
+#endif
 #if defined(_OPENMP)
   ", OpenMP"
 #endif
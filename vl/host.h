@@ -22,6 +22,8 @@ the terms of the BSD license (see the COPYING file).
 #if defined(__DOXYGEN__)
 #define VL_DISABLE_THREADS
 #define VL_DISABLE_SSE2
+#define VL_DISABLE_AVX
+#define VL_DISABLE_AVX512
 #define VL_DISABLE_OPENMP
 #endif
 
@@ -562,6 +564,8 @@ typedef struct _VlX86CpuInfo
     char string [0x20] ;
     vl_uint32 words [0x20 / 4] ;
   } vendor ;
+  vl_bool hasAVX512F ;
+  vl_bool hasAVX2 ;
   vl_bool hasAVX ;
   vl_bool hasSSE42 ;
   vl_bool hasSSE41 ;
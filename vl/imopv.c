@@ -36,8 +36,138 @@ the terms of the BSD license (see the COPYING file).
 
 #include "imopv.h"
 #include "imopv_sse2.h"
+#include "imopv_avx.h"
+#include "imopv_avx512.h"
 #include "mathop.h"
 
+#include <string.h>
+
+/** @internal @brief Minimum number of pixels to smooth in parallel */
+#define VL_IMOPV_MIN_PARALLEL_SIZE (64 * 64)
+
+/** @internal @brief Working set of a tile of the column convolution (in bytes) */
+#define VL_IMOPV_TILE_SIZE (128 * 1024)
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Get a band of an image for parallel processing
+ ** @param begin    first element of the band (out).
+ ** @param end      one past the last element of the band (out).
+ ** @param size     number of elements to split.
+ ** @param band     band index.
+ ** @param numBands number of bands.
+ **
+ ** The band size is rounded to a multiple of four elements so that
+ ** bands start at addresses suitable for SIMD processing.
+ **/
+
+static void
+_vl_imopv_get_band (vl_size *begin, vl_size *end,
+                    vl_size size, vl_index band, vl_index numBands)
+{
+  vl_size bandSize = (size + numBands - 1) / numBands ;
+  bandSize = (bandSize + 3) & ~ (vl_size)3 ;
+  *begin = VL_MIN(band * bandSize, size) ;
+  *end = VL_MIN(*begin + bandSize, size) ;
+}
+
+/** @internal @brief Smallest standard deviation of the recursive Gaussian */
+#define VL_IMOPV_RECURSIVE_MIN_SIGMA 2.0
+
+/** @internal @brief Length of the recursive Gaussian border extension (in units of sigma) */
+#define VL_IMOPV_RECURSIVE_TAIL 6.0
+
+/** @internal @brief Complex pole of the recursive Gaussian for a standard deviation of 2 */
+#define VL_IMOPV_RECURSIVE_POLE_RE 1.41650
+#define VL_IMOPV_RECURSIVE_POLE_IM 1.00829
+/** @internal @brief Real pole of the recursive Gaussian for a standard deviation of 2 */
+#define VL_IMOPV_RECURSIVE_POLE_REAL 1.86543
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Get the variance of a scaled recursive Gaussian filter
+ ** @param q scale.
+ ** @return variance.
+ **
+ ** The function returns the variance of the impulse response of the
+ ** causal and anti-causal recursive filters with poles
+ ** @f$ d_k^{1/q} @f$, where @f$ d_k @f$ are the poles for a standard
+ ** deviation of 2. Each pole contributes
+ ** @f$ 2 z / (z - 1)^2 @f$, with @f$ z = d_k^{1/q} @f$.
+ **/
+
+static double
+_vl_imopv_get_recursive_variance (double q)
+{
+  double const rho = pow (VL_IMOPV_RECURSIVE_POLE_RE * VL_IMOPV_RECURSIVE_POLE_RE +
+                          VL_IMOPV_RECURSIVE_POLE_IM * VL_IMOPV_RECURSIVE_POLE_IM, 0.5 / q) ;
+  double const theta = atan2 (VL_IMOPV_RECURSIVE_POLE_IM, VL_IMOPV_RECURSIVE_POLE_RE) / q ;
+  double const zr = rho * cos (theta) ;
+  double const zi = rho * sin (theta) ;
+  double const z3 = pow (VL_IMOPV_RECURSIVE_POLE_REAL, 1.0 / q) ;
+  /* (z - 1)^2 for the complex pole */
+  double const er = (zr - 1) * (zr - 1) - zi * zi ;
+  double const ei = 2 * (zr - 1) * zi ;
+  /* the complex conjugate poles contribute twice the real part */
+  double const pair = 2 * (zr * er + zi * ei) / (er * er + ei * ei) ;
+  return 2 * (pair + z3 / ((z3 - 1) * (z3 - 1))) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Get the coefficients of a recursive Gaussian filter
+ ** @param B  gain (out).
+ ** @param a1 first feedback coefficient (out).
+ ** @param a2 second feedback coefficient (out).
+ ** @param a3 third feedback coefficient (out).
+ ** @param sigma standard deviation (at least 0.5).
+ **
+ ** The filter is the third order one of Young and van Vliet,
+ ** <em>Recursive implementation of the Gaussian filter</em>, Signal
+ ** Processing, 1995, applied causally as
+ ** @f$ w_n = B x_n + a_1 w_{n-1} + a_2 w_{n-2} + a_3 w_{n-3} @f$
+ ** and then anti-causally in the same manner. The poles are the
+ ** ones optimized for the maximum error by van Vliet, Young and
+ ** Verbeek, <em>Recursive Gaussian derivative filters</em>, ICPR
+ ** 1998, for a standard deviation of 2. They are scaled to
+ ** @f$ d_k^{1/q} @f$, where @f$ q @f$ is found by bisection so that
+ ** the variance of the filter is exactly @f$ \sigma^2 @f$. This is
+ ** considerably more accurate than the closed form approximation of
+ ** @f$ q @f$ given in the first paper.
+ **/
+
+static void
+_vl_imopv_get_recursive_gaussian (double *B, double *a1, double *a2, double *a3,
+                                  double sigma)
+{
+  double const variance = sigma * sigma ;
+  double qmin = 0, qmax = sigma ;
+  double q, rho, theta, pr, pi, p3, pp ;
+  int i ;
+
+  while (_vl_imopv_get_recursive_variance (qmax) < variance) qmax *= 2 ;
+  for (i = 0 ; i < 60 ; ++i) {
+    q = 0.5 * (qmin + qmax) ;
+    if (_vl_imopv_get_recursive_variance (q) < variance) qmin = q ; else qmax = q ;
+  }
+  q = 0.5 * (qmin + qmax) ;
+
+  /* the filter poles are the reciprocal of the scaled poles */
+  rho = pow (VL_IMOPV_RECURSIVE_POLE_RE * VL_IMOPV_RECURSIVE_POLE_RE +
+             VL_IMOPV_RECURSIVE_POLE_IM * VL_IMOPV_RECURSIVE_POLE_IM, - 0.5 / q) ;
+  theta = - atan2 (VL_IMOPV_RECURSIVE_POLE_IM, VL_IMOPV_RECURSIVE_POLE_RE) / q ;
+  pr = rho * cos (theta) ;
+  pi = rho * sin (theta) ;
+  p3 = pow (VL_IMOPV_RECURSIVE_POLE_REAL, - 1.0 / q) ;
+  pp = pr * pr + pi * pi ;
+
+  /* expand (1 - p z^-1) (1 - conj(p) z^-1) (1 - p3 z^-1) */
+  *a1 = 2 * pr + p3 ;
+  *a2 = - (pp + 2 * pr * p3) ;
+  *a3 = pp * p3 ;
+  *B = 1.0 - (*a1 + *a2 + *a3) ;
+}
+
 #define FLT VL_TYPE_FLOAT
 #define VL_IMOPV_INSTANTIATING
 #include "imopv.c"
@@ -67,6 +197,223 @@ the terms of the BSD license (see the COPYING file).
 
 #if (FLT == VL_TYPE_FLOAT || FLT == VL_TYPE_DOUBLE)
 
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Linear combination of image rows
+ ** @param dst destination row.
+ ** @param rows source rows.
+ ** @param coeffs coefficients.
+ ** @param numRows number of source rows and coefficients.
+ ** @param n number of elements per row.
+ **
+ ** The function computes <code>dst[i] = sum_k rows[k][i] *
+ ** coeffs[k]</code>, accumulating the terms in order of increasing
+ ** @c k starting from zero. This is the same order as in
+ ** ::vl_imconvcol_vf, so that the tiled convolutions below give
+ ** identical results.
+ **/
+
+static void
+VL_XCAT(_vl_imcombrows_v, SFX)
+(T * dst, T const ** rows, T const * coeffs, vl_size numRows, vl_size n)
+{
+  vl_uindex i, k ;
+
+  /* dispatch to accelerated version */
+#ifndef VL_DISABLE_AVX512
+  if (vl_cpu_has_avx512f() && vl_get_simd_enabled()) {
+    VL_XCAT3(_vl_imcombrows_v,SFX,_avx512) (dst, rows, coeffs, numRows, n) ;
+    return ;
+  }
+#endif
+#ifndef VL_DISABLE_AVX
+  if (vl_cpu_has_avx() && vl_get_simd_enabled()) {
+    VL_XCAT3(_vl_imcombrows_v,SFX,_avx) (dst, rows, coeffs, numRows, n) ;
+    return ;
+  }
+#endif
+#ifndef VL_DISABLE_SSE2
+  if (vl_cpu_has_sse2() && vl_get_simd_enabled()) {
+    VL_XCAT3(_vl_imcombrows_v,SFX,_sse2) (dst, rows, coeffs, numRows, n) ;
+    return ;
+  }
+#endif
+
+  for (i = 0 ; i < n ; ++i) {
+    T acc = 0 ;
+    for (k = 0 ; k < numRows ; ++k) {
+      acc += rows [k] [i] * coeffs [k] ;
+    }
+    dst [i] = acc ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Convolve image along columns (tiled, not transposed)
+ ** @param dst destination image.
+ ** @param dst_stride width of the destination image including padding.
+ ** @param src source image.
+ ** @param src_width width of the source image.
+ ** @param src_height height of the source image.
+ ** @param src_stride width of the source image including padding.
+ ** @param filt filter kernel.
+ ** @param filt_begin coordinate of the first filter element.
+ ** @param filt_end coordinate of the last filter element.
+ ** @param step sub-sampling step.
+ ** @param flags operation modes (::VL_TRANSPOSE is ignored).
+ ** @param begin first destination row to compute.
+ ** @param end one past the last destination row to compute.
+ **
+ ** The function computes the destination rows in the range
+ ** [@a begin, @a end) of ::vl_imconvcol_vf without transposition. The
+ ** image is traversed in row order, one tile of columns at a time.
+ ** The tile width is chosen so that the source rows touched by the
+ ** filter (the tile and its halo above and below) fit in
+ ** ::VL_IMOPV_TILE_SIZE bytes, so that each source row is read from
+ ** the memory once per tile. Each destination row of a tile is then
+ ** a linear combination of source rows (::_vl_imcombrows_vf), with
+ ** padding implemented by pointing at the first or last row or at a
+ ** row of zeros.
+ **/
+
+static void
+VL_XCAT(_vl_imconvcol_tiled_v, SFX)
+(T* dst, vl_size dst_stride,
+ T const* src,
+ vl_size src_width, vl_size src_height, vl_size src_stride,
+ T const* filt, vl_index filt_begin, vl_index filt_end,
+ int step, unsigned int flags,
+ vl_index begin, vl_index end)
+{
+  vl_size const numTaps = filt_end - filt_begin + 1 ;
+  vl_bool const zeropad = (flags & VL_PAD_MASK) == VL_PAD_BY_ZERO ;
+  vl_size tileWidth = VL_IMOPV_TILE_SIZE / (sizeof(T) * numTaps) ;
+  T const ** rows ;
+  T * coeffs ;
+  T * zeros = NULL ;
+  vl_uindex x, k ;
+  vl_index j ;
+
+  tileWidth = VL_MAX(tileWidth & ~ (vl_size)63, 64) ;
+  tileWidth = VL_MIN(tileWidth, src_width) ;
+
+#if defined(_OPENMP)
+#pragma omp critical
+#endif
+  {
+    rows = vl_malloc (sizeof(T const*) * numTaps) ;
+    coeffs = vl_malloc (sizeof(T) * numTaps) ;
+    if (zeropad) zeros = vl_calloc (tileWidth, sizeof(T)) ;
+  }
+
+  /* the k-th term of the sum multiplies the source row y - filt_end + k */
+  for (k = 0 ; k < numTaps ; ++k) {
+    coeffs [k] = filt [numTaps - 1 - k] ;
+  }
+
+  for (x = 0 ; x < src_width ; x += tileWidth) {
+    vl_size const n = VL_MIN(tileWidth, src_width - x) ;
+    T const * first = src + x ;
+    T const * last = src + x + (src_height - 1) * src_stride ;
+    for (j = begin ; j < end ; ++j) {
+      vl_index const y = j * step ;
+      for (k = 0 ; k < numTaps ; ++k) {
+        vl_index const p = y - filt_end + (signed)k ;
+        if (p < 0) {
+          rows [k] = zeropad ? zeros : first ;
+        } else if (p >= (signed)src_height) {
+          rows [k] = zeropad ? zeros : last ;
+        } else {
+          rows [k] = first + p * src_stride ;
+        }
+      }
+      VL_XCAT(_vl_imcombrows_v, SFX) (dst + j * dst_stride + x, rows, coeffs, numTaps, n) ;
+    }
+  }
+
+#if defined(_OPENMP)
+#pragma omp critical
+#endif
+  {
+    vl_free (rows) ;
+    vl_free (coeffs) ;
+    if (zeros) vl_free (zeros) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Convolve image along rows
+ ** @param dst destination image.
+ ** @param dst_stride width of the destination image including padding.
+ ** @param src source image.
+ ** @param width width of the image.
+ ** @param src_stride width of the source image including padding.
+ ** @param filt filter kernel.
+ ** @param filt_begin coordinate of the first filter element.
+ ** @param filt_end coordinate of the last filter element.
+ ** @param begin first row to filter.
+ ** @param end one past the last row to filter.
+ **
+ ** The function is the row-wise counterpart of
+ ** ::_vl_imconvcol_tiled_vf, padding by continuity. Each row is
+ ** copied to a padded buffer, and the filter taps become shifted
+ ** views of it. The result is identical to filtering the transposed
+ ** image by ::vl_imconvcol_vf.
+ **/
+
+static void
+VL_XCAT(_vl_imconvrow_v, SFX)
+(T* dst, vl_size dst_stride,
+ T const* src, vl_size width, vl_size src_stride,
+ T const* filt, vl_index filt_begin, vl_index filt_end,
+ vl_index begin, vl_index end)
+{
+  vl_size const numTaps = filt_end - filt_begin + 1 ;
+  T const ** rows ;
+  T * coeffs ;
+  T * padded ;
+  vl_uindex k ;
+  vl_index x, y ;
+
+#if defined(_OPENMP)
+#pragma omp critical
+#endif
+  {
+    rows = vl_malloc (sizeof(T const*) * numTaps) ;
+    coeffs = vl_malloc (sizeof(T) * numTaps) ;
+    padded = vl_malloc (sizeof(T) * (width + numTaps - 1)) ;
+  }
+
+  /* padded [filt_end + x] is the source element x */
+  for (k = 0 ; k < numTaps ; ++k) {
+    coeffs [k] = filt [numTaps - 1 - k] ;
+    rows [k] = padded + k ;
+  }
+
+  for (y = begin ; y < end ; ++y) {
+    T const * srci = src + y * src_stride ;
+    for (x = 0 ; x < filt_end ; ++x) {
+      padded [x] = srci [0] ;
+    }
+    memcpy (padded + filt_end, srci, sizeof(T) * width) ;
+    for (x = filt_end + width ; x < (signed)(width + numTaps - 1) ; ++x) {
+      padded [x] = srci [width - 1] ;
+    }
+    VL_XCAT(_vl_imcombrows_v, SFX) (dst + y * dst_stride, rows, coeffs, numTaps, width) ;
+  }
+
+#if defined(_OPENMP)
+#pragma omp critical
+#endif
+  {
+    vl_free (rows) ;
+    vl_free (coeffs) ;
+    vl_free (padded) ;
+  }
+}
+
 /** @fn vl_imconvcol_vd(double*,vl_size,double const*,vl_size,vl_size,vl_size,double const*,vl_index,vl_index,int,unsigned int)
  ** @brief Convolve image along columns
  **
@@ -110,6 +457,16 @@ the terms of the BSD license (see the COPYING file).
  ** boundary. To cope with this edge cases, the function either pads
  ** the image by zero (::VL_PAD_BY_ZERO) or with the values at the
  ** boundary (::VL_PAD_BY_CONTINUITY).
+ **
+ ** If SIMD instructions are enabled (::vl_set_simd_enabled), the
+ ** function uses the widest of the AVX-512, AVX and SSE2 kernels
+ ** supported by the CPU. The AVX and AVX-512 kernels do not require
+ ** the image to be aligned and produce the same results as the
+ ** plain C code.
+ **
+ ** Without ::VL_TRANSPOSE, the image is processed in tiles of columns
+ ** small enough to stay in the cache, writing the output in row
+ ** order. The results are identical to the transposed case.
  **/
 
 /** @fn vl_imconvcol_vf(float*,vl_size,float const*,vl_size,vl_size,vl_size,float const*,vl_index,vl_index,int,unsigned int)
@@ -130,7 +487,36 @@ VL_XCAT(vl_imconvcol_v, SFX)
   vl_bool transp = flags & VL_TRANSPOSE ;
   vl_bool zeropad = (flags & VL_PAD_MASK) == VL_PAD_BY_ZERO ;
 
+  /* without transposition, traverse the image in row order by tiles */
+  if (! transp) {
+    VL_XCAT(_vl_imconvcol_tiled_v, SFX) (dst, dst_stride,
+                                         src, src_width, src_height, src_stride,
+                                         filt, filt_begin, filt_end,
+                                         step, flags, 0, dheight) ;
+    return ;
+  }
+
   /* dispatch to accelerated version */
+#ifndef VL_DISABLE_AVX512
+  if (vl_cpu_has_avx512f() && vl_get_simd_enabled()) {
+    VL_XCAT3(_vl_imconvcol_v,SFX,_avx512)
+    (dst,dst_stride,
+     src,src_width,src_height,src_stride,
+     filt,filt_begin,filt_end,
+     step,flags) ;
+    return ;
+  }
+#endif
+#ifndef VL_DISABLE_AVX
+  if (vl_cpu_has_avx() && vl_get_simd_enabled()) {
+    VL_XCAT3(_vl_imconvcol_v,SFX,_avx)
+    (dst,dst_stride,
+     src,src_width,src_height,src_stride,
+     filt,filt_begin,filt_end,
+     step,flags) ;
+    return ;
+  }
+#endif
 #ifndef VL_DISABLE_SSE2
   if (vl_cpu_has_sse2() && vl_get_simd_enabled()) {
     VL_XCAT3(_vl_imconvcol_v,SFX,_sse2)
@@ -610,6 +996,17 @@ VL_XCAT(vl_imconvcoltri_, SFX)
  ** @param stride
  ** @param sigmax
  ** @param sigmay
+ **
+ ** If VLFeat is compiled with OpenMP, images of sufficient size are
+ ** smoothed by up to ::vl_get_max_threads() threads (see @ref
+ ** threads-parallel). The result does not depend on the number of
+ ** threads.
+ **
+ ** The image is filtered first along the columns, one cache-sized
+ ** tile of columns at a time, and then along the rows. Neither pass
+ ** transposes the image, so memory is read and written in row order.
+ ** The result is the same as filtering twice with ::vl_imconvcol_vd
+ ** and ::VL_TRANSPOSE.
  **/
 
 /** @fn vl_imsmooth_f(float*,vl_size,float const*,vl_size,vl_size,vl_size,double,double)
@@ -641,41 +1038,332 @@ VL_XCAT(_vl_new_gaussian_fitler_,SFX)(vl_size *size, double sigma)
   return filter ;
 }
 
+/** @fn vl_imsmooth_planes_d(double**,vl_size,double const*const*,vl_size,vl_size,vl_size,vl_size,double,double)
+ ** @brief Smooth several images with the same Gaussian filter
+ ** @param smoothed smoothed images (out).
+ ** @param smoothedStride width of the smoothed images including padding.
+ ** @param images images.
+ ** @param numPlanes number of images.
+ ** @param width image width.
+ ** @param height image height.
+ ** @param stride width of the images including padding.
+ ** @param sigmax standard deviation along the rows.
+ ** @param sigmay standard deviation along the columns.
+ **
+ ** The function is equivalent to calling ::vl_imsmooth_d on each of
+ ** the @a numPlanes images, with the same result, but creates the
+ ** filters, the temporary buffer and the threads only once. The
+ ** images may be smoothed in place.
+ **/
+
+/** @fn vl_imsmooth_planes_f(float**,vl_size,float const*const*,vl_size,vl_size,vl_size,vl_size,double,double)
+ ** @brief Smooth several images with the same Gaussian filter
+ ** @see ::vl_imsmooth_planes_d
+ **/
+
+VL_EXPORT void
+VL_XCAT(vl_imsmooth_planes_, SFX)
+(T ** smoothed, vl_size smoothedStride,
+ T const * const * images, vl_size numPlanes,
+ vl_size width, vl_size height, vl_size stride,
+ double sigmax, double sigmay)
+{
+  T *filterx, *filtery, *buffer ;
+  vl_size sizex, sizey ;
+  vl_index band, numBands = 1 ;
+
+  /* the function may be called from a parallel region (e.g. VlCovDet) */
+#if defined(_OPENMP)
+#pragma omp critical
+#endif
+  {
+    filterx = VL_XCAT(_vl_new_gaussian_fitler_,SFX)(&sizex,sigmax) ;
+    if (sigmax == sigmay) {
+      filtery = filterx ;
+      sizey = sizex ;
+    } else {
+      filtery = VL_XCAT(_vl_new_gaussian_fitler_,SFX)(&sizey,sigmay) ;
+    }
+    buffer = vl_malloc(width*height*sizeof(T)) ;
+  }
+
+  /*
+   The image is filtered along the columns and then along the rows,
+   without transposing it, so that both passes read and write memory
+   in row order. The passes are split in bands of rows, one per
+   thread. Since each row is computed independently, the result does
+   not depend on the number of bands. Small images are processed by a
+   single thread. The planes are processed in turn by the same
+   threads, reusing the buffer.
+   */
+  if (width * height >= VL_IMOPV_MIN_PARALLEL_SIZE) {
+    numBands = vl_get_max_threads() ;
+  }
+
+#if defined(_OPENMP)
+#pragma omp parallel default(shared) private(band) num_threads(numBands)
+#endif
+  {
+    vl_uindex p ;
+    for (p = 0 ; p < numPlanes ; ++p) {
+#if defined(_OPENMP)
+#pragma omp for
+#endif
+      for (band = 0 ; band < numBands ; ++band) {
+        vl_size begin, end ;
+        _vl_imopv_get_band (&begin, &end, height, band, numBands) ;
+        if (begin >= end) continue ;
+        VL_XCAT(_vl_imconvcol_tiled_v, SFX) (buffer, width,
+                                             images[p], width, height, stride,
+                                             filtery,
+                                             -((signed)sizey-1)/2, ((signed)sizey-1)/2,
+                                             1, VL_PAD_BY_CONTINUITY,
+                                             begin, end) ;
+      }
+
+#if defined(_OPENMP)
+#pragma omp for
+#endif
+      for (band = 0 ; band < numBands ; ++band) {
+        vl_size begin, end ;
+        _vl_imopv_get_band (&begin, &end, height, band, numBands) ;
+        if (begin >= end) continue ;
+        VL_XCAT(_vl_imconvrow_v, SFX) (smoothed[p], smoothedStride,
+                                       buffer, width, width,
+                                       filterx,
+                                       -((signed)sizex-1)/2, ((signed)sizex-1)/2,
+                                       begin, end) ;
+      }
+    }
+  }
+
+#if defined(_OPENMP)
+#pragma omp critical
+#endif
+  {
+    vl_free(buffer) ;
+    vl_free(filterx) ;
+    if (sigmax != sigmay) {
+      vl_free(filtery) ;
+    }
+  }
+}
+
 VL_EXPORT void
 VL_XCAT(vl_imsmooth_, SFX)
 (T * smoothed, vl_size smoothedStride,
  T const *image, vl_size width, vl_size height, vl_size stride,
  double sigmax, double sigmay)
 {
-  T *filterx, *filtery, *buffer ;
-  vl_size sizex, sizey ;
+  VL_XCAT(vl_imsmooth_planes_, SFX) (&smoothed, smoothedStride,
+                                     &image, 1,
+                                     width, height, stride,
+                                     sigmax, sigmay) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Convolve image along columns by a recursive Gaussian
+ ** @param dst destination image (transposed).
+ ** @param dstStride width of the destination image including padding.
+ ** @param src source image.
+ ** @param srcWidth width of the source image.
+ ** @param srcHeight height of the source image.
+ ** @param srcStride width of the source image including padding.
+ ** @param sigma standard deviation (at least 0.5).
+ ** @param buffer temporary buffer.
+ **
+ ** The function is the recursive equivalent of ::vl_imconvcol_vf with
+ ** a Gaussian filter and the flags ::VL_PAD_BY_CONTINUITY and
+ ** ::VL_TRANSPOSE. The buffer must hold <code>srcHeight +
+ ** ceil(VL_IMOPV_RECURSIVE_TAIL * sigma)</code> elements.
+ **
+ ** Padding by continuity is exact for the causal pass, as a constant
+ ** signal is a steady state of the filter. For the anti-causal pass
+ ** the column is extended by continuity for a few standard
+ ** deviations, after which the filter is assumed to be in the steady
+ ** state.
+ **/
 
-  filterx = VL_XCAT(_vl_new_gaussian_fitler_,SFX)(&sizex,sigmax) ;
-  if (sigmax == sigmay) {
-    filtery = filterx ;
-    sizey = sizex ;
-  } else {
-    filtery = VL_XCAT(_vl_new_gaussian_fitler_,SFX)(&sizey,sigmay) ;
+static void
+VL_XCAT(_vl_imconvcol_recursive_, SFX)
+(T * dst, vl_size dstStride,
+ T const * src, vl_size srcWidth, vl_size srcHeight, vl_size srcStride,
+ double sigma, double * buffer)
+{
+  double B, a1, a2, a3 ;
+  vl_index const numSamples = srcHeight + (vl_size) vl_ceil_d (VL_IMOPV_RECURSIVE_TAIL * sigma) ;
+  vl_index x, y ;
+
+  _vl_imopv_get_recursive_gaussian (&B, &a1, &a2, &a3, sigma) ;
+
+  for (x = 0 ; x < (signed)srcWidth ; ++x) {
+    T const * column = src + x ;
+    T * row = dst + x * dstStride ;
+    double w1, w2, w3, v ;
+    double const last = column [(srcHeight - 1) * srcStride] ;
+
+    /* causal pass */
+    w1 = w2 = w3 = column [0] ;
+    for (y = 0 ; y < (signed)srcHeight ; ++y) {
+      v = B * column [y * srcStride] + a1 * w1 + a2 * w2 + a3 * w3 ;
+      buffer [y] = v ; w3 = w2 ; w2 = w1 ; w1 = v ;
+    }
+    for ( ; y < numSamples ; ++y) {
+      v = B * last + a1 * w1 + a2 * w2 + a3 * w3 ;
+      buffer [y] = v ; w3 = w2 ; w2 = w1 ; w1 = v ;
+    }
+
+    /* anti-causal pass */
+    w1 = w2 = w3 = buffer [numSamples - 1] ;
+    for (y = numSamples - 1 ; y >= (signed)srcHeight ; --y) {
+      v = B * buffer [y] + a1 * w1 + a2 * w2 + a3 * w3 ;
+      w3 = w2 ; w2 = w1 ; w1 = v ;
+    }
+    for ( ; y >= 0 ; --y) {
+      v = B * buffer [y] + a1 * w1 + a2 * w2 + a3 * w3 ;
+      row [y] = (T) v ; w3 = w2 ; w2 = w1 ; w1 = v ;
+    }
   }
-  buffer = vl_malloc(width*height*sizeof(T)) ;
+}
 
-  VL_XCAT(vl_imconvcol_v,SFX) (buffer, height,
-                               image, width, height, stride,
-                               filtery,
-                               -((signed)sizey-1)/2, ((signed)sizey-1)/2,
-                               1, VL_PAD_BY_CONTINUITY | VL_TRANSPOSE) ;
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Smooth image along columns by a Gaussian
+ ** @param dst destination image (transposed).
+ ** @param dstStride width of the destination image including padding.
+ ** @param src source image.
+ ** @param width width of the source image.
+ ** @param height height of the source image.
+ ** @param stride width of the source image including padding.
+ ** @param sigma standard deviation.
+ ** @param numBands number of bands to process in parallel.
+ **
+ ** The function uses the recursive filter if @a sigma is at least
+ ** ::VL_IMOPV_RECURSIVE_MIN_SIGMA and the FIR filter otherwise.
+ **/
 
-  VL_XCAT(vl_imconvcol_v,SFX) (smoothed, smoothedStride,
-                               buffer, height, width, height,
-                               filterx,
-                               -((signed)sizex-1)/2, ((signed)sizex-1)/2,
-                               1, VL_PAD_BY_CONTINUITY | VL_TRANSPOSE) ;
+static void
+VL_XCAT(_vl_imsmooth_recursive_pass_, SFX)
+(T * dst, vl_size dstStride,
+ T const * src, vl_size width, vl_size height, vl_size stride,
+ double sigma, vl_index numBands)
+{
+  vl_index band ;
+  vl_size filterSize = 0 ;
+  T * filter = NULL ;
 
-  vl_free(buffer) ;
-  vl_free(filterx) ;
-  if (sigmax != sigmay) {
-    vl_free(filtery) ;
+  if (sigma < VL_IMOPV_RECURSIVE_MIN_SIGMA) {
+    filter = VL_XCAT(_vl_new_gaussian_fitler_,SFX)(&filterSize, sigma) ;
   }
+
+#if defined(_OPENMP)
+#pragma omp parallel default(shared) private(band) num_threads(numBands)
+#endif
+  {
+    double * buffer = NULL ;
+    if (filter == NULL) {
+#if defined(_OPENMP)
+#pragma omp critical
+#endif
+      buffer = vl_malloc (sizeof(double) *
+                          (height + (vl_size) vl_ceil_d (VL_IMOPV_RECURSIVE_TAIL * sigma))) ;
+    }
+
+#if defined(_OPENMP)
+#pragma omp for
+#endif
+    for (band = 0 ; band < numBands ; ++band) {
+      vl_size begin, end ;
+      _vl_imopv_get_band (&begin, &end, width, band, numBands) ;
+      if (begin >= end) continue ;
+      if (filter) {
+        VL_XCAT(vl_imconvcol_v,SFX) (dst + begin * dstStride, dstStride,
+                                     src + begin, end - begin, height, stride,
+                                     filter,
+                                     -((signed)filterSize-1)/2, ((signed)filterSize-1)/2,
+                                     1, VL_PAD_BY_CONTINUITY | VL_TRANSPOSE) ;
+      } else {
+        VL_XCAT(_vl_imconvcol_recursive_, SFX) (dst + begin * dstStride, dstStride,
+                                                src + begin, end - begin, height, stride,
+                                                sigma, buffer) ;
+      }
+    }
+
+    if (buffer) {
+#if defined(_OPENMP)
+#pragma omp critical
+#endif
+      vl_free (buffer) ;
+    }
+  }
+
+  if (filter) vl_free (filter) ;
+}
+
+/** @fn vl_imsmooth_recursive_d(double*,vl_size,double const*,vl_size,vl_size,vl_size,double,double)
+ ** @brief Smooth an image with a recursive Gaussian filter
+ ** @param smoothed smoothed image (out).
+ ** @param smoothedStride width of the smoothed image including padding.
+ ** @param image image.
+ ** @param width image width.
+ ** @param height image height.
+ ** @param stride width of the image including padding.
+ ** @param sigmax standard deviation along the rows.
+ ** @param sigmay standard deviation along the columns.
+ **
+ ** The function is a drop-in replacement of ::vl_imsmooth_d whose
+ ** cost per pixel does not depend on the standard deviation. It
+ ** uses a third order recursive filter (Young and van Vliet, 1995,
+ ** with the poles of van Vliet, Young and Verbeek, 1998), run
+ ** forward and backward along each dimension, with the image padded
+ ** by continuity. This is advantageous for standard deviations
+ ** larger than a few pixels, as the cost of ::vl_imsmooth_d grows
+ ** linearly with them.
+ **
+ ** The recursive filter approximates the Gaussian kernel. For
+ ** standard deviations in the range 2 to 64, the smoothed image
+ ** differs from the one computed by ::vl_imsmooth_d (whose kernel is
+ ** itself truncated at three standard deviations) by less than 1% of
+ ** the range of the input image for smooth images, noise and
+ ** checkerboards of any square size. The largest differences occur
+ ** for checkerboards with squares of three to five standard
+ ** deviations and do not decrease steadily with the standard
+ ** deviation. For arbitrary inputs the difference is bounded by half
+ ** the L1 distance between the two kernels, which is below 2.5% of
+ ** the range of the input image and tends to 1.5% for large standard
+ ** deviations. Along a dimension with standard deviation smaller
+ ** than 2, where the approximation is coarser and the FIR filter is
+ ** cheap anyway, the function uses the FIR filter instead.
+ **
+ ** The image is processed in parallel as in ::vl_imsmooth_d.
+ **/
+
+/** @fn vl_imsmooth_recursive_f(float*,vl_size,float const*,vl_size,vl_size,vl_size,double,double)
+ ** @brief Smooth an image with a recursive Gaussian filter
+ ** @see ::vl_imsmooth_recursive_d
+ **/
+
+VL_EXPORT void
+VL_XCAT(vl_imsmooth_recursive_, SFX)
+(T * smoothed, vl_size smoothedStride,
+ T const *image, vl_size width, vl_size height, vl_size stride,
+ double sigmax, double sigmay)
+{
+  vl_index numBands = 1 ;
+  T * buffer = vl_malloc(width*height*sizeof(T)) ;
+
+  if (width * height >= VL_IMOPV_MIN_PARALLEL_SIZE) {
+    numBands = vl_get_max_threads() ;
+  }
+
+  VL_XCAT(_vl_imsmooth_recursive_pass_, SFX) (buffer, height,
+                                              image, width, height, stride,
+                                              sigmay, numBands) ;
+  VL_XCAT(_vl_imsmooth_recursive_pass_, SFX) (smoothed, smoothedStride,
+                                              buffer, height, width, height,
+                                              sigmax, numBands) ;
+  vl_free(buffer) ;
 }
 
 /* VL_TYPE_FLOAT, VL_TYPE_DOUBLE */
@@ -119,6 +119,28 @@ vl_imsmooth_d (double *smoothed, vl_size smoothedStride,
                double const *image, vl_size width, vl_size height, vl_size stride,
                double sigmax, double sigmay) ;
 
+VL_EXPORT void
+vl_imsmooth_planes_f (float **smoothed, vl_size smoothedStride,
+                      float const * const *images, vl_size numPlanes,
+                      vl_size width, vl_size height, vl_size stride,
+                      double sigmax, double sigmay) ;
+
+VL_EXPORT void
+vl_imsmooth_planes_d (double **smoothed, vl_size smoothedStride,
+                      double const * const *images, vl_size numPlanes,
+                      vl_size width, vl_size height, vl_size stride,
+                      double sigmax, double sigmay) ;
+
+VL_EXPORT void
+vl_imsmooth_recursive_f (float *smoothed, vl_size smoothedStride,
+                         float const *image, vl_size width, vl_size height, vl_size stride,
+                         double sigmax, double sigmay) ;
+
+VL_EXPORT void
+vl_imsmooth_recursive_d (double *smoothed, vl_size smoothedStride,
+                         double const *image, vl_size width, vl_size height, vl_size stride,
+                         double sigmax, double sigmay) ;
+
 /** @} */
 
 /* ---------------------------------------------------------------- */
@@ -0,0 +1,185 @@
+/** @file imopv_avx.c
+ ** @brief Vectorized image operations - AVX - Definition
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#if ! defined(VL_DISABLE_AVX) & ! defined(__AVX__)
+#error "Compiling with AVX enabled, but no __AVX__ defined"
+#endif
+
+#if ! defined(VL_DISABLE_AVX)
+
+#ifndef VL_IMOPV_AVX_INSTANTIATING
+
+#include <immintrin.h>
+
+#include "imopv.h"
+#include "imopv_avx.h"
+
+/* lane masks for the last, partial, group of columns */
+static vl_int32 const _vl_imopv_avx_mask32 [16] =
+{ -1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0 } ;
+static vl_int64 const _vl_imopv_avx_mask64 [8] =
+{ -1, -1, -1, -1, 0, 0, 0, 0 } ;
+
+#define FLT VL_TYPE_FLOAT
+#define VL_IMOPV_AVX_INSTANTIATING
+#include "imopv_avx.c"
+
+#define FLT VL_TYPE_DOUBLE
+#define VL_IMOPV_AVX_INSTANTIATING
+#include "imopv_avx.c"
+
+/* ---------------------------------------------------------------- */
+/* VL_IMOPV_AVX_INSTANTIATING */
+#else
+
+#include "float.th"
+
+#undef VMASK
+#if (FLT == VL_TYPE_FLOAT)
+#define VMASK(n) _mm256_loadu_si256 ((__m256i const*) (_vl_imopv_avx_mask32 + 8 - (n)))
+#else
+#define VMASK(n) _mm256_loadu_si256 ((__m256i const*) (_vl_imopv_avx_mask64 + 4 - (n)))
+#endif
+
+/* ---------------------------------------------------------------- */
+/*
+ This is the same algorithm as vl_imconvcol_v in imopv.c, processing
+ VSIZEavx columns at a time. The columns need not be aligned: full
+ groups use unaligned loads and the last group masked loads and
+ stores. Products and sums are evaluated in the same order as in the
+ scalar code and without fused multiply-add, so the results are
+ identical to it.
+ */
+
+void
+VL_XCAT3(_vl_imconvcol_v, SFX, _avx)
+(T* dst, vl_size dst_stride,
+ T const* src,
+ vl_size src_width, vl_size src_height, vl_size src_stride,
+ T const* filt, vl_index filt_begin, vl_index filt_end,
+ int step, unsigned int flags)
+{
+  vl_index x, y, k ;
+  vl_bool transp    = flags & VL_TRANSPOSE ;
+  vl_bool zeropad   = (flags & VL_PAD_MASK) == VL_PAD_BY_ZERO ;
+
+  /* let filt point to the last sample of the filter */
+  filt += filt_end - filt_begin ;
+
+  for (x = 0 ; x < (signed)src_width ; x += VSIZEavx) {
+    vl_index const numColumns = VL_MIN(VSIZEavx, (signed)src_width - x) ;
+    vl_bool const full = (numColumns == VSIZEavx) ;
+    __m256i const mask = VMASK(numColumns) ;
+    T * dsti = transp ? dst + x * dst_stride : dst + x ;
+
+#define LOAD(p) (full ? VLDUavx (p) : VLDMavx ((p), mask))
+
+    for (y = 0 ; y < (signed)src_height ; y += step)  {
+      union {VTYPEavx v ; T x [VSIZEavx] ; } acc ;
+      VTYPEavx v, c ;
+      T const *filti ;
+      T const *srci ;
+      vl_index stop ;
+      acc.v = VSTZavx () ;
+      v = VSTZavx () ;
+
+      filti = filt ;
+      stop = filt_end - y ;
+      srci = src + x - stop * src_stride ;
+
+      if (stop > 0) {
+        if (! zeropad) {
+          v = LOAD (src + x) ;
+        }
+        while (filti > filt - stop) {
+          c = VLD1avx (filti--) ;
+          acc.v = VADDavx (acc.v, VMULavx (v, c)) ;
+          srci += src_stride ;
+        }
+      }
+
+      stop = filt_end - VL_MAX(filt_begin, y - (signed)src_height + 1) + 1 ;
+      while (filti > filt - stop) {
+        v = LOAD (srci) ;
+        c = VLD1avx (filti--) ;
+        acc.v = VADDavx (acc.v, VMULavx (v, c)) ;
+        srci += src_stride ;
+      }
+
+      if (zeropad) v = VSTZavx () ;
+
+      stop = filt_end - filt_begin + 1 ;
+      while (filti > filt - stop) {
+        c = VLD1avx (filti--) ;
+        acc.v = VADDavx (acc.v, VMULavx (v, c)) ;
+      }
+
+      if (transp) {
+        for (k = 0 ; k < numColumns ; ++k) {
+          dsti [k * dst_stride] = acc.x [k] ;
+        }
+        dsti += 1 ;
+      } else {
+        if (full) {
+          VST2Uavx (dsti, acc.v) ;
+        } else {
+          VSTMavx (dsti, mask, acc.v) ;
+        }
+        dsti += dst_stride ;
+      }
+    } /* next y */
+#undef LOAD
+  } /* next x */
+}
+
+/* ---------------------------------------------------------------- */
+void
+VL_XCAT3(_vl_imcombrows_v, SFX, _avx)
+(T* dst, T const** rows, T const* coeffs, vl_size num_rows, vl_size n)
+{
+  vl_uindex i = 0, k ;
+
+  for ( ; i + 4 * VSIZEavx <= n ; i += 4 * VSIZEavx) {
+    VTYPEavx a0 = VSTZavx (), a1 = VSTZavx (), a2 = VSTZavx (), a3 = VSTZavx () ;
+    for (k = 0 ; k < num_rows ; ++k) {
+      T const * r = rows [k] + i ;
+      VTYPEavx c = VLD1avx (coeffs + k) ;
+      a0 = VADDavx (a0, VMULavx (VLDUavx (r               ), c)) ;
+      a1 = VADDavx (a1, VMULavx (VLDUavx (r +     VSIZEavx), c)) ;
+      a2 = VADDavx (a2, VMULavx (VLDUavx (r + 2 * VSIZEavx), c)) ;
+      a3 = VADDavx (a3, VMULavx (VLDUavx (r + 3 * VSIZEavx), c)) ;
+    }
+    VST2Uavx (dst + i,                a0) ;
+    VST2Uavx (dst + i +     VSIZEavx, a1) ;
+    VST2Uavx (dst + i + 2 * VSIZEavx, a2) ;
+    VST2Uavx (dst + i + 3 * VSIZEavx, a3) ;
+  }
+
+  while (i < n) {
+    vl_size const numColumns = VL_MIN(VSIZEavx, n - i) ;
+    __m256i const mask = VMASK(numColumns) ;
+    VTYPEavx acc = VSTZavx () ;
+    for (k = 0 ; k < num_rows ; ++k) {
+      acc = VADDavx (acc, VMULavx (VLDMavx (rows [k] + i, mask), VLD1avx (coeffs + k))) ;
+    }
+    VSTMavx (dst + i, mask, acc) ;
+    i += numColumns ;
+  }
+}
+
+#undef FLT
+#undef VL_IMOPV_AVX_INSTANTIATING
+#endif
+
+/* ! VL_DISABLE_AVX */
+#endif
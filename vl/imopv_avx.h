@@ -0,0 +1,46 @@
+/** @file imopv_avx.h
+ ** @brief Vectorized image operations - AVX
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_IMOPV_AVX_H
+#define VL_IMOPV_AVX_H
+
+#include "generic.h"
+
+#ifndef VL_DISABLE_AVX
+
+VL_EXPORT
+void _vl_imconvcol_vf_avx (float* dst, vl_size dst_stride,
+                           float const* src,
+                           vl_size src_width, vl_size src_height, vl_size src_stride,
+                           float const* filt, vl_index filt_begin, vl_index filt_end,
+                           int step, unsigned int flags) ;
+
+VL_EXPORT
+void _vl_imconvcol_vd_avx (double* dst, vl_size dst_stride,
+                           double const* src,
+                           vl_size src_width, vl_size src_height, vl_size src_stride,
+                           double const* filt, vl_index filt_begin, vl_index filt_end,
+                           int step, unsigned int flags) ;
+
+VL_EXPORT
+void _vl_imcombrows_vf_avx (float* dst, float const** rows, float const* coeffs,
+                            vl_size num_rows, vl_size n) ;
+
+VL_EXPORT
+void _vl_imcombrows_vd_avx (double* dst, double const** rows, double const* coeffs,
+                            vl_size num_rows, vl_size n) ;
+
+#endif
+
+/* VL_IMOPV_AVX_H */
+#endif
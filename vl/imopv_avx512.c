@@ -0,0 +1,170 @@
+/** @file imopv_avx512.c
+ ** @brief Vectorized image operations - AVX-512 - Definition
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#if ! defined(VL_DISABLE_AVX512) & ! defined(__AVX512F__)
+#error "Compiling with AVX-512 enabled, but no __AVX512F__ defined"
+#endif
+
+#if ! defined(VL_DISABLE_AVX512)
+
+#ifndef VL_IMOPV_AVX512_INSTANTIATING
+
+#include <immintrin.h>
+
+#include "imopv.h"
+#include "imopv_avx512.h"
+
+#define FLT VL_TYPE_FLOAT
+#define VL_IMOPV_AVX512_INSTANTIATING
+#include "imopv_avx512.c"
+
+#define FLT VL_TYPE_DOUBLE
+#define VL_IMOPV_AVX512_INSTANTIATING
+#include "imopv_avx512.c"
+
+/* ---------------------------------------------------------------- */
+/* VL_IMOPV_AVX512_INSTANTIATING */
+#else
+
+#include "float.th"
+
+/* ---------------------------------------------------------------- */
+/*
+ This is the same kernel as in imopv_avx.c, processing VSIZEavx512
+ columns at a time. The file must be compiled without floating point
+ contraction (-ffp-contract=off), as AVX-512 implies FMA and fused
+ multiply-adds would change the results.
+ */
+
+void
+VL_XCAT3(_vl_imconvcol_v, SFX, _avx512)
+(T* dst, vl_size dst_stride,
+ T const* src,
+ vl_size src_width, vl_size src_height, vl_size src_stride,
+ T const* filt, vl_index filt_begin, vl_index filt_end,
+ int step, unsigned int flags)
+{
+  vl_index x, y, k ;
+  vl_bool transp    = flags & VL_TRANSPOSE ;
+  vl_bool zeropad   = (flags & VL_PAD_MASK) == VL_PAD_BY_ZERO ;
+
+  /* let filt point to the last sample of the filter */
+  filt += filt_end - filt_begin ;
+
+  for (x = 0 ; x < (signed)src_width ; x += VSIZEavx512) {
+    vl_index const numColumns = VL_MIN(VSIZEavx512, (signed)src_width - x) ;
+    vl_bool const full = (numColumns == VSIZEavx512) ;
+    VMASKavx512 const mask = (VMASKavx512) ((1u << numColumns) - 1) ;
+    T * dsti = transp ? dst + x * dst_stride : dst + x ;
+
+#define LOAD(p) (full ? VLDUavx512 (p) : VLDMavx512 (mask, (p)))
+
+    for (y = 0 ; y < (signed)src_height ; y += step)  {
+      union {VTYPEavx512 v ; T x [VSIZEavx512] ; } acc ;
+      VTYPEavx512 v, c ;
+      T const *filti ;
+      T const *srci ;
+      vl_index stop ;
+      acc.v = VSTZavx512 () ;
+      v = VSTZavx512 () ;
+
+      filti = filt ;
+      stop = filt_end - y ;
+      srci = src + x - stop * src_stride ;
+
+      if (stop > 0) {
+        if (! zeropad) {
+          v = LOAD (src + x) ;
+        }
+        while (filti > filt - stop) {
+          c = VSET1avx512 (*filti--) ;
+          acc.v = VADDavx512 (acc.v, VMULavx512 (v, c)) ;
+          srci += src_stride ;
+        }
+      }
+
+      stop = filt_end - VL_MAX(filt_begin, y - (signed)src_height + 1) + 1 ;
+      while (filti > filt - stop) {
+        v = LOAD (srci) ;
+        c = VSET1avx512 (*filti--) ;
+        acc.v = VADDavx512 (acc.v, VMULavx512 (v, c)) ;
+        srci += src_stride ;
+      }
+
+      if (zeropad) v = VSTZavx512 () ;
+
+      stop = filt_end - filt_begin + 1 ;
+      while (filti > filt - stop) {
+        c = VSET1avx512 (*filti--) ;
+        acc.v = VADDavx512 (acc.v, VMULavx512 (v, c)) ;
+      }
+
+      if (transp) {
+        for (k = 0 ; k < numColumns ; ++k) {
+          dsti [k * dst_stride] = acc.x [k] ;
+        }
+        dsti += 1 ;
+      } else {
+        if (full) {
+          VST2Uavx512 (dsti, acc.v) ;
+        } else {
+          VSTMavx512 (dsti, mask, acc.v) ;
+        }
+        dsti += dst_stride ;
+      }
+    } /* next y */
+#undef LOAD
+  } /* next x */
+}
+
+/* ---------------------------------------------------------------- */
+void
+VL_XCAT3(_vl_imcombrows_v, SFX, _avx512)
+(T* dst, T const** rows, T const* coeffs, vl_size num_rows, vl_size n)
+{
+  vl_uindex i = 0, k ;
+
+  for ( ; i + 4 * VSIZEavx512 <= n ; i += 4 * VSIZEavx512) {
+    VTYPEavx512 a0 = VSTZavx512 (), a1 = VSTZavx512 (), a2 = VSTZavx512 (), a3 = VSTZavx512 () ;
+    for (k = 0 ; k < num_rows ; ++k) {
+      T const * r = rows [k] + i ;
+      VTYPEavx512 c = VSET1avx512 (coeffs [k]) ;
+      a0 = VADDavx512 (a0, VMULavx512 (VLDUavx512 (r                  ), c)) ;
+      a1 = VADDavx512 (a1, VMULavx512 (VLDUavx512 (r +     VSIZEavx512), c)) ;
+      a2 = VADDavx512 (a2, VMULavx512 (VLDUavx512 (r + 2 * VSIZEavx512), c)) ;
+      a3 = VADDavx512 (a3, VMULavx512 (VLDUavx512 (r + 3 * VSIZEavx512), c)) ;
+    }
+    VST2Uavx512 (dst + i,                   a0) ;
+    VST2Uavx512 (dst + i +     VSIZEavx512, a1) ;
+    VST2Uavx512 (dst + i + 2 * VSIZEavx512, a2) ;
+    VST2Uavx512 (dst + i + 3 * VSIZEavx512, a3) ;
+  }
+
+  while (i < n) {
+    vl_size const numColumns = VL_MIN(VSIZEavx512, n - i) ;
+    VMASKavx512 const mask = (VMASKavx512) ((1u << numColumns) - 1) ;
+    VTYPEavx512 acc = VSTZavx512 () ;
+    for (k = 0 ; k < num_rows ; ++k) {
+      acc = VADDavx512 (acc, VMULavx512 (VLDMavx512 (mask, rows [k] + i), VSET1avx512 (coeffs [k]))) ;
+    }
+    VSTMavx512 (dst + i, mask, acc) ;
+    i += numColumns ;
+  }
+}
+
+#undef FLT
+#undef VL_IMOPV_AVX512_INSTANTIATING
+#endif
+
+/* ! VL_DISABLE_AVX512 */
+#endif
@@ -200,6 +200,46 @@ VL_XCAT3(_vl_imconvcol_v, SFX, _sse2)
   }
 }
 
+/* ---------------------------------------------------------------- */
+void
+VL_XCAT3(_vl_imcombrows_v, SFX, _sse2)
+(T* dst, T const** rows, T const* coeffs, vl_size num_rows, vl_size n)
+{
+  vl_uindex i = 0, k ;
+
+  for ( ; i + 4 * VSIZE <= n ; i += 4 * VSIZE) {
+    VTYPE a0 = VSTZ (), a1 = VSTZ (), a2 = VSTZ (), a3 = VSTZ () ;
+    for (k = 0 ; k < num_rows ; ++k) {
+      T const * r = rows [k] + i ;
+      VTYPE c = VLD1 (coeffs + k) ;
+      a0 = VADD (a0, VMUL (VLDU (r            ), c)) ;
+      a1 = VADD (a1, VMUL (VLDU (r +     VSIZE), c)) ;
+      a2 = VADD (a2, VMUL (VLDU (r + 2 * VSIZE), c)) ;
+      a3 = VADD (a3, VMUL (VLDU (r + 3 * VSIZE), c)) ;
+    }
+    VST2U (dst + i,             a0) ;
+    VST2U (dst + i +     VSIZE, a1) ;
+    VST2U (dst + i + 2 * VSIZE, a2) ;
+    VST2U (dst + i + 3 * VSIZE, a3) ;
+  }
+
+  for ( ; i + VSIZE <= n ; i += VSIZE) {
+    VTYPE acc = VSTZ () ;
+    for (k = 0 ; k < num_rows ; ++k) {
+      acc = VADD (acc, VMUL (VLDU (rows [k] + i), VLD1 (coeffs + k))) ;
+    }
+    VST2U (dst + i, acc) ;
+  }
+
+  for ( ; i < n ; ++i) {
+    T acc = 0 ;
+    for (k = 0 ; k < num_rows ; ++k) {
+      acc += rows [k] [i] * coeffs [k] ;
+    }
+    dst [i] = acc ;
+  }
+}
+
 /* ---------------------------------------------------------------- */
 #if 0
 void
@@ -32,6 +32,14 @@ void _vl_imconvcol_vd_sse2 (double* dst, vl_size dst_stride,
                             double const* filt, vl_index filt_begin, vl_index filt_end,
                             int step, unsigned int flags) ;
 
+VL_EXPORT
+void _vl_imcombrows_vf_sse2 (float* dst, float const** rows, float const* coeffs,
+                             vl_size num_rows, vl_size n) ;
+
+VL_EXPORT
+void _vl_imcombrows_vd_sse2 (double* dst, double const** rows, double const* coeffs,
+                             vl_size num_rows, vl_size n) ;
+
 /*
 VL_EXPORT
 void _vl_imconvcoltri_vf_sse2 (float* dst, int dst_stride,
@@ -600,6 +600,83 @@ VL_FAST_SQRT_UI(vl_uint32,ui32)
 VL_FAST_SQRT_UI(vl_uint16,ui16)
 VL_FAST_SQRT_UI(vl_uint8,ui8)
 
+/* ---------------------------------------------------------------- */
+/*                                                   Half precision */
+/* ---------------------------------------------------------------- */
+
+/** @brief Convert to IEEE half precision
+ ** @param x single precision value.
+ ** @return IEEE 754 half precision encoding of @a x.
+ **
+ ** The value is rounded to the nearest representable half precision
+ ** number (ties to even). Values too large in magnitude are mapped to
+ ** infinity, and values too small to denormalized numbers or zero.
+ **/
+
+VL_INLINE vl_uint16
+vl_float_to_half (float x)
+{
+  union {
+    float x ;
+    vl_uint32 i ;
+  } u ;
+  vl_uint32 sign, absx ;
+
+  u.x = x ;
+  sign = (u.i >> 16) & 0x8000 ;
+  absx = u.i & 0x7fffffff ;
+
+  if (absx >= 0x7f800000) {
+    /* infinity or NaN */
+    return (vl_uint16) (sign | 0x7c00 | ((absx > 0x7f800000) ? 0x200 : 0)) ;
+  }
+  if (absx >= 0x477ff000) {
+    /* rounds past the largest half (65504) */
+    return (vl_uint16) (sign | 0x7c00) ;
+  }
+  if (absx < 0x38800000) {
+    /* below 2^-14: adding 0.5 lets the FPU round the mantissa to
+       multiples of 2^-24, the half precision denormal step */
+    u.i = absx ;
+    u.x += 0.5F ;
+    return (vl_uint16) (sign | (u.i - 0x3f000000)) ;
+  }
+  /* normal number: rebias exponent and round mantissa to even */
+  absx += 0xfff + ((absx >> 13) & 1) ;
+  return (vl_uint16) (sign | ((absx - 0x38000000) >> 13)) ;
+}
+
+/** @brief Convert from IEEE half precision
+ ** @param h IEEE 754 half precision encoding.
+ ** @return single precision value.
+ **
+ ** The conversion is exact.
+ **/
+
+VL_INLINE float
+vl_half_to_float (vl_uint16 h)
+{
+  union {
+    float x ;
+    vl_uint32 i ;
+  } u ;
+  vl_uint32 sign = (vl_uint32) (h & 0x8000) << 16 ;
+  vl_uint32 exponent = (h >> 10) & 0x1f ;
+  vl_uint32 mantissa = h & 0x3ff ;
+
+  if (exponent == 0x1f) {
+    /* infinity or NaN */
+    u.i = sign | 0x7f800000 | (mantissa << 13) ;
+  } else if (exponent == 0) {
+    /* zero or denormal */
+    u.x = (float) mantissa * (1.0F / 16777216.0F) ;
+    u.i |= sign ;
+  } else {
+    u.i = sign | ((exponent + 112) << 23) | (mantissa << 13) ;
+  }
+  return u.x ;
+}
+
 /* ---------------------------------------------------------------- */
 /*                                Vector distances and similarities */
 /* ---------------------------------------------------------------- */
@@ -0,0 +1,405 @@
+/** @file phow.c
+ ** @brief Pyramid Histogram Of visual Words (PHOW) features - Definition
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include "phow.h"
+#include "imopv.h"
+#include "mathop.h"
+#include <math.h>
+#include <string.h>
+
+/**
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+@page phow Pyramid Histogram Of visual Words (PHOW)
+@author Andrea Vedaldi
+@tableofcontents
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+
+@ref phow.h implements the PHOW features of [1], i.e. @ref dsift
+"dense SIFT" descriptors extracted at several scales, as computed by
+the MATLAB function @c vl_phow. It is a thin layer over
+::VlDsiftFilter.
+
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+@section phow-usage Usage
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+
+@code
+int sizes [] = {4, 6, 8, 10} ;
+VlPhowFilter * phow = vl_phow_new (width, height, sizes, 4) ;
+vl_phow_set_color (phow, VlPhowHsv) ;
+vl_phow_process (phow, image, 3) ;
+descrs = vl_phow_get_descriptors (phow) ;
+frames = vl_phow_get_keypoints (phow) ;
+numFrames = vl_phow_get_keypoint_num (phow) ;
+vl_phow_delete (phow) ;
+@endcode
+
+The image is stored by rows and, for color images, as three
+consecutive R, G and B planes, with values in the range [0,1].
+For each bin size @c size (::vl_phow_new), the image is smoothed by
+a Gaussian of standard deviation <code>size / magnif</code>
+(::vl_phow_set_magnif) and dense SIFT descriptors with the specified
+bin size are extracted every ::vl_phow_get_step pixels. The
+descriptors of the different sizes are aligned so that they have
+the same centers (exactly so only if all sizes are even or all are
+odd). Keypoints and descriptors are returned in order of size and,
+for each size, in the order of ::vl_dsift_get_descriptors.
+
+Color descriptors (::vl_phow_set_color) are obtained by stacking the
+descriptors of the three channels in the selected color space. The
+contrast of a feature (the field @c norm of ::VlDsiftKeypoint) is the
+one of the first channel and descriptors with contrast below
+::vl_phow_get_contrast_threshold are set to zero. As in @c vl_phow,
+contrast is measured on the value channel for HSV descriptors and
+on the average of the channels for RGB descriptors.
+
+The smoothed images are computed incrementally, smoothing the
+image of the previous (smaller) size rather than the original image,
+and the dense SIFT filter and its buffers are reused for all the
+sizes and channels.
+
+[1] A. Bosch, A. Zisserman, and X. Munoz. Image classification using
+random forests and ferns. In Proc. ICCV, 2007.
+**/
+
+/** ------------------------------------------------------------------
+ ** @brief Create a new PHOW filter
+ ** @param width image width.
+ ** @param height image height.
+ ** @param sizes bin sizes.
+ ** @param numSizes number of bin sizes.
+ ** @return new filter or @c NULL if the filter cannot be allocated.
+ **
+ ** The default parameters are the ones of the MATLAB function
+ ** @c vl_phow: gray-scale descriptors, step 2, flat windows,
+ ** magnification factor 6, window size 1.5 and contrast
+ ** threshold 0.005.
+ **/
+
+VL_EXPORT VlPhowFilter *
+vl_phow_new (int width, int height, int const *sizes, vl_size numSizes)
+{
+  VlPhowFilter * self = vl_calloc (1, sizeof(VlPhowFilter)) ;
+  if (self == NULL) return NULL ;
+  self->width = width ;
+  self->height = height ;
+  self->sizes = vl_malloc (sizeof(int) * VL_MAX(numSizes, 1)) ;
+  if (self->sizes == NULL) goto err_alloc ;
+  memcpy (self->sizes, sizes, sizeof(int) * numSizes) ;
+  self->numSizes = numSizes ;
+
+  self->step = 2 ;
+  self->color = VlPhowGray ;
+  self->fast = VL_TRUE ;
+  self->magnif = 6 ;
+  self->windowSize = 1.5 ;
+  self->contrastThreshold = 0.005 ;
+
+  self->dsift = vl_dsift_new (width, height) ;
+  self->channels = vl_malloc (sizeof(float) * 3 * width * height) ;
+  self->smoothed = vl_malloc (sizeof(float) * 3 * width * height) ;
+  if (self->dsift == NULL ||
+      self->channels == NULL ||
+      self->smoothed == NULL) goto err_alloc ;
+
+  self->frames = NULL ;
+  self->descrs = NULL ;
+  self->numFrames = 0 ;
+  self->numFrameAlloc = 0 ;
+  self->descrSize = 0 ;
+  return self ;
+
+err_alloc:
+  vl_phow_delete (self) ;
+  return NULL ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Delete a PHOW filter
+ ** @param self PHOW filter.
+ **/
+
+VL_EXPORT void
+vl_phow_delete (VlPhowFilter *self)
+{
+  if (self->frames) vl_free (self->frames) ;
+  if (self->descrs) vl_free (self->descrs) ;
+  if (self->smoothed) vl_free (self->smoothed) ;
+  if (self->channels) vl_free (self->channels) ;
+  if (self->dsift) vl_dsift_delete (self->dsift) ;
+  if (self->sizes) vl_free (self->sizes) ;
+  vl_free (self) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Convert the image to the PHOW color space
+ ** @param self PHOW filter.
+ ** @param image image.
+ ** @param numChannels number of image channels (1 or 3).
+ **
+ ** The conversions match the ones of the MATLAB functions @c rgb2gray
+ ** and @c rgb2hsv and of @c vl_phow (for the opponent colors).
+ **/
+
+static void
+_vl_phow_convert_color (VlPhowFilter *self, float const *image,
+                        vl_size numChannels)
+{
+  vl_size const numPixels = (vl_size) self->width * self->height ;
+  float * c0 = self->channels ;
+  float * c1 = c0 + numPixels ;
+  float * c2 = c1 + numPixels ;
+  float const * r = image ;
+  float const * g = (numChannels == 3) ? image + numPixels : image ;
+  float const * b = (numChannels == 3) ? image + 2 * numPixels : image ;
+  vl_uindex i ;
+
+  switch (self->color) {
+    case VlPhowGray :
+      if (numChannels == 1) {
+        memcpy (c0, image, sizeof(float) * numPixels) ;
+      } else {
+        for (i = 0 ; i < numPixels ; ++i) {
+          c0[i] = 0.2989F * r[i] + 0.5870F * g[i] + 0.1140F * b[i] ;
+        }
+      }
+      break ;
+
+    case VlPhowRgb :
+      memcpy (c0, r, sizeof(float) * numPixels) ;
+      memcpy (c1, g, sizeof(float) * numPixels) ;
+      memcpy (c2, b, sizeof(float) * numPixels) ;
+      break ;
+
+    case VlPhowOpponent :
+      /*
+       The first channel is the intensity rather than the standard
+       opponent component, and a small multiple of it is added to
+       the other two for monochromatic regions.
+       */
+      for (i = 0 ; i < numPixels ; ++i) {
+        float mu = 0.3F * r[i] + 0.59F * g[i] + 0.11F * b[i] ;
+        float alpha = 0.01F ;
+        c0[i] = mu ;
+        c1[i] = (r[i] - g[i]) / sqrtf(2.0F) + alpha * mu ;
+        c2[i] = (r[i] + g[i] - 2 * b[i]) / sqrtf(6.0F) + alpha * mu ;
+      }
+      break ;
+
+    case VlPhowHsv :
+      for (i = 0 ; i < numPixels ; ++i) {
+        float maxv = VL_MAX(r[i], VL_MAX(g[i], b[i])) ;
+        float minv = VL_MIN(r[i], VL_MIN(g[i], b[i])) ;
+        float delta = maxv - minv ;
+        float h = 0 ;
+        if (delta > 0) {
+          if (r[i] == maxv) {
+            h = (g[i] - b[i]) / delta ;
+          } else if (g[i] == maxv) {
+            h = 2 + (b[i] - r[i]) / delta ;
+          } else {
+            h = 4 + (r[i] - g[i]) / delta ;
+          }
+          h /= 6 ;
+          if (h < 0) h += 1 ;
+        }
+        c0[i] = h ;
+        c1[i] = (maxv > 0) ? delta / maxv : 0 ;
+        c2[i] = maxv ;
+      }
+      break ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Configure the dense SIFT filter for a bin size
+ ** @param self PHOW filter.
+ ** @param size bin size.
+ ** @param maxSize maximum bin size.
+ **/
+
+static void
+_vl_phow_setup_dsift (VlPhowFilter *self, int size, int maxSize)
+{
+  VlDsiftDescriptorGeometry geom = *vl_dsift_get_geometry (self->dsift) ;
+
+  /*
+   The first descriptor center is at off + 3/2 size. Choosing off as
+   follows aligns the centers for all the sizes.
+   */
+  int off = (int) floor (1.5 * (maxSize - size)) ;
+
+  geom.binSizeX = size ;
+  geom.binSizeY = size ;
+  vl_dsift_set_geometry (self->dsift, &geom) ;
+  vl_dsift_set_steps (self->dsift, self->step, self->step) ;
+  vl_dsift_set_bounds (self->dsift, off, off, self->width - 1, self->height - 1) ;
+  vl_dsift_set_flat_window (self->dsift, self->fast) ;
+  vl_dsift_set_window_size (self->dsift, self->windowSize) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Compute PHOW keypoints and descriptors
+ ** @param self PHOW filter.
+ ** @param image image data.
+ ** @param numChannels number of channels of the image (1 or 3).
+ ** @return error code.
+ **
+ ** Gray-scale images are replicated to compute color descriptors
+ ** and color images are converted to gray-scale to compute gray-scale
+ ** descriptors. The function returns ::VL_ERR_BAD_ARG if
+ ** @a numChannels is neither 1 or 3 and ::VL_ERR_ALLOC if the
+ ** buffers cannot be allocated, in which case no keypoint is
+ ** returned.
+ **/
+
+VL_EXPORT int
+vl_phow_process (VlPhowFilter *self, float const *image, vl_size numChannels)
+{
+  vl_size const numPixels = (vl_size) self->width * self->height ;
+  vl_size const descrSize = vl_phow_get_descriptor_size (self) ;
+  vl_size const numDescrChannels = descrSize / 128 ;
+  vl_size * order = NULL ;
+  vl_size * begin = NULL ;
+  float * contrast = NULL ;
+  double sigma = 0 ;
+  int maxSize = 0 ;
+  int err = VL_ERR_OK ;
+  vl_uindex si, k, c, i ;
+
+  if (numChannels != 1 && numChannels != 3) return VL_ERR_BAD_ARG ;
+
+  self->numFrames = 0 ;
+  _vl_phow_convert_color (self, image, numChannels) ;
+
+  /* count the frames and find where the frames of each size begin */
+  for (si = 0 ; si < self->numSizes ; ++si) {
+    maxSize = VL_MAX(maxSize, self->sizes[si]) ;
+  }
+  begin = vl_malloc (sizeof(vl_size) * (self->numSizes + 1)) ;
+  if (begin == NULL) goto err_alloc ;
+  begin[0] = 0 ;
+  for (si = 0 ; si < self->numSizes ; ++si) {
+    _vl_phow_setup_dsift (self, self->sizes[si], maxSize) ;
+    begin[si + 1] = begin[si] + vl_dsift_get_keypoint_num (self->dsift) ;
+  }
+
+  if (begin[self->numSizes] > self->numFrameAlloc || descrSize != self->descrSize) {
+    vl_size numFrameAlloc = VL_MAX(begin[self->numSizes], self->numFrameAlloc) ;
+    if (self->frames) vl_free (self->frames) ;
+    if (self->descrs) vl_free (self->descrs) ;
+    self->frames = vl_malloc (sizeof(VlDsiftKeypoint) * VL_MAX(numFrameAlloc, 1)) ;
+    self->descrs = vl_malloc (sizeof(float) * descrSize * VL_MAX(numFrameAlloc, 1)) ;
+    if (self->frames == NULL || self->descrs == NULL) {
+      if (self->frames) vl_free (self->frames) ;
+      if (self->descrs) vl_free (self->descrs) ;
+      self->frames = NULL ;
+      self->descrs = NULL ;
+      self->numFrameAlloc = 0 ;
+      self->descrSize = 0 ;
+      goto err_alloc ;
+    }
+    self->numFrameAlloc = numFrameAlloc ;
+    self->descrSize = descrSize ;
+  }
+  contrast = vl_malloc (sizeof(float) * VL_MAX(begin[self->numSizes], 1)) ;
+
+  /* process the sizes by increasing smoothing */
+  order = vl_malloc (sizeof(vl_size) * VL_MAX(self->numSizes, 1)) ;
+  if (contrast == NULL || order == NULL) goto err_alloc ;
+  for (si = 0 ; si < self->numSizes ; ++si) {
+    for (k = si ; k > 0 && self->sizes[order[k-1]] > self->sizes[si] ; --k) {
+      order[k] = order[k-1] ;
+    }
+    order[k] = si ;
+  }
+  memcpy (self->smoothed, self->channels, sizeof(float) * numDescrChannels * numPixels) ;
+
+  for (k = 0 ; k < self->numSizes ; ++k) {
+    int const size = self->sizes[order[k]] ;
+    double const targetSigma = size / self->magnif ;
+    vl_size const numFrames = begin[order[k] + 1] - begin[order[k]] ;
+    VlDsiftKeypoint * frames = self->frames + begin[order[k]] ;
+    float * descrs = self->descrs + descrSize * begin[order[k]] ;
+    float * contrast_ = contrast + begin[order[k]] ;
+
+    /* smooth incrementally */
+    if (targetSigma > sigma) {
+      double deltaSigma = sqrt (targetSigma * targetSigma - sigma * sigma) ;
+      for (c = 0 ; c < numDescrChannels ; ++c) {
+        vl_imsmooth_f (self->smoothed + c * numPixels, self->width,
+                       self->smoothed + c * numPixels, self->width, self->height, self->width,
+                       deltaSigma, deltaSigma) ;
+      }
+      sigma = targetSigma ;
+    }
+
+    _vl_phow_setup_dsift (self, size, maxSize) ;
+
+    for (c = 0 ; c < numDescrChannels ; ++c) {
+      VlDsiftKeypoint const * dframes ;
+      float const * ddescrs ;
+      err = vl_dsift_process (self->dsift, self->smoothed + c * numPixels) ;
+      if (err != VL_ERR_OK) goto done ;
+      dframes = vl_dsift_get_keypoints (self->dsift) ;
+      ddescrs = vl_dsift_get_descriptors (self->dsift) ;
+
+      for (i = 0 ; i < numFrames ; ++i) {
+        memcpy (descrs + descrSize * i + 128 * c, ddescrs + 128 * i, sizeof(float) * 128) ;
+      }
+
+      if (c == 0) {
+        for (i = 0 ; i < numFrames ; ++i) {
+          frames[i].x = dframes[i].x ;
+          frames[i].y = dframes[i].y ;
+          frames[i].s = size ;
+          frames[i].norm = dframes[i].norm ;
+          contrast_[i] = 0 ;
+        }
+      }
+
+      /* the contrast is measured on the intensity (or value) channel */
+      for (i = 0 ; i < numFrames ; ++i) {
+        switch (self->color) {
+          case VlPhowGray :
+          case VlPhowOpponent :
+            if (c == 0) contrast_[i] = dframes[i].norm ;
+            break ;
+          case VlPhowRgb :
+            contrast_[i] += dframes[i].norm / 3 ;
+            break ;
+          case VlPhowHsv :
+            if (c == 2) contrast_[i] = dframes[i].norm ;
+            break ;
+        }
+      }
+    }
+
+    /* remove low contrast descriptors */
+    for (i = 0 ; i < numFrames ; ++i) {
+      if (contrast_[i] < self->contrastThreshold) {
+        memset (descrs + descrSize * i, 0, sizeof(float) * descrSize) ;
+      }
+    }
+  }
+  self->numFrames = begin[self->numSizes] ;
+  goto done ;
+
+err_alloc:
+  err = vl_set_last_error (VL_ERR_ALLOC, "Unable to allocate the PHOW buffers.") ;
+done:
+  if (order) vl_free (order) ;
+  if (contrast) vl_free (contrast) ;
+  if (begin) vl_free (begin) ;
+  return err ;
+}
@@ -0,0 +1,301 @@
+/** @file phow.h
+ ** @brief Pyramid Histogram Of visual Words (PHOW) features
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_PHOW_H
+#define VL_PHOW_H
+
+#include "generic.h"
+#include "dsift.h"
+
+/** @brief PHOW color spaces */
+typedef enum _VlPhowColor
+{
+  VlPhowGray = 0, /**< gray-scale descriptors (PHOW-gray) */
+  VlPhowRgb,      /**< RGB descriptors */
+  VlPhowHsv,      /**< HSV descriptors (PHOW-color) */
+  VlPhowOpponent  /**< opponent color descriptors */
+} VlPhowColor ;
+
+/** @brief PHOW filter */
+typedef struct _VlPhowFilter
+{
+  int width ;              /**< image width */
+  int height ;             /**< image height */
+  int *sizes ;             /**< bin sizes */
+  vl_size numSizes ;       /**< number of bin sizes */
+
+  int step ;               /**< sampling step */
+  VlPhowColor color ;      /**< color space */
+  vl_bool fast ;           /**< use flat windows */
+  double magnif ;          /**< bin size to smoothing ratio */
+  double windowSize ;      /**< size of the Gaussian window */
+  double contrastThreshold ; /**< contrast threshold */
+
+  VlDsiftFilter *dsift ;   /**< dense SIFT filter */
+  float *channels ;        /**< image channels (in the color space) */
+  float *smoothed ;        /**< smoothed image channels */
+
+  VlDsiftKeypoint *frames ; /**< frame buffer */
+  float *descrs ;          /**< descriptor buffer */
+  vl_size numFrames ;      /**< number of frames */
+  vl_size numFrameAlloc ;  /**< size of the frame buffer */
+  vl_size descrSize ;      /**< size of the descriptor buffer */
+} VlPhowFilter ;
+
+/** @name Create and destroy
+ ** @{
+ **/
+VL_EXPORT VlPhowFilter *vl_phow_new (int width, int height,
+                                     int const *sizes, vl_size numSizes) ;
+VL_EXPORT void vl_phow_delete (VlPhowFilter *self) ;
+/** @} */
+
+/** @name Process data
+ ** @{
+ **/
+VL_EXPORT int vl_phow_process (VlPhowFilter *self,
+                               float const *image,
+                               vl_size numChannels) ;
+/** @} */
+
+/** @name Retrieve data and parameters
+ ** @{
+ **/
+VL_INLINE VlDsiftKeypoint const *vl_phow_get_keypoints (VlPhowFilter const *self) ;
+VL_INLINE vl_size vl_phow_get_keypoint_num (VlPhowFilter const *self) ;
+VL_INLINE float const *vl_phow_get_descriptors (VlPhowFilter const *self) ;
+VL_INLINE vl_size vl_phow_get_descriptor_size (VlPhowFilter const *self) ;
+VL_INLINE int vl_phow_get_step (VlPhowFilter const *self) ;
+VL_INLINE VlPhowColor vl_phow_get_color (VlPhowFilter const *self) ;
+VL_INLINE vl_bool vl_phow_get_fast (VlPhowFilter const *self) ;
+VL_INLINE double vl_phow_get_magnif (VlPhowFilter const *self) ;
+VL_INLINE double vl_phow_get_window_size (VlPhowFilter const *self) ;
+VL_INLINE double vl_phow_get_contrast_threshold (VlPhowFilter const *self) ;
+/** @} */
+
+/** @name Set parameters
+ ** @{
+ **/
+VL_INLINE void vl_phow_set_step (VlPhowFilter *self, int step) ;
+VL_INLINE void vl_phow_set_color (VlPhowFilter *self, VlPhowColor color) ;
+VL_INLINE void vl_phow_set_fast (VlPhowFilter *self, vl_bool fast) ;
+VL_INLINE void vl_phow_set_magnif (VlPhowFilter *self, double magnif) ;
+VL_INLINE void vl_phow_set_window_size (VlPhowFilter *self, double windowSize) ;
+VL_INLINE void vl_phow_set_contrast_threshold (VlPhowFilter *self, double threshold) ;
+/** @} */
+
+/* -------------------------------------------------------------------
+ *                                     Inline functions implementation
+ * ---------------------------------------------------------------- */
+
+/** ------------------------------------------------------------------
+ ** @brief Get the keypoints
+ ** @param self PHOW filter.
+ ** @return keypoints.
+ **
+ ** The field @c s of a keypoint is the bin size of its descriptor.
+ **/
+
+VL_INLINE VlDsiftKeypoint const *
+vl_phow_get_keypoints (VlPhowFilter const *self)
+{
+  return self->frames ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the number of keypoints
+ ** @param self PHOW filter.
+ ** @return number of keypoints.
+ **/
+
+VL_INLINE vl_size
+vl_phow_get_keypoint_num (VlPhowFilter const *self)
+{
+  return self->numFrames ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the descriptors
+ ** @param self PHOW filter.
+ ** @return descriptors.
+ **/
+
+VL_INLINE float const *
+vl_phow_get_descriptors (VlPhowFilter const *self)
+{
+  return self->descrs ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the descriptor size
+ ** @param self PHOW filter.
+ ** @return size of a descriptor.
+ **
+ ** This is 128 for gray-scale descriptors and 3 x 128 for color
+ ** descriptors.
+ **/
+
+VL_INLINE vl_size
+vl_phow_get_descriptor_size (VlPhowFilter const *self)
+{
+  return (self->color == VlPhowGray) ? 128 : 3 * 128 ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the sampling step
+ ** @param self PHOW filter.
+ ** @return sampling step.
+ **/
+
+VL_INLINE int
+vl_phow_get_step (VlPhowFilter const *self)
+{
+  return self->step ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the color space
+ ** @param self PHOW filter.
+ ** @return color space.
+ **/
+
+VL_INLINE VlPhowColor
+vl_phow_get_color (VlPhowFilter const *self)
+{
+  return self->color ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get whether flat windows are used
+ ** @param self PHOW filter.
+ ** @return @c true if flat windows are used.
+ **/
+
+VL_INLINE vl_bool
+vl_phow_get_fast (VlPhowFilter const *self)
+{
+  return self->fast ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the magnification factor
+ ** @param self PHOW filter.
+ ** @return ratio of the bin size to the image smoothing.
+ **/
+
+VL_INLINE double
+vl_phow_get_magnif (VlPhowFilter const *self)
+{
+  return self->magnif ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the window size
+ ** @param self PHOW filter.
+ ** @return size of the Gaussian window in units of spatial bins.
+ **/
+
+VL_INLINE double
+vl_phow_get_window_size (VlPhowFilter const *self)
+{
+  return self->windowSize ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the contrast threshold
+ ** @param self PHOW filter.
+ ** @return contrast threshold.
+ **/
+
+VL_INLINE double
+vl_phow_get_contrast_threshold (VlPhowFilter const *self)
+{
+  return self->contrastThreshold ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the sampling step
+ ** @param self PHOW filter.
+ ** @param step sampling step (in pixels).
+ **/
+
+VL_INLINE void
+vl_phow_set_step (VlPhowFilter *self, int step)
+{
+  self->step = step ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the color space
+ ** @param self PHOW filter.
+ ** @param color color space.
+ **/
+
+VL_INLINE void
+vl_phow_set_color (VlPhowFilter *self, VlPhowColor color)
+{
+  self->color = color ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set whether to use flat windows
+ ** @param self PHOW filter.
+ ** @param fast @c true to use flat windows (see ::vl_dsift_set_flat_window).
+ **/
+
+VL_INLINE void
+vl_phow_set_fast (VlPhowFilter *self, vl_bool fast)
+{
+  self->fast = fast ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the magnification factor
+ ** @param self PHOW filter.
+ ** @param magnif ratio of the bin size to the image smoothing.
+ **/
+
+VL_INLINE void
+vl_phow_set_magnif (VlPhowFilter *self, double magnif)
+{
+  self->magnif = magnif ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the window size
+ ** @param self PHOW filter.
+ ** @param windowSize size of the Gaussian window in units of spatial bins.
+ **/
+
+VL_INLINE void
+vl_phow_set_window_size (VlPhowFilter *self, double windowSize)
+{
+  self->windowSize = windowSize ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the contrast threshold
+ ** @param self PHOW filter.
+ ** @param threshold contrast threshold.
+ **
+ ** Descriptors with contrast below @a threshold are set to zero.
+ **/
+
+VL_INLINE void
+vl_phow_set_contrast_threshold (VlPhowFilter *self, double threshold)
+{
+  self->contrastThreshold = threshold ;
+}
+
+/* VL_PHOW_H */
+#endif
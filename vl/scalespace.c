@@ -89,6 +89,16 @@ to be computed and `s` varies in the range
 `geom.octaveFirstSubdivision` to `geom.octaveLastSubdivision`. See
 @ref scalespace-fundamentals for further details.
 
+When only some of the levels are needed, for example the coarser
+ones, ::vl_scalespace_set_lazy makes the object compute the levels
+on demand, upon calling ::vl_scalespace_get_level, and release the
+intermediate octaves.
+
+If VLFeat is compiled with OpenMP, the Gaussian smoothing used to
+compute each level is split across threads (see ::vl_imsmooth_f and
+@ref threads-parallel). The result does not depend on the number of
+threads.
+
 The geometry of the scale space can be customized upon creation, as
 follows:
 
@@ -100,6 +110,18 @@ geom.octaveLastSubdivision = geom.octaveResolution ;
 VlScaleSpacae ss = vl_scalespace_new_with_geometry (geom) ;
 @endcode
 
+::vl_scalespace_new_with_crops restricts each octave to a rectangle
+(crop), for example to process only a region of a large image. The
+levels of an octave are computed only in its crop, and the crop of
+an octave must contain the crop of the next (coarser) octave. Since
+the levels are padded at the crop boundaries, they are the same as
+for the whole image only sufficiently far from the crop boundaries,
+depending on the smoothing (see ::vl_covdet_put_image_region for an
+example). `ogeom.origin` is the position of the first pixel of the
+crop in the whole octave, so that the pixel `(x,y)` of a level
+corresponds to the point `((ogeom.origin[0] + x) * ogeom.step,
+(ogeom.origin[1] + y) * ogeom.step)` of the image.
+
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
 @page scalespace-fundamentals Gaussian scale space fundamentals
 @tableofcontents
@@ -272,6 +294,7 @@ represented properly.
 
 #include "scalespace.h"
 #include "mathop.h"
+#include "imopv.h"
 
 #include <assert.h>
 #include <stdlib.h>
@@ -291,8 +314,16 @@ struct _VlScaleSpace
 {
   VlScaleSpaceGeometry geom ; /**< Geometry of the scale space */
   float **octaves ; /**< Data */
+  vl_bool lazy ; /**< Whether levels are computed on demand */
+  float *image ; /**< Copy of the input image (lazy mode) */
+  vl_index *lastComputedLevels ; /**< Last computed level of each octave */
+  vl_bool *accessedOctaves ; /**< Whether each octave was accessed (lazy mode) */
+  vl_index *crops ; /**< Crop of each octave (xmin, ymin, xmax, ymax) */
+  float *upsampleBuffer ; /**< Intermediate upsampled images */
 } ;
 
+static int _vl_scalespace_materialize (VlScaleSpace *self, vl_index o, vl_index s) ;
+
 /* ---------------------------------------------------------------- */
 /** @brief Get the default geometry for a given image size.
  ** @param width image width.
@@ -363,18 +394,46 @@ vl_scalespace_get_geometry (VlScaleSpace const * self)
  ** @param self object.
  ** @param o octave index.
  ** @return the geometry of octave @a o.
+ **
+ ** The width and height are the ones of the crop of the octave (see
+ ** ::vl_scalespace_new_with_crops), which is the whole octave by
+ ** default.
  **/
 
 VlScaleSpaceOctaveGeometry
 vl_scalespace_get_octave_geometry (VlScaleSpace const * self, vl_index o)
 {
   VlScaleSpaceOctaveGeometry ogeom ;
-  ogeom.width = VL_SHIFT_LEFT(self->geom.width, -o) ;
-  ogeom.height = VL_SHIFT_LEFT(self->geom.height, -o) ;
+  vl_index const * crop = self->crops + 4 * (o - self->geom.firstOctave) ;
+  assert(o >= self->geom.firstOctave) ;
+  assert(o <= self->geom.lastOctave) ;
+  ogeom.width = crop[2] - crop[0] + 1 ;
+  ogeom.height = crop[3] - crop[1] + 1 ;
   ogeom.step = pow(2.0, o) ;
+  ogeom.origin[0] = crop[0] ;
+  ogeom.origin[1] = crop[1] ;
   return ogeom ;
 }
 
+/** @internal @brief Get the buffer of a scale space level
+ ** @param self object.
+ ** @param o octave index.
+ ** @param s level index.
+ ** @return pointer to the buffer for octave @a o, level @a s.
+ **
+ ** Unlike ::vl_scalespace_get_level, the function never computes the
+ ** level. The octave must be allocated.
+ **/
+
+static float *
+_vl_scalespace_get_level_data (VlScaleSpace *self, vl_index o, vl_index s)
+{
+  VlScaleSpaceOctaveGeometry ogeom = vl_scalespace_get_octave_geometry(self,o) ;
+  float * octave = self->octaves[o - self->geom.firstOctave] ;
+  assert(octave) ;
+  return octave + ogeom.width * ogeom.height * (s - self->geom.octaveFirstSubdivision) ;
+}
+
 /** @brief Get the data of a scale space level
  ** @param self object.
  ** @param o octave index.
@@ -384,21 +443,42 @@ vl_scalespace_get_octave_geometry (VlScaleSpace const * self, vl_index o)
  ** The octave index @a o must be in the range @c firstOctave
  ** to @c lastOctave and the scale index @a s must be in the
  ** range @c octaveFirstSubdivision to @c octaveLastSubdivision.
+ **
+ ** In lazy mode (::vl_scalespace_set_lazy), the function computes
+ ** the level, and the ones it depends on, if needed. It returns
+ ** @c NULL if no image has been set since switching to lazy mode
+ ** (::vl_scalespace_put_image), and also if the memory to compute
+ ** the level is insufficient, in which case the last error is set to
+ ** ::VL_ERR_ALLOC.
  **/
 
 float *
 vl_scalespace_get_level (VlScaleSpace *self, vl_index o, vl_index s)
 {
-  VlScaleSpaceOctaveGeometry ogeom = vl_scalespace_get_octave_geometry(self,o) ;
-  float * octave ;
   assert(self) ;
   assert(o >= self->geom.firstOctave) ;
   assert(o <= self->geom.lastOctave) ;
   assert(s >= self->geom.octaveFirstSubdivision) ;
   assert(s <= self->geom.octaveLastSubdivision) ;
 
-  octave = self->octaves[o - self->geom.firstOctave] ;
-  return octave + ogeom.width * ogeom.height * (s - self->geom.octaveFirstSubdivision) ;
+  if (self->lazy) {
+    int err ;
+    if (self->image == NULL) return NULL ;
+#if defined(_OPENMP)
+#pragma omp critical(vl_scalespace)
+#endif
+    {
+      err = _vl_scalespace_materialize(self, o, s) ;
+      if (err == VL_ERR_OK) {
+        self->accessedOctaves[o - self->geom.firstOctave] = VL_TRUE ;
+      }
+    }
+    if (err != VL_ERR_OK) {
+      vl_set_last_error(err, "Unable to allocate the scale space level.") ;
+      return NULL ;
+    }
+  }
+  return _vl_scalespace_get_level_data(self, o, s) ;
 }
 
 /** @brief Get the data of a scale space level (const)
@@ -434,84 +514,101 @@ vl_scalespace_get_level_sigma (VlScaleSpace const *self, vl_index o, vl_index s)
 }
 
 /** ------------------------------------------------------------------
- ** @internal @brief Upsample the rows and take the transpose
+ ** @internal @brief Upsample a crop
  ** @param destination output image.
+ ** @param destinationCrop crop of the output image.
  ** @param source input image.
- ** @param width input image width.
- ** @param height input image height.
+ ** @param sourceCrop crop of the input image.
+ ** @param width width of the whole input image.
+ ** @param height height of the whole input image.
  **
- ** The output image has dimensions @a height by 2 @a width (so the
- ** destination buffer must be at least as big as two times the
- ** input buffer).
+ ** The output image samples the input image at twice the resolution.
+ ** @a destinationCrop and @a sourceCrop are rectangles (xmin, ymin,
+ ** xmax, ymax) in the whole output and input images respectively,
+ ** and @a sourceCrop must contain the pixels needed to compute @a
+ ** destinationCrop.
  **
- ** Upsampling is performed by linear interpolation.
+ ** Upsampling is performed by linear interpolation, extending the
+ ** whole input image by continuity.
  **/
 
 static void
 copy_and_upsample
-(float *destination,
- float const *source, vl_size width, vl_size height)
+(float *destination, vl_index const *destinationCrop,
+ float const *source, vl_index const *sourceCrop,
+ vl_size width, vl_size height)
 {
-  vl_index x, y, ox, oy ;
-  float v00, v10, v01, v11 ;
+  vl_index x, y ;
+  vl_index const sourceWidth = sourceCrop[2] - sourceCrop[0] + 1 ;
 
   assert(destination) ;
   assert(source) ;
 
-  for(y = 0 ; y < (signed)height ; ++y) {
-    oy = (y < ((signed)height - 1)) * width ;
-    v10 = source[0] ;
-    v11 = source[oy] ;
-    for(x = 0 ; x < (signed)width ; ++x) {
-      ox = x < ((signed)width - 1) ;
-      v00 = v10 ;
-      v01 = v11 ;
-      v10 = source[ox] ;
-      v11 = source[ox + oy] ;
-      destination[0] = v00 ;
-      destination[1] = 0.5f * (v00 + v10) ;
-      destination[2*width] = 0.5f * (v00 + v01) ;
-      destination[2*width+1] = 0.25f * (v00 + v01 + v10 + v11) ;
-      destination += 2 ;
-      source ++;
+  for (y = destinationCrop[1] ; y <= destinationCrop[3] ; ++y) {
+    vl_index const y0 = y / 2 ;
+    vl_index const y1 = VL_MIN(y0 + 1, (signed)height - 1) ;
+    float const *row0 = source + (y0 - sourceCrop[1]) * sourceWidth - sourceCrop[0] ;
+    float const *row1 = source + (y1 - sourceCrop[1]) * sourceWidth - sourceCrop[0] ;
+    for (x = destinationCrop[0] ; x <= destinationCrop[2] ; ++x) {
+      vl_index const x0 = x / 2 ;
+      vl_index const x1 = VL_MIN(x0 + 1, (signed)width - 1) ;
+      float const v00 = row0[x0] ;
+      if (x & 1) {
+        float const v10 = row0[x1] ;
+        if (y & 1) {
+          *destination++ = 0.25f * (v00 + row1[x0] + v10 + row1[x1]) ;
+        } else {
+          *destination++ = 0.5f * (v00 + v10) ;
+        }
+      } else {
+        if (y & 1) {
+          *destination++ = 0.5f * (v00 + row1[x0]) ;
+        } else {
+          *destination++ = v00 ;
+        }
+      }
     }
-    destination += 2*width ;
   }
 }
 
 /** ------------------------------------------------------------------
- ** @internal @brief Downsample
- ** @param destination output imgae buffer.
- ** @param source input image buffer.
- ** @param width input image width.
- ** @param height input image height.
+ ** @internal @brief Downsample a crop
+ ** @param destination output image.
+ ** @param destinationCrop crop of the output image.
+ ** @param source input image.
+ ** @param sourceCrop crop of the input image.
  ** @param numOctaves octaves (non negative).
  **
- ** The function downsamples the image @a d times, reducing it to @c
- ** 1/2^d of its original size. The parameters @a width and @a height
- ** are the size of the input image. The destination image @a dst is
- ** assumed to be <code>floor(width/2^d)</code> pixels wide and
- ** <code>floor(height/2^d)</code> pixels high.
+ ** The function samples the input image every <code>2^numOctaves</code>
+ ** pixels. @a destinationCrop and @a sourceCrop are rectangles
+ ** (xmin, ymin, xmax, ymax) in the whole output and input images
+ ** respectively, and @a sourceCrop must contain the samples of @a
+ ** destinationCrop.
  **/
 
 static void
 copy_and_downsample
-(float *destination,
- float const *source,
- vl_size width, vl_size height, vl_size numOctaves)
+(float *destination, vl_index const *destinationCrop,
+ float const *source, vl_index const *sourceCrop,
+ vl_size numOctaves)
 {
   vl_index x, y ;
-  vl_size step = 1 << numOctaves ; /* step = 2^numOctaves */
+  vl_index const step = (vl_index)1 << numOctaves ; /* step = 2^numOctaves */
+  vl_index const sourceWidth = sourceCrop[2] - sourceCrop[0] + 1 ;
+  vl_index const width = destinationCrop[2] - destinationCrop[0] + 1 ;
 
   assert(destination) ;
   assert(source) ;
 
-  if (numOctaves == 0) {
-    memcpy(destination, source, sizeof(float) * width * height) ;
-  } else {
-    for(y = 0 ; y < (signed)height ; y += step) {
-      float const *p = source + y * width ;
-      for(x = 0 ; x < (signed)width - ((signed)step - 1) ; x += step) {
+  for (y = destinationCrop[1] ; y <= destinationCrop[3] ; ++y) {
+    float const *p = source
+    + (y * step - sourceCrop[1]) * sourceWidth
+    + destinationCrop[0] * step - sourceCrop[0] ;
+    if (step == 1) {
+      memcpy(destination, p, sizeof(float) * width) ;
+      destination += width ;
+    } else {
+      for (x = 0 ; x < width ; ++x) {
         *destination++ = *p ;
         p += step ;
       }
@@ -519,6 +616,58 @@ copy_and_downsample
   }
 }
 
+/** ------------------------------------------------------------------
+ ** @internal @brief Get the crops of the upsampled images
+ ** @param self object.
+ ** @param crops crops (output).
+ **
+ ** If the first octave is negative, the image is upsampled one octave
+ ** at a time. The function computes the crops of the upsampled images
+ ** of octaves @c geom.firstOctave to -1 needed to compute the crop of
+ ** the first octave, and stores them in @a crops (four numbers per
+ ** octave, from the finest).
+ **/
+
+static void
+_vl_scalespace_get_upsampling_crops (VlScaleSpace const *self, vl_index *crops)
+{
+  vl_index const o = self->geom.firstOctave ;
+  vl_index op ;
+  assert(o < 0) ;
+  memcpy(crops, self->crops, 4 * sizeof(vl_index)) ;
+  for (op = o + 1 ; op < 0 ; ++op) {
+    vl_index const * finer = crops + 4 * (op - o - 1) ;
+    vl_index * coarser = crops + 4 * (op - o) ;
+    coarser[0] = finer[0] / 2 ;
+    coarser[1] = finer[1] / 2 ;
+    coarser[2] = VL_MIN(finer[2] / 2 + 1, (signed)VL_SHIFT_LEFT(self->geom.width, -op) - 1) ;
+    coarser[3] = VL_MIN(finer[3] / 2 + 1, (signed)VL_SHIFT_LEFT(self->geom.height, -op) - 1) ;
+  }
+}
+
+#define VL_CROP_AREA(c) ((vl_size)((c)[2] - (c)[0] + 1) * (vl_size)((c)[3] - (c)[1] + 1))
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Allocate the data of an octave
+ ** @param self object.
+ ** @param o octave index.
+ ** @return @c true if the octave is allocated.
+ **
+ ** The function does nothing if the octave is already allocated.
+ **/
+
+static vl_bool
+_vl_scalespace_alloc_octave (VlScaleSpace *self, vl_index o)
+{
+  float ** octave = self->octaves + (o - self->geom.firstOctave) ;
+  if (*octave == NULL) {
+    VlScaleSpaceOctaveGeometry ogeom = vl_scalespace_get_octave_geometry(self,o) ;
+    vl_size numSublevels = self->geom.octaveLastSubdivision - self->geom.octaveFirstSubdivision + 1 ;
+    *octave = vl_malloc(ogeom.width * ogeom.height * numSublevels * sizeof(float)) ;
+  }
+  return *octave != NULL ;
+}
+
 /* ---------------------------------------------------------------- */
 /** @brief Create a new scale space object
  ** @param width image width.
@@ -551,32 +700,92 @@ vl_scalespace_new (vl_size width, vl_size height)
  ** The function returns `NULL` if it was not possible to allocate the
  ** object because of an out-of-memory condition.
  **
- ** @sa ::VlScaleSpaceGeometry, ::vl_scalespace_delete().
+ ** @sa ::VlScaleSpaceGeometry, ::vl_scalespace_new_with_crops,
+ ** ::vl_scalespace_delete().
  **/
 
 VlScaleSpace *
 vl_scalespace_new_with_geometry (VlScaleSpaceGeometry geom)
 {
+  return vl_scalespace_new_with_crops(geom, NULL) ;
+}
 
+/** ------------------------------------------------------------------
+ ** @brief Create a new scale space computed only in some crops
+ ** @param geom scale space geomerty.
+ ** @param crops crop of each octave or @c NULL.
+ ** @return new scale space object.
+ **
+ ** The function is like ::vl_scalespace_new_with_geometry, but the
+ ** octaves are computed only in the given crops (see @ref
+ ** scalespace-starting). @a crops lists four numbers (xmin, ymin,
+ ** xmax, ymax) for each octave from @c geom.firstOctave to @c
+ ** geom.lastOctave. These are the first and last column and row of
+ ** the crop, in pixels of the octave, and must be within the octave
+ ** (of size <code>geom.width / 2^o</code> by <code>geom.height /
+ ** 2^o</code>). The crop of an octave must contain the samples of the
+ ** crop of the next octave, i.e. be no smaller than twice that crop.
+ ** If @a crops is @c NULL, each crop is the whole octave.
+ **
+ ** The images passed to ::vl_scalespace_put_image have still size @c
+ ** geom.width by @c geom.height, but only the pixels sampled by the
+ ** crop of the first octave are read.
+ **/
+
+VlScaleSpace *
+vl_scalespace_new_with_crops (VlScaleSpaceGeometry geom, vl_index const * crops)
+{
   vl_index o ;
-  vl_size numSublevels = geom.octaveLastSubdivision - geom.octaveFirstSubdivision + 1 ;
   vl_size numOctaves = geom.lastOctave - geom.firstOctave + 1 ;
   VlScaleSpace *self ;
 
   assert(is_valid_geometry(geom)) ;
-  numOctaves = geom.lastOctave - geom.firstOctave + 1 ;
-  numSublevels = geom.octaveLastSubdivision - geom.octaveFirstSubdivision + 1 ;
 
   self = vl_calloc(1, sizeof(VlScaleSpace)) ;
   if (self == NULL) goto err_alloc_self ;
   self->geom = geom ;
+  self->lazy = VL_FALSE ;
+  self->image = NULL ;
+  self->lastComputedLevels = vl_malloc(numOctaves * sizeof(vl_index)) ;
+  self->accessedOctaves = vl_calloc(numOctaves, sizeof(vl_bool)) ;
+  self->crops = vl_malloc(4 * numOctaves * sizeof(vl_index)) ;
+  if (self->lastComputedLevels == NULL ||
+      self->accessedOctaves == NULL ||
+      self->crops == NULL) goto err_alloc_state ;
+  for (o = geom.firstOctave ; o <= geom.lastOctave ; ++o) {
+    vl_index * crop = self->crops + 4 * (o - geom.firstOctave) ;
+    vl_index const width = VL_SHIFT_LEFT(geom.width, -o) ;
+    vl_index const height = VL_SHIFT_LEFT(geom.height, -o) ;
+    if (crops) {
+      memcpy(crop, crops + 4 * (o - geom.firstOctave), 4 * sizeof(vl_index)) ;
+      assert(0 <= crop[0] && crop[0] <= crop[2] && crop[2] < width) ;
+      assert(0 <= crop[1] && crop[1] <= crop[3] && crop[3] < height) ;
+      assert(o == geom.firstOctave ||
+             (crop[-4] <= 2 * crop[0] && 2 * crop[2] <= crop[-2] &&
+              crop[-3] <= 2 * crop[1] && 2 * crop[3] <= crop[-1])) ;
+    } else {
+      crop[0] = 0 ;
+      crop[1] = 0 ;
+      crop[2] = width - 1 ;
+      crop[3] = height - 1 ;
+    }
+  }
   self->octaves = vl_calloc(numOctaves, sizeof(float*)) ;
   if (self->octaves == NULL) goto err_alloc_octave_list ;
   for (o = self->geom.firstOctave ; o <= self->geom.lastOctave ; ++o) {
-    VlScaleSpaceOctaveGeometry ogeom = vl_scalespace_get_octave_geometry(self,o) ;
-    vl_size octaveSize = ogeom.width * ogeom.height * numSublevels ;
-    self->octaves[o - self->geom.firstOctave] = vl_malloc(octaveSize * sizeof(float)) ;
-    if (self->octaves[o - self->geom.firstOctave] == NULL) goto err_alloc_octaves;
+    self->lastComputedLevels[o - self->geom.firstOctave] = geom.octaveFirstSubdivision - 1 ;
+    if (! _vl_scalespace_alloc_octave(self, o)) goto err_alloc_octaves;
+  }
+  if (geom.firstOctave < -1) {
+    /* two buffers, used alternately to upsample the image */
+    vl_index upsampleCrops [4 * 32] ;
+    vl_size size ;
+    assert(-geom.firstOctave < 32) ;
+    _vl_scalespace_get_upsampling_crops(self, upsampleCrops) ;
+    size = VL_CROP_AREA(upsampleCrops + 4) ;
+    if (geom.firstOctave < -2) size += VL_CROP_AREA(upsampleCrops + 8) ;
+    self->upsampleBuffer = vl_malloc(size * sizeof(float)) ;
+    if (self->upsampleBuffer == NULL) goto err_alloc_octaves ;
   }
   return self ;
 
@@ -586,7 +795,12 @@ err_alloc_octaves:
       vl_free(self->octaves[o - self->geom.firstOctave]) ;
     }
   }
+  vl_free(self->octaves) ;
 err_alloc_octave_list:
+err_alloc_state:
+  if (self->lastComputedLevels) vl_free(self->lastComputedLevels) ;
+  if (self->accessedOctaves) vl_free(self->accessedOctaves) ;
+  if (self->crops) vl_free(self->crops) ;
   vl_free(self) ;
 err_alloc_self:
   return NULL ;
@@ -597,7 +811,10 @@ err_alloc_self:
  ** @param self object to copy from.
  **
  ** The function returns `NULL` if the copy cannot be made due to an
- ** out-of-memory condition.
+ ** out-of-memory condition. If @a self is lazy
+ ** (::vl_scalespace_set_lazy), all its levels are computed first; the
+ ** copy is not lazy. If @a self is lazy and has no image, the content
+ ** of the copy is undefined.
  **/
 
 VlScaleSpace *
@@ -610,9 +827,22 @@ vl_scalespace_new_copy (VlScaleSpace* self)
   for (o = self->geom.firstOctave ; o <= self->geom.lastOctave ; ++o) {
     VlScaleSpaceOctaveGeometry ogeom = vl_scalespace_get_octave_geometry(self,o) ;
     vl_size numSubevels = self->geom.octaveLastSubdivision - self->geom.octaveFirstSubdivision + 1;
+    /* in lazy mode, this computes the octave */
+    float const * octave = vl_scalespace_get_level(self, o, self->geom.octaveLastSubdivision) ;
+    if (octave == NULL) {
+      if (self->lazy && self->image) {
+        /* out of memory */
+        vl_scalespace_delete(copy) ;
+        return NULL ;
+      }
+      continue ;
+    }
+    octave -= ogeom.width * ogeom.height * (numSubevels - 1) ;
     memcpy(copy->octaves[o - self->geom.firstOctave],
-           self->octaves[o - self->geom.firstOctave],
+           octave,
            ogeom.width * ogeom.height * numSubevels * sizeof(float)) ;
+    copy->lastComputedLevels[o - self->geom.firstOctave] =
+      self->lastComputedLevels[o - self->geom.firstOctave] ;
   }
   return copy ;
 }
@@ -628,7 +858,7 @@ vl_scalespace_new_copy (VlScaleSpace* self)
 VlScaleSpace *
 vl_scalespace_new_shallow_copy (VlScaleSpace* self)
 {
-  return vl_scalespace_new_with_geometry (self->geom) ;
+  return vl_scalespace_new_with_crops (self->geom, self->crops) ;
 }
 
 /* ---------------------------------------------------------------- */
@@ -650,35 +880,42 @@ vl_scalespace_delete (VlScaleSpace * self)
       }
       vl_free(self->octaves) ;
     }
+    if (self->image) vl_free(self->image) ;
+    if (self->lastComputedLevels) vl_free(self->lastComputedLevels) ;
+    if (self->accessedOctaves) vl_free(self->accessedOctaves) ;
+    if (self->crops) vl_free(self->crops) ;
+    if (self->upsampleBuffer) vl_free(self->upsampleBuffer) ;
     vl_free(self) ;
   }
 }
 
 /* ---------------------------------------------------------------- */
 
-/** @internal @brief Fill octave starting from the first level
+/** @internal @brief Fill octave starting from a given level
  ** @param self object instance.
  ** @param o octave to process.
+ ** @param firstLevel first level to compute.
+ ** @param lastLevel last level to compute.
  **
- ** The function takes the first sublevel of octave @a o (the one at
- ** sublevel `octaveFirstLevel` and iteratively
- ** smoothes it to obtain the other octave levels.
+ ** The function computes the levels @a firstLevel to @a lastLevel of
+ ** octave @a o by iteratively smoothing level <code>firstLevel -
+ ** 1</code>.
  **/
 
-void
-_vl_scalespace_fill_octave (VlScaleSpace *self, vl_index o)
+static void
+_vl_scalespace_fill_octave (VlScaleSpace *self, vl_index o,
+                            vl_index firstLevel, vl_index lastLevel)
 {
   vl_index s ;
   VlScaleSpaceOctaveGeometry ogeom = vl_scalespace_get_octave_geometry(self, o) ;
 
-  for(s = self->geom.octaveFirstSubdivision + 1 ;
-      s <= self->geom.octaveLastSubdivision ; ++s) {
+  for(s = firstLevel ; s <= lastLevel ; ++s) {
     double sigma = vl_scalespace_get_level_sigma(self, o, s) ;
     double previousSigma = vl_scalespace_get_level_sigma(self, o, s - 1) ;
     double deltaSigma = sqrtf(sigma*sigma - previousSigma*previousSigma) ;
 
-    float* level = vl_scalespace_get_level (self, o, s) ;
-    float* previous = vl_scalespace_get_level (self, o, s-1) ;
+    float* level = _vl_scalespace_get_level_data (self, o, s) ;
+    float* previous = _vl_scalespace_get_level_data (self, o, s-1) ;
     vl_imsmooth_f (level, ogeom.width,
                    previous, ogeom.width, ogeom.height, ogeom.width,
                    deltaSigma / ogeom.step, deltaSigma / ogeom.step) ;
@@ -703,7 +940,8 @@ _vl_scalespace_start_octave_from_image (VlScaleSpace *self,
 {
   float *level ;
   double sigma, imageSigma ;
-  vl_index op ;
+  vl_index const imageCrop [4] = {0, 0, self->geom.width - 1, self->geom.height - 1} ;
+  vl_index const * crop = self->crops + 4 * (o - self->geom.firstOctave) ;
 
   assert(self) ;
   assert(image) ;
@@ -715,14 +953,35 @@ _vl_scalespace_start_octave_from_image (VlScaleSpace *self,
    * downscaling as needed.
    */
 
-  level = vl_scalespace_get_level(self, VL_MAX(0, o), self->geom.octaveFirstSubdivision) ;
-  copy_and_downsample(level, image, self->geom.width, self->geom.height, VL_MAX(0, o)) ;
-
-  for (op = -1 ; op >= o ; --op) {
-    VlScaleSpaceOctaveGeometry ogeom = vl_scalespace_get_octave_geometry(self, op + 1) ;
-    float *succLevel = vl_scalespace_get_level(self, op + 1, self->geom.octaveFirstSubdivision) ;
-    level = vl_scalespace_get_level(self, op, self->geom.octaveFirstSubdivision) ;
-    copy_and_upsample(level, succLevel, ogeom.width, ogeom.height) ;
+  level = _vl_scalespace_get_level_data(self, o, self->geom.octaveFirstSubdivision) ;
+  if (o >= 0) {
+    copy_and_downsample(level, crop, image, imageCrop, o) ;
+  } else {
+    /*
+     * Upsample one octave at a time. The intermediate octaves are
+     * only needed around the crop of octave o, and are stored
+     * alternately in the two halves of self->upsampleBuffer.
+     */
+    vl_index crops [4 * 32] ;
+    float *buffers [2] ;
+    float const *source = image ;
+    vl_index op ;
+    assert(o == self->geom.firstOctave) ;
+    _vl_scalespace_get_upsampling_crops(self, crops) ;
+    if (o < -1) {
+      buffers[1] = self->upsampleBuffer ;
+      buffers[0] = self->upsampleBuffer + VL_CROP_AREA(crops + 4) ;
+    }
+    for (op = -1 ; op >= o ; --op) {
+      vl_index const * sourceCrop = (op == -1) ? imageCrop : crops + 4 * (op + 1 - o) ;
+      vl_index const * destinationCrop = crops + 4 * (op - o) ;
+      float *destination = (op > o) ? buffers[(op - o) & 1] : level ;
+      copy_and_upsample(destination, destinationCrop,
+                        source, sourceCrop,
+                        VL_SHIFT_LEFT(self->geom.width, -op - 1),
+                        VL_SHIFT_LEFT(self->geom.height, -op - 1)) ;
+      source = destination ;
+    }
   }
 
   /*
@@ -737,7 +996,7 @@ _vl_scalespace_start_octave_from_image (VlScaleSpace *self,
   if (sigma > imageSigma) {
     VlScaleSpaceOctaveGeometry ogeom = vl_scalespace_get_octave_geometry(self, o) ;
     double deltaSigma = sqrt (sigma*sigma - imageSigma*imageSigma) ;
-    level = vl_scalespace_get_level (self, o, self->geom.octaveFirstSubdivision) ;
+    level = _vl_scalespace_get_level_data (self, o, self->geom.octaveFirstSubdivision) ;
     vl_imsmooth_f (level, ogeom.width,
                    level, ogeom.width, ogeom.height, ogeom.width,
                    deltaSigma / ogeom.step, deltaSigma / ogeom.step) ;
@@ -758,7 +1017,6 @@ _vl_scalespace_start_octave_from_previous_octave (VlScaleSpace *self, vl_index o
   double sigma, prevSigma ;
   float *level, *prevLevel ;
   vl_index prevLevelIndex ;
-  VlScaleSpaceOctaveGeometry ogeom ;
 
   assert(self) ;
   assert(o > self->geom.firstOctave) ; /* must not be the first octave */
@@ -775,11 +1033,12 @@ _vl_scalespace_start_octave_from_previous_octave (VlScaleSpace *self, vl_index o
   prevLevelIndex = VL_MIN(self->geom.octaveFirstSubdivision
                           + (signed)self->geom.octaveResolution,
                           self->geom.octaveLastSubdivision) ;
-  prevLevel = vl_scalespace_get_level (self, o - 1, prevLevelIndex) ;
-  level = vl_scalespace_get_level (self, o, self->geom.octaveFirstSubdivision) ;
-  ogeom = vl_scalespace_get_octave_geometry(self, o - 1) ;
+  prevLevel = _vl_scalespace_get_level_data (self, o - 1, prevLevelIndex) ;
+  level = _vl_scalespace_get_level_data (self, o, self->geom.octaveFirstSubdivision) ;
 
-  copy_and_downsample (level, prevLevel, ogeom.width, ogeom.height, 1) ;
+  copy_and_downsample (level, self->crops + 4 * (o - self->geom.firstOctave),
+                       prevLevel, self->crops + 4 * (o - 1 - self->geom.firstOctave),
+                       1) ;
 
   /*
    * Add remaining smoothing, if any.
@@ -791,7 +1050,7 @@ _vl_scalespace_start_octave_from_previous_octave (VlScaleSpace *self, vl_index o
   if (sigma > prevSigma) {
     VlScaleSpaceOctaveGeometry ogeom = vl_scalespace_get_octave_geometry(self, o) ;
     double deltaSigma = sqrt (sigma*sigma - prevSigma*prevSigma) ;
-    level = vl_scalespace_get_level (self, o, self->geom.octaveFirstSubdivision) ;
+    level = _vl_scalespace_get_level_data (self, o, self->geom.octaveFirstSubdivision) ;
 
     /* todo: this may fail due to an out-of-memory condition */
     vl_imsmooth_f (level, ogeom.width,
@@ -800,22 +1059,186 @@ _vl_scalespace_start_octave_from_previous_octave (VlScaleSpace *self, vl_index o
   }
 }
 
+/** ------------------------------------------------------------------
+ ** @internal @brief Compute a level on demand
+ ** @param self object.
+ ** @param o octave index.
+ ** @param s level index.
+ **
+ ** The function computes the levels of octave @a o up to @a s, if
+ ** they are not available yet, as well as the levels of the
+ ** previous octaves they depend on. Octaves computed only to
+ ** initialize the next one are released afterwards. An image must
+ ** have been set.
+ **
+ ** @return error code. The function returns ::VL_ERR_ALLOC if an
+ ** octave cannot be allocated, leaving the levels computed so far
+ ** unchanged.
+ **/
+
+static int
+_vl_scalespace_materialize (VlScaleSpace *self, vl_index o, vl_index s)
+{
+  vl_index const firstLevel = self->geom.octaveFirstSubdivision ;
+  vl_index * lastComputed = self->lastComputedLevels + (o - self->geom.firstOctave) ;
+
+  assert(self->image) ;
+  if (*lastComputed >= s) return VL_ERR_OK ;
+
+  if (! _vl_scalespace_alloc_octave(self, o)) {
+    return VL_ERR_ALLOC ;
+  }
+
+  if (*lastComputed < firstLevel) {
+    if (o == self->geom.firstOctave) {
+      _vl_scalespace_start_octave_from_image(self, self->image, o) ;
+    } else {
+      vl_index prev = o - 1 - self->geom.firstOctave ;
+      vl_index prevLevelIndex = VL_MIN(firstLevel + (signed)self->geom.octaveResolution,
+                                       self->geom.octaveLastSubdivision) ;
+      int err = _vl_scalespace_materialize(self, o - 1, prevLevelIndex) ;
+      if (err != VL_ERR_OK) return err ;
+      _vl_scalespace_start_octave_from_previous_octave(self, o) ;
+      if (! self->accessedOctaves[prev]) {
+        vl_free(self->octaves[prev]) ;
+        self->octaves[prev] = NULL ;
+        self->lastComputedLevels[prev] = firstLevel - 1 ;
+      }
+    }
+    *lastComputed = firstLevel ;
+  }
+
+  _vl_scalespace_fill_octave(self, o, *lastComputed + 1, s) ;
+  *lastComputed = s ;
+  return VL_ERR_OK ;
+}
+
 /** @brief Initialise Scale space with new image
  ** @param self ::VlScaleSpace object instance.
  ** @param image image to process.
  **
  ** Compute the data of all the defined octaves and scales of the scale
- ** space @a self.
+ ** space @a self. In lazy mode (::vl_scalespace_set_lazy), the
+ ** function only stores a copy of @a image, and the levels are
+ ** computed when they are first accessed.
+ **
+ ** @return error code. In lazy mode, the function fails with
+ ** ::VL_ERR_ALLOC if the copy of the image cannot be allocated; the
+ ** scale space has then no image.
  **/
 
-void
+int
 vl_scalespace_put_image (VlScaleSpace *self, float const *image)
 {
   vl_index o ;
+  vl_index const numOctaves = self->geom.lastOctave - self->geom.firstOctave + 1 ;
+
+  if (self->lazy) {
+    vl_size const numPixels = self->geom.width * self->geom.height ;
+    for (o = 0 ; o < numOctaves ; ++o) {
+      self->lastComputedLevels[o] = self->geom.octaveFirstSubdivision - 1 ;
+      self->accessedOctaves[o] = VL_FALSE ;
+    }
+    if (self->image == NULL) {
+      self->image = vl_malloc(numPixels * sizeof(float)) ;
+      if (self->image == NULL) {
+        return vl_set_last_error(VL_ERR_ALLOC, "Unable to allocate the image copy.") ;
+      }
+    }
+    memcpy(self->image, image, numPixels * sizeof(float)) ;
+    return VL_ERR_OK ;
+  }
+
   _vl_scalespace_start_octave_from_image(self, image, self->geom.firstOctave) ;
-  _vl_scalespace_fill_octave(self, self->geom.firstOctave) ;
+  _vl_scalespace_fill_octave(self, self->geom.firstOctave,
+                             self->geom.octaveFirstSubdivision + 1,
+                             self->geom.octaveLastSubdivision) ;
   for (o = self->geom.firstOctave + 1 ; o <= self->geom.lastOctave ; ++o) {
     _vl_scalespace_start_octave_from_previous_octave(self, o) ;
-    _vl_scalespace_fill_octave(self, o) ;
+    _vl_scalespace_fill_octave(self, o,
+                               self->geom.octaveFirstSubdivision + 1,
+                               self->geom.octaveLastSubdivision) ;
+  }
+  for (o = 0 ; o < numOctaves ; ++o) {
+    self->lastComputedLevels[o] = self->geom.octaveLastSubdivision ;
   }
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the lazy mode
+ ** @param self object.
+ ** @param lazy whether to compute the levels on demand.
+ **
+ ** In lazy mode, ::vl_scalespace_put_image does not compute the
+ ** scale space. Instead, ::vl_scalespace_get_level computes (and
+ ** allocates) the requested level when it is first accessed, together
+ ** with the levels it depends on. Since octaves are computed
+ ** incrementally, only the levels up to the requested one are
+ ** computed, and octaves computed only to obtain a coarser one are
+ ** released. This reduces time and memory when only some of the
+ ** levels, such as the coarser ones, are needed.
+ **
+ ** Switching to the lazy mode discards the content of the scale
+ ** space, and ::vl_scalespace_get_level returns @c NULL until an image
+ ** is set. Switching back computes all the levels of the last image,
+ ** if any. If the memory is insufficient for that, the object stays in
+ ** lazy mode and the last error is set to ::VL_ERR_ALLOC.
+ **
+ ** @remark In lazy mode, ::vl_scalespace_get_level and
+ ** ::vl_scalespace_get_level_const may modify the object. They are
+ ** safe to call from several OpenMP threads, but not from threads
+ ** created otherwise.
+ **/
+
+void
+vl_scalespace_set_lazy (VlScaleSpace *self, vl_bool lazy)
+{
+  vl_index o ;
+  lazy = (lazy != 0) ;
+  if (lazy == self->lazy) return ;
+
+  if (lazy) {
+    for (o = self->geom.firstOctave ; o <= self->geom.lastOctave ; ++o) {
+      vl_index k = o - self->geom.firstOctave ;
+      if (self->octaves[k]) {
+        vl_free(self->octaves[k]) ;
+        self->octaves[k] = NULL ;
+      }
+      self->lastComputedLevels[k] = self->geom.octaveFirstSubdivision - 1 ;
+      self->accessedOctaves[k] = VL_FALSE ;
+    }
+    self->lazy = VL_TRUE ;
+  } else {
+    vl_bool ok = VL_TRUE ;
+    for (o = self->geom.firstOctave ; o <= self->geom.lastOctave && ok ; ++o) {
+      if (self->image) {
+        ok = (vl_scalespace_get_level(self, o, self->geom.octaveLastSubdivision) != NULL) ;
+      } else {
+        ok = _vl_scalespace_alloc_octave(self, o) ;
+      }
+    }
+    if (! ok) {
+      vl_set_last_error(VL_ERR_ALLOC, "Unable to allocate the scale space.") ;
+      return ;
+    }
+    if (self->image) {
+      vl_free(self->image) ;
+      self->image = NULL ;
+    }
+    self->lazy = VL_FALSE ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the lazy mode
+ ** @param self object.
+ ** @return whether the levels are computed on demand.
+ ** @sa ::vl_scalespace_set_lazy
+ **/
+
+vl_bool
+vl_scalespace_get_lazy (VlScaleSpace const *self)
+{
+  return self->lazy ;
 }
@@ -55,6 +55,7 @@ typedef struct _VlScaleSpaceOctaveGeometry
   vl_size width ; /**< Width (number of pixels) */
   vl_size height ; /**< Height (number of pixels) */
   double step ; /**< Sampling step (size of a pixel) */
+  vl_index origin [2] ; /**< Column and row of the first pixel in the whole octave */
 } VlScaleSpaceOctaveGeometry ;
 
 /* ---------------------------------------------------------------- */
@@ -69,6 +70,7 @@ typedef struct _VlScaleSpace VlScaleSpace ;
 VL_EXPORT VlScaleSpaceGeometry vl_scalespace_get_default_geometry(vl_size width, vl_size height) ;
 VL_EXPORT VlScaleSpace * vl_scalespace_new (vl_size width, vl_size height) ;
 VL_EXPORT VlScaleSpace * vl_scalespace_new_with_geometry (VlScaleSpaceGeometry geom) ;
+VL_EXPORT VlScaleSpace * vl_scalespace_new_with_crops (VlScaleSpaceGeometry geom, vl_index const * crops) ;
 VL_EXPORT VlScaleSpace * vl_scalespace_new_copy (VlScaleSpace* src);
 VL_EXPORT VlScaleSpace * vl_scalespace_new_shallow_copy (VlScaleSpace* src);
 VL_EXPORT void vl_scalespace_delete (VlScaleSpace *self) ;
@@ -77,8 +79,10 @@ VL_EXPORT void vl_scalespace_delete (VlScaleSpace *self) ;
 /** @name Process data
  ** @{
  **/
-VL_EXPORT void
+VL_EXPORT int
 vl_scalespace_put_image (VlScaleSpace *self, float const* image);
+VL_EXPORT void
+vl_scalespace_set_lazy (VlScaleSpace *self, vl_bool lazy) ;
 /** @} */
 
 /** @name Retrieve data and parameters
@@ -92,6 +96,8 @@ VL_EXPORT float const *
 vl_scalespace_get_level_const (VlScaleSpace const * self, vl_index o, vl_index s) ;
 VL_EXPORT double
 vl_scalespace_get_level_sigma (VlScaleSpace const *self, vl_index o, vl_index s) ;
+VL_EXPORT vl_bool
+vl_scalespace_get_lazy (VlScaleSpace const *self) ;
 /** @} */
 
 /* VL_SCALESPACE_H */
@@ -232,6 +232,89 @@ no descriptor is zeroed. Normally this option is useful only with
 custom keypoints, as detected keypoints are implicitly selected at
 high contrast image regions.
 
+<b>RootSIFT.</b> ::vl_sift_set_root_sift() causes the SIFT descriptor
+to be mapped to its RootSIFT version, obtained by normalizing it in
+L1 norm and taking the element-wise square root. Comparing RootSIFT
+descriptors by the Euclidean distance is equivalent to comparing the
+original descriptors by the Hellinger kernel.
+
+<b>Compact descriptors.</b> Descriptors are often stored as 8-bit
+integers, computed as @f$ \min\{255, \lfloor 512 h \rfloor\} @f$ from the
+normalized descriptor @f$ h @f$.
+::vl_sift_calc_keypoint_descriptor_ui8() and
+::vl_sift_calc_octave_descriptors_ui8() compute such descriptors
+directly, fusing normalization, clamping and quantization in a single
+step. The result is the same as quantizing the output of
+::vl_sift_calc_keypoint_descriptor().
+
+<b>Projected descriptors.</b> ::vl_sift_set_projection() sets a linear
+projection (for example learned by PCA) which is applied to the
+normalized descriptors. This is useful to obtain compact descriptors
+(PCA-SIFT), possibly combined with RootSIFT, without post-processing
+them.
+
+<b>Keypoint budget.</b> ::vl_sift_set_max_keypoints() limits the
+keypoints of the image to the strongest ones (by the magnitude of
+the DoG response before refinement). The keypoints of all octaves
+are scored when the image is started, and afterwards the detector
+drops weaker candidates before refinement, so that orientations and
+descriptors are computed only for the surviving keypoints.
+
+<b>Upright features.</b> ::vl_sift_set_upright() fixes the
+orientation of all keypoints to zero. This is useful when images
+are known to be upright, as it skips the computation of the
+gradient orientation histograms and makes the descriptor
+discriminate between rotated patches.
+::vl_sift_calc_keypoint_orientations() then returns the single
+orientation zero, and descriptors are computed by a simplified
+kernel (with SSE2 and AVX variants) which gives the same result as
+the general one.
+
+<b>Sharing the scale space.</b> When several detectors are run on
+the same image, the Gaussian scale space can be computed once.
+::vl_sift_process_first_octave_from_scale_space() starts processing
+an image from a ::VlScaleSpace object, for example the one computed
+by a ::VlCovDet detector, instead of smoothing the image again:
+
+@code
+vl_covdet_put_image (covdet, image, width, height) ;
+vl_covdet_detect (covdet) ;
+err = vl_sift_process_first_octave_from_scale_space
+  (filt, vl_covdet_get_gss (covdet)) ;
+while (err == VL_ERR_OK) {
+  vl_sift_detect (filt) ;
+  ...
+  err = vl_sift_process_next_octave (filt) ;
+}
+@endcode
+
+The geometry of the scale space must be compatible with the one
+returned by ::vl_sift_get_scale_space_geometry() (this is the case
+for the DoG detector of ::VlCovDet with the same number of levels per
+octave). Levels and octaves missing from the scale space, such as the
+last level of the octaves of the Hessian detector of ::VlCovDet, are
+computed by the SIFT filter.
+
+<b>Large images.</b> The memory used by the SIFT filter is
+proportional to the image size. ::vl_sift_process_tiled() processes
+an image by overlapping tiles, read on demand, and finds exactly the
+same keypoints (with the same orientations and descriptors) as
+processing the whole image at once. The overlap is the smallest one
+that makes the result exact, and keypoints found in the overlap of
+two tiles are reported only once. Since the overlap grows with the
+octave index, the first few octaves are processed by tiles and the
+following octaves are processed in further passes, with tiles
+covering more image pixels. All the passes run together, row of
+tiles by row of tiles: each tile of a pass downsamples its core to
+the base of the next octave and appends it to a band of rows read by
+the tiles of the next pass, which drops the rows it does not need
+anymore. Hence each octave is computed once, and the memory is
+bounded by one tile and one band per pass. A band spans the width of
+the image and about one tile in height, so the memory grows with the
+image width and the tile size, but not with the image height.
+Keypoints are reported tile by tile and not in the same order as
+processing the whole image.
+
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
 @section sift-usage Using the SIFT filter object
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
@@ -247,7 +330,8 @@ To use a <b>SIFT filter</b> object:
 
 - Initialize a SIFT filter object with ::vl_sift_new(). The filter can
   be reused for multiple images of the same size (e.g. for an entire
-  video sequence).
+  video sequence), and re-targeted to images of a different size by
+  ::vl_sift_reset_geometry(), which reuses its buffers.
 - For each octave in the scale space:
   - Compute the next octave of the DOG scale space using either
    ::vl_sift_process_first_octave() or ::vl_sift_process_next_octave()
@@ -259,9 +343,26 @@ To use a <b>SIFT filter</b> object:
       - Use ::vl_sift_calc_keypoint_descriptor() to get the keypoint descriptor.
 - Delete the SIFT filter by ::vl_sift_delete().
 
+Alternatively, the orientations and descriptors of all the keypoints
+of an octave can be computed in one go by
+::vl_sift_calc_octave_orientations() and
+::vl_sift_calc_octave_descriptors(). These functions process the
+keypoints in order of scale level and in parallel, and store the
+results in contiguous arrays.
+
 To compute SIFT descriptors of custom keypoints, use
 ::vl_sift_calc_raw_descriptor().
 
+If VLFeat is compiled with OpenMP, the computation of the scale space,
+of the DoG and of the image gradients is split across up to
+::vl_get_max_threads() threads (see @ref threads-parallel). The result
+does not depend on the number of threads. Keypoint orientations and
+descriptors can be computed in parallel too: after calling
+::vl_sift_update_gradient() for the current octave,
+::vl_sift_calc_keypoint_orientations() and
+::vl_sift_calc_keypoint_descriptor() do not modify the filter and can
+be called concurrently for different keypoints.
+
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
 @section sift-tech Technical details
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
@@ -656,15 +757,25 @@ Gaussian window size is set to have standard deviation
 **/
 
 #include "sift.h"
+#include "sift_sse2.h"
+#include "sift_avx.h"
 #include "imopv.h"
 #include "mathop.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <stdio.h>
 
+/* min-heap of the scores of the strongest keypoints */
+#define VL_HEAP_prefix     vl_sift_score_heap
+#define VL_HEAP_type       float
+#include "heap-def.h"
+
+static int _vl_sift_select_keypoints (VlSiftFilt *f) ;
+
 /** @internal @brief Use bilinear interpolation to compute orientations */
 #define VL_SIFT_BILINEAR_ORIENTATIONS 1
 
@@ -757,6 +868,29 @@ copy_and_upsample_rows
   }
 }
 
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Get a band of an image for parallel processing
+ ** @param begin    first element of the band (out).
+ ** @param end      one past the last element of the band (out).
+ ** @param size     number of elements to split.
+ ** @param band     band index.
+ ** @param numBands number of bands.
+ **
+ ** The band size is rounded to a multiple of four elements so that
+ ** bands start at addresses suitable for SIMD processing.
+ **/
+
+static void
+_vl_sift_get_band (vl_size *begin, vl_size *end,
+                   vl_size size, vl_index band, vl_index numBands)
+{
+  vl_size bandSize = (size + numBands - 1) / numBands ;
+  bandSize = (bandSize + 3) & ~ (vl_size)3 ;
+  *begin = VL_MIN(band * bandSize, size) ;
+  *end = VL_MIN(*begin + bandSize, size) ;
+}
+
 /** ------------------------------------------------------------------
  ** @internal
  ** @brief Smooth an image
@@ -778,23 +912,43 @@ _vl_sift_smooth (VlSiftFilt * self,
                  vl_size height,
                  double sigma)
 {
-  /* prepare Gaussian filter */
-  if (self->gaussFilterSigma != sigma) {
-    vl_uindex j ;
+  /* prepare Gaussian filter, reusing a cached one if possible */
+  if (self->gaussFilterSigma != sigma || self->gaussFilter == NULL) {
+    vl_uindex i, j ;
     vl_sift_pix acc = 0 ;
-    if (self->gaussFilter) vl_free (self->gaussFilter) ;
-    self->gaussFilterWidth = VL_MAX(ceil(4.0 * sigma), 1) ;
-    self->gaussFilterSigma = sigma ;
-    self->gaussFilter = vl_malloc (sizeof(vl_sift_pix) * (2 * self->gaussFilterWidth + 1)) ;
-
-    for (j = 0 ; j < 2 * self->gaussFilterWidth + 1 ; ++j) {
-      vl_sift_pix d = ((vl_sift_pix)((signed)j - (signed)self->gaussFilterWidth)) / ((vl_sift_pix)sigma) ;
-      self->gaussFilter[j] = (vl_sift_pix) exp (- 0.5 * (d*d)) ;
-      acc += self->gaussFilter[j] ;
+    vl_sift_pix *filter ;
+    vl_size filterWidth ;
+
+    for (i = 0 ; i < VL_SIFT_NUM_CACHED_FILTERS ; ++i) {
+      if (self->gaussFilterCache[i] && self->gaussFilterCacheSigma[i] == sigma) break ;
     }
-    for (j = 0 ; j < 2 * self->gaussFilterWidth + 1 ; ++j) {
-      self->gaussFilter[j] /= acc ;
+
+    if (i == VL_SIFT_NUM_CACHED_FILTERS) {
+      /* replace the oldest cache entry */
+      i = self->gaussFilterCacheNext ;
+      self->gaussFilterCacheNext = (i + 1) % VL_SIFT_NUM_CACHED_FILTERS ;
+
+      filterWidth = VL_MAX(ceil(4.0 * sigma), 1) ;
+      filter = vl_realloc (self->gaussFilterCache[i],
+                           sizeof(vl_sift_pix) * (2 * filterWidth + 1)) ;
+
+      for (j = 0 ; j < 2 * filterWidth + 1 ; ++j) {
+        vl_sift_pix d = ((vl_sift_pix)((signed)j - (signed)filterWidth)) / ((vl_sift_pix)sigma) ;
+        filter[j] = (vl_sift_pix) exp (- 0.5 * (d*d)) ;
+        acc += filter[j] ;
+      }
+      for (j = 0 ; j < 2 * filterWidth + 1 ; ++j) {
+        filter[j] /= acc ;
+      }
+
+      self->gaussFilterCache[i] = filter ;
+      self->gaussFilterCacheSigma[i] = sigma ;
+      self->gaussFilterCacheWidth[i] = filterWidth ;
     }
+
+    self->gaussFilter = self->gaussFilterCache[i] ;
+    self->gaussFilterSigma = self->gaussFilterCacheSigma[i] ;
+    self->gaussFilterWidth = self->gaussFilterCacheWidth[i] ;
   }
 
   if (self->gaussFilterWidth == 0) {
@@ -802,17 +956,48 @@ _vl_sift_smooth (VlSiftFilt * self,
     return ;
   }
 
-  vl_imconvcol_vf (tempImage, height,
-                   inputImage, width, height, width,
-                   self->gaussFilter,
-                   - self->gaussFilterWidth, self->gaussFilterWidth,
-                   1, VL_PAD_BY_CONTINUITY | VL_TRANSPOSE) ;
+  /*
+   The two convolution passes are split in bands of columns, one per
+   thread. Since each column is filtered independently, the result
+   does not depend on the number of bands.
+   */
+  {
+    vl_index const numBands = vl_get_max_threads() ;
+    vl_index band ;
+
+#if defined(_OPENMP)
+#pragma omp parallel default(shared) private(band) num_threads(numBands)
+#endif
+    {
+#if defined(_OPENMP)
+#pragma omp for
+#endif
+      for (band = 0 ; band < numBands ; ++band) {
+        vl_size begin, end ;
+        _vl_sift_get_band (&begin, &end, width, band, numBands) ;
+        if (begin >= end) continue ;
+        vl_imconvcol_vf (tempImage + begin * height, height,
+                         inputImage + begin, end - begin, height, width,
+                         self->gaussFilter,
+                         - self->gaussFilterWidth, self->gaussFilterWidth,
+                         1, VL_PAD_BY_CONTINUITY | VL_TRANSPOSE) ;
+      }
 
-  vl_imconvcol_vf (outputImage, width,
-                   tempImage, height, width, height,
-                   self->gaussFilter,
-                   - self->gaussFilterWidth, self->gaussFilterWidth,
-                   1, VL_PAD_BY_CONTINUITY | VL_TRANSPOSE) ;
+#if defined(_OPENMP)
+#pragma omp for
+#endif
+      for (band = 0 ; band < numBands ; ++band) {
+        vl_size begin, end ;
+        _vl_sift_get_band (&begin, &end, height, band, numBands) ;
+        if (begin >= end) continue ;
+        vl_imconvcol_vf (outputImage + begin * width, width,
+                         tempImage + begin, end - begin, width, height,
+                         self->gaussFilter,
+                         - self->gaussFilterWidth, self->gaussFilterWidth,
+                         1, VL_PAD_BY_CONTINUITY | VL_TRANSPOSE) ;
+      }
+    }
+  }
 }
 
 /** ------------------------------------------------------------------
@@ -850,6 +1035,132 @@ copy_and_downsample
   }
 }
 
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Allocate the scale space buffers of a SIFT filter
+ ** @param f SIFT filter.
+ **
+ ** The buffers are sized for the first octave of an image of the
+ ** size currently set in the filter. They are reallocated only if
+ ** they are too small, so that they can be reused for images of
+ ** different sizes (see ::vl_sift_reset_geometry()).
+ **
+ ** @return error code. On failure the buffers are released.
+ **/
+
+static int
+_vl_sift_alloc_buffers (VlSiftFilt *f)
+{
+  vl_size numPixels = (vl_size) VL_SHIFT_LEFT (f->width,  -f->o_min)
+                                * VL_SHIFT_LEFT (f->height, -f->o_min) ;
+  int numLevels = f->s_max - f->s_min + 1 ;
+
+  if (f->octave &&
+      numPixels <= f->bufferNumPixels &&
+      numLevels <= f->bufferNumLevels) return VL_ERR_OK ;
+
+  numPixels = VL_MAX(numPixels, f->bufferNumPixels) ;
+  numLevels = VL_MAX(numLevels, f->bufferNumLevels) ;
+
+  if (f->temp) vl_free (f->temp) ;
+  if (f->octave) vl_free (f->octave) ;
+  if (f->dog) vl_free (f->dog) ;
+  if (f->grad) vl_free (f->grad) ;
+
+  f-> temp    = vl_malloc (sizeof(vl_sift_pix) * numPixels) ;
+  f-> octave  = vl_malloc (sizeof(vl_sift_pix) * numPixels * numLevels) ;
+  f-> dog     = vl_malloc (sizeof(vl_sift_pix) * numPixels * (numLevels - 1)) ;
+  f-> grad    = vl_malloc (sizeof(vl_sift_pix) * numPixels * 2 * (numLevels - 1)) ;
+
+  if (f->temp == NULL || f->octave == NULL || f->dog == NULL || f->grad == NULL) {
+    if (f->temp) vl_free (f->temp) ;
+    if (f->octave) vl_free (f->octave) ;
+    if (f->dog) vl_free (f->dog) ;
+    if (f->grad) vl_free (f->grad) ;
+    f-> temp = f-> octave = f-> dog = f-> grad = NULL ;
+    f-> bufferNumPixels = 0 ;
+    f-> bufferNumLevels = 0 ;
+    return vl_set_last_error (VL_ERR_ALLOC, "Unable to allocate the scale space buffers.") ;
+  }
+
+  f-> bufferNumPixels = numPixels ;
+  f-> bufferNumLevels = numLevels ;
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the levels of the current octave from its base
+ ** @param f SIFT filter.
+ ** @param s_first last level already computed.
+ **
+ ** The function computes the levels @a s_first+1 to @c s_max of the
+ ** current octave by incremental smoothing of level @a s_first.
+ **/
+
+static void
+_vl_sift_fill_octave (VlSiftFilt *f, int s_first)
+{
+  int s ;
+  int w = f-> octave_width ;
+  int h = f-> octave_height ;
+
+  for(s = s_first + 1 ; s <= f->s_max ; ++s) {
+    double sd = f->dsigma0 * pow (f->sigmak, s) ;
+    _vl_sift_smooth (f, vl_sift_get_octave(f, s), f->temp,
+                     vl_sift_get_octave(f, s - 1), w, h, sd) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the base of the next octave
+ ** @param f SIFT filter.
+ **
+ ** The function moves to the next octave and computes its first
+ ** level @c s_min by downsampling the current octave. The other
+ ** levels are not computed.
+ **/
+
+static void
+_vl_sift_start_next_octave (VlSiftFilt *f)
+{
+  int h, w, s_best ;
+  double sa, sb ;
+  vl_sift_pix *octave, *pt ;
+
+  /* shortcuts */
+  vl_sift_pix *temp   = f-> temp ;
+  int S               = f-> S ;
+  int s_min           = f-> s_min ;
+  int s_max           = f-> s_max ;
+  double sigma0       = f-> sigma0 ;
+  double sigmak       = f-> sigmak ;
+
+  /* retrieve base */
+  s_best = VL_MIN(s_min + S, s_max) ;
+  w      = vl_sift_get_octave_width  (f) ;
+  h      = vl_sift_get_octave_height (f) ;
+  pt     = vl_sift_get_octave        (f, s_best) ;
+  octave = vl_sift_get_octave        (f, s_min) ;
+
+  /* next octave */
+  copy_and_downsample (octave, pt, w, h, 1) ;
+
+  f-> o_cur            += 1 ;
+  f-> nkeys             = 0 ;
+  w = f-> octave_width  = VL_SHIFT_LEFT(f->width,  - f->o_cur) ;
+  h = f-> octave_height = VL_SHIFT_LEFT(f->height, - f->o_cur) ;
+
+  sa = sigma0 * powf (sigmak, s_min     ) ;
+  sb = sigma0 * powf (sigmak, s_best - S) ;
+
+  if (sa > sb) {
+    double sd = sqrt (sa*sa - sb*sb) ;
+    _vl_sift_smooth (f, octave, temp, octave, w, h, sd) ;
+  }
+}
+
 /** ------------------------------------------------------------------
  ** @brief Create a new SIFT filter
  **
@@ -860,12 +1171,15 @@ copy_and_downsample
  ** @param o_min    first octave index.
  **
  ** The function allocates and returns a new SIFT filter for the
- ** specified image and scale space geometry.
+ ** specified image and scale space geometry. The scale space buffers
+ ** are allocated when the first image is processed, so that a filter
+ ** used only as a parameter holder for ::vl_sift_process_tiled() is
+ ** cheap even for very large images.
  **
  ** Setting @a O to a negative value sets the number of octaves to the
  ** maximum possible value depending on the size of the image.
  **
- ** @return the new SIFT filter.
+ ** @return the new SIFT filter (or @c NULL if memory is insufficient).
  ** @sa ::vl_sift_delete().
  **/
 
@@ -876,33 +1190,19 @@ vl_sift_new (int width, int height,
              int o_min)
 {
   VlSiftFilt *f = vl_malloc (sizeof(VlSiftFilt)) ;
+  vl_uindex i ;
 
-  int w   = VL_SHIFT_LEFT (width,  -o_min) ;
-  int h   = VL_SHIFT_LEFT (height, -o_min) ;
-  int nel = w * h ;
+  if (f == NULL) return NULL ;
 
-  /* negative value O => calculate max. value */
-  if (noctaves < 0) {
-    noctaves = VL_MAX (floor (log2 (VL_MIN(width, height))) - o_min - 3, 1) ;
-  }
+  /* the scale space buffers are allocated on first use */
+  f-> temp    = NULL ;
+  f-> octave  = NULL ;
+  f-> dog     = NULL ;
+  f-> grad    = NULL ;
+  f-> bufferNumPixels = 0 ;
+  f-> bufferNumLevels = 0 ;
 
-  f-> width   = width ;
-  f-> height  = height ;
-  f-> O       = noctaves ;
   f-> S       = nlevels ;
-  f-> o_min   = o_min ;
-  f-> s_min   = -1 ;
-  f-> s_max   = nlevels + 1 ;
-  f-> o_cur   = o_min ;
-
-  f-> temp    = vl_malloc (sizeof(vl_sift_pix) * nel    ) ;
-  f-> octave  = vl_malloc (sizeof(vl_sift_pix) * nel
-                        * (f->s_max - f->s_min + 1)  ) ;
-  f-> dog     = vl_malloc (sizeof(vl_sift_pix) * nel
-                        * (f->s_max - f->s_min    )  ) ;
-  f-> grad    = vl_malloc (sizeof(vl_sift_pix) * nel * 2
-                        * (f->s_max - f->s_min    )  ) ;
-
   f-> sigman  = 0.5 ;
   f-> sigmak  = pow (2.0, 1.0 / nlevels) ;
   f-> sigma0  = 1.6 * f->sigmak ;
@@ -911,9 +1211,12 @@ vl_sift_new (int width, int height,
   f-> gaussFilter = NULL ;
   f-> gaussFilterSigma = 0 ;
   f-> gaussFilterWidth = 0 ;
-
-  f-> octave_width  = 0 ;
-  f-> octave_height = 0 ;
+  for (i = 0 ; i < VL_SIFT_NUM_CACHED_FILTERS ; ++i) {
+    f-> gaussFilterCache [i] = NULL ;
+    f-> gaussFilterCacheSigma [i] = 0 ;
+    f-> gaussFilterCacheWidth [i] = 0 ;
+  }
+  f-> gaussFilterCacheNext = 0 ;
 
   f-> keys     = 0 ;
   f-> nkeys    = 0 ;
@@ -924,8 +1227,22 @@ vl_sift_new (int width, int height,
   f-> norm_thresh = 0.0 ;
   f-> magnif      = 3.0 ;
   f-> windowSize  = NBP / 2 ;
+  f-> rootSift    = VL_FALSE ;
+  f-> upright     = VL_FALSE ;
 
-  f-> grad_o  = o_min - 1 ;
+  f-> projection          = NULL ;
+  f-> projectionMean      = NULL ;
+  f-> projectionDimension = 0 ;
+
+  f-> maxNumKeypoints = 0 ;
+  f-> keyScores       = NULL ;
+  f-> scoreHeap       = NULL ;
+  f-> scoreHeapSize   = 0 ;
+  f-> scoreThresh     = 0 ;
+  f-> numScoreTies    = INT_MAX ;
+  f-> detectError     = VL_ERR_OK ;
+
+  vl_sift_reset_geometry (f, width, height, noctaves, nlevels, o_min) ;
 
   /* initialize fast_expn stuff */
   fast_expn_init () ;
@@ -933,6 +1250,70 @@ vl_sift_new (int width, int height,
   return f ;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Change the image and scale space geometry of a SIFT filter
+ **
+ ** @param f        SIFT filter.
+ ** @param width    image width.
+ ** @param height   image height.
+ ** @param noctaves number of octaves.
+ ** @param nlevels  number of levels per octave.
+ ** @param o_min    first octave index.
+ **
+ ** The function re-targets the filter @a f to images of a different
+ ** size, with the same meaning of the parameters as in
+ ** ::vl_sift_new(). The other parameters of the filter (thresholds,
+ ** descriptor options) are preserved, and so are the internal
+ ** buffers, which are enlarged only when needed, and the Gaussian
+ ** filters computed so far. This is much cheaper than creating a new
+ ** filter when processing many images of varying size. Changing @a
+ ** nlevels resets the scale space smoothing to its default.
+ **
+ ** The function also discards the keypoints and the scale space of
+ ** the image processed so far.
+ **/
+
+VL_EXPORT
+void
+vl_sift_reset_geometry (VlSiftFilt *f,
+                        int width, int height,
+                        int noctaves, int nlevels,
+                        int o_min)
+{
+  /* negative value O => calculate max. value */
+  if (noctaves < 0) {
+    noctaves = VL_MAX (floor (log2 (VL_MIN(width, height))) - o_min - 3, 1) ;
+  }
+
+  if (nlevels != f->S) {
+    f-> sigmak  = pow (2.0, 1.0 / nlevels) ;
+    f-> sigma0  = 1.6 * f->sigmak ;
+    f-> dsigma0 = f->sigma0 * sqrt (1.0 - 1.0 / (f->sigmak*f->sigmak)) ;
+  }
+
+  f-> width   = width ;
+  f-> height  = height ;
+  f-> O       = noctaves ;
+  f-> S       = nlevels ;
+  f-> o_min   = o_min ;
+  f-> s_min   = -1 ;
+  f-> s_max   = nlevels + 1 ;
+  f-> o_cur   = o_min ;
+
+  f-> originX = 0 ;
+  f-> originY = 0 ;
+
+  f-> octave_width  = 0 ;
+  f-> octave_height = 0 ;
+  f-> nkeys   = 0 ;
+  f-> grad_o  = o_min - 1 ;
+  f-> scoreHeapSize = 0 ;
+  f-> scoreThresh = 0 ;
+  f-> numScoreTies = INT_MAX ;
+  f-> detectError = VL_ERR_OK ;
+  f-> scaleSpace = NULL ;
+}
+
 /** -------------------------------------------------------------------
  ** @brief Delete SIFT filter
  **
@@ -945,38 +1326,102 @@ VL_EXPORT
 void
 vl_sift_delete (VlSiftFilt* f)
 {
+  vl_uindex i ;
   if (f) {
     if (f->keys) vl_free (f->keys) ;
     if (f->grad) vl_free (f->grad) ;
     if (f->dog) vl_free (f->dog) ;
     if (f->octave) vl_free (f->octave) ;
     if (f->temp) vl_free (f->temp) ;
-    if (f->gaussFilter) vl_free (f->gaussFilter) ;
+    for (i = 0 ; i < VL_SIFT_NUM_CACHED_FILTERS ; ++i) {
+      if (f->gaussFilterCache[i]) vl_free (f->gaussFilterCache[i]) ;
+    }
+    if (f->projection) vl_free (f->projection) ;
+    if (f->projectionMean) vl_free (f->projectionMean) ;
+    if (f->keyScores) vl_free (f->keyScores) ;
+    if (f->scoreHeap) vl_free (f->scoreHeap) ;
     vl_free (f) ;
   }
 }
 
 /** ------------------------------------------------------------------
- ** @brief Start processing a new image
+ ** @brief Set the descriptor projection
  **
- ** @param f  SIFT filter.
- ** @param im image data.
+ ** @param f          SIFT filter.
+ ** @param projection projection matrix (or @c NULL).
+ ** @param mean       projection mean (or @c NULL).
+ ** @param dimension  number of projections.
  **
- ** The function starts processing a new image by computing its
- ** Gaussian scale space at the lower octave. It also empties the
- ** internal keypoint buffer.
+ ** The function sets a linear projection @f$ P^\top (h - \mu) @f$
+ ** applied to the SIFT descriptors @f$ h @f$ after normalization
+ ** (and RootSIFT, if enabled). @a projection is a 128 x @a dimension
+ ** matrix stored by columns (so that each column is a projection
+ ** direction, as for the principal components returned by PCA) and
+ ** @a mean is a 128-dimensional vector, or @c NULL for a zero mean.
+ ** The data is copied in the filter. Use @c NULL as @a projection to
+ ** remove the projection.
  **
- ** @return error code. The function returns ::VL_ERR_EOF if there are
- ** no more octaves to process.
+ ** After setting a projection, ::vl_sift_calc_keypoint_descriptor(),
+ ** ::vl_sift_calc_octave_descriptors() and
+ ** ::vl_sift_calc_raw_descriptor() output @a dimension elements per
+ ** descriptor (see ::vl_sift_get_descriptor_size()).
  **
- ** @sa ::vl_sift_process_next_octave().
+ ** @return error code. The function fails with ::VL_ERR_BAD_ARG if
+ ** @a dimension is not in the range 1 to 128 and with ::VL_ERR_ALLOC
+ ** if memory is insufficient. In both cases the projection is removed.
  **/
 
 VL_EXPORT
 int
-vl_sift_process_first_octave (VlSiftFilt *f, vl_sift_pix const *im)
+vl_sift_set_projection (VlSiftFilt *f,
+                        float const *projection,
+                        float const *mean,
+                        vl_size dimension)
+{
+  if (f->projection) vl_free (f->projection) ;
+  if (f->projectionMean) vl_free (f->projectionMean) ;
+  f->projection = NULL ;
+  f->projectionMean = NULL ;
+  f->projectionDimension = 0 ;
+
+  if (projection == NULL) return VL_ERR_OK ;
+
+  if (dimension < 1 || dimension > NBO*NBP*NBP) {
+    return vl_set_last_error (VL_ERR_BAD_ARG,
+                              "Projection dimension %d is not in the range 1 to %d.",
+                              (int) dimension, NBO*NBP*NBP) ;
+  }
+  f->projection = vl_malloc (sizeof(float) * NBO*NBP*NBP * dimension) ;
+  if (mean) {
+    f->projectionMean = vl_malloc (sizeof(float) * NBO*NBP*NBP) ;
+  }
+  if (f->projection == NULL || (mean && f->projectionMean == NULL)) {
+    vl_sift_set_projection (f, NULL, NULL, 0) ;
+    return vl_set_last_error (VL_ERR_ALLOC, "Unable to allocate the projection.") ;
+  }
+  memcpy (f->projection, projection, sizeof(float) * NBO*NBP*NBP * dimension) ;
+  if (mean) {
+    memcpy (f->projectionMean, mean, sizeof(float) * NBO*NBP*NBP) ;
+  }
+  f->projectionDimension = dimension ;
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the first octave of an image
+ ** @param f  SIFT filter.
+ ** @param im image data.
+ **
+ ** The function restarts from the first octave and computes its
+ ** levels from the image @a im. The filter must have at least one
+ ** octave.
+ **/
+
+static void
+_vl_sift_compute_first_octave (VlSiftFilt *f, vl_sift_pix const *im)
 {
-  int o, s, h, w ;
+  int o, h, w ;
   double sa, sb ;
   vl_sift_pix *octave ;
 
@@ -986,22 +1431,18 @@ vl_sift_process_first_octave (VlSiftFilt *f, vl_sift_pix const *im)
   int height          = f-> height ;
   int o_min           = f-> o_min ;
   int s_min           = f-> s_min ;
-  int s_max           = f-> s_max ;
   double sigma0       = f-> sigma0 ;
   double sigmak       = f-> sigmak ;
   double sigman       = f-> sigman ;
-  double dsigma0      = f-> dsigma0 ;
 
   /* restart from the first */
   f->o_cur = o_min ;
   f->nkeys = 0 ;
+  f->grad_o = o_min - 1 ;
+  f->scaleSpace = NULL ;
   w = f-> octave_width  = VL_SHIFT_LEFT(f->width,  - f->o_cur) ;
   h = f-> octave_height = VL_SHIFT_LEFT(f->height, - f->o_cur) ;
 
-  /* is there at least one octave? */
-  if (f->O == 0)
-    return VL_ERR_EOF ;
-
   /* ------------------------------------------------------------------
    *                     Compute the first sublevel of the first octave
    * --------------------------------------------------------------- */
@@ -1054,103 +1495,376 @@ vl_sift_process_first_octave (VlSiftFilt *f, vl_sift_pix const *im)
    *                                          Compute the first octave
    * -------------------------------------------------------------- */
 
-  for(s = s_min + 1 ; s <= s_max ; ++s) {
-    double sd = dsigma0 * pow (sigmak, s) ;
-    _vl_sift_smooth (f, vl_sift_get_octave(f, s), temp,
-                     vl_sift_get_octave(f, s - 1), w, h, sd) ;
-  }
-
-  return VL_ERR_OK ;
+  _vl_sift_fill_octave (f, s_min) ;
 }
 
 /** ------------------------------------------------------------------
- ** @brief Process next octave
+ ** @brief Start processing a new image
  **
- ** @param f SIFT filter.
+ ** @param f  SIFT filter.
+ ** @param im image data.
  **
- ** The function computes the next octave of the Gaussian scale space.
- ** Notice that this clears the record of any feature detected in the
- ** previous octave.
+ ** The function starts processing a new image by computing its
+ ** Gaussian scale space at the lower octave. It also empties the
+ ** internal keypoint buffer. If a maximum number of keypoints is set
+ ** (see ::vl_sift_set_max_keypoints()), the function selects the
+ ** strongest keypoints of the whole image first.
  **
- ** @return error code. The function returns the error
- ** ::VL_ERR_EOF when there are no more octaves to process.
+ ** @return error code. The function returns ::VL_ERR_EOF if there are
+ ** no more octaves to process and ::VL_ERR_ALLOC if the scale space
+ ** cannot be allocated.
  **
- ** @sa ::vl_sift_process_first_octave().
+ ** @sa ::vl_sift_process_next_octave().
  **/
 
 VL_EXPORT
 int
-vl_sift_process_next_octave (VlSiftFilt *f)
+vl_sift_process_first_octave (VlSiftFilt *f, vl_sift_pix const *im)
 {
+  int err = _vl_sift_alloc_buffers (f) ;
+  if (err != VL_ERR_OK) return err ;
 
-  int s, h, w, s_best ;
-  double sa, sb ;
-  vl_sift_pix *octave, *pt ;
-
-  /* shortcuts */
-  vl_sift_pix *temp   = f-> temp ;
-  int O               = f-> O ;
-  int S               = f-> S ;
-  int o_min           = f-> o_min ;
-  int s_min           = f-> s_min ;
-  int s_max           = f-> s_max ;
-  double sigma0       = f-> sigma0 ;
-  double sigmak       = f-> sigmak ;
-  double dsigma0      = f-> dsigma0 ;
+  /* restart from the first */
+  f->o_cur = f->o_min ;
+  f->nkeys = 0 ;
+  f->scoreHeapSize = 0 ;
+  f->scoreThresh = 0 ;
+  f->numScoreTies = INT_MAX ;
+  f->detectError = VL_ERR_OK ;
 
-  /* is there another octave ? */
-  if (f->o_cur == o_min + O - 1)
+  /* is there at least one octave? */
+  if (f->O == 0)
     return VL_ERR_EOF ;
 
-  /* retrieve base */
-  s_best = VL_MIN(s_min + S, s_max) ;
-  w      = vl_sift_get_octave_width  (f) ;
-  h      = vl_sift_get_octave_height (f) ;
-  pt     = vl_sift_get_octave        (f, s_best) ;
-  octave = vl_sift_get_octave        (f, s_min) ;
-
-  /* next octave */
-  copy_and_downsample (octave, pt, w, h, 1) ;
+  _vl_sift_compute_first_octave (f, im) ;
+  if (f->maxNumKeypoints > 0) {
+    err = _vl_sift_select_keypoints (f) ;
+    if (err != VL_ERR_OK) return err ;
+    _vl_sift_compute_first_octave (f, im) ;
+  }
+  return VL_ERR_OK ;
+}
 
-  f-> o_cur            += 1 ;
-  f-> nkeys             = 0 ;
-  w = f-> octave_width  = VL_SHIFT_LEFT(f->width,  - f->o_cur) ;
-  h = f-> octave_height = VL_SHIFT_LEFT(f->height, - f->o_cur) ;
+/** ------------------------------------------------------------------
+ ** @brief Get the geometry of the SIFT Gaussian scale space
+ ** @param f SIFT filter.
+ ** @return scale space geometry.
+ **
+ ** The function returns the geometry of a ::VlScaleSpace object
+ ** containing the same Gaussian scale space computed by the filter.
+ ** Such an object can be fed to the filter by
+ ** ::vl_sift_process_first_octave_from_scale_space(). Note that a
+ ** ::VlCovDet object using the DoG method and the same number of
+ ** levels per octave (three by default) uses this geometry too.
+ **/
 
-  sa = sigma0 * powf (sigmak, s_min     ) ;
-  sb = sigma0 * powf (sigmak, s_best - S) ;
+VL_EXPORT
+VlScaleSpaceGeometry
+vl_sift_get_scale_space_geometry (VlSiftFilt const *f)
+{
+  VlScaleSpaceGeometry geom ;
+  geom.width = f->width ;
+  geom.height = f->height ;
+  geom.firstOctave = f->o_min ;
+  geom.lastOctave = f->o_min + f->O - 1 ;
+  geom.octaveResolution = f->S ;
+  geom.octaveFirstSubdivision = f->s_min ;
+  geom.octaveLastSubdivision = f->s_max ;
+  geom.baseScale = f->sigma0 ;
+  geom.nominalScale = f->sigman ;
+  return geom ;
+}
 
-  if (sa > sb) {
-    double sd = sqrt (sa*sa - sb*sb) ;
-    _vl_sift_smooth (f, octave, temp, octave, w, h, sd) ;
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Copy the current octave from the external scale space
+ ** @param f SIFT filter.
+ **
+ ** The function copies the levels of the current octave from the
+ ** scale space set by ::vl_sift_process_first_octave_from_scale_space()
+ ** and computes the levels that the scale space does not contain
+ ** by incremental smoothing.
+ **
+ ** @return error code. The function fails with ::VL_ERR_ALLOC if a
+ ** level of a lazy scale space cannot be computed (see
+ ** ::vl_scalespace_set_lazy()).
+ **/
+
+static int
+_vl_sift_copy_octave (VlSiftFilt *f)
+{
+  VlScaleSpaceGeometry geom = vl_scalespace_get_geometry (f->scaleSpace) ;
+  vl_size numPixels = (vl_size) f->octave_width * f->octave_height ;
+  int s_last = VL_MIN (f->s_max, (int) geom.octaveLastSubdivision) ;
+  int s ;
+
+  for (s = f->s_min ; s <= s_last ; ++s) {
+    float const * level = vl_scalespace_get_level_const (f->scaleSpace, f->o_cur, s) ;
+    if (level == NULL) {
+      return vl_set_last_error (VL_ERR_ALLOC, "Unable to get the scale space level.") ;
+    }
+    memcpy (vl_sift_get_octave (f, s), level, sizeof(vl_sift_pix) * numPixels) ;
   }
+  _vl_sift_fill_octave (f, s_last) ;
+  return VL_ERR_OK ;
+}
 
-  /* ------------------------------------------------------------------
-   *                                                        Fill octave
-   * --------------------------------------------------------------- */
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Copy the first octave from an external scale space
+ ** @param f          SIFT filter.
+ ** @param scaleSpace Gaussian scale space of the image.
+ **
+ ** The function restarts from the first octave and copies it from
+ ** @a scaleSpace as ::_vl_sift_copy_octave().
+ **
+ ** @return error code.
+ **/
 
-  for(s = s_min + 1 ; s <= s_max ; ++s) {
-    double sd = dsigma0 * pow (sigmak, s) ;
-    _vl_sift_smooth (f, vl_sift_get_octave(f, s), temp,
-                     vl_sift_get_octave(f, s - 1), w, h, sd) ;
+static int
+_vl_sift_copy_first_octave (VlSiftFilt *f, VlScaleSpace const *scaleSpace)
+{
+  f->o_cur = f->o_min ;
+  f->nkeys = 0 ;
+  f->grad_o = f->o_min - 1 ;
+  f->octave_width  = VL_SHIFT_LEFT(f->width,  - f->o_cur) ;
+  f->octave_height = VL_SHIFT_LEFT(f->height, - f->o_cur) ;
+  f->scaleSpace = scaleSpace ;
+  return _vl_sift_copy_octave (f) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Start processing a new image from its Gaussian scale space
+ **
+ ** @param f          SIFT filter.
+ ** @param scaleSpace Gaussian scale space of the image.
+ **
+ ** The function is like ::vl_sift_process_first_octave(), but the
+ ** Gaussian scale space is copied from @a scaleSpace instead of being
+ ** computed from the image. In this way a scale space computed once
+ ** can be shared by several detectors (for example the one computed
+ ** by a ::VlCovDet object, see ::vl_covdet_get_gss()).
+ ** ::vl_sift_process_next_octave() keeps copying the octaves from
+ ** @a scaleSpace, which must not be modified or deleted until the
+ ** image is processed.
+ **
+ ** The geometry of @a scaleSpace must be compatible with
+ ** ::vl_sift_get_scale_space_geometry(): it must have the same image
+ ** size, number of levels per octave, base and nominal smoothing and
+ ** it must contain the first level of the first octave. Octaves and
+ ** levels beyond the ones contained in @a scaleSpace are computed by
+ ** the filter, incrementally from the last ones available.
+ **
+ ** @return error code. The function returns ::VL_ERR_BAD_ARG if the
+ ** geometry of @a scaleSpace is not compatible, ::VL_ERR_ALLOC if
+ ** memory is insufficient (including to compute the levels of a lazy
+ ** @a scaleSpace) and ::VL_ERR_EOF if there are no octaves to process.
+ **
+ ** @sa ::vl_sift_process_first_octave().
+ **/
+
+VL_EXPORT
+int
+vl_sift_process_first_octave_from_scale_space (VlSiftFilt *f,
+                                               VlScaleSpace const *scaleSpace)
+{
+  VlScaleSpaceGeometry geom = vl_scalespace_get_geometry (scaleSpace) ;
+  int err ;
+
+  if (geom.width != (vl_size) f->width ||
+      geom.height != (vl_size) f->height ||
+      geom.octaveResolution != (vl_size) f->S ||
+      geom.firstOctave > f->o_min ||
+      geom.lastOctave < f->o_min ||
+      geom.octaveFirstSubdivision > f->s_min ||
+      geom.octaveLastSubdivision < f->s_min ||
+      vl_abs_d (geom.baseScale - f->sigma0) > 1e-6 * f->sigma0 ||
+      geom.nominalScale != f->sigman) {
+    return vl_set_last_error (VL_ERR_BAD_ARG,
+                              "The scale space geometry is not compatible with the SIFT filter.") ;
   }
 
-  return VL_ERR_OK ;
+  err = _vl_sift_alloc_buffers (f) ;
+  if (err != VL_ERR_OK) return err ;
+
+  /* restart from the first */
+  f->o_cur = f->o_min ;
+  f->nkeys = 0 ;
+  f->scoreHeapSize = 0 ;
+  f->scoreThresh = 0 ;
+  f->numScoreTies = INT_MAX ;
+  f->detectError = VL_ERR_OK ;
+
+  /* is there at least one octave? */
+  if (f->O == 0)
+    return VL_ERR_EOF ;
+
+  err = _vl_sift_copy_first_octave (f, scaleSpace) ;
+  if (err == VL_ERR_OK && f->maxNumKeypoints > 0) {
+    err = _vl_sift_select_keypoints (f) ;
+    if (err == VL_ERR_OK) err = _vl_sift_copy_first_octave (f, scaleSpace) ;
+  }
+  return err ;
 }
 
 /** ------------------------------------------------------------------
- ** @brief Detect keypoints
+ ** @brief Process next octave
  **
- ** The function detect keypoints in the current octave filling the
- ** internal keypoint buffer. Keypoints can be retrieved by
- ** ::vl_sift_get_keypoints().
+ ** @param f SIFT filter.
+ **
+ ** The function computes the next octave of the Gaussian scale space.
+ ** Notice that this clears the record of any feature detected in the
+ ** previous octave.
+ **
+ ** @return error code. The function returns the error
+ ** ::VL_ERR_EOF when there are no more octaves to process and
+ ** ::VL_ERR_ALLOC if memory is insufficient, including for the
+ ** keypoints of the previous octave (see ::vl_sift_detect()) and
+ ** for the levels of a lazy scale space.
  **
+ ** @sa ::vl_sift_process_first_octave().
+ **/
+
+VL_EXPORT
+int
+vl_sift_process_next_octave (VlSiftFilt *f)
+{
+  /* did the detection of the previous octave fail ? */
+  if (f->detectError != VL_ERR_OK) {
+    int err = f->detectError ;
+    f->detectError = VL_ERR_OK ;
+    return err ;
+  }
+
+  /* is there another octave ? */
+  if (f->o_cur == f->o_min + f->O - 1)
+    return VL_ERR_EOF ;
+
+  if (f->scaleSpace &&
+      f->o_cur < vl_scalespace_get_geometry (f->scaleSpace).lastOctave) {
+    f->o_cur += 1 ;
+    f->nkeys  = 0 ;
+    f->octave_width  = VL_SHIFT_LEFT(f->width,  - f->o_cur) ;
+    f->octave_height = VL_SHIFT_LEFT(f->height, - f->o_cur) ;
+    return _vl_sift_copy_octave (f) ;
+  }
+
+  _vl_sift_start_next_octave (f) ;
+  _vl_sift_fill_octave (f, f->s_min) ;
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Get the score of the weakest of the strongest keypoints
+ ** @param f SIFT filter.
+ ** @return score threshold.
+ **
+ ** The function returns the smallest score in the heap of the
+ ** strongest keypoints found so far if the heap is full, and zero
+ ** otherwise. Keypoints with a smaller score cannot be among the
+ ** strongest ones.
+ **/
+
+static float
+_vl_sift_get_score_thresh (VlSiftFilt const *f)
+{
+  if (f->maxNumKeypoints > 0 &&
+      f->scoreHeapSize == (vl_size) f->maxNumKeypoints) {
+    return f->scoreHeap [0] ;
+  }
+  return 0 ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the maximum number of keypoints
  ** @param f SIFT filter.
+ ** @param n maximum number of keypoints (0 for no limit).
+ **
+ ** The function limits the keypoints returned by ::vl_sift_detect()
+ ** for the whole image to the @a n strongest ones, as measured by
+ ** the absolute value of the DoG scale space at the detected
+ ** extremum (see ::vl_sift_get_keypoint_scores()).
+ **
+ ** When a limit is set, ::vl_sift_process_first_octave() and
+ ** ::vl_sift_process_first_octave_from_scale_space() score the
+ ** keypoints of all the octaves of the image first, keeping a heap
+ ** of the @a n strongest ones, and then restart from the first
+ ** octave. ::vl_sift_detect() then discards the weaker candidates
+ ** before refinement and returns only the selected keypoints, so
+ ** that orientations and descriptors are computed only for these.
+ ** The scale space is computed twice, which is much cheaper than
+ ** describing all the keypoints of a textured image. Ties with the
+ ** weakest selected score are broken by the order of detection, so
+ ** that exactly @a n keypoints are returned if the image has that
+ ** many.
+ **
+ ** The score is the DoG value at the integer extremum, before
+ ** refinement, so it may differ slightly from the interpolated peak
+ ** value used by the peak threshold.
+ **
+ ** The limit applies from the next image processed.
  **/
 
 VL_EXPORT
 void
-vl_sift_detect (VlSiftFilt * f)
+vl_sift_set_max_keypoints (VlSiftFilt *f, int n)
+{
+  n = VL_MAX(n, 0) ;
+  if (f->scoreHeap) vl_free (f->scoreHeap) ;
+  f->scoreHeap = NULL ;
+  f->scoreHeapSize = 0 ;
+  f->scoreThresh = 0 ;
+  f->numScoreTies = INT_MAX ;
+  f->maxNumKeypoints = n ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Enlarge the keypoint buffers
+ ** @param f SIFT filter.
+ ** @return error code.
+ **
+ ** The function makes room for 500 more keypoints and scores. On
+ ** failure the buffers are left unchanged.
+ **/
+
+static int
+_vl_sift_grow_keypoints (VlSiftFilt *f)
+{
+  int const keys_res = f->keys_res + 500 ;
+  VlSiftKeypoint *keys ;
+  float *keyScores ;
+
+  keys = vl_realloc (f->keys, keys_res * sizeof(VlSiftKeypoint)) ;
+  if (keys == NULL) goto err_alloc ;
+  f->keys = keys ;
+  keyScores = vl_realloc (f->keyScores, keys_res * sizeof(float)) ;
+  if (keyScores == NULL) goto err_alloc ;
+  f->keyScores = keyScores ;
+  f->keys_res = keys_res ;
+  return VL_ERR_OK ;
+
+err_alloc:
+  return vl_set_last_error (VL_ERR_ALLOC, "Unable to allocate the keypoints.") ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Detect and refine the keypoints of the current octave
+ ** @param f SIFT filter.
+ ** @param scoreThresh minimum keypoint score.
+ ** @return error code.
+ **
+ ** The function fills the keypoint buffer with the keypoints of the
+ ** current octave and their scores. Candidates with a score smaller
+ ** than @a scoreThresh are discarded before refinement. If the
+ ** keypoint buffer cannot be enlarged, the function keeps the
+ ** candidates found so far and returns ::VL_ERR_ALLOC.
+ **/
+
+static int
+_vl_sift_detect_octave (VlSiftFilt * f, float scoreThresh)
 {
   vl_sift_pix* dog   = f-> dog ;
   int          s_min = f-> s_min ;
@@ -1165,22 +1879,27 @@ vl_sift_detect (VlSiftFilt * f)
   int const    so    = w * h ;  /* s-stride */
 
   double       xper  = pow (2.0, f->o_cur) ;
+  int          ox    = VL_SHIFT_LEFT(f->originX, - f->o_cur) ;
+  int          oy    = VL_SHIFT_LEFT(f->originY, - f->o_cur) ;
 
   int x, y, s, i, ii, jj ;
+  int err = VL_ERR_OK ;
   vl_sift_pix *pt, v ;
   VlSiftKeypoint *k ;
 
   /* clear current list */
   f-> nkeys = 0 ;
 
-  /* compute difference of gaussian (DoG) */
-  pt = f-> dog ;
-  for (s = s_min ; s <= s_max - 1 ; ++s) {
-    vl_sift_pix* src_a = vl_sift_get_octave (f, s    ) ;
-    vl_sift_pix* src_b = vl_sift_get_octave (f, s + 1) ;
-    vl_sift_pix* end_a = src_a + w * h ;
-    while (src_a != end_a) {
-      *pt++ = *src_b++ - *src_a++ ;
+  /* compute difference of gaussian (DoG), one row per iteration */
+#if defined(_OPENMP)
+#pragma omp parallel for default(shared) private(i,x) num_threads(vl_get_max_threads())
+#endif
+  for (i = 0 ; i < (s_max - s_min) * h ; ++i) {
+    vl_sift_pix const* src_a = f->octave + i * w ;
+    vl_sift_pix const* src_b = src_a + so ;
+    vl_sift_pix* dst = dog + i * w ;
+    for (x = 0 ; x < w ; ++x) {
+      dst [x] = src_b [x] - src_a [x] ;
     }
   }
 
@@ -1191,8 +1910,8 @@ vl_sift_detect (VlSiftFilt * f)
   /* start from dog [1,1,s_min+1] */
   pt  = dog + xo + yo + so ;
 
-  for(s = s_min + 1 ; s <= s_max - 2 ; ++s) {
-    for(y = 1 ; y < h - 1 ; ++y) {
+  for(s = s_min + 1 ; s <= s_max - 2 && err == VL_ERR_OK ; ++s) {
+    for(y = 1 ; y < h - 1 && err == VL_ERR_OK ; ++y) {
       for(x = 1 ; x < w - 1 ; ++x) {
         v = *pt ;
 
@@ -1233,15 +1952,8 @@ vl_sift_detect (VlSiftFilt * f)
 
           /* make room for more keypoints */
           if (f->nkeys >= f->keys_res) {
-            f->keys_res += 500 ;
-            if (f->keys) {
-              f->keys = vl_realloc (f->keys,
-                                    f->keys_res *
-                                    sizeof(VlSiftKeypoint)) ;
-            } else {
-              f->keys = vl_malloc (f->keys_res *
-                                   sizeof(VlSiftKeypoint)) ;
-            }
+            err = _vl_sift_grow_keypoints (f) ;
+            if (err != VL_ERR_OK) break ;
           }
 
           k = f->keys + (f->nkeys ++) ;
@@ -1257,6 +1969,24 @@ vl_sift_detect (VlSiftFilt * f)
     pt += 2 * yo ;
   }
 
+  /* -----------------------------------------------------------------
+   *                           Score keypoints and discard weaker ones
+   * -------------------------------------------------------------- */
+
+  {
+    int n = 0 ;
+    for (i = 0 ; i < f->nkeys ; ++i) {
+      VlSiftKeypoint const *kp = f->keys + i ;
+      float score = vl_abs_f (dog [kp->ix * xo + kp->iy * yo + (kp->is - s_min) * so]) ;
+      if (score >= scoreThresh) {
+        f->keys [n] = *kp ;
+        f->keyScores [n] = score ;
+        ++ n ;
+      }
+    }
+    f->nkeys = n ;
+  }
+
   /* -----------------------------------------------------------------
    *                                               Refine local maxima
    * -------------------------------------------------------------- */
@@ -1269,6 +1999,7 @@ vl_sift_detect (VlSiftFilt * f)
     int x = f-> keys [i] .ix ;
     int y = f-> keys [i] .iy ;
     int s = f-> keys [i]. is ;
+    float peakScore = f-> keyScores [i] ;
 
     double Dx=0,Dy=0,Ds=0,Dxx=0,Dyy=0,Dss=0,Dxy=0,Dxs=0,Dys=0 ;
     double A [3*3], b [3] ;
@@ -1412,14 +2143,17 @@ vl_sift_detect (VlSiftFilt * f)
         sn              <= s_max ;
 
       if (good) {
+        /* the origin is added before the offset, as if the whole
+           image was processed, so that tiles give identical results */
         k-> o     = f->o_cur ;
-        k-> ix    = x ;
-        k-> iy    = y ;
+        k-> ix    = x + ox ;
+        k-> iy    = y + oy ;
         k-> is    = s ;
         k-> s     = sn ;
-        k-> x     = xn * xper ;
-        k-> y     = yn * xper ;
+        k-> x     = ((x + ox) + b[0]) * xper ;
+        k-> y     = ((y + oy) + b[1]) * xper ;
         k-> sigma = f->sigma0 * pow (2.0, sn/f->S) * xper ;
+        f->keyScores [k - f->keys] = peakScore ;
         ++ k ;
       }
 
@@ -1428,137 +2162,242 @@ vl_sift_detect (VlSiftFilt * f)
 
   /* update keypoint count */
   f-> nkeys = (int)(k - f->keys) ;
+  return err ;
 }
 
-
 /** ------------------------------------------------------------------
  ** @internal
- ** @brief Update gradients to current GSS octave
- **
+ ** @brief Select the strongest keypoints of the image
  ** @param f SIFT filter.
  **
- ** The function makes sure that the gradient buffer is up-to-date
- ** with the current GSS data.
+ ** The function detects the keypoints of all the octaves, starting
+ ** from the current one, and keeps a heap of the scores of the
+ ** strongest ::VlSiftFilt::maxNumKeypoints ones. It then sets the
+ ** score threshold and the number of ties with it used by
+ ** ::vl_sift_detect() to return only these keypoints.
  **
- ** @remark The minimum octave size is 2x2xS.
+ ** @return error code, as for ::vl_sift_process_next_octave(), except
+ ** that reaching the last octave is not an error.
  **/
 
-static void
-update_gradient (VlSiftFilt *f)
+static int
+_vl_sift_select_keypoints (VlSiftFilt *f)
 {
-  int       s_min = f->s_min ;
-  int       s_max = f->s_max ;
-  int       w     = vl_sift_get_octave_width  (f) ;
-  int       h     = vl_sift_get_octave_height (f) ;
-  int const xo    = 1 ;
-  int const yo    = w ;
-  int const so    = h * w ;
-  int y, s ;
-
-  if (f->grad_o == f->o_cur) return ;
-
-  for (s  = s_min + 1 ;
-       s <= s_max - 2 ; ++ s) {
+  vl_size const maxNumKeypoints = f->maxNumKeypoints ;
+  vl_size i ;
+  int err = VL_ERR_OK ;
+
+  if (f->scoreHeap == NULL) {
+    f->scoreHeap = vl_malloc (sizeof(float) * maxNumKeypoints) ;
+    if (f->scoreHeap == NULL) {
+      return vl_set_last_error (VL_ERR_ALLOC, "Unable to allocate the keypoint scores.") ;
+    }
+  }
 
-    vl_sift_pix *src, *end, *grad, gx, gy ;
+  f->scoreHeapSize = 0 ;
+  while (err == VL_ERR_OK) {
+    err = _vl_sift_detect_octave (f, _vl_sift_get_score_thresh (f)) ;
+    if (err != VL_ERR_OK) return err ;
+    for (i = 0 ; i < (vl_size) f->nkeys ; ++i) {
+      float score = f->keyScores [i] ;
+      if (f->scoreHeapSize < maxNumKeypoints) {
+        f->scoreHeap [f->scoreHeapSize] = score ;
+        vl_sift_score_heap_push (f->scoreHeap, &f->scoreHeapSize) ;
+      } else if (score > f->scoreHeap [0]) {
+        vl_sift_score_heap_pop (f->scoreHeap, &f->scoreHeapSize) ;
+        f->scoreHeap [f->scoreHeapSize] = score ;
+        vl_sift_score_heap_push (f->scoreHeap, &f->scoreHeapSize) ;
+      }
+    }
+    err = vl_sift_process_next_octave (f) ;
+  }
+  if (err != VL_ERR_EOF) return err ;
+
+  /* keypoints scoring as the weakest selected one are kept in order
+     of detection until the budget is filled */
+  f->scoreThresh = _vl_sift_get_score_thresh (f) ;
+  f->numScoreTies = f->maxNumKeypoints ;
+  for (i = 0 ; i < f->scoreHeapSize ; ++i) {
+    if (f->scoreHeap [i] > f->scoreThresh) -- f->numScoreTies ;
+  }
+  f->nkeys = 0 ;
+  return VL_ERR_OK ;
+}
 
-#define SAVE_BACK                                                       \
-    *grad++ = vl_fast_sqrt_f (gx*gx + gy*gy) ;                          \
-    *grad++ = vl_mod_2pi_f   (vl_fast_atan2_f (gy, gx) + 2*VL_PI) ;     \
-    ++src ;                                                             \
+/** ------------------------------------------------------------------
+ ** @brief Detect keypoints
+ **
+ ** The function detect keypoints in the current octave filling the
+ ** internal keypoint buffer. Keypoints can be retrieved by
+ ** ::vl_sift_get_keypoints().
+ **
+ ** If a maximum number of keypoints is set (see
+ ** ::vl_sift_set_max_keypoints()), only the keypoints of the octave
+ ** which are among the strongest ones of the image are returned.
+ **
+ ** If the keypoint buffer cannot be enlarged, the function returns
+ ** the keypoints found so far and the next call to
+ ** ::vl_sift_process_next_octave() fails with ::VL_ERR_ALLOC.
+ **
+ ** @param f SIFT filter.
+ **/
 
-    src  = vl_sift_get_octave (f,s) ;
-    grad = f->grad + 2 * so * (s - s_min -1) ;
+VL_EXPORT
+void
+vl_sift_detect (VlSiftFilt * f)
+{
+  int i, n = 0 ;
 
-    /* first pixel of the first row */
-    gx = src[+xo] - src[0] ;
-    gy = src[+yo] - src[0] ;
-    SAVE_BACK ;
+  if (f->maxNumKeypoints <= 0) {
+    f->detectError = _vl_sift_detect_octave (f, 0) ;
+    return ;
+  }
 
-    /* middle pixels of the  first row */
-    end = (src - 1) + w - 1 ;
-    while (src < end) {
-      gx = 0.5 * (src[+xo] - src[-xo]) ;
-      gy =        src[+yo] - src[0] ;
-      SAVE_BACK ;
+  f->detectError = _vl_sift_detect_octave (f, f->scoreThresh) ;
+  for (i = 0 ; i < f->nkeys ; ++i) {
+    if (f->keyScores [i] == f->scoreThresh) {
+      if (f->numScoreTies == 0) continue ;
+      -- f->numScoreTies ;
     }
+    f->keys [n] = f->keys [i] ;
+    f->keyScores [n] = f->keyScores [i] ;
+    ++ n ;
+  }
+  f->nkeys = n ;
 
-    /* last pixel of the first row */
-    gx = src[0]   - src[-xo] ;
-    gy = src[+yo] - src[0] ;
-    SAVE_BACK ;
+}
 
-    for (y = 1 ; y < h -1 ; ++y) {
 
-      /* first pixel of the middle rows */
-      gx =        src[+xo] - src[0] ;
-      gy = 0.5 * (src[+yo] - src[-yo]) ;
-      SAVE_BACK ;
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the gradient of a row of a GSS level
+ **
+ ** @param grad   gradient row (output).
+ ** @param src    GSS row.
+ ** @param width  row width.
+ ** @param up     offset to the previous row (zero on the first row).
+ ** @param down   offset to the next row (zero on the last row).
+ **
+ ** The function writes to @a grad the interleaved gradient modulus
+ ** and angle of each pixel. Derivatives are computed by central
+ ** differences, or by forward/backward differences at the image
+ ** boundaries. The interior pixels are processed by the SSE2 or AVX
+ ** kernels if available (see @ref mathop-simd); the result does not
+ ** change.
+ **/
 
-      /* middle pixels of the middle rows */
-      end = (src - 1) + w - 1 ;
-      while (src < end) {
-        gx = 0.5 * (src[+xo] - src[-xo]) ;
-        gy = 0.5 * (src[+yo] - src[-yo]) ;
-        SAVE_BACK ;
-      }
+static void
+_vl_sift_gradient_row (vl_sift_pix *grad,
+                       vl_sift_pix const *src,
+                       int width, int up, int down)
+{
+  double const dyscale = (up && down) ? 0.5 : 1.0 ;
+  vl_sift_pix const *end ;
+  vl_sift_pix gx, gy ;
 
-      /* last pixel of the middle row */
-      gx =        src[0]   - src[-xo] ;
-      gy = 0.5 * (src[+yo] - src[-yo]) ;
-      SAVE_BACK ;
-    }
+#define SAVE_BACK                                                       \
+    *grad++ = vl_fast_sqrt_f (gx*gx + gy*gy) ;                          \
+    *grad++ = vl_mod_2pi_f   (vl_fast_atan2_f (gy, gx) + 2*VL_PI) ;     \
+    ++src ;                                                             \
 
-    /* first pixel of the last row */
-    gx = src[+xo] - src[0] ;
-    gy = src[  0] - src[-yo] ;
+  /* first pixel */
+  gx = src[+1] - src[0] ;
+  gy = dyscale * (src[+down] - src[-up]) ;
+  SAVE_BACK ;
+
+  /* middle pixels */
+  end = (src - 1) + width - 1 ;
+#ifndef VL_DISABLE_AVX
+  if (vl_cpu_has_avx() && vl_get_simd_enabled() && src < end) {
+    vl_size n = _vl_sift_gradient_avx (grad, src, end - src,
+                                       up, down, (float) dyscale) ;
+    grad += 2 * n ;
+    src += n ;
+  }
+#endif
+#ifndef VL_DISABLE_SSE2
+  if (vl_cpu_has_sse2() && vl_get_simd_enabled() && src < end) {
+    vl_size n = _vl_sift_gradient_sse2 (grad, src, end - src,
+                                        up, down, (float) dyscale) ;
+    grad += 2 * n ;
+    src += n ;
+  }
+#endif
+  while (src < end) {
+    gx = 0.5 * (src[+1] - src[-1]) ;
+    gy = dyscale * (src[+down] - src[-up]) ;
     SAVE_BACK ;
+  }
 
-    /* middle pixels of the last row */
-    end = (src - 1) + w - 1 ;
-    while (src < end) {
-      gx = 0.5 * (src[+xo] - src[-xo]) ;
-      gy =        src[0]   - src[-yo] ;
-      SAVE_BACK ;
-    }
+  /* last pixel */
+  gx = src[0] - src[-1] ;
+  gy = dyscale * (src[+down] - src[-up]) ;
+  SAVE_BACK ;
+}
 
-    /* last pixel of the last row */
-    gx = src[0]   - src[-xo] ;
-    gy = src[0]   - src[-yo] ;
-    SAVE_BACK ;
+/** ------------------------------------------------------------------
+ ** @brief Update gradients to current GSS octave
+ **
+ ** @param f SIFT filter.
+ **
+ ** The function makes sure that the gradient buffer is up-to-date
+ ** with the current GSS data. Rows are processed in parallel
+ ** (see @ref threads-parallel).
+ **
+ ** The function is called implicitly by
+ ** ::vl_sift_calc_keypoint_orientations() and
+ ** ::vl_sift_calc_keypoint_descriptor(). Once the gradient buffer
+ ** is up to date, these two functions do not modify the filter and
+ ** can be called concurrently from several threads. Hence call this
+ ** function explicitly before doing so.
+ **
+ ** @remark The minimum octave size is 2x2xS.
+ **/
+
+VL_EXPORT
+void
+vl_sift_update_gradient (VlSiftFilt *f)
+{
+  int       s_min = f->s_min ;
+  int       s_max = f->s_max ;
+  int       w     = vl_sift_get_octave_width  (f) ;
+  int       h     = vl_sift_get_octave_height (f) ;
+  int const yo    = w ;
+  int i ;
+
+  if (f->grad_o == f->o_cur) return ;
+
+  /* one row of the levels s_min+1 ... s_max-2 per iteration */
+#if defined(_OPENMP)
+#pragma omp parallel for default(shared) private(i) num_threads(vl_get_max_threads())
+#endif
+  for (i = 0 ; i < (s_max - s_min - 2) * h ; ++i) {
+    int y = i % h ;
+    _vl_sift_gradient_row (f->grad + 2 * w * i,
+                           vl_sift_get_octave (f, s_min + 1) + w * i,
+                           w,
+                           (y > 0)     ? yo : 0,
+                           (y < h - 1) ? yo : 0) ;
   }
   f->grad_o = f->o_cur ;
 }
 
 /** ------------------------------------------------------------------
+ ** @internal
  ** @brief Calculate the keypoint orientation(s)
- **
  ** @param f        SIFT filter.
  ** @param angles   orientations (output).
  ** @param k        keypoint.
- **
- ** The function computes the orientation(s) of the keypoint @a k.
- ** The function returns the number of orientations found (up to
- ** four). The orientations themselves are written to the vector @a
- ** angles.
- **
- ** @remark The function requires the keypoint octave @a k->o to be
- ** equal to the filter current octave ::vl_sift_get_octave. If this
- ** is not the case, the function returns zero orientations.
- **
- ** @remark The function requires the keypoint scale level @c k->s to
- ** be in the range @c s_min+1 and @c s_max-2 (where usually @c
- ** s_min=0 and @c s_max=S+2). If this is not the case, the function
- ** returns zero orientations.
- **
  ** @return number of orientations found.
+ **
+ ** Same as ::vl_sift_calc_keypoint_orientations(), but assumes that
+ ** the gradient buffer is up to date.
  **/
 
-VL_EXPORT
-int
-vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
-                                    double angles [4],
-                                    VlSiftKeypoint const *k)
+static int
+_vl_sift_calc_keypoint_orientations (VlSiftFilt const *f,
+                                     double angles [4],
+                                     VlSiftKeypoint const *k)
 {
   double const winf   = 1.5 ;
   double       xper   = pow (2.0, f->o_cur) ;
@@ -1568,8 +2407,8 @@ vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
   int const    xo     = 2 ;         /* x-stride */
   int const    yo     = 2 * w ;     /* y-stride */
   int const    so     = 2 * w * h ; /* s-stride */
-  double       x      = k-> x     / xper ;
-  double       y      = k-> y     / xper ;
+  double       x      = (k-> x - f->originX) / xper ;
+  double       y      = (k-> y - f->originY) / xper ;
   double       sigma  = k-> sigma / xper ;
 
   int          xi     = (int) (x + 0.5) ;
@@ -1601,8 +2440,11 @@ vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
     return 0 ;
   }
 
-  /* make gradient up to date */
-  update_gradient (f) ;
+  /* upright features have a fixed orientation */
+  if (f->upright) {
+    angles [0] = 0 ;
+    return 1 ;
+  }
 
   /* clear histogram */
   memset (hist, 0, sizeof(double) * nbins) ;
@@ -1691,18 +2533,56 @@ vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
   return nangles ;
 }
 
-
 /** ------------------------------------------------------------------
- ** @internal
- ** @brief Normalizes in norm L_2 a descriptor
- ** @param begin begin of histogram.
- ** @param end   end of histogram.
- **/
-
-VL_INLINE vl_sift_pix
-normalize_histogram
-(vl_sift_pix *begin, vl_sift_pix *end)
-{
+ ** @brief Calculate the keypoint orientation(s)
+ **
+ ** @param f        SIFT filter.
+ ** @param angles   orientations (output).
+ ** @param k        keypoint.
+ **
+ ** The function computes the orientation(s) of the keypoint @a k.
+ ** The function returns the number of orientations found (up to
+ ** four). The orientations themselves are written to the vector @a
+ ** angles.
+ **
+ ** @remark The function requires the keypoint octave @a k->o to be
+ ** equal to the filter current octave ::vl_sift_get_octave. If this
+ ** is not the case, the function returns zero orientations.
+ **
+ ** @remark The function requires the keypoint scale level @c k->s to
+ ** be in the range @c s_min+1 and @c s_max-2 (where usually @c
+ ** s_min=0 and @c s_max=S+2). If this is not the case, the function
+ ** returns zero orientations.
+ **
+ ** @remark In upright mode (::vl_sift_set_upright()) the function
+ ** returns the single orientation zero without any computation.
+ **
+ ** @return number of orientations found.
+ **/
+
+VL_EXPORT
+int
+vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
+                                    double angles [4],
+                                    VlSiftKeypoint const *k)
+{
+  /* make gradient up to date */
+  if (! f->upright) vl_sift_update_gradient (f) ;
+  return _vl_sift_calc_keypoint_orientations (f, angles, k) ;
+}
+
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Normalizes in norm L_2 a descriptor
+ ** @param begin begin of histogram.
+ ** @param end   end of histogram.
+ **/
+
+VL_INLINE vl_sift_pix
+normalize_histogram
+(vl_sift_pix *begin, vl_sift_pix *end)
+{
   vl_sift_pix* iter ;
   vl_sift_pix  norm = 0.0 ;
 
@@ -1717,6 +2597,351 @@ normalize_histogram
   return norm;
 }
 
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Maps a descriptor to RootSIFT
+ ** @param begin begin of histogram.
+ ** @param end   end of histogram.
+ **
+ ** The histogram is normalized in L1 norm and square rooted.
+ **/
+
+VL_INLINE void
+root_histogram
+(vl_sift_pix *begin, vl_sift_pix *end)
+{
+  vl_sift_pix* iter ;
+  vl_sift_pix  norm = 0.0 ;
+
+  for (iter = begin ; iter != end ; ++ iter)
+    norm += *iter ;
+
+  norm += VL_EPSILON_F ;
+
+  for (iter = begin; iter != end ; ++ iter)
+    *iter = sqrtf (*iter / norm) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Projects a descriptor
+ ** @param f     SIFT filter.
+ ** @param descr projected descriptor (output).
+ ** @param hist  descriptor (overwritten).
+ **
+ ** The function subtracts the projection mean from @a hist and
+ ** projects the result on the columns of the projection matrix (see
+ ** ::vl_sift_set_projection). Inner products are computed by the
+ ** ::VlKernelL2 vector comparison function, which uses SIMD
+ ** instructions if available.
+ **/
+
+static void
+project_histogram
+(VlSiftFilt const *f, vl_sift_pix *descr, vl_sift_pix *hist)
+{
+  VlFloatVectorComparisonFunction dot =
+    vl_get_vector_comparison_function_f (VlKernelL2) ;
+  vl_uindex i ;
+
+  if (f->projectionMean) {
+    for (i = 0 ; i < NBO*NBP*NBP ; ++i) hist [i] -= f->projectionMean [i] ;
+  }
+  for (i = 0 ; i < f->projectionDimension ; ++i) {
+    descr [i] = dot (NBO*NBP*NBP, f->projection + NBO*NBP*NBP * i, hist) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Normalizes and quantizes a descriptor
+ ** @param descr       quantized descriptor (output).
+ ** @param begin       begin of histogram.
+ ** @param end         end of histogram.
+ ** @param norm_thresh norm threshold.
+ ** @param rootSift    whether to map the descriptor to RootSIFT.
+ **
+ ** The function computes the same result as normalizing,
+ ** truncating and normalizing again the histogram (and optionally
+ ** applying ::root_histogram) followed by quantization to 8 bits,
+ ** but without modifying the histogram. The norms are accumulated in
+ ** the same order as the separate steps, so that the result is
+ ** identical. The final element-wise pass uses SSE2 if available.
+ **/
+
+static void
+quantize_histogram
+(vl_uint8 *descr, vl_sift_pix const *begin, vl_sift_pix const *end,
+ double norm_thresh, vl_bool rootSift)
+{
+  vl_sift_pix const* iter ;
+  vl_sift_pix  norm = 0.0 ;
+  vl_sift_pix  norm2 = 0.0 ;
+  vl_sift_pix  norm1 = 0.0 ;
+  vl_size n = end - begin ;
+  vl_uindex i = 0 ;
+
+  for (iter = begin ; iter != end ; ++ iter)
+    norm += (*iter) * (*iter) ;
+  norm = vl_fast_sqrt_f (norm) + VL_EPSILON_F ;
+
+  if (norm_thresh && norm < norm_thresh) {
+    memset (descr, 0, n) ;
+    return ;
+  }
+
+  /* norm of the truncated histogram */
+  for (iter = begin ; iter != end ; ++ iter) {
+    vl_sift_pix x = *iter / norm ;
+    if (x > 0.2) x = 0.2 ;
+    norm2 += x * x ;
+  }
+  norm2 = vl_fast_sqrt_f (norm2) + VL_EPSILON_F ;
+
+  if (rootSift) {
+    for (iter = begin ; iter != end ; ++ iter) {
+      vl_sift_pix x = *iter / norm ;
+      if (x > 0.2) x = 0.2 ;
+      norm1 += x / norm2 ;
+    }
+    norm1 += VL_EPSILON_F ;
+  }
+
+#ifndef VL_DISABLE_SSE2
+  if (vl_cpu_has_sse2() && vl_get_simd_enabled()) {
+    i = _vl_sift_quantize_sse2 (descr, begin, n,
+                                norm, norm2, rootSift, norm1) ;
+  }
+#endif
+
+  for ( ; i < n ; ++i) {
+    vl_sift_pix x = begin [i] / norm ;
+    if (x > 0.2) x = 0.2 ;
+    x /= norm2 ;
+    if (rootSift) x = sqrtf (x / norm1) ;
+    x *= 512.0F ;
+    descr [i] = (vl_uint8) ((x < 255.0F) ? x : 255.0F) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the descriptor bins of a run of samples
+ **
+ ** The function computes, for each sample of a descriptor row, the
+ ** argument of the Gaussian window and the lower bins and remainders
+ ** of the trilinear interpolation. It is the scalar counterpart of
+ ** ::_vl_sift_descriptor_samples_sse2 and
+ ** ::_vl_sift_descriptor_samples_avx.
+ **/
+
+static void
+_vl_sift_descriptor_samples (double *expnArg,
+                             int *binx, int *biny, int *bint,
+                             vl_sift_pix *rbinx, vl_sift_pix *rbiny, vl_sift_pix *rbint,
+                             vl_sift_pix const *grad,
+                             vl_size numSamples,
+                             int ix, double x, vl_sift_pix dy,
+                             double ct0, double st0, double SBP,
+                             double angle0, double wnorm)
+{
+  vl_uindex i ;
+  for (i = 0 ; i < numSamples ; ++i) {
+    vl_sift_pix angle = grad [2 * i + 1] ;
+    vl_sift_pix theta = vl_mod_2pi_f (angle - angle0) ;
+
+    /* fractional displacement */
+    vl_sift_pix dx = ix + (int) i - x ;
+
+    /* get the displacement normalized w.r.t. the keypoint
+       orientation and extension */
+    vl_sift_pix nx = ( ct0 * dx + st0 * dy) / SBP ;
+    vl_sift_pix ny = (-st0 * dx + ct0 * dy) / SBP ;
+    vl_sift_pix nt = NBO * theta / (2 * VL_PI) ;
+
+    expnArg [i] = (nx*nx + ny*ny) / wnorm ;
+
+    /* The sample will be distributed in 8 adjacent bins.
+       We start from the ``lower-left'' bin. */
+    binx [i] = (int)vl_floor_f (nx - 0.5) ;
+    biny [i] = (int)vl_floor_f (ny - 0.5) ;
+    bint [i] = (int)vl_floor_f (nt) ;
+    rbinx [i] = nx - (binx [i] + 0.5) ;
+    rbiny [i] = ny - (biny [i] + 0.5) ;
+    rbint [i] = nt - bint [i] ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the bins of upright descriptor samples
+ **
+ ** Same as ::_vl_sift_descriptor_samples(), specialized for a zero
+ ** keypoint orientation, for which the sample displacements need not
+ ** be rotated. The result is the same.
+ **/
+
+static void
+_vl_sift_descriptor_samples_upright (double *expnArg,
+                                     int *binx, int *biny, int *bint,
+                                     vl_sift_pix *rbinx, vl_sift_pix *rbiny, vl_sift_pix *rbint,
+                                     vl_sift_pix const *grad,
+                                     vl_size numSamples,
+                                     int ix, double x, vl_sift_pix dy,
+                                     double SBP, double wnorm)
+{
+  vl_uindex i ;
+  vl_sift_pix const ny = dy / SBP ;
+  int const biny0 = (int)vl_floor_f (ny - 0.5) ;
+  vl_sift_pix const rbiny0 = ny - (biny0 + 0.5) ;
+
+  for (i = 0 ; i < numSamples ; ++i) {
+    vl_sift_pix theta = vl_mod_2pi_f (grad [2 * i + 1]) ;
+    vl_sift_pix dx = ix + (int) i - x ;
+    vl_sift_pix nx = dx / SBP ;
+    vl_sift_pix nt = NBO * theta / (2 * VL_PI) ;
+
+    expnArg [i] = (nx*nx + ny*ny) / wnorm ;
+
+    binx [i] = (int)vl_floor_f (nx - 0.5) ;
+    biny [i] = biny0 ;
+    bint [i] = (int)vl_floor_f (nt) ;
+    rbinx [i] = nx - (binx [i] + 0.5) ;
+    rbiny [i] = rbiny0 ;
+    rbint [i] = nt - bint [i] ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Accumulate a row of samples into a SIFT descriptor
+ **
+ ** @param dpt        descriptor bin of center (SBP/2,SBP/2,0).
+ ** @param grad       gradient of the first sample.
+ ** @param numSamples number of samples.
+ ** @param ix         x coordinate of the first sample.
+ ** @param x          keypoint x coordinate.
+ ** @param dy         y displacement of the row from the keypoint.
+ ** @param ct0        cosine of the keypoint orientation.
+ ** @param st0        sine of the keypoint orientation.
+ ** @param SBP        spatial bin extent.
+ ** @param angle0     keypoint orientation.
+ ** @param wnorm      Gaussian window normalization.
+ **
+ ** The samples are processed in chunks. For each chunk, the
+ ** interpolation bins are computed by the SSE2 or AVX kernels if
+ ** available, and then accumulated into the histogram.
+ **/
+
+#define SAMPLES_CHUNK 64 /**< descriptor row chunk size @internal */
+
+static void
+_vl_sift_descriptor_row (vl_sift_pix *dpt,
+                         vl_sift_pix const *grad,
+                         int numSamples,
+                         int ix, double x, vl_sift_pix dy,
+                         double ct0, double st0, double SBP,
+                         double angle0, double wnorm)
+{
+  int const binto = 1 ;          /* bin theta-stride */
+  int const binyo = NBO * NBP ;  /* bin y-stride */
+  int const binxo = NBO ;        /* bin x-stride */
+
+  double      expnArg [SAMPLES_CHUNK] ;
+  int         binx [SAMPLES_CHUNK] ;
+  int         biny [SAMPLES_CHUNK] ;
+  int         bint [SAMPLES_CHUNK] ;
+  vl_sift_pix rbinx [SAMPLES_CHUNK] ;
+  vl_sift_pix rbiny [SAMPLES_CHUNK] ;
+  vl_sift_pix rbint [SAMPLES_CHUNK] ;
+  int i, j ;
+
+#undef atd
+#define atd(dbinx,dbiny,dbint) *(dpt + (dbint)*binto + (dbiny)*binyo + (dbinx)*binxo)
+
+  for (i = 0 ; i < numSamples ; i += SAMPLES_CHUNK) {
+    vl_size n = VL_MIN (SAMPLES_CHUNK, numSamples - i) ;
+    vl_size k = 0 ;
+
+#ifndef VL_DISABLE_AVX
+    if (vl_cpu_has_avx() && vl_get_simd_enabled()) {
+      if (angle0 == 0) {
+        k += _vl_sift_descriptor_samples_upright_avx
+          (expnArg + k, binx + k, biny + k, bint + k,
+           rbinx + k, rbiny + k, rbint + k,
+           grad + 2 * (i + k), n - k, ix + i + (int) k,
+           x, dy, SBP, wnorm) ;
+      } else {
+        k += _vl_sift_descriptor_samples_avx
+          (expnArg + k, binx + k, biny + k, bint + k,
+           rbinx + k, rbiny + k, rbint + k,
+           grad + 2 * (i + k), n - k, ix + i + (int) k,
+           x, dy, ct0, st0, SBP, angle0, wnorm) ;
+      }
+    }
+#endif
+#ifndef VL_DISABLE_SSE2
+    if (vl_cpu_has_sse2() && vl_get_simd_enabled()) {
+      if (angle0 == 0) {
+        k += _vl_sift_descriptor_samples_upright_sse2
+          (expnArg + k, binx + k, biny + k, bint + k,
+           rbinx + k, rbiny + k, rbint + k,
+           grad + 2 * (i + k), n - k, ix + i + (int) k,
+           x, dy, SBP, wnorm) ;
+      } else {
+        k += _vl_sift_descriptor_samples_sse2
+          (expnArg + k, binx + k, biny + k, bint + k,
+           rbinx + k, rbiny + k, rbint + k,
+           grad + 2 * (i + k), n - k, ix + i + (int) k,
+           x, dy, ct0, st0, SBP, angle0, wnorm) ;
+      }
+    }
+#endif
+    if (angle0 == 0) {
+      _vl_sift_descriptor_samples_upright
+        (expnArg + k, binx + k, biny + k, bint + k,
+         rbinx + k, rbiny + k, rbint + k,
+         grad + 2 * (i + k), n - k, ix + i + (int) k,
+         x, dy, SBP, wnorm) ;
+    } else {
+      _vl_sift_descriptor_samples
+        (expnArg + k, binx + k, biny + k, bint + k,
+         rbinx + k, rbiny + k, rbint + k,
+         grad + 2 * (i + k), n - k, ix + i + (int) k,
+         x, dy, ct0, st0, SBP, angle0, wnorm) ;
+    }
+
+    for (j = 0 ; j < (int) n ; ++j) {
+      vl_sift_pix mod = grad [2 * (i + j)] ;
+      vl_sift_pix win = fast_expn (expnArg [j]) ;
+      int         dbinx ;
+      int         dbiny ;
+      int         dbint ;
+
+      /* Distribute the current sample into the 8 adjacent bins*/
+      for(dbinx = 0 ; dbinx < 2 ; ++dbinx) {
+        for(dbiny = 0 ; dbiny < 2 ; ++dbiny) {
+          for(dbint = 0 ; dbint < 2 ; ++dbint) {
+
+            if (binx [j] + dbinx >= - (NBP/2) &&
+                binx [j] + dbinx <    (NBP/2) &&
+                biny [j] + dbiny >= - (NBP/2) &&
+                biny [j] + dbiny <    (NBP/2) ) {
+              vl_sift_pix weight = win
+                * mod
+                * vl_abs_f (1 - dbinx - rbinx [j])
+                * vl_abs_f (1 - dbiny - rbiny [j])
+                * vl_abs_f (1 - dbint - rbint [j]) ;
+
+              atd(binx [j] + dbinx, biny [j] + dbiny, (bint [j] + dbint) % NBO) += weight ;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
 /** ------------------------------------------------------------------
  ** @brief Run the SIFT descriptor on raw data
  **
@@ -1775,13 +3000,17 @@ vl_sift_calc_raw_descriptor (VlSiftFilt const *f,
   int    const W      = floor
     (sqrt(2.0) * SBP * (NBP + 1) / 2.0 + 0.5) ;
 
-  int const binto = 1 ;          /* bin theta-stride */
   int const binyo = NBO * NBP ;  /* bin y-stride */
   int const binxo = NBO ;        /* bin x-stride */
 
-  int bin, dxi, dyi ;
+  vl_sift_pix const wsigma = f->windowSize ;
+  double const wnorm = 2.0 * wsigma * wsigma ;
+
+  int bin, dyi ;
   vl_sift_pix const *pt ;
   vl_sift_pix       *dpt ;
+  vl_sift_pix        hist [NBO*NBP*NBP] ;
+  vl_sift_pix       *output = descr ;
 
   /* check bounds */
   if(xi    <  0               ||
@@ -1790,6 +3019,9 @@ vl_sift_calc_raw_descriptor (VlSiftFilt const *f,
      yi    >= h -    1        )
     return ;
 
+  /* projected descriptors are computed in a temporary buffer */
+  if (f->projection) descr = hist ;
+
   /* clear descriptor */
   memset (descr, 0, sizeof(vl_sift_pix) * NBO*NBP*NBP) ;
 
@@ -1799,75 +3031,18 @@ vl_sift_calc_raw_descriptor (VlSiftFilt const *f,
   pt  = grad + xi*xo + yi*yo ;
   dpt = descr + (NBP/2) * binyo + (NBP/2) * binxo ;
 
-#undef atd
-#define atd(dbinx,dbiny,dbint) *(dpt + (dbint)*binto + (dbiny)*binyo + (dbinx)*binxo)
-
   /*
    * Process pixels in the intersection of the image rectangle
    * (1,1)-(M-1,N-1) and the keypoint bounding box.
    */
   for(dyi =  VL_MAX(- W,   - yi   ) ;
       dyi <= VL_MIN(+ W, h - yi -1) ; ++ dyi) {
-
-    for(dxi =  VL_MAX(- W,   - xi   ) ;
-        dxi <= VL_MIN(+ W, w - xi -1) ; ++ dxi) {
-
-      /* retrieve */
-      vl_sift_pix mod   = *( pt + dxi*xo + dyi*yo + 0 ) ;
-      vl_sift_pix angle = *( pt + dxi*xo + dyi*yo + 1 ) ;
-      vl_sift_pix theta = vl_mod_2pi_f (angle - angle0) ;
-
-      /* fractional displacement */
-      vl_sift_pix dx = xi + dxi - x;
-      vl_sift_pix dy = yi + dyi - y;
-
-      /* get the displacement normalized w.r.t. the keypoint
-         orientation and extension */
-      vl_sift_pix nx = ( ct0 * dx + st0 * dy) / SBP ;
-      vl_sift_pix ny = (-st0 * dx + ct0 * dy) / SBP ;
-      vl_sift_pix nt = NBO * theta / (2 * VL_PI) ;
-
-      /* Get the Gaussian weight of the sample. The Gaussian window
-       * has a standard deviation equal to NBP/2. Note that dx and dy
-       * are in the normalized frame, so that -NBP/2 <= dx <=
-       * NBP/2. */
-      vl_sift_pix const wsigma = f->windowSize ;
-      vl_sift_pix win = fast_expn
-        ((nx*nx + ny*ny)/(2.0 * wsigma * wsigma)) ;
-
-      /* The sample will be distributed in 8 adjacent bins.
-         We start from the ``lower-left'' bin. */
-      int         binx = (int)vl_floor_f (nx - 0.5) ;
-      int         biny = (int)vl_floor_f (ny - 0.5) ;
-      int         bint = (int)vl_floor_f (nt) ;
-      vl_sift_pix rbinx = nx - (binx + 0.5) ;
-      vl_sift_pix rbiny = ny - (biny + 0.5) ;
-      vl_sift_pix rbint = nt - bint ;
-      int         dbinx ;
-      int         dbiny ;
-      int         dbint ;
-
-      /* Distribute the current sample into the 8 adjacent bins*/
-      for(dbinx = 0 ; dbinx < 2 ; ++dbinx) {
-        for(dbiny = 0 ; dbiny < 2 ; ++dbiny) {
-          for(dbint = 0 ; dbint < 2 ; ++dbint) {
-
-            if (binx + dbinx >= - (NBP/2) &&
-                binx + dbinx <    (NBP/2) &&
-                biny + dbiny >= - (NBP/2) &&
-                biny + dbiny <    (NBP/2) ) {
-              vl_sift_pix weight = win
-                * mod
-                * vl_abs_f (1 - dbinx - rbinx)
-                * vl_abs_f (1 - dbiny - rbiny)
-                * vl_abs_f (1 - dbint - rbint) ;
-
-              atd(binx+dbinx, biny+dbiny, (bint+dbint) % NBO) += weight ;
-            }
-          }
-        }
-      }
-    }
+    int         dxi0 = VL_MAX (- W,   - xi   ) ;
+    int         dxi1 = VL_MIN (+ W, w - xi -1) ;
+    vl_sift_pix dy   = yi + dyi - y ;
+    _vl_sift_descriptor_row (dpt, pt + dxi0*xo + dyi*yo, dxi1 - dxi0 + 1,
+                             xi + dxi0, x, dy, ct0, st0, SBP,
+                             angle0, wnorm) ;
   }
 
   /* Standard SIFT descriptors are normalized, truncated and normalized again */
@@ -1900,27 +3075,26 @@ vl_sift_calc_raw_descriptor (VlSiftFilt const *f,
       normalize_histogram (descr, descr + NBO*NBP*NBP) ;
     }
   }
+
+  if (f->rootSift) root_histogram (descr, descr + NBO*NBP*NBP) ;
+  if (f->projection) project_histogram (f, output, descr) ;
 }
 
 /** ------------------------------------------------------------------
- ** @brief Compute the descriptor of a keypoint
- **
+ ** @internal
+ ** @brief Compute the histogram of a keypoint descriptor
  ** @param f        SIFT filter.
- ** @param descr    SIFT descriptor (output)
+ ** @param descr    unnormalized SIFT histogram (output)
  ** @param k        keypoint.
  ** @param angle0   keypoint direction.
+ ** @return @c false if the keypoint is out of bounds.
  **
- ** The function computes the SIFT descriptor of the keypoint @a k of
- ** orientation @a angle0. The function fills the buffer @a descr
- ** which must be large enough to hold the descriptor.
- **
- ** The function assumes that the keypoint is on the current octave.
- ** If not, it does not do anything.
+ ** The function assumes that the gradient buffer is up to date. If
+ ** the keypoint is out of bounds, @a descr is left unchanged.
  **/
 
-VL_EXPORT
-void
-vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
+static vl_bool
+_vl_sift_calc_keypoint_histogram (VlSiftFilt const *f,
                                   vl_sift_pix *descr,
                                   VlSiftKeypoint const* k,
                                   double angle0)
@@ -1950,8 +3124,8 @@ vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
   int const    xo          = 2 ;         /* x-stride */
   int const    yo          = 2 * w ;     /* y-stride */
   int const    so          = 2 * w * h ; /* s-stride */
-  double       x           = k-> x     / xper ;
-  double       y           = k-> y     / xper ;
+  double       x           = (k-> x - f->originX) / xper ;
+  double       y           = (k-> y - f->originY) / xper ;
   double       sigma       = k-> sigma / xper ;
 
   int          xi          = (int) (x + 0.5) ;
@@ -1964,11 +3138,13 @@ vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
   int    const W           = floor
     (sqrt(2.0) * SBP * (NBP + 1) / 2.0 + 0.5) ;
 
-  int const binto = 1 ;          /* bin theta-stride */
   int const binyo = NBO * NBP ;  /* bin y-stride */
   int const binxo = NBO ;        /* bin x-stride */
 
-  int bin, dxi, dyi ;
+  vl_sift_pix const wsigma = f->windowSize ;
+  double const wnorm = 2.0 * wsigma * wsigma ;
+
+  int dyi ;
   vl_sift_pix const *pt ;
   vl_sift_pix       *dpt ;
 
@@ -1980,10 +3156,7 @@ vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
      yi    >= h -    1        ||
      si    <  f->s_min + 1    ||
      si    >  f->s_max - 2     )
-    return ;
-
-  /* synchronize gradient buffer */
-  update_gradient (f) ;
+    return VL_FALSE ;
 
   /* VL_PRINTF("W = %d ; magnif = %g ; SBP = %g\n", W,magnif,SBP) ; */
 
@@ -1996,76 +3169,48 @@ vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
   pt  = f->grad + xi*xo + yi*yo + (si - f->s_min - 1)*so ;
   dpt = descr + (NBP/2) * binyo + (NBP/2) * binxo ;
 
-#undef atd
-#define atd(dbinx,dbiny,dbint) *(dpt + (dbint)*binto + (dbiny)*binyo + (dbinx)*binxo)
-
   /*
    * Process pixels in the intersection of the image rectangle
    * (1,1)-(M-1,N-1) and the keypoint bounding box.
    */
   for(dyi =  VL_MAX (- W, 1 - yi    ) ;
       dyi <= VL_MIN (+ W, h - yi - 2) ; ++ dyi) {
+    int         dxi0 = VL_MAX (- W, 1 - xi    ) ;
+    int         dxi1 = VL_MIN (+ W, w - xi - 2) ;
+    vl_sift_pix dy   = yi + dyi - y ;
+    _vl_sift_descriptor_row (dpt, pt + dxi0*xo + dyi*yo, dxi1 - dxi0 + 1,
+                             xi + dxi0, x, dy, ct0, st0, SBP,
+                             angle0, wnorm) ;
+  }
+  return VL_TRUE ;
+}
 
-    for(dxi =  VL_MAX (- W, 1 - xi    ) ;
-        dxi <= VL_MIN (+ W, w - xi - 2) ; ++ dxi) {
-
-      /* retrieve */
-      vl_sift_pix mod   = *( pt + dxi*xo + dyi*yo + 0 ) ;
-      vl_sift_pix angle = *( pt + dxi*xo + dyi*yo + 1 ) ;
-      vl_sift_pix theta = vl_mod_2pi_f (angle - angle0) ;
-
-      /* fractional displacement */
-      vl_sift_pix dx = xi + dxi - x;
-      vl_sift_pix dy = yi + dyi - y;
-
-      /* get the displacement normalized w.r.t. the keypoint
-         orientation and extension */
-      vl_sift_pix nx = ( ct0 * dx + st0 * dy) / SBP ;
-      vl_sift_pix ny = (-st0 * dx + ct0 * dy) / SBP ;
-      vl_sift_pix nt = NBO * theta / (2 * VL_PI) ;
-
-      /* Get the Gaussian weight of the sample. The Gaussian window
-       * has a standard deviation equal to NBP/2. Note that dx and dy
-       * are in the normalized frame, so that -NBP/2 <= dx <=
-       * NBP/2. */
-      vl_sift_pix const wsigma = f->windowSize ;
-      vl_sift_pix win = fast_expn
-        ((nx*nx + ny*ny)/(2.0 * wsigma * wsigma)) ;
-
-      /* The sample will be distributed in 8 adjacent bins.
-         We start from the ``lower-left'' bin. */
-      int         binx = (int)vl_floor_f (nx - 0.5) ;
-      int         biny = (int)vl_floor_f (ny - 0.5) ;
-      int         bint = (int)vl_floor_f (nt) ;
-      vl_sift_pix rbinx = nx - (binx + 0.5) ;
-      vl_sift_pix rbiny = ny - (biny + 0.5) ;
-      vl_sift_pix rbint = nt - bint ;
-      int         dbinx ;
-      int         dbiny ;
-      int         dbint ;
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the descriptor of a keypoint
+ ** @param f        SIFT filter.
+ ** @param descr    SIFT descriptor (output)
+ ** @param k        keypoint.
+ ** @param angle0   keypoint direction.
+ **
+ ** Same as ::vl_sift_calc_keypoint_descriptor(), but assumes that the
+ ** gradient buffer is up to date.
+ **/
 
-      /* Distribute the current sample into the 8 adjacent bins*/
-      for(dbinx = 0 ; dbinx < 2 ; ++dbinx) {
-        for(dbiny = 0 ; dbiny < 2 ; ++dbiny) {
-          for(dbint = 0 ; dbint < 2 ; ++dbint) {
+static void
+_vl_sift_calc_keypoint_descriptor (VlSiftFilt const *f,
+                                   vl_sift_pix *descr,
+                                   VlSiftKeypoint const* k,
+                                   double angle0)
+{
+  int bin ;
+  vl_sift_pix  hist [NBO*NBP*NBP] ;
+  vl_sift_pix *output = descr ;
 
-            if (binx + dbinx >= - (NBP/2) &&
-                binx + dbinx <    (NBP/2) &&
-                biny + dbiny >= - (NBP/2) &&
-                biny + dbiny <    (NBP/2) ) {
-              vl_sift_pix weight = win
-                * mod
-                * vl_abs_f (1 - dbinx - rbinx)
-                * vl_abs_f (1 - dbiny - rbiny)
-                * vl_abs_f (1 - dbint - rbint) ;
+  /* projected descriptors are computed in a temporary buffer */
+  if (f->projection) descr = hist ;
 
-              atd(binx+dbinx, biny+dbiny, (bint+dbint) % NBO) += weight ;
-            }
-          }
-        }
-      }
-    }
-  }
+  if (! _vl_sift_calc_keypoint_histogram (f, descr, k, angle0)) return ;
 
   /* Standard SIFT descriptors are normalized, truncated and normalized again */
   if(1) {
@@ -2090,6 +3235,293 @@ vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
     }
   }
 
+  if (f->rootSift) root_histogram (descr, descr + NBO*NBP*NBP) ;
+  if (f->projection) project_histogram (f, output, descr) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the quantized descriptor of a keypoint
+ ** @param f        SIFT filter.
+ ** @param descr    SIFT descriptor (output)
+ ** @param k        keypoint.
+ ** @param angle0   keypoint direction.
+ **
+ ** Same as ::vl_sift_calc_keypoint_descriptor_ui8(), but assumes that
+ ** the gradient buffer is up to date.
+ **/
+
+static void
+_vl_sift_calc_keypoint_descriptor_ui8 (VlSiftFilt const *f,
+                                       vl_uint8 *descr,
+                                       VlSiftKeypoint const* k,
+                                       double angle0)
+{
+  vl_sift_pix hist [NBO*NBP*NBP] ;
+
+  if (! _vl_sift_calc_keypoint_histogram (f, hist, k, angle0)) return ;
+  quantize_histogram (descr, hist, hist + NBO*NBP*NBP,
+                      f->norm_thresh, f->rootSift) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Compute the descriptor of a keypoint
+ **
+ ** @param f        SIFT filter.
+ ** @param descr    SIFT descriptor (output)
+ ** @param k        keypoint.
+ ** @param angle0   keypoint direction.
+ **
+ ** The function computes the SIFT descriptor of the keypoint @a k of
+ ** orientation @a angle0. The function fills the buffer @a descr
+ ** which must be large enough to hold the descriptor (see
+ ** ::vl_sift_get_descriptor_size).
+ **
+ ** The function assumes that the keypoint is on the current octave.
+ ** If not, it does not do anything.
+ **/
+
+VL_EXPORT
+void
+vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
+                                  vl_sift_pix *descr,
+                                  VlSiftKeypoint const* k,
+                                  double angle0)
+{
+  /* synchronize gradient buffer */
+  vl_sift_update_gradient (f) ;
+  _vl_sift_calc_keypoint_descriptor (f, descr, k, angle0) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Compute the quantized descriptor of a keypoint
+ **
+ ** @param f        SIFT filter.
+ ** @param descr    SIFT descriptor (output)
+ ** @param k        keypoint.
+ ** @param angle0   keypoint direction.
+ **
+ ** The function is the same as ::vl_sift_calc_keypoint_descriptor(),
+ ** except that the descriptor is returned as 128 8-bit integers
+ ** (see @ref sift-intro-extensions). Normalization and quantization
+ ** are fused, so no floating point descriptor is stored. The
+ ** projection set by ::vl_sift_set_projection() is not applied.
+ **/
+
+VL_EXPORT
+void
+vl_sift_calc_keypoint_descriptor_ui8 (VlSiftFilt *f,
+                                      vl_uint8 *descr,
+                                      VlSiftKeypoint const* k,
+                                      double angle0)
+{
+  vl_sift_update_gradient (f) ;
+  _vl_sift_calc_keypoint_descriptor_ui8 (f, descr, k, angle0) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Sort keypoints by scale level
+ ** @param f       SIFT filter.
+ ** @param order   keypoint permutation (output).
+ ** @param keys    keypoints.
+ ** @param numKeys number of keypoints.
+ **
+ ** The function fills @a order with the indexes of the keypoints
+ ** @a keys sorted by increasing scale level @c is (the sort is
+ ** stable). Keypoints with a level outside the range
+ ** @c s_min+1 ... @c s_max-2 are put last.
+ **/
+
+static void
+_vl_sift_sort_keypoints_by_level (VlSiftFilt const *f,
+                                  vl_uindex *order,
+                                  VlSiftKeypoint const *keys,
+                                  vl_size numKeys)
+{
+  enum { maxNumLevels = 64 } ;
+  vl_size counts [maxNumLevels + 1] ;
+  int const numLevels = VL_MIN(f->s_max - f->s_min - 2, maxNumLevels) ;
+  vl_uindex i ;
+  int l ;
+
+#define LEVEL(k) \
+  (((k)->is >= f->s_min + 1 && (k)->is < f->s_min + 1 + numLevels) ? \
+  (k)->is - f->s_min - 1 : numLevels)
+
+  memset (counts, 0, sizeof(counts)) ;
+  for (i = 0 ; i < numKeys ; ++i) {
+    counts [LEVEL(keys + i)] ++ ;
+  }
+  for (l = numLevels ; l > 0 ; --l) {
+    counts [l] = counts [l - 1] ;
+  }
+  counts [0] = 0 ;
+  for (l = 1 ; l <= numLevels ; ++l) {
+    counts [l] += counts [l - 1] ;
+  }
+  for (i = 0 ; i < numKeys ; ++i) {
+    order [counts [LEVEL(keys + i)] ++] = i ;
+  }
+#undef LEVEL
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Calculate the orientations of several keypoints
+ **
+ ** @param f         SIFT filter.
+ ** @param angles    orientations (output).
+ ** @param numAngles number of orientations of each keypoint (output).
+ ** @param keys      keypoints.
+ ** @param numKeys   number of keypoints.
+ **
+ ** The function runs ::vl_sift_calc_keypoint_orientations() on the
+ ** @a numKeys keypoints @a keys of the current octave, usually the
+ ** ones returned by ::vl_sift_get_keypoints(). The orientations of
+ ** the keypoint @c keys[i] are written to <code>angles[4*i]</code>,
+ ** ..., <code>angles[4*i+numAngles[i]-1]</code>, so that @a angles
+ ** must have room for @c 4*numKeys elements and @a numAngles for @a
+ ** numKeys elements.
+ **
+ ** Keypoints are processed by increasing scale level and in
+ ** parallel (see @ref threads-parallel).
+ **
+ ** @return total number of orientations found.
+ **/
+
+VL_EXPORT
+vl_size
+vl_sift_calc_octave_orientations (VlSiftFilt *f,
+                                  double *angles,
+                                  int *numAngles,
+                                  VlSiftKeypoint const *keys,
+                                  vl_size numKeys)
+{
+  vl_uindex *order ;
+  vl_index i ;
+  vl_size total = 0 ;
+
+  if (f->upright) {
+    for (i = 0 ; i < (signed)numKeys ; ++i) {
+      numAngles [i] = _vl_sift_calc_keypoint_orientations
+        (f, angles + 4 * i, keys + i) ;
+      total += numAngles [i] ;
+    }
+    return total ;
+  }
+
+  order = vl_malloc (sizeof(vl_uindex) * numKeys) ;
+  vl_sift_update_gradient (f) ;
+  _vl_sift_sort_keypoints_by_level (f, order, keys, numKeys) ;
+
+#if defined(_OPENMP)
+#pragma omp parallel for default(shared) private(i) reduction(+:total) \
+  num_threads(vl_get_max_threads())
+#endif
+  for (i = 0 ; i < (signed)numKeys ; ++i) {
+    vl_uindex j = order [i] ;
+    numAngles [j] = _vl_sift_calc_keypoint_orientations
+      (f, angles + 4 * j, keys + j) ;
+    total += numAngles [j] ;
+  }
+
+  vl_free (order) ;
+  return total ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Compute the descriptors of several keypoints
+ **
+ ** @param f        SIFT filter.
+ ** @param descrs   SIFT descriptors (output).
+ ** @param keys     keypoints.
+ ** @param angles   keypoint orientations.
+ ** @param numKeys  number of keypoints.
+ **
+ ** The function runs ::vl_sift_calc_keypoint_descriptor() on the
+ ** @a numKeys keypoints @a keys of the current octave with
+ ** orientations @a angles (one per keypoint). The descriptor of
+ ** @c keys[i] is written to the @c D elements starting at
+ ** <code>descrs + D*i</code>, where @c D is the descriptor size
+ ** ::vl_sift_get_descriptor_size() (128 unless a projection is set),
+ ** so @a descrs must have room for @c D*numKeys elements. The
+ ** descriptor of keypoints which are not in the current octave or
+ ** out of bounds is set to zero.
+ **
+ ** Keypoints are processed by increasing scale level, so that
+ ** consecutive descriptors access the same portion of the gradient
+ ** buffer, and in parallel (see @ref threads-parallel).
+ **/
+
+VL_EXPORT
+void
+vl_sift_calc_octave_descriptors (VlSiftFilt *f,
+                                 vl_sift_pix *descrs,
+                                 VlSiftKeypoint const *keys,
+                                 double const *angles,
+                                 vl_size numKeys)
+{
+  vl_uindex *order = vl_malloc (sizeof(vl_uindex) * numKeys) ;
+  vl_size dimension = vl_sift_get_descriptor_size (f) ;
+  vl_index i ;
+
+  vl_sift_update_gradient (f) ;
+  _vl_sift_sort_keypoints_by_level (f, order, keys, numKeys) ;
+  memset (descrs, 0, sizeof(vl_sift_pix) * dimension * numKeys) ;
+
+#if defined(_OPENMP)
+#pragma omp parallel for default(shared) private(i) \
+  num_threads(vl_get_max_threads())
+#endif
+  for (i = 0 ; i < (signed)numKeys ; ++i) {
+    vl_uindex j = order [i] ;
+    _vl_sift_calc_keypoint_descriptor
+      (f, descrs + dimension * j, keys + j, angles [j]) ;
+  }
+
+  vl_free (order) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Compute the quantized descriptors of several keypoints
+ **
+ ** @param f        SIFT filter.
+ ** @param descrs   SIFT descriptors (output).
+ ** @param keys     keypoints.
+ ** @param angles   keypoint orientations.
+ ** @param numKeys  number of keypoints.
+ **
+ ** The function is the same as ::vl_sift_calc_octave_descriptors(),
+ ** except that the descriptors are computed by
+ ** ::vl_sift_calc_keypoint_descriptor_ui8().
+ **/
+
+VL_EXPORT
+void
+vl_sift_calc_octave_descriptors_ui8 (VlSiftFilt *f,
+                                     vl_uint8 *descrs,
+                                     VlSiftKeypoint const *keys,
+                                     double const *angles,
+                                     vl_size numKeys)
+{
+  vl_uindex *order = vl_malloc (sizeof(vl_uindex) * numKeys) ;
+  vl_index i ;
+
+  vl_sift_update_gradient (f) ;
+  _vl_sift_sort_keypoints_by_level (f, order, keys, numKeys) ;
+  memset (descrs, 0, NBO*NBP*NBP * numKeys) ;
+
+#if defined(_OPENMP)
+#pragma omp parallel for default(shared) private(i) \
+  num_threads(vl_get_max_threads())
+#endif
+  for (i = 0 ; i < (signed)numKeys ; ++i) {
+    vl_uindex j = order [i] ;
+    _vl_sift_calc_keypoint_descriptor_ui8
+      (f, descrs + NBO*NBP*NBP * j, keys + j, angles [j]) ;
+  }
+
+  vl_free (order) ;
 }
 
 /** ------------------------------------------------------------------
@@ -2195,3 +3627,536 @@ vl_sift_keypoint_init (VlSiftFilt const *f,
 
   k->sigma = sigma ;
 }
+
+/* ---------------------------------------------------------------- */
+/*                                                 Tiled processing */
+/* ---------------------------------------------------------------- */
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Radius of the Gaussian filter used by ::_vl_sift_smooth()
+ ** @param sigma standard deviation.
+ ** @return radius.
+ **/
+
+static int
+_vl_sift_get_smoothing_radius (double sigma)
+{
+  return (int) VL_MAX(ceil(4.0 * sigma), 1) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Get the margin required to process a tile exactly
+ ** @param f          SIFT filter.
+ ** @param o_first    first octave computed from the tile.
+ ** @param numOctaves number of octaves processed in the tile.
+ ** @param fromImage  whether the tile contains image pixels (as
+ **                   opposed to the base of octave @a o_first).
+ ** @return margin in image pixels.
+ **
+ ** Filtering a tile differs from filtering the whole image only
+ ** close to the tile boundaries. This region grows by the radius of
+ ** the Gaussian filter at each smoothing step and halves at each
+ ** downsampling. A keypoint is computed exactly if its refinement
+ ** steps, its orientation window and its descriptor window do not
+ ** reach this region. If octaves follow the last processed one, the
+ ** margin also covers the base of the next octave.
+ **/
+
+static int
+_vl_sift_get_tile_margin (VlSiftFilt const *f,
+                          int o_first, int numOctaves,
+                          vl_bool fromImage)
+{
+  int const    s_min    = f->s_min ;
+  int const    s_max    = f->s_max ;
+  int const    s_best   = VL_MIN(s_min + f->S, s_max) ;
+  vl_bool const hasNext = (o_first + numOctaves < f->o_min + f->O) ;
+
+  /* largest orientation and descriptor windows (in octave pixels) */
+  double const sigmaMax = f->sigma0 * pow (2.0, (double) s_max / f->S) ;
+  int const    Wo       = VL_MAX(floor (3.0 * 1.5 * sigmaMax), 1) ;
+  int const    Wd       = floor
+    (sqrt(2.0) * f->magnif * sigmaMax * (NBP + 1) / 2.0 + 0.5) ;
+  int const    reach    = VL_MAX(Wo, Wd) + 3 ;
+
+  int c = 0, margin = 0, o, s ;
+  double sa, sb ;
+
+  if (fromImage) {
+    /* linear interpolation replicates the last pixel of the tile */
+    for (o = -1 ; o >= f->o_min ; --o) c = 2 * c + 1 ;
+    sa = f->sigma0 * pow (f->sigmak,   s_min) ;
+    sb = f->sigman * pow (2.0,       - f->o_min) ;
+    if (sa > sb) c += _vl_sift_get_smoothing_radius (sqrt (sa*sa - sb*sb)) ;
+  }
+
+  for (o = o_first ; o < o_first + numOctaves + hasNext ; ++o) {
+    int cs = c, cbest = c, cgrad = c, need ;
+
+    if (o > o_first) {
+      sa = f->sigma0 * powf (f->sigmak, s_min     ) ;
+      sb = f->sigma0 * powf (f->sigmak, s_best - f->S) ;
+      if (sa > sb) c += _vl_sift_get_smoothing_radius (sqrt (sa*sa - sb*sb)) ;
+      cs = c ;
+    }
+
+    if (o == o_first + numOctaves) {
+      /* base of the next octave */
+      need = c ;
+    } else {
+      for (s = s_min + 1 ; s <= s_max ; ++s) {
+        cs += _vl_sift_get_smoothing_radius (f->dsigma0 * pow (f->sigmak, s)) ;
+        if (s == s_best)    cbest = cs ;
+        if (s == s_max - 2) cgrad = cs ;
+      }
+      /* refinement moves a keypoint by at most four pixels, and the
+         gradient uses one more pixel at each side */
+      need = VL_MAX(cs + 8, cgrad + 1 + reach) ;
+      c = (cbest + 1) / 2 ;
+    }
+
+    if (o >= 0) {
+      need <<= o ;
+    } else {
+      need = (need + (1 << -o) - 1) >> -o ;
+    }
+    margin = VL_MAX(margin, need) ;
+  }
+  return margin ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Start processing from the base of the first octave
+ ** @param f    SIFT filter.
+ ** @param base base of the first octave.
+ ** @return error code.
+ **
+ ** The function is like ::vl_sift_process_first_octave(), except
+ ** that @a base is the first level of the first octave rather than
+ ** the image. Its size is given by ::vl_sift_get_octave_width() and
+ ** ::vl_sift_get_octave_height().
+ **/
+
+static int
+_vl_sift_process_first_octave_base (VlSiftFilt *f, vl_sift_pix const *base)
+{
+  int w, h ;
+  int err = _vl_sift_alloc_buffers (f) ;
+  if (err != VL_ERR_OK) return err ;
+
+  f->o_cur = f->o_min ;
+  f->nkeys = 0 ;
+  f->grad_o = f->o_min - 1 ;
+  w = f-> octave_width  = VL_SHIFT_LEFT(f->width,  - f->o_cur) ;
+  h = f-> octave_height = VL_SHIFT_LEFT(f->height, - f->o_cur) ;
+
+  memcpy (vl_sift_get_octave (f, f->s_min), base, sizeof(vl_sift_pix) * w * h) ;
+  f->scaleSpace = NULL ;
+  _vl_sift_fill_octave (f, f->s_min) ;
+  return VL_ERR_OK ;
+}
+
+/** @internal
+ ** @brief Pass of the tiled SIFT detector
+ **
+ ** A pass processes by tiles the octaves that fit in them. The first
+ ** pass reads its tiles from the image. The other ones read them
+ ** from a band of rows of the base of their first octave, which the
+ ** previous pass fills as it proceeds (see
+ ** ::_vl_sift_tile_pass_fill_band()).
+ **/
+
+typedef struct _VlSiftTilePass
+{
+  VlSiftFilt const *f ;    /**< SIFT filter (parameters). */
+  int o_first ;            /**< first octave processed. */
+  int numOctaves ;         /**< number of octaves processed. */
+  int margin ;             /**< tile margin (image pixels). */
+  int step ;               /**< tile core size (image pixels). */
+  int nextRow ;            /**< first image row not processed yet. */
+  VlSiftFilt *tf ;         /**< SIFT filter of the current tile. */
+  vl_sift_pix *tile ;      /**< tile buffer. */
+  vl_sift_pix *band ;      /**< rows of the base of the next octave. */
+  int bandFirstRow ;       /**< first row in @c band (octave pixels). */
+  int bandNumRows ;        /**< number of rows in @c band. */
+  struct _VlSiftTilePass *previous ; /**< previous pass (or @c NULL). */
+} VlSiftTilePass ;
+
+/** @internal
+ ** @brief Data of the tiled SIFT detector callbacks
+ **/
+
+typedef struct _VlSiftTileCallbacks
+{
+  VlSiftReadTileFunction readTile ;            /**< image reader. */
+  VlSiftTileKeypointsFunction processKeypoints ; /**< keypoint callback. */
+  void *data ;                                 /**< callbacks data. */
+} VlSiftTileCallbacks ;
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Initialize a pass of the tiled SIFT detector
+ ** @param pass     pass (output).
+ ** @param f        SIFT filter (parameters).
+ ** @param tileSize tile size.
+ ** @param previous previous pass (or @c NULL for the first one).
+ ** @return error code.
+ **
+ ** The pass starts from the octave following the ones of @a previous,
+ ** or from the first octave of @a f. It processes as many octaves as
+ ** allowed by the tile size.
+ **/
+
+static int
+_vl_sift_tile_pass_init (VlSiftTilePass *pass,
+                         VlSiftFilt const *f,
+                         int tileSize,
+                         VlSiftTilePass *previous)
+{
+  int const width   = f->width ;
+  int const height  = f->height ;
+  int const o_first = previous ? previous->o_first + previous->numOctaves : f->o_min ;
+  int const numOctaves = f->o_min + f->O - o_first ;
+  int const maxSize = tileSize << VL_MAX(o_first, 0) ;
+  int numTileOctaves, alignment, margin, step, o ;
+  VlSiftFilt *tf ;
+
+  /* choose the octaves processed in this pass */
+  if (width <= maxSize && height <= maxSize) {
+    numTileOctaves = numOctaves ;
+    margin = 0 ;
+    step = VL_MAX(width, height) ;
+  } else {
+    numTileOctaves = 1 ;
+    while (numTileOctaves < numOctaves &&
+           _vl_sift_get_tile_margin (f, o_first, numTileOctaves + 1, previous == NULL)
+           <= maxSize / 2) {
+      ++ numTileOctaves ;
+    }
+    margin = _vl_sift_get_tile_margin (f, o_first, numTileOctaves, previous == NULL) ;
+
+    /* tiles are aligned to the pixels of the coarsest octave touched */
+    o = o_first + numTileOctaves - (numTileOctaves == numOctaves) ;
+    alignment = 1 << VL_MAX(o, 0) ;
+    margin = (margin + alignment - 1) / alignment * alignment ;
+    step = VL_MAX(maxSize / alignment, 1) * alignment ;
+  }
+
+  pass->f            = f ;
+  pass->o_first      = o_first ;
+  pass->numOctaves   = numTileOctaves ;
+  pass->margin       = margin ;
+  pass->step         = step ;
+  pass->nextRow      = 0 ;
+  pass->tile         = NULL ;
+  pass->band         = NULL ;
+  pass->bandFirstRow = 0 ;
+  pass->bandNumRows  = 0 ;
+  pass->previous     = previous ;
+
+  tf = pass->tf = vl_sift_new (VL_MIN(width,  step + 2 * margin),
+                               VL_MIN(height, step + 2 * margin),
+                               numTileOctaves, f->S, o_first) ;
+  if (tf == NULL) goto err_alloc ;
+  tf->sigman      = f->sigman ;
+  tf->sigma0      = f->sigma0 ;
+  tf->sigmak      = f->sigmak ;
+  tf->dsigma0     = f->dsigma0 ;
+  tf->peak_thresh = f->peak_thresh ;
+  tf->edge_thresh = f->edge_thresh ;
+  tf->norm_thresh = f->norm_thresh ;
+  tf->magnif      = f->magnif ;
+  tf->windowSize  = f->windowSize ;
+  tf->rootSift    = f->rootSift ;
+  tf->upright     = f->upright ;
+  if (f->projection &&
+      vl_sift_set_projection (tf, f->projection, f->projectionMean,
+                              f->projectionDimension) != VL_ERR_OK) {
+    goto err_alloc ;
+  }
+  if (_vl_sift_alloc_buffers (tf) != VL_ERR_OK) goto err_alloc ;
+
+  if (previous) {
+    pass->tile = vl_malloc (sizeof(vl_sift_pix)
+                            * VL_SHIFT_LEFT(tf->width,  - o_first)
+                            * VL_SHIFT_LEFT(tf->height, - o_first)) ;
+  } else {
+    pass->tile = vl_malloc (sizeof(vl_sift_pix) * tf->width * tf->height) ;
+  }
+  if (pass->tile == NULL) goto err_alloc ;
+
+  if (previous) {
+    /* the band holds the rows of the tiles of this pass, plus the
+       rows of one row of tiles of the previous pass */
+    previous->band = vl_malloc (sizeof(vl_sift_pix)
+                                * VL_SHIFT_LEFT(width, - o_first)
+                                * (VL_SHIFT_LEFT(step + 2 * margin, - o_first) +
+                                   VL_SHIFT_LEFT(previous->step, - o_first) + 2)) ;
+    if (previous->band == NULL) goto err_alloc ;
+  }
+  return VL_ERR_OK ;
+
+err_alloc:
+  if (pass->tile) vl_free (pass->tile) ;
+  vl_sift_delete (pass->tf) ;
+  pass->tile = NULL ;
+  pass->tf = NULL ;
+  return vl_set_last_error (VL_ERR_ALLOC, "Unable to allocate the tile buffers.") ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Release the buffers of a pass of the tiled SIFT detector
+ ** @param pass pass.
+ **/
+
+static void
+_vl_sift_tile_pass_release (VlSiftTilePass *pass)
+{
+  if (pass->tile) vl_free (pass->tile) ;
+  if (pass->band) vl_free (pass->band) ;
+  vl_sift_delete (pass->tf) ;
+}
+
+static int
+_vl_sift_tile_pass_fill_band (VlSiftTilePass *pass,
+                              VlSiftTileCallbacks const *callbacks,
+                              int y0, int y1) ;
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Process a row of tiles of a pass of the tiled SIFT detector
+ ** @param pass      pass.
+ ** @param callbacks callbacks.
+ ** @param y0        first image row of the tile cores.
+ ** @return error code.
+ **
+ ** The function processes the tiles whose core starts at row @a y0,
+ ** reporting their keypoints. If octaves follow the ones of @a pass,
+ ** it also appends the rows of the base of the next octave
+ ** corresponding to the tile cores to the band of @a pass.
+ **/
+
+static int
+_vl_sift_tile_pass_process_row (VlSiftTilePass *pass,
+                                VlSiftTileCallbacks const *callbacks,
+                                int y0)
+{
+  VlSiftFilt const *f = pass->f ;
+  VlSiftFilt *tf = pass->tf ;
+  VlSiftTilePass *previous = pass->previous ;
+  int const o_next = pass->o_first + pass->numOctaves ;
+  int const y1  = VL_MIN(y0 + pass->step, f->height) ;
+  int const ty0 = VL_MAX(y0 - pass->margin, 0) ;
+  int const ty1 = VL_MIN(y1 + pass->margin, f->height) ;
+  int x0, o, i ;
+  int err = VL_ERR_OK ;
+
+  if (previous) {
+    err = _vl_sift_tile_pass_fill_band (previous, callbacks, ty0, ty1) ;
+  }
+
+  for (x0 = 0 ; x0 < f->width && err == VL_ERR_OK ; x0 += pass->step) {
+    int const x1  = VL_MIN(x0 + pass->step, f->width) ;
+    int const tx0 = VL_MAX(x0 - pass->margin, 0) ;
+    int const tx1 = VL_MIN(x1 + pass->margin, f->width) ;
+
+    vl_sift_reset_geometry (tf, tx1 - tx0, ty1 - ty0,
+                            pass->numOctaves, f->S, pass->o_first) ;
+    tf->originX = tx0 ;
+    tf->originY = ty0 ;
+
+    if (previous) {
+      int const stride = VL_SHIFT_LEFT(f->width, - pass->o_first) ;
+      int const w = VL_SHIFT_LEFT(tf->width,  - pass->o_first) ;
+      int const h = VL_SHIFT_LEFT(tf->height, - pass->o_first) ;
+      vl_sift_pix const *src = previous->band
+        + VL_SHIFT_LEFT(tx0, - pass->o_first)
+        + (VL_SHIFT_LEFT(ty0, - pass->o_first) - previous->bandFirstRow) * stride ;
+      for (i = 0 ; i < h ; ++i) {
+        memcpy (pass->tile + i * w, src + i * stride, sizeof(vl_sift_pix) * w) ;
+      }
+      err = _vl_sift_process_first_octave_base (tf, pass->tile) ;
+    } else {
+      err = callbacks->readTile (callbacks->data, pass->tile,
+                                 tx0, ty0, tf->width, tf->height) ;
+      if (err == VL_ERR_OK) {
+        err = vl_sift_process_first_octave (tf, pass->tile) ;
+      }
+    }
+
+    for (o = pass->o_first ; o < o_next && err == VL_ERR_OK ; ++o) {
+      int cx0 = VL_SHIFT_LEFT(x0, - o) ;
+      int cy0 = VL_SHIFT_LEFT(y0, - o) ;
+      int cx1 = VL_SHIFT_LEFT(x1, - o) ;
+      int cy1 = VL_SHIFT_LEFT(y1, - o) ;
+      int numKeys = 0 ;
+
+      if (o > pass->o_first) {
+        err = vl_sift_process_next_octave (tf) ;
+        if (err != VL_ERR_OK) break ;
+      }
+      vl_sift_detect (tf) ;
+      err = tf->detectError ;
+      if (err != VL_ERR_OK) break ;
+
+      /* keep the keypoints in the tile core, dropping duplicates */
+      for (i = 0 ; i < tf->nkeys ; ++i) {
+        VlSiftKeypoint const *k = tf->keys + i ;
+        if (cx0 <= k->ix && k->ix < cx1 && cy0 <= k->iy && k->iy < cy1) {
+          tf->keys [numKeys++] = *k ;
+        }
+      }
+      tf->nkeys = numKeys ;
+      err = callbacks->processKeypoints (callbacks->data, tf, tf->keys, tf->nkeys) ;
+    }
+
+    if (pass->band && err == VL_ERR_OK) {
+      int stride = VL_SHIFT_LEFT(f->width, - o_next) ;
+      int cx0 = VL_SHIFT_LEFT(x0, - o_next) ;
+      int cy0 = VL_SHIFT_LEFT(y0, - o_next) ;
+      int cw = VL_SHIFT_LEFT(x1, - o_next) - cx0 ;
+      int ch = VL_SHIFT_LEFT(y1, - o_next) - cy0 ;
+      int ox = VL_SHIFT_LEFT(tx0, - o_next) ;
+      int oy = VL_SHIFT_LEFT(ty0, - o_next) ;
+      vl_sift_pix const *src ;
+
+      _vl_sift_start_next_octave (tf) ;
+      src = vl_sift_get_octave (tf, tf->s_min) ;
+      for (i = 0 ; i < ch ; ++i) {
+        memcpy (pass->band + cx0 + (cy0 - pass->bandFirstRow + i) * stride,
+                src + (cx0 - ox) + (cy0 - oy + i) * tf->octave_width,
+                sizeof(vl_sift_pix) * cw) ;
+      }
+    }
+  }
+
+  if (pass->band && err == VL_ERR_OK) {
+    pass->bandNumRows = VL_SHIFT_LEFT(y1, - o_next) - pass->bandFirstRow ;
+  }
+  return err ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Fill the band of a pass of the tiled SIFT detector
+ ** @param pass      pass.
+ ** @param callbacks callbacks.
+ ** @param y0        first image row needed.
+ ** @param y1        last image row needed (excluded).
+ ** @return error code.
+ **
+ ** The function makes the band of @a pass contain the rows of the
+ ** base of the next octave corresponding to the image rows @a y0 to
+ ** @a y1. It drops the rows above @a y0, which the next pass does
+ ** not need anymore, and processes rows of tiles of @a pass until
+ ** the band reaches @a y1.
+ **/
+
+static int
+_vl_sift_tile_pass_fill_band (VlSiftTilePass *pass,
+                              VlSiftTileCallbacks const *callbacks,
+                              int y0, int y1)
+{
+  int const o_next = pass->o_first + pass->numOctaves ;
+  int const stride = VL_SHIFT_LEFT(pass->f->width, - o_next) ;
+  int const numDropped = VL_SHIFT_LEFT(y0, - o_next) - pass->bandFirstRow ;
+  int err = VL_ERR_OK ;
+
+  if (numDropped > 0) {
+    memmove (pass->band, pass->band + numDropped * stride,
+             sizeof(vl_sift_pix) * (pass->bandNumRows - numDropped) * stride) ;
+    pass->bandFirstRow += numDropped ;
+    pass->bandNumRows  -= numDropped ;
+  }
+
+  while (pass->nextRow < y1 && err == VL_ERR_OK) {
+    err = _vl_sift_tile_pass_process_row (pass, callbacks, pass->nextRow) ;
+    pass->nextRow += pass->step ;
+  }
+  return err ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Run the SIFT detector on a large image by tiles
+ ** @param f                SIFT filter.
+ ** @param tileSize         tile size (in pixels).
+ ** @param readTile         function reading a block of the image.
+ ** @param processKeypoints function receiving the keypoints.
+ ** @param data             data passed to the callbacks.
+ ** @return error code.
+ **
+ ** The function runs the SIFT detector on the image of the size and
+ ** with the parameters of the filter @a f, reading the image in
+ ** overlapping tiles by calling @a readTile. It finds the same
+ ** keypoints as processing the whole image with @a f, but it requires
+ ** an amount of memory proportional to the tile size times the image
+ ** width instead of the image size. See @ref sift-intro-extensions.
+ **
+ ** @a readTile is called as <code>readTile(data, tile, x, y, width,
+ ** height)</code> and must copy to @a tile the image block of size
+ ** @c width x @c height with top-left corner @c (x,y), stored by rows.
+ **
+ ** For each tile and octave, @a processKeypoints is called as
+ ** <code>processKeypoints(data, filt, keys, numKeys)</code>, where @a
+ ** filt is a temporary SIFT filter with the parameters of @a f set
+ ** to the tile and octave. The keypoints @a keys are expressed in
+ ** image coordinates and can be passed to
+ ** ::vl_sift_calc_keypoint_orientations(),
+ ** ::vl_sift_calc_keypoint_descriptor() and similar functions
+ ** together with @a filt. The orientations and descriptors are the
+ ** same as for the whole image, provided that the magnification
+ ** factor of @a filt is not increased.
+ **
+ ** The maximum number of keypoints set by
+ ** ::vl_sift_set_max_keypoints() is not applied.
+ **
+ ** Any of the two callbacks can stop the computation by returning an
+ ** error code other than ::VL_ERR_OK, which is returned by the
+ ** function.
+ **/
+
+VL_EXPORT
+int
+vl_sift_process_tiled (VlSiftFilt const *f,
+                       int tileSize,
+                       VlSiftReadTileFunction readTile,
+                       VlSiftTileKeypointsFunction processKeypoints,
+                       void *data)
+{
+  VlSiftTileCallbacks callbacks ;
+  VlSiftTilePass *passes, *last ;
+  int numPasses = 0, p, y0 ;
+  int err = VL_ERR_OK ;
+
+  if (f->O <= 0) return VL_ERR_OK ;
+
+  passes = vl_calloc (f->O, sizeof(VlSiftTilePass)) ;
+  if (passes == NULL) {
+    return vl_set_last_error (VL_ERR_ALLOC, "Unable to allocate the tile buffers.") ;
+  }
+  do {
+    last = passes + numPasses ;
+    err = _vl_sift_tile_pass_init (last, f, VL_MAX(tileSize, 1),
+                                   numPasses ? last - 1 : NULL) ;
+    if (err != VL_ERR_OK) break ;
+    ++ numPasses ;
+  } while (last->o_first + last->numOctaves < f->o_min + f->O) ;
+
+  /* the last pass pulls the rows it needs from the previous ones */
+  callbacks.readTile = readTile ;
+  callbacks.processKeypoints = processKeypoints ;
+  callbacks.data = data ;
+  for (y0 = 0 ; y0 < f->height && err == VL_ERR_OK ; y0 += last->step) {
+    err = _vl_sift_tile_pass_process_row (last, &callbacks, y0) ;
+  }
+
+  for (p = 0 ; p < numPasses ; ++p) {
+    _vl_sift_tile_pass_release (passes + p) ;
+  }
+  vl_free (passes) ;
+  return err ;
+}
@@ -16,10 +16,14 @@ the terms of the BSD license (see the COPYING file).
 
 #include <stdio.h>
 #include "generic.h"
+#include "scalespace.h"
 
 /** @brief SIFT filter pixel type */
 typedef float vl_sift_pix ;
 
+/** @brief Number of Gaussian filters cached by the SIFT filter */
+#define VL_SIFT_NUM_CACHED_FILTERS 16
+
 /** ------------------------------------------------------------------
  ** @brief SIFT filter keypoint
  **
@@ -68,10 +72,17 @@ typedef struct _VlSiftFilt
   vl_sift_pix *dog ;    /**< current DoG data. */
   int octave_width ;    /**< current octave width. */
   int octave_height ;   /**< current octave height. */
+  vl_size bufferNumPixels ; /**< pixels per level of the buffers. */
+  int bufferNumLevels ; /**< levels of the buffers. */
+  VlScaleSpace const *scaleSpace ; /**< external GSS data (or NULL). */
 
   vl_sift_pix *gaussFilter ;  /**< current Gaussian filter */
   double gaussFilterSigma ;   /**< current Gaussian filter std */
   vl_size gaussFilterWidth ;  /**< current Gaussian filter width */
+  vl_sift_pix *gaussFilterCache [VL_SIFT_NUM_CACHED_FILTERS] ; /**< cached Gaussian filters */
+  double gaussFilterCacheSigma [VL_SIFT_NUM_CACHED_FILTERS] ;  /**< cached Gaussian filters std */
+  vl_size gaussFilterCacheWidth [VL_SIFT_NUM_CACHED_FILTERS] ; /**< cached Gaussian filters width */
+  vl_size gaussFilterCacheNext ; /**< next cached Gaussian filter to replace */
 
   VlSiftKeypoint* keys ;/**< detected keypoints. */
   int nkeys ;           /**< number of detected keypoints. */
@@ -82,12 +93,41 @@ typedef struct _VlSiftFilt
   double norm_thresh ;  /**< norm threshold. */
   double magnif ;       /**< magnification factor. */
   double windowSize ;   /**< size of Gaussian window (in spatial bins) */
+  vl_bool rootSift ;    /**< use RootSIFT descriptors. */
+  vl_bool upright ;     /**< compute upright features. */
+  float *projection ;   /**< descriptor projection matrix. */
+  float *projectionMean ; /**< descriptor projection mean. */
+  vl_size projectionDimension ; /**< descriptor projection dimension. */
 
   vl_sift_pix *grad ;   /**< GSS gradient data. */
   int grad_o ;          /**< GSS gradient data octave. */
 
+  int originX ;         /**< x coordinate of the image in a larger image. */
+  int originY ;         /**< y coordinate of the image in a larger image. */
+
+  int maxNumKeypoints ; /**< maximum number of keypoints (0 for no limit). */
+  float *keyScores ;    /**< scores of the detected keypoints. */
+  float *scoreHeap ;    /**< heap of the scores of the strongest keypoints. */
+  vl_size scoreHeapSize ; /**< number of scores in the heap. */
+  float scoreThresh ;   /**< score of the weakest selected keypoint. */
+  int numScoreTies ;    /**< selected keypoints left with score equal to the threshold. */
+  int detectError ;     /**< error of the last detection, reported by the next octave. */
+
 } VlSiftFilt ;
 
+/** @typedef VlSiftReadTileFunction
+ ** @brief Pointer to a function reading an image block for ::vl_sift_process_tiled()
+ **/
+typedef int (*VlSiftReadTileFunction) (void *data, vl_sift_pix *tile,
+                                       int x, int y, int width, int height) ;
+
+/** @typedef VlSiftTileKeypointsFunction
+ ** @brief Pointer to a function receiving the keypoints found by ::vl_sift_process_tiled()
+ **/
+typedef int (*VlSiftTileKeypointsFunction) (void *data, VlSiftFilt *filt,
+                                            VlSiftKeypoint const *keys,
+                                            int numKeys) ;
+
 /** @name Create and destroy
  ** @{
  **/
@@ -97,6 +137,23 @@ VlSiftFilt*  vl_sift_new    (int width, int height,
                              int o_min) ;
 VL_EXPORT
 void         vl_sift_delete (VlSiftFilt *f) ;
+VL_EXPORT
+void         vl_sift_reset_geometry (VlSiftFilt *f,
+                                     int width, int height,
+                                     int noctaves, int nlevels,
+                                     int o_min) ;
+/** @} */
+
+/** @name Descriptor projection and keypoint budget
+ ** @{
+ **/
+VL_EXPORT
+int vl_sift_set_projection (VlSiftFilt *f,
+                            float const *projection,
+                            float const *mean,
+                            vl_size dimension) ;
+VL_EXPORT
+void vl_sift_set_max_keypoints (VlSiftFilt *f, int n) ;
 /** @} */
 
 /** @name Process data
@@ -107,12 +164,20 @@ VL_EXPORT
 int   vl_sift_process_first_octave       (VlSiftFilt *f,
                                           vl_sift_pix const *im) ;
 
+VL_EXPORT
+int   vl_sift_process_first_octave_from_scale_space
+                                         (VlSiftFilt *f,
+                                          VlScaleSpace const *scaleSpace) ;
+
 VL_EXPORT
 int   vl_sift_process_next_octave        (VlSiftFilt *f) ;
 
 VL_EXPORT
 void  vl_sift_detect                     (VlSiftFilt *f) ;
 
+VL_EXPORT
+void  vl_sift_update_gradient            (VlSiftFilt *f) ;
+
 VL_EXPORT
 int   vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
                                           double angles [4],
@@ -123,6 +188,33 @@ void  vl_sift_calc_keypoint_descriptor   (VlSiftFilt *f,
                                           VlSiftKeypoint const* k,
                                           double angle) ;
 
+VL_EXPORT
+void  vl_sift_calc_keypoint_descriptor_ui8 (VlSiftFilt *f,
+                                            vl_uint8 *descr,
+                                            VlSiftKeypoint const* k,
+                                            double angle) ;
+
+VL_EXPORT
+vl_size vl_sift_calc_octave_orientations (VlSiftFilt *f,
+                                          double *angles,
+                                          int *numAngles,
+                                          VlSiftKeypoint const *keys,
+                                          vl_size numKeys) ;
+
+VL_EXPORT
+void  vl_sift_calc_octave_descriptors    (VlSiftFilt *f,
+                                          vl_sift_pix *descrs,
+                                          VlSiftKeypoint const *keys,
+                                          double const *angles,
+                                          vl_size numKeys) ;
+
+VL_EXPORT
+void  vl_sift_calc_octave_descriptors_ui8 (VlSiftFilt *f,
+                                           vl_uint8 *descrs,
+                                           VlSiftKeypoint const *keys,
+                                           double const *angles,
+                                           vl_size numKeys) ;
+
 VL_EXPORT
 void  vl_sift_calc_raw_descriptor        (VlSiftFilt const *f,
                                           vl_sift_pix const* image,
@@ -139,6 +231,17 @@ void  vl_sift_keypoint_init              (VlSiftFilt const *f,
                                           double sigma) ;
 /** @} */
 
+/** @name Process large images
+ ** @{
+ **/
+VL_EXPORT
+int   vl_sift_process_tiled              (VlSiftFilt const *f,
+                                          int tileSize,
+                                          VlSiftReadTileFunction readTile,
+                                          VlSiftTileKeypointsFunction processKeypoints,
+                                          void *data) ;
+/** @} */
+
 /** @name Retrieve data and parameters
  ** @{
  **/
@@ -154,9 +257,17 @@ VL_INLINE double vl_sift_get_edge_thresh    (VlSiftFilt const *f) ;
 VL_INLINE double vl_sift_get_norm_thresh    (VlSiftFilt const *f) ;
 VL_INLINE double vl_sift_get_magnif         (VlSiftFilt const *f) ;
 VL_INLINE double vl_sift_get_window_size    (VlSiftFilt const *f) ;
+VL_INLINE vl_bool vl_sift_get_root_sift     (VlSiftFilt const *f) ;
+VL_INLINE vl_bool vl_sift_get_upright       (VlSiftFilt const *f) ;
+VL_INLINE vl_size vl_sift_get_descriptor_size (VlSiftFilt const *f) ;
+VL_INLINE int    vl_sift_get_max_keypoints (VlSiftFilt const *f) ;
 
 VL_INLINE vl_sift_pix *vl_sift_get_octave  (VlSiftFilt const *f, int s) ;
 VL_INLINE VlSiftKeypoint const *vl_sift_get_keypoints (VlSiftFilt const *f) ;
+VL_INLINE float const *vl_sift_get_keypoint_scores (VlSiftFilt const *f) ;
+
+VL_EXPORT
+VlScaleSpaceGeometry vl_sift_get_scale_space_geometry (VlSiftFilt const *f) ;
 /** @} */
 
 /** @name Set parameters
@@ -167,6 +278,8 @@ VL_INLINE void vl_sift_set_edge_thresh (VlSiftFilt *f, double t) ;
 VL_INLINE void vl_sift_set_norm_thresh (VlSiftFilt *f, double t) ;
 VL_INLINE void vl_sift_set_magnif      (VlSiftFilt *f, double m) ;
 VL_INLINE void vl_sift_set_window_size (VlSiftFilt *f, double m) ;
+VL_INLINE void vl_sift_set_root_sift   (VlSiftFilt *f, vl_bool x) ;
+VL_INLINE void vl_sift_set_upright     (VlSiftFilt *f, vl_bool x) ;
 /** @} */
 
 /* -------------------------------------------------------------------
@@ -289,6 +402,23 @@ vl_sift_get_keypoints (VlSiftFilt const *f)
   return f-> keys ;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Get keypoint scores.
+ ** @param f SIFT filter.
+ ** @return pointer to the keypoint scores.
+ **
+ ** The score of a keypoint is the absolute value of the DoG scale
+ ** space at the integer extremum, before refinement. The array has
+ ** an element for each keypoint of ::vl_sift_get_keypoints() and it
+ ** is the measure used by the keypoint budget.
+ **/
+
+VL_INLINE float const *
+vl_sift_get_keypoint_scores (VlSiftFilt const *f)
+{
+  return f-> keyScores ;
+}
+
 /** ------------------------------------------------------------------
  ** @brief Get peaks treashold
  ** @param f SIFT filter.
@@ -349,6 +479,59 @@ vl_sift_get_window_size (VlSiftFilt const *f)
   return f -> windowSize ;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Get whether RootSIFT descriptors are computed.
+ ** @param f SIFT filter.
+ ** @return @c true if RootSIFT descriptors are computed.
+ **/
+
+VL_INLINE vl_bool
+vl_sift_get_root_sift (VlSiftFilt const *f)
+{
+  return f -> rootSift ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get whether upright features are computed.
+ ** @param f SIFT filter.
+ ** @return @c true if upright features are computed.
+ **/
+
+VL_INLINE vl_bool
+vl_sift_get_upright (VlSiftFilt const *f)
+{
+  return f -> upright ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the descriptor size.
+ ** @param f SIFT filter.
+ ** @return number of elements of a descriptor.
+ **
+ ** This is 128, or the projection dimension if a projection is set
+ ** (see ::vl_sift_set_projection).
+ **/
+
+VL_INLINE vl_size
+vl_sift_get_descriptor_size (VlSiftFilt const *f)
+{
+  return f -> projection ? f -> projectionDimension : 128 ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the maximum number of keypoints
+ ** @param f SIFT filter.
+ ** @return maximum number of keypoints (0 for no limit).
+ **
+ ** See ::vl_sift_set_max_keypoints().
+ **/
+
+VL_INLINE int
+vl_sift_get_max_keypoints (VlSiftFilt const *f)
+{
+  return f -> maxNumKeypoints ;
+}
+
 
 
 /** ------------------------------------------------------------------
@@ -414,5 +597,34 @@ vl_sift_set_window_size (VlSiftFilt *f, double x)
   f -> windowSize = x ;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Set whether to compute RootSIFT descriptors
+ ** @param f SIFT filter.
+ ** @param x @c true to compute RootSIFT descriptors.
+ **
+ ** See @ref sift-intro-extensions.
+ **/
+
+VL_INLINE void
+vl_sift_set_root_sift (VlSiftFilt *f, vl_bool x)
+{
+  f -> rootSift = x ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set whether to compute upright features
+ ** @param f SIFT filter.
+ ** @param x @c true to compute upright features.
+ **
+ ** Upright features have orientation zero, which skips orientation
+ ** estimation. See @ref sift-intro-extensions.
+ **/
+
+VL_INLINE void
+vl_sift_set_upright (VlSiftFilt *f, vl_bool x)
+{
+  f -> upright = x ;
+}
+
 /* VL_SIFT_H */
 #endif
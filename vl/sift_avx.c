@@ -0,0 +1,298 @@
+/** @file sift_avx.c
+ ** @brief SIFT - AVX - Definition
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_DISABLE_AVX
+
+#ifndef __AVX__
+#error Compiling AVX functions but AVX does not seem to be supported by the compiler.
+#endif
+
+#include <immintrin.h>
+#include "sift_avx.h"
+#include "mathop.h"
+
+/*
+ These are the same kernels as in sift_sse2.c, processing eight
+ samples at a time. The results are identical to the scalar code in
+ sift.c.
+ */
+
+/* convert the lower and upper halves of a float vector to double */
+#define VLO(v) _mm256_cvtps_pd (_mm256_castps256_ps128 (v))
+#define VHI(v) _mm256_cvtps_pd (_mm256_extractf128_ps ((v), 1))
+/* convert two double vectors back to a float vector */
+#define VJOIN(a,b) _mm256_insertf128_ps \
+  (_mm256_castps128_ps256 (_mm256_cvtpd_ps (a)), _mm256_cvtpd_ps (b), 1)
+
+/** @internal @brief AVX version of ::vl_mod_2pi_f */
+VL_INLINE __m256
+_vl_mod_2pi_avx (__m256 x)
+{
+  __m256 const twopi = _mm256_set1_ps ((float) (2 * VL_PI)) ;
+  __m256 const zero = _mm256_setzero_ps () ;
+  __m256 mask ;
+  while (_mm256_movemask_ps (mask = _mm256_cmp_ps (x, twopi, _CMP_GT_OQ))) {
+    x = _mm256_sub_ps (x, _mm256_and_ps (mask, twopi)) ;
+  }
+  while (_mm256_movemask_ps (mask = _mm256_cmp_ps (x, zero, _CMP_LT_OQ))) {
+    x = _mm256_add_ps (x, _mm256_and_ps (mask, twopi)) ;
+  }
+  return x ;
+}
+
+/** @internal @brief AVX version of ::vl_fast_sqrt_f */
+VL_INLINE __m256
+_vl_fast_sqrt_avx (__m256 x)
+{
+  union { float x ; vl_int32 i ; } thresh ;
+  __m256 const threehalfs = _mm256_set1_ps (1.5f) ;
+  __m256 xhalf = _mm256_mul_ps (_mm256_set1_ps (0.5f), x) ;
+  __m128i const magic = _mm_set1_epi32 (0x5f3759df) ;
+  __m128i xlo = _mm_castps_si128 (_mm256_castps256_ps128 (x)) ;
+  __m128i xhi = _mm_castps_si128 (_mm256_extractf128_ps (x, 1)) ;
+  __m256 y ;
+
+  /* AVX lacks 256-bit integer arithmetic: use two 128-bit halves */
+  xlo = _mm_sub_epi32 (magic, _mm_srai_epi32 (xlo, 1)) ;
+  xhi = _mm_sub_epi32 (magic, _mm_srai_epi32 (xhi, 1)) ;
+  y = _mm256_insertf128_ps (_mm256_castps128_ps256 (_mm_castsi128_ps (xlo)),
+                            _mm_castsi128_ps (xhi), 1) ;
+  y = _mm256_mul_ps (y, _mm256_sub_ps (threehalfs, _mm256_mul_ps (_mm256_mul_ps (xhalf, y), y))) ;
+  y = _mm256_mul_ps (y, _mm256_sub_ps (threehalfs, _mm256_mul_ps (_mm256_mul_ps (xhalf, y), y))) ;
+
+  /* smallest float not smaller than the (double) threshold 1e-8 */
+  thresh.x = 1e-8f ;
+  if ((double) thresh.x < 1e-8) thresh.i += 1 ;
+
+  return _mm256_andnot_ps (_mm256_cmp_ps (x, _mm256_set1_ps (thresh.x), _CMP_LT_OQ),
+                           _mm256_mul_ps (x, y)) ;
+}
+
+/** @internal @brief AVX version of ::vl_fast_atan2_f */
+VL_INLINE __m256
+_vl_fast_atan2_avx (__m256 y, __m256 x)
+{
+  __m256 const signmask = _mm256_set1_ps (-0.0f) ;
+  __m256 const zero = _mm256_setzero_ps () ;
+  __m256 const c3 = _mm256_set1_ps (0.1821F) ;
+  __m256 const c1 = _mm256_set1_ps (0.9675F) ;
+  __m256 abs_y = _mm256_add_ps (_mm256_andnot_ps (signmask, y), _mm256_set1_ps (VL_EPSILON_F)) ;
+  __m256 pos = _mm256_cmp_ps (x, zero, _CMP_GE_OQ) ;
+  __m256 num = _mm256_blendv_ps (_mm256_add_ps (x, abs_y), _mm256_sub_ps (x, abs_y), pos) ;
+  __m256 den = _mm256_blendv_ps (_mm256_sub_ps (abs_y, x), _mm256_add_ps (x, abs_y), pos) ;
+  __m256 r = _mm256_div_ps (num, den) ;
+  __m256 angle = _mm256_blendv_ps (_mm256_set1_ps ((float) (3 * VL_PI / 4)),
+                                   _mm256_set1_ps ((float) (VL_PI / 4)), pos) ;
+  angle = _mm256_add_ps (angle, _mm256_mul_ps (_mm256_sub_ps (_mm256_mul_ps (_mm256_mul_ps (c3, r), r), c1), r)) ;
+  return _mm256_xor_ps (angle, _mm256_and_ps (_mm256_cmp_ps (y, zero, _CMP_LT_OQ), signmask)) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the polar gradient of a run of pixels
+ **
+ ** Same as ::_vl_sift_gradient_sse2, but processes the pixels in
+ ** groups of eight.
+ **/
+
+vl_size
+_vl_sift_gradient_avx (float *grad,
+                       float const *src,
+                       vl_size numPixels,
+                       vl_index up, vl_index down,
+                       float dyscale)
+{
+  __m256 const half = _mm256_set1_ps (0.5f) ;
+  __m256 const vdyscale = _mm256_set1_ps (dyscale) ;
+  __m256d const twopi = _mm256_set1_pd (2 * VL_PI) ;
+  vl_size i ;
+
+  for (i = 0 ; i + 8 <= numPixels ; i += 8) {
+    float const * pt = src + i ;
+    __m256 gx = _mm256_mul_ps (half, _mm256_sub_ps (_mm256_loadu_ps (pt + 1),
+                                                    _mm256_loadu_ps (pt - 1))) ;
+    __m256 gy = _mm256_mul_ps (vdyscale, _mm256_sub_ps (_mm256_loadu_ps (pt + down),
+                                                        _mm256_loadu_ps (pt - up))) ;
+    __m256 mod = _vl_fast_sqrt_avx (_mm256_add_ps (_mm256_mul_ps (gx, gx),
+                                                   _mm256_mul_ps (gy, gy))) ;
+    __m256 ang = _vl_fast_atan2_avx (gy, gx) ;
+    __m256 lo, hi ;
+    ang = _vl_mod_2pi_avx (VJOIN (_mm256_add_pd (VLO(ang), twopi),
+                                  _mm256_add_pd (VHI(ang), twopi))) ;
+    lo = _mm256_unpacklo_ps (mod, ang) ;
+    hi = _mm256_unpackhi_ps (mod, ang) ;
+    _mm256_storeu_ps (grad + 2 * i,     _mm256_permute2f128_ps (lo, hi, 0x20)) ;
+    _mm256_storeu_ps (grad + 2 * i + 8, _mm256_permute2f128_ps (lo, hi, 0x31)) ;
+  }
+  return i ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the SIFT descriptor bins of a run of samples
+ **
+ ** Same as ::_vl_sift_descriptor_samples_sse2, but processes the
+ ** samples in groups of eight.
+ **/
+
+vl_size
+_vl_sift_descriptor_samples_avx (double *expnArg,
+                                 int *binx, int *biny, int *bint,
+                                 float *rbinx, float *rbiny, float *rbint,
+                                 float const *grad,
+                                 vl_size numSamples,
+                                 int ix, double x, float dy,
+                                 double ct0, double st0, double SBP,
+                                 double angle0, double wnorm)
+{
+  __m256d const vx = _mm256_set1_pd (x) ;
+  __m256d const vdy = _mm256_set1_pd (dy) ;
+  __m256d const vct0 = _mm256_set1_pd (ct0) ;
+  __m256d const vst0 = _mm256_set1_pd (st0) ;
+  __m256d const vmst0 = _mm256_set1_pd (- st0) ;
+  __m256d const vSBP = _mm256_set1_pd (SBP) ;
+  __m256d const vangle0 = _mm256_set1_pd (angle0) ;
+  __m256d const vwnorm = _mm256_set1_pd (wnorm) ;
+  __m256d const half = _mm256_set1_pd (0.5) ;
+  __m256d const twopi = _mm256_set1_pd (2 * VL_PI) ;
+  vl_size i ;
+
+  for (i = 0 ; i + 8 <= numSamples ; i += 8) {
+    __m256 v0 = _mm256_loadu_ps (grad + 2 * i) ;
+    __m256 v1 = _mm256_loadu_ps (grad + 2 * i + 8) ;
+    __m256 angle = _mm256_shuffle_ps (_mm256_permute2f128_ps (v0, v1, 0x20),
+                                      _mm256_permute2f128_ps (v0, v1, 0x31),
+                                      _MM_SHUFFLE(3,1,3,1)) ;
+    __m256 theta, dx, nx, ny, nt, fbinx, fbiny, fbint ;
+    __m256d dxlo, dxhi, nxlo, nxhi, nylo, nyhi ;
+    int j = ix + (int)i ;
+
+    theta = _vl_mod_2pi_avx (VJOIN (_mm256_sub_pd (VLO(angle), vangle0),
+                                    _mm256_sub_pd (VHI(angle), vangle0))) ;
+
+    dx = VJOIN (_mm256_sub_pd (_mm256_set_pd (j + 3, j + 2, j + 1, j    ), vx),
+                _mm256_sub_pd (_mm256_set_pd (j + 7, j + 6, j + 5, j + 4), vx)) ;
+    dxlo = VLO(dx) ;
+    dxhi = VHI(dx) ;
+
+    nx = VJOIN (_mm256_div_pd (_mm256_add_pd (_mm256_mul_pd (vct0, dxlo), _mm256_mul_pd (vst0, vdy)), vSBP),
+                _mm256_div_pd (_mm256_add_pd (_mm256_mul_pd (vct0, dxhi), _mm256_mul_pd (vst0, vdy)), vSBP)) ;
+    ny = VJOIN (_mm256_div_pd (_mm256_add_pd (_mm256_mul_pd (vmst0, dxlo), _mm256_mul_pd (vct0, vdy)), vSBP),
+                _mm256_div_pd (_mm256_add_pd (_mm256_mul_pd (vmst0, dxhi), _mm256_mul_pd (vct0, vdy)), vSBP)) ;
+    theta = _mm256_mul_ps (_mm256_set1_ps (8.0f), theta) ;
+    nt = VJOIN (_mm256_div_pd (VLO(theta), twopi),
+                _mm256_div_pd (VHI(theta), twopi)) ;
+
+    {
+      __m256 r2 = _mm256_add_ps (_mm256_mul_ps (nx, nx), _mm256_mul_ps (ny, ny)) ;
+      _mm256_storeu_pd (expnArg + i,     _mm256_div_pd (VLO(r2), vwnorm)) ;
+      _mm256_storeu_pd (expnArg + i + 4, _mm256_div_pd (VHI(r2), vwnorm)) ;
+    }
+
+    nxlo = VLO(nx) ;
+    nxhi = VHI(nx) ;
+    nylo = VLO(ny) ;
+    nyhi = VHI(ny) ;
+
+    fbinx = _mm256_floor_ps (VJOIN (_mm256_sub_pd (nxlo, half), _mm256_sub_pd (nxhi, half))) ;
+    fbiny = _mm256_floor_ps (VJOIN (_mm256_sub_pd (nylo, half), _mm256_sub_pd (nyhi, half))) ;
+    fbint = _mm256_floor_ps (nt) ;
+
+    _mm256_storeu_si256 ((__m256i*) (binx + i), _mm256_cvttps_epi32 (fbinx)) ;
+    _mm256_storeu_si256 ((__m256i*) (biny + i), _mm256_cvttps_epi32 (fbiny)) ;
+    _mm256_storeu_si256 ((__m256i*) (bint + i), _mm256_cvttps_epi32 (fbint)) ;
+
+    _mm256_storeu_ps (rbinx + i, VJOIN (_mm256_sub_pd (nxlo, _mm256_add_pd (VLO(fbinx), half)),
+                                        _mm256_sub_pd (nxhi, _mm256_add_pd (VHI(fbinx), half)))) ;
+    _mm256_storeu_ps (rbiny + i, VJOIN (_mm256_sub_pd (nylo, _mm256_add_pd (VLO(fbiny), half)),
+                                        _mm256_sub_pd (nyhi, _mm256_add_pd (VHI(fbiny), half)))) ;
+    _mm256_storeu_ps (rbint + i, _mm256_sub_ps (nt, fbint)) ;
+  }
+  return i ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the SIFT descriptor bins of a run of upright samples
+ **
+ ** Same as ::_vl_sift_descriptor_samples_upright_sse2, but processes
+ ** the samples in groups of eight.
+ **/
+
+vl_size
+_vl_sift_descriptor_samples_upright_avx (double *expnArg,
+                                         int *binx, int *biny, int *bint,
+                                         float *rbinx, float *rbiny, float *rbint,
+                                         float const *grad,
+                                         vl_size numSamples,
+                                         int ix, double x, float dy,
+                                         double SBP, double wnorm)
+{
+  __m256d const vx = _mm256_set1_pd (x) ;
+  __m256d const vSBP = _mm256_set1_pd (SBP) ;
+  __m256d const vwnorm = _mm256_set1_pd (wnorm) ;
+  __m256d const half = _mm256_set1_pd (0.5) ;
+  __m256d const twopi = _mm256_set1_pd (2 * VL_PI) ;
+  float const ny = dy / SBP ;
+  int const biny0 = (int) vl_floor_f (ny - 0.5) ;
+  __m256 const vny2 = _mm256_set1_ps (ny * ny) ;
+  __m256i const vbiny = _mm256_set1_epi32 (biny0) ;
+  __m256 const vrbiny = _mm256_set1_ps (ny - (biny0 + 0.5)) ;
+  vl_size i ;
+
+  for (i = 0 ; i + 8 <= numSamples ; i += 8) {
+    __m256 v0 = _mm256_loadu_ps (grad + 2 * i) ;
+    __m256 v1 = _mm256_loadu_ps (grad + 2 * i + 8) ;
+    __m256 theta = _mm256_shuffle_ps (_mm256_permute2f128_ps (v0, v1, 0x20),
+                                      _mm256_permute2f128_ps (v0, v1, 0x31),
+                                      _MM_SHUFFLE(3,1,3,1)) ;
+    __m256 dx, nx, nt, fbinx, fbint ;
+    __m256d nxlo, nxhi ;
+    int j = ix + (int)i ;
+
+    theta = _vl_mod_2pi_avx (theta) ;
+
+    dx = VJOIN (_mm256_sub_pd (_mm256_set_pd (j + 3, j + 2, j + 1, j    ), vx),
+                _mm256_sub_pd (_mm256_set_pd (j + 7, j + 6, j + 5, j + 4), vx)) ;
+    nx = VJOIN (_mm256_div_pd (VLO(dx), vSBP),
+                _mm256_div_pd (VHI(dx), vSBP)) ;
+    theta = _mm256_mul_ps (_mm256_set1_ps (8.0f), theta) ;
+    nt = VJOIN (_mm256_div_pd (VLO(theta), twopi),
+                _mm256_div_pd (VHI(theta), twopi)) ;
+
+    {
+      __m256 r2 = _mm256_add_ps (_mm256_mul_ps (nx, nx), vny2) ;
+      _mm256_storeu_pd (expnArg + i,     _mm256_div_pd (VLO(r2), vwnorm)) ;
+      _mm256_storeu_pd (expnArg + i + 4, _mm256_div_pd (VHI(r2), vwnorm)) ;
+    }
+
+    nxlo = VLO(nx) ;
+    nxhi = VHI(nx) ;
+
+    fbinx = _mm256_floor_ps (VJOIN (_mm256_sub_pd (nxlo, half), _mm256_sub_pd (nxhi, half))) ;
+    fbint = _mm256_floor_ps (nt) ;
+
+    _mm256_storeu_si256 ((__m256i*) (binx + i), _mm256_cvttps_epi32 (fbinx)) ;
+    _mm256_storeu_si256 ((__m256i*) (biny + i), vbiny) ;
+    _mm256_storeu_si256 ((__m256i*) (bint + i), _mm256_cvttps_epi32 (fbint)) ;
+
+    _mm256_storeu_ps (rbinx + i, VJOIN (_mm256_sub_pd (nxlo, _mm256_add_pd (VLO(fbinx), half)),
+                                        _mm256_sub_pd (nxhi, _mm256_add_pd (VHI(fbinx), half)))) ;
+    _mm256_storeu_ps (rbiny + i, vrbiny) ;
+    _mm256_storeu_ps (rbint + i, _mm256_sub_ps (nt, fbint)) ;
+  }
+  return i ;
+}
+
+/* ! VL_DISABLE_AVX */
+#endif
@@ -0,0 +1,50 @@
+/** @file sift_avx.h
+ ** @brief SIFT - AVX
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_SIFT_AVX_H
+#define VL_SIFT_AVX_H
+
+#include "generic.h"
+
+#ifndef VL_DISABLE_AVX
+
+VL_EXPORT
+vl_size _vl_sift_gradient_avx (float *grad,
+                               float const *src,
+                               vl_size numPixels,
+                               vl_index up, vl_index down,
+                               float dyscale) ;
+
+VL_EXPORT
+vl_size _vl_sift_descriptor_samples_avx (double *expnArg,
+                                         int *binx, int *biny, int *bint,
+                                         float *rbinx, float *rbiny, float *rbint,
+                                         float const *grad,
+                                         vl_size numSamples,
+                                         int ix, double x, float dy,
+                                         double ct0, double st0, double SBP,
+                                         double angle0, double wnorm) ;
+
+VL_EXPORT
+vl_size _vl_sift_descriptor_samples_upright_avx (double *expnArg,
+                                                 int *binx, int *biny, int *bint,
+                                                 float *rbinx, float *rbiny, float *rbint,
+                                                 float const *grad,
+                                                 vl_size numSamples,
+                                                 int ix, double x, float dy,
+                                                 double SBP, double wnorm) ;
+
+#endif
+
+/* VL_SIFT_AVX_H */
+#endif
@@ -0,0 +1,370 @@
+/** @file sift_sse2.c
+ ** @brief SIFT - SSE2 - Definition
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#if ! defined(VL_DISABLE_SSE2) & ! defined(__SSE2__)
+#error "Compiling with SSE2 enabled, but no __SSE2__ defined"
+#endif
+
+#if ! defined(VL_DISABLE_SSE2)
+
+#include <emmintrin.h>
+#include "sift_sse2.h"
+#include "mathop.h"
+
+/*
+ The kernels in this file replicate exactly the sequence of single
+ and double precision operations of the scalar code in sift.c, so
+ that the results are identical.
+ */
+
+/* convert the lower and upper halves of a float vector to double */
+#define VLO(v) _mm_cvtps_pd (v)
+#define VHI(v) _mm_cvtps_pd (_mm_movehl_ps ((v), (v)))
+/* convert two double vectors back to a float vector */
+#define VJOIN(a,b) _mm_movelh_ps (_mm_cvtpd_ps (a), _mm_cvtpd_ps (b))
+
+/** @internal @brief SSE2 version of ::vl_floor_f */
+VL_INLINE __m128i
+_vl_floor_sse2 (__m128 x)
+{
+  __m128i xi = _mm_cvttps_epi32 (x) ;
+  __m128 fix = _mm_cmpgt_ps (_mm_cvtepi32_ps (xi), x) ;
+  return _mm_add_epi32 (xi, _mm_castps_si128 (fix)) ;
+}
+
+/** @internal @brief SSE2 version of ::vl_mod_2pi_f */
+VL_INLINE __m128
+_vl_mod_2pi_sse2 (__m128 x)
+{
+  __m128 const twopi = _mm_set1_ps ((float) (2 * VL_PI)) ;
+  __m128 const zero = _mm_setzero_ps () ;
+  __m128 mask ;
+  while (_mm_movemask_ps (mask = _mm_cmpgt_ps (x, twopi))) {
+    x = _mm_sub_ps (x, _mm_and_ps (mask, twopi)) ;
+  }
+  while (_mm_movemask_ps (mask = _mm_cmplt_ps (x, zero))) {
+    x = _mm_add_ps (x, _mm_and_ps (mask, twopi)) ;
+  }
+  return x ;
+}
+
+/** @internal @brief SSE2 version of ::vl_fast_sqrt_f */
+VL_INLINE __m128
+_vl_fast_sqrt_sse2 (__m128 x)
+{
+  union { float x ; vl_int32 i ; } thresh ;
+  __m128 const threehalfs = _mm_set1_ps (1.5f) ;
+  __m128 xhalf = _mm_mul_ps (_mm_set1_ps (0.5f), x) ;
+  __m128 y = _mm_castsi128_ps
+    (_mm_sub_epi32 (_mm_set1_epi32 (0x5f3759df),
+                    _mm_srai_epi32 (_mm_castps_si128 (x), 1))) ;
+  y = _mm_mul_ps (y, _mm_sub_ps (threehalfs, _mm_mul_ps (_mm_mul_ps (xhalf, y), y))) ;
+  y = _mm_mul_ps (y, _mm_sub_ps (threehalfs, _mm_mul_ps (_mm_mul_ps (xhalf, y), y))) ;
+
+  /* smallest float not smaller than the (double) threshold 1e-8 */
+  thresh.x = 1e-8f ;
+  if ((double) thresh.x < 1e-8) thresh.i += 1 ;
+
+  return _mm_andnot_ps (_mm_cmplt_ps (x, _mm_set1_ps (thresh.x)),
+                        _mm_mul_ps (x, y)) ;
+}
+
+/** @internal @brief SSE2 version of ::vl_fast_atan2_f */
+VL_INLINE __m128
+_vl_fast_atan2_sse2 (__m128 y, __m128 x)
+{
+  __m128 const signmask = _mm_set1_ps (-0.0f) ;
+  __m128 const zero = _mm_setzero_ps () ;
+  __m128 const c3 = _mm_set1_ps (0.1821F) ;
+  __m128 const c1 = _mm_set1_ps (0.9675F) ;
+  __m128 abs_y = _mm_add_ps (_mm_andnot_ps (signmask, y), _mm_set1_ps (VL_EPSILON_F)) ;
+  __m128 pos = _mm_cmpge_ps (x, zero) ;
+  __m128 num = _mm_or_ps (_mm_and_ps    (pos, _mm_sub_ps (x, abs_y)),
+                          _mm_andnot_ps (pos, _mm_add_ps (x, abs_y))) ;
+  __m128 den = _mm_or_ps (_mm_and_ps    (pos, _mm_add_ps (x, abs_y)),
+                          _mm_andnot_ps (pos, _mm_sub_ps (abs_y, x))) ;
+  __m128 r = _mm_div_ps (num, den) ;
+  __m128 angle = _mm_or_ps (_mm_and_ps    (pos, _mm_set1_ps ((float) (VL_PI / 4))),
+                            _mm_andnot_ps (pos, _mm_set1_ps ((float) (3 * VL_PI / 4)))) ;
+  angle = _mm_add_ps (angle, _mm_mul_ps (_mm_sub_ps (_mm_mul_ps (_mm_mul_ps (c3, r), r), c1), r)) ;
+  return _mm_xor_ps (angle, _mm_and_ps (_mm_cmplt_ps (y, zero), signmask)) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the polar gradient of a run of pixels
+ ** @param grad      gradient (output).
+ ** @param src       first pixel.
+ ** @param numPixels number of pixels.
+ ** @param up        offset to the previous row.
+ ** @param down      offset to the next row.
+ ** @param dyscale   scale of the vertical derivative.
+ ** @return number of processed pixels.
+ **
+ ** The function processes the pixels in groups of four, skipping the
+ ** remainder. The pixels must not be on the first or last column.
+ **/
+
+vl_size
+_vl_sift_gradient_sse2 (float *grad,
+                        float const *src,
+                        vl_size numPixels,
+                        vl_index up, vl_index down,
+                        float dyscale)
+{
+  __m128 const half = _mm_set1_ps (0.5f) ;
+  __m128 const vdyscale = _mm_set1_ps (dyscale) ;
+  __m128d const twopi = _mm_set1_pd (2 * VL_PI) ;
+  vl_size i ;
+
+  for (i = 0 ; i + 4 <= numPixels ; i += 4) {
+    float const * pt = src + i ;
+    __m128 gx = _mm_mul_ps (half, _mm_sub_ps (_mm_loadu_ps (pt + 1),
+                                              _mm_loadu_ps (pt - 1))) ;
+    __m128 gy = _mm_mul_ps (vdyscale, _mm_sub_ps (_mm_loadu_ps (pt + down),
+                                                  _mm_loadu_ps (pt - up))) ;
+    __m128 mod = _vl_fast_sqrt_sse2 (_mm_add_ps (_mm_mul_ps (gx, gx),
+                                                 _mm_mul_ps (gy, gy))) ;
+    __m128 ang = _vl_fast_atan2_sse2 (gy, gx) ;
+    ang = _vl_mod_2pi_sse2 (VJOIN (_mm_add_pd (VLO(ang), twopi),
+                                   _mm_add_pd (VHI(ang), twopi))) ;
+    _mm_storeu_ps (grad + 2 * i,     _mm_unpacklo_ps (mod, ang)) ;
+    _mm_storeu_ps (grad + 2 * i + 4, _mm_unpackhi_ps (mod, ang)) ;
+  }
+  return i ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the SIFT descriptor bins of a run of samples
+ ** @param expnArg    argument of the Gaussian window (output).
+ ** @param binx       x bin (output).
+ ** @param biny       y bin (output).
+ ** @param bint       orientation bin (output).
+ ** @param rbinx      x bin remainder (output).
+ ** @param rbiny      y bin remainder (output).
+ ** @param rbint      orientation bin remainder (output).
+ ** @param grad       gradient of the first sample.
+ ** @param numSamples number of samples.
+ ** @param ix         x coordinate of the first sample.
+ ** @param x          x coordinate of the keypoint.
+ ** @param dy         y displacement of the samples from the keypoint.
+ ** @param ct0        cosine of the keypoint orientation.
+ ** @param st0        sine of the keypoint orientation.
+ ** @param SBP        spatial bin extent.
+ ** @param angle0     keypoint orientation.
+ ** @param wnorm      Gaussian window normalization.
+ ** @return number of processed samples.
+ **
+ ** The samples are processed in groups of four, skipping the
+ ** remainder.
+ **/
+
+vl_size
+_vl_sift_descriptor_samples_sse2 (double *expnArg,
+                                  int *binx, int *biny, int *bint,
+                                  float *rbinx, float *rbiny, float *rbint,
+                                  float const *grad,
+                                  vl_size numSamples,
+                                  int ix, double x, float dy,
+                                  double ct0, double st0, double SBP,
+                                  double angle0, double wnorm)
+{
+  __m128d const vx = _mm_set1_pd (x) ;
+  __m128d const vdy = _mm_set1_pd (dy) ;
+  __m128d const vct0 = _mm_set1_pd (ct0) ;
+  __m128d const vst0 = _mm_set1_pd (st0) ;
+  __m128d const vmst0 = _mm_set1_pd (- st0) ;
+  __m128d const vSBP = _mm_set1_pd (SBP) ;
+  __m128d const vangle0 = _mm_set1_pd (angle0) ;
+  __m128d const vwnorm = _mm_set1_pd (wnorm) ;
+  __m128d const half = _mm_set1_pd (0.5) ;
+  __m128d const twopi = _mm_set1_pd (2 * VL_PI) ;
+  vl_size i ;
+
+  for (i = 0 ; i + 4 <= numSamples ; i += 4) {
+    __m128 v0 = _mm_loadu_ps (grad + 2 * i) ;
+    __m128 v1 = _mm_loadu_ps (grad + 2 * i + 4) ;
+    __m128 angle = _mm_shuffle_ps (v0, v1, _MM_SHUFFLE(3,1,3,1)) ;
+    __m128 theta, dx, nx, ny, nt, fbinx, fbiny ;
+    __m128d dxlo, dxhi, nxlo, nxhi, nylo, nyhi ;
+    __m128i ibinx, ibiny, ibint ;
+
+    theta = _vl_mod_2pi_sse2 (VJOIN (_mm_sub_pd (VLO(angle), vangle0),
+                                     _mm_sub_pd (VHI(angle), vangle0))) ;
+
+    dx = VJOIN (_mm_sub_pd (_mm_set_pd (ix + (int)i + 1, ix + (int)i    ), vx),
+                _mm_sub_pd (_mm_set_pd (ix + (int)i + 3, ix + (int)i + 2), vx)) ;
+    dxlo = VLO(dx) ;
+    dxhi = VHI(dx) ;
+
+    nx = VJOIN (_mm_div_pd (_mm_add_pd (_mm_mul_pd (vct0, dxlo), _mm_mul_pd (vst0, vdy)), vSBP),
+                _mm_div_pd (_mm_add_pd (_mm_mul_pd (vct0, dxhi), _mm_mul_pd (vst0, vdy)), vSBP)) ;
+    ny = VJOIN (_mm_div_pd (_mm_add_pd (_mm_mul_pd (vmst0, dxlo), _mm_mul_pd (vct0, vdy)), vSBP),
+                _mm_div_pd (_mm_add_pd (_mm_mul_pd (vmst0, dxhi), _mm_mul_pd (vct0, vdy)), vSBP)) ;
+    theta = _mm_mul_ps (_mm_set1_ps (8.0f), theta) ;
+    nt = VJOIN (_mm_div_pd (VLO(theta), twopi),
+                _mm_div_pd (VHI(theta), twopi)) ;
+
+    {
+      __m128 r2 = _mm_add_ps (_mm_mul_ps (nx, nx), _mm_mul_ps (ny, ny)) ;
+      _mm_storeu_pd (expnArg + i,     _mm_div_pd (VLO(r2), vwnorm)) ;
+      _mm_storeu_pd (expnArg + i + 2, _mm_div_pd (VHI(r2), vwnorm)) ;
+    }
+
+    nxlo = VLO(nx) ;
+    nxhi = VHI(nx) ;
+    nylo = VLO(ny) ;
+    nyhi = VHI(ny) ;
+
+    ibinx = _vl_floor_sse2 (VJOIN (_mm_sub_pd (nxlo, half), _mm_sub_pd (nxhi, half))) ;
+    ibiny = _vl_floor_sse2 (VJOIN (_mm_sub_pd (nylo, half), _mm_sub_pd (nyhi, half))) ;
+    ibint = _vl_floor_sse2 (nt) ;
+    fbinx = _mm_cvtepi32_ps (ibinx) ;
+    fbiny = _mm_cvtepi32_ps (ibiny) ;
+
+    _mm_storeu_si128 ((__m128i*) (binx + i), ibinx) ;
+    _mm_storeu_si128 ((__m128i*) (biny + i), ibiny) ;
+    _mm_storeu_si128 ((__m128i*) (bint + i), ibint) ;
+
+    _mm_storeu_ps (rbinx + i, VJOIN (_mm_sub_pd (nxlo, _mm_add_pd (VLO(fbinx), half)),
+                                     _mm_sub_pd (nxhi, _mm_add_pd (VHI(fbinx), half)))) ;
+    _mm_storeu_ps (rbiny + i, VJOIN (_mm_sub_pd (nylo, _mm_add_pd (VLO(fbiny), half)),
+                                     _mm_sub_pd (nyhi, _mm_add_pd (VHI(fbiny), half)))) ;
+    _mm_storeu_ps (rbint + i, _mm_sub_ps (nt, _mm_cvtepi32_ps (ibint))) ;
+  }
+  return i ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the SIFT descriptor bins of a run of upright samples
+ **
+ ** Same as ::_vl_sift_descriptor_samples_sse2, specialized for a zero
+ ** keypoint orientation as ::_vl_sift_descriptor_samples_upright.
+ **/
+
+vl_size
+_vl_sift_descriptor_samples_upright_sse2 (double *expnArg,
+                                          int *binx, int *biny, int *bint,
+                                          float *rbinx, float *rbiny, float *rbint,
+                                          float const *grad,
+                                          vl_size numSamples,
+                                          int ix, double x, float dy,
+                                          double SBP, double wnorm)
+{
+  __m128d const vx = _mm_set1_pd (x) ;
+  __m128d const vSBP = _mm_set1_pd (SBP) ;
+  __m128d const vwnorm = _mm_set1_pd (wnorm) ;
+  __m128d const half = _mm_set1_pd (0.5) ;
+  __m128d const twopi = _mm_set1_pd (2 * VL_PI) ;
+  float const ny = dy / SBP ;
+  int const biny0 = (int) vl_floor_f (ny - 0.5) ;
+  __m128 const vny2 = _mm_set1_ps (ny * ny) ;
+  __m128i const vbiny = _mm_set1_epi32 (biny0) ;
+  __m128 const vrbiny = _mm_set1_ps (ny - (biny0 + 0.5)) ;
+  vl_size i ;
+
+  for (i = 0 ; i + 4 <= numSamples ; i += 4) {
+    __m128 v0 = _mm_loadu_ps (grad + 2 * i) ;
+    __m128 v1 = _mm_loadu_ps (grad + 2 * i + 4) ;
+    __m128 theta = _mm_shuffle_ps (v0, v1, _MM_SHUFFLE(3,1,3,1)) ;
+    __m128 dx, nx, nt, fbinx ;
+    __m128d nxlo, nxhi ;
+    __m128i ibinx, ibint ;
+
+    theta = _vl_mod_2pi_sse2 (theta) ;
+
+    dx = VJOIN (_mm_sub_pd (_mm_set_pd (ix + (int)i + 1, ix + (int)i    ), vx),
+                _mm_sub_pd (_mm_set_pd (ix + (int)i + 3, ix + (int)i + 2), vx)) ;
+    nx = VJOIN (_mm_div_pd (VLO(dx), vSBP),
+                _mm_div_pd (VHI(dx), vSBP)) ;
+    theta = _mm_mul_ps (_mm_set1_ps (8.0f), theta) ;
+    nt = VJOIN (_mm_div_pd (VLO(theta), twopi),
+                _mm_div_pd (VHI(theta), twopi)) ;
+
+    {
+      __m128 r2 = _mm_add_ps (_mm_mul_ps (nx, nx), vny2) ;
+      _mm_storeu_pd (expnArg + i,     _mm_div_pd (VLO(r2), vwnorm)) ;
+      _mm_storeu_pd (expnArg + i + 2, _mm_div_pd (VHI(r2), vwnorm)) ;
+    }
+
+    nxlo = VLO(nx) ;
+    nxhi = VHI(nx) ;
+
+    ibinx = _vl_floor_sse2 (VJOIN (_mm_sub_pd (nxlo, half), _mm_sub_pd (nxhi, half))) ;
+    ibint = _vl_floor_sse2 (nt) ;
+    fbinx = _mm_cvtepi32_ps (ibinx) ;
+
+    _mm_storeu_si128 ((__m128i*) (binx + i), ibinx) ;
+    _mm_storeu_si128 ((__m128i*) (biny + i), vbiny) ;
+    _mm_storeu_si128 ((__m128i*) (bint + i), ibint) ;
+
+    _mm_storeu_ps (rbinx + i, VJOIN (_mm_sub_pd (nxlo, _mm_add_pd (VLO(fbinx), half)),
+                                     _mm_sub_pd (nxhi, _mm_add_pd (VHI(fbinx), half)))) ;
+    _mm_storeu_ps (rbiny + i, vrbiny) ;
+    _mm_storeu_ps (rbint + i, _mm_sub_ps (nt, _mm_cvtepi32_ps (ibint))) ;
+  }
+  return i ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Normalize and quantize a SIFT histogram
+ ** @param descr    quantized descriptor (output).
+ ** @param hist     histogram.
+ ** @param n        number of histogram elements.
+ ** @param norm     L2 norm of the histogram.
+ ** @param norm2    L2 norm of the truncated histogram.
+ ** @param rootSift whether to compute RootSIFT.
+ ** @param norm1    L1 norm of the normalized histogram (for RootSIFT).
+ ** @return number of processed elements.
+ **
+ ** The elements are processed in groups of sixteen, skipping the
+ ** remainder.
+ **/
+
+vl_size
+_vl_sift_quantize_sse2 (vl_uint8 *descr,
+                        float const *hist,
+                        vl_size n,
+                        float norm, float norm2,
+                        vl_bool rootSift, float norm1)
+{
+  __m128 const vnorm = _mm_set1_ps (norm) ;
+  __m128 const vnorm2 = _mm_set1_ps (norm2) ;
+  __m128 const vnorm1 = _mm_set1_ps (norm1) ;
+  __m128 const thresh = _mm_set1_ps (0.2f) ;
+  __m128 const scale = _mm_set1_ps (512.0f) ;
+  __m128 const maxv = _mm_set1_ps (255.0f) ;
+  vl_size i ;
+
+  for (i = 0 ; i + 16 <= n ; i += 16) {
+    __m128i q [4] ;
+    int j ;
+    for (j = 0 ; j < 4 ; ++j) {
+      __m128 x = _mm_div_ps (_mm_loadu_ps (hist + i + 4 * j), vnorm) ;
+      x = _mm_div_ps (_mm_min_ps (x, thresh), vnorm2) ;
+      if (rootSift) x = _mm_sqrt_ps (_mm_div_ps (x, vnorm1)) ;
+      x = _mm_min_ps (_mm_mul_ps (x, scale), maxv) ;
+      q [j] = _mm_cvttps_epi32 (x) ;
+    }
+    _mm_storeu_si128 ((__m128i*) (descr + i),
+                      _mm_packus_epi16 (_mm_packs_epi32 (q [0], q [1]),
+                                        _mm_packs_epi32 (q [2], q [3]))) ;
+  }
+  return i ;
+}
+
+/* ! VL_DISABLE_SSE2 */
+#endif
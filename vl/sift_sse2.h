@@ -0,0 +1,57 @@
+/** @file sift_sse2.h
+ ** @brief SIFT - SSE2
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_SIFT_SSE2_H
+#define VL_SIFT_SSE2_H
+
+#include "generic.h"
+
+#ifndef VL_DISABLE_SSE2
+
+VL_EXPORT
+vl_size _vl_sift_gradient_sse2 (float *grad,
+                                float const *src,
+                                vl_size numPixels,
+                                vl_index up, vl_index down,
+                                float dyscale) ;
+
+VL_EXPORT
+vl_size _vl_sift_descriptor_samples_sse2 (double *expnArg,
+                                          int *binx, int *biny, int *bint,
+                                          float *rbinx, float *rbiny, float *rbint,
+                                          float const *grad,
+                                          vl_size numSamples,
+                                          int ix, double x, float dy,
+                                          double ct0, double st0, double SBP,
+                                          double angle0, double wnorm) ;
+
+VL_EXPORT
+vl_size _vl_sift_descriptor_samples_upright_sse2 (double *expnArg,
+                                                  int *binx, int *biny, int *bint,
+                                                  float *rbinx, float *rbiny, float *rbint,
+                                                  float const *grad,
+                                                  vl_size numSamples,
+                                                  int ix, double x, float dy,
+                                                  double SBP, double wnorm) ;
+
+VL_EXPORT
+vl_size _vl_sift_quantize_sse2 (vl_uint8 *descr,
+                                float const *hist,
+                                vl_size n,
+                                float norm, float norm2,
+                                vl_bool rootSift, float norm1) ;
+
+#endif
+
+/* VL_SIFT_SSE2_H */
+#endif